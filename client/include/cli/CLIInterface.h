@@ -47,6 +47,7 @@ private:
 
     // 文件操作
     void handleRead(const std::vector<std::string>& args);
+    void handleReadAt(const std::vector<std::string>& args);
     void handleWrite(const std::vector<std::string>& args);
     void handleMkdir(const std::vector<std::string>& args);
 
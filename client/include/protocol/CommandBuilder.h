@@ -15,6 +15,7 @@ public:
 
     // ========== 文件操作命令 ==========
     static std::string buildRead(const std::string& token, const std::string& path);
+    static std::string buildReadAt(const std::string& token, const std::string& snapshot, const std::string& path);
     static std::string buildWrite(const std::string& token, const std::string& path, const std::string& content);
     static std::string buildMkdir(const std::string& token, const std::string& path);
 
@@ -91,6 +91,8 @@ void CLIInterface::handleCommand(const std::string& input) {
     // 文件操作
     else if (cmd == "read") {
         handleRead(args);
+    } else if (cmd == "read_at") {
+        handleReadAt(args);
     } else if (cmd == "write") {
         handleWrite(args);
     } else if (cmd == "mkdir") {
@@ -216,6 +218,15 @@ void CLIInterface::handleRead(const std::vector<std::string>& args) {
     sendCommandAndDisplay(command);
 }
 
+void CLIInterface::handleReadAt(const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        displayError("用法: read_at <快照名> <路径>");
+        return;
+    }
+    std::string command = CommandBuilder::buildReadAt(session_->getCurrentToken(), args[1], args[2]);
+    sendCommandAndDisplay(command);
+}
+
 void CLIInterface::handleWrite(const std::vector<std::string>& args) {
     if (args.size() < 3) {
         displayError("用法: write <路径> <内容>");
@@ -495,6 +506,7 @@ void CLIInterface::showEditorHelp() {
     std::cout << "  reviews <论文ID>          - 查看所有评审意见\n";
     std::cout << "\n========== 通用命令 ==========\n";
     std::cout << "  read <路径>               - 读取文件\n";
+    std::cout << "  read_at <快照名> <路径>   - 读取快照中的版本（不恢复快照）\n";
     std::cout << "  logout                    - 登出\n";
     std::cout << "  help                      - 显示帮助\n";
     std::cout << "  exit                      - 退出\n\n";
@@ -513,6 +525,7 @@ void CLIInterface::showAdminHelp() {
     std::cout << "  cache_clear                      - 清空缓存\n";
     std::cout << "\n========== 通用命令 ==========\n";
     std::cout << "  read <路径>                      - 读取文件\n";
+    std::cout << "  read_at <快照名> <路径>          - 读取快照中的版本（不恢复快照）\n";
     std::cout << "  write <路径> <内容>              - 写入文件\n";
     std::cout << "  mkdir <路径>                     - 创建目录\n";
     std::cout << "  logout                           - 登出\n";
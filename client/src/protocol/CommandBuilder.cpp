@@ -19,6 +19,10 @@ std::string CommandBuilder::buildRead(const std::string& token, const std::strin
     return "READ " + token + " " + path;
 }
 
+std::string CommandBuilder::buildReadAt(const std::string& token, const std::string& snapshot, const std::string& path) {
+    return "READ_AT " + token + " " + snapshot + " " + path;
+}
+
 std::string CommandBuilder::buildWrite(const std::string& token, const std::string& path, const std::string& content) {
     return "WRITE " + token + " " + path + " " + content;
 }
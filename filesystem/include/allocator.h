@@ -0,0 +1,292 @@
+// allocator.h - 内存位图分配器（inode / 数据块）
+#ifndef FS_ALLOCATOR_H
+#define FS_ALLOCATOR_H
+
+#include <cstdint>
+
+/**
+ * 分配器统计信息（累计值，可用来计算 allocations/sec）
+ */
+struct AllocatorStats {
+    uint64_t inode_allocs;      // 成功分配的 inode 数
+    uint64_t inode_frees;       // 释放的 inode 数
+    uint64_t block_allocs;      // 成功分配的数据块数
+    uint64_t block_frees;       // 释放的数据块数
+    uint64_t alloc_failures;    // 分配失败次数（空间耗尽）
+    uint64_t words_scanned;     // 分配时检查过的 64 位位图字数（衡量查找成本）
+    uint64_t bitmap_flushes;    // 位图块写回次数
+    uint64_t superblock_flushes;// superblock 计数写回次数
+    uint64_t alloc_ns;          // 分配/释放累计耗时（纳秒）
+    uint64_t goal_allocs;       // 带目标位置的块分配次数
+    uint64_t goal_hits;         // 其中正好拿到目标块的次数
+    uint64_t windows_opened;    // 开出的预留窗口数
+    int free_inodes;            // 当前空闲 inode 数
+    int free_blocks;            // 当前空闲块数（含暂缓复用的块）
+    int held_blocks;            // 已释放、等待事务提交 / 检查点后才能再分配的块数
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * 挂了日志的磁盘上，释放的数据块先"暂缓复用"：位图里已经是空闲（随当前事务写回），但在释放它的事务提交之前
+ * 不再分配出去——否则新主人的数据经块缓存先落盘，事务没提交就崩溃时，旧主人（已提交的状态里仍引用它）读到的是别人的数据。
+ * 日志里还有这个块的映像（目录项块、extent 节点等结构块）时还要等到检查点：重放会用旧映像覆盖新主人的内容。
+ * 日志由 allocator_commit_prepare / allocator_commit_done / allocator_checkpoint_done 推进这些块的状态
+ */
+
+/**
+ * C 接口：从磁盘加载 inode/块位图到内存（disk_open 调用，在 journal_load 之后：挂了日志时释放的块暂缓复用）
+ * @return 0 成功，-1 失败
+ */
+int allocator_load(int fd);
+
+/**
+ * C 接口：写回脏位图并释放内存状态（disk_close 调用）
+ */
+void allocator_unload(int fd);
+
+/**
+ * C 接口：丢弃内存状态，不写回（disk_open 时清理同号 fd 的残留状态）
+ */
+void allocator_discard(int fd);
+
+/**
+ * C 接口：丢弃内存状态并从磁盘重新加载（位图被外部整体改写后调用，如快照恢复）
+ * 重新加载前已分配（或暂缓复用）、加载后空闲的块继续暂缓复用，等当前事务提交
+ */
+int allocator_reload(int fd);
+
+/**
+ * C 接口：把脏位图块和 superblock 空闲计数写回磁盘（持久化点）
+ */
+void allocator_sync(int fd);
+
+/**
+ * C 接口：日志提交的各个阶段（只由 journal.cpp 调用）
+ * commit_prepare：写回位图（进入正在截取的事务），此前释放的块归入这个事务
+ * commit_done：事务已经持久化；logged（升序，count 个）是日志中有映像的数据区块，
+ *   归入这个事务的块在其中的等到检查点，其余的可以再分配
+ * checkpoint_done：日志已清空，等检查点的块都可以再分配
+ */
+void allocator_commit_prepare(int fd);
+void allocator_commit_done(int fd, const int* logged, int count);
+void allocator_checkpoint_done(int fd);
+
+/**
+ * C 接口：暂缓复用的块数（空间不足时调用者据此决定先提交 / 检查点再重试）
+ */
+int allocator_held_blocks(int fd);
+
+/**
+ * C 接口：日志的暂存块（超过日志容量的事务把映像先写到这里，见 journal.h）
+ * alloc_spill：取 count 个空闲块，不写进位图（磁盘上仍是空闲）、也不再分配给别人；0 成功，-1 空闲块不够（不取）
+ * release_spill：放回
+ */
+int allocator_alloc_spill(int fd, int count, int* block_ids);
+void allocator_release_spill(int fd, const int* block_ids, int count);
+
+/**
+ * C 接口：分配 / 释放 inode 与数据块
+ * 分配返回编号，-1 表示空间耗尽（可能只是暂缓复用的块还没放出来，见上）；释放返回 0，-1 表示原本就是空闲的
+ */
+int allocator_alloc_inode(int fd);
+int allocator_free_inode(int fd, int inode_id);
+int allocator_claim_inode(int fd, int inode_id);  // 占用指定编号：0 成功，-1 已被占用
+int allocator_alloc_block(int fd);
+int allocator_free_block(int fd, int block_id);
+
+/**
+ * C 接口：就近分配数据块（块的引用计数在分配器锁内置为 1）
+ * goal：希望拿到的块号（通常是文件最后一块 + 1），从它向后找第一个空闲块，到末尾后绕回；< 0 表示没有目标
+ * owner：块属于哪个 inode（-1 = 不属于某个文件）
+ *   - owner 有预留窗口时先在自己的窗口里分配；窗口用完或目标不在窗口里时，在目标处开新窗口，
+ *     顺着上一个窗口写下去时窗口大小加倍（ALLOCATOR_WINDOW_MIN ~ ALLOCATOR_WINDOW_MAX 块）
+ *   - 没有目标时用 allocator_set_goal 记下的位置，再没有就从 next-fit 游标开始
+ * 别人的预留窗口会被跳过，只有窗口外没有空闲块时才占用
+ * @return 块号，-1 表示空间耗尽
+ */
+int allocator_alloc_block_goal(int fd, int goal, int owner);
+
+/**
+ * C 接口：预留窗口的开始 / 结束（inode_write_begin / inode_write_end 调用，可嵌套）
+ * 窗口只在内存中：不改位图和空闲计数，崩溃后不需要回收；最后一次 end 时撤销
+ */
+void allocator_reserve_begin(int fd, int owner);
+void allocator_reserve_end(int fd, int owner);
+
+/**
+ * C 接口：记下 inode 第一个数据块的目标位置（dir_add_entry 记为父目录所在的块）
+ * 只在 inode 还没有数据块、分配时没有目标的情况下使用，用过一次即清除
+ */
+void allocator_set_goal(int fd, int owner, int goal);
+
+/**
+ * C 接口：按位图批量释放数据块（mask 第 i 位为 1 表示释放块 i，共 nwords 个 64 位字）
+ * @return 实际释放的块数（原本就空闲的位忽略）
+ */
+int allocator_free_block_mask(int fd, const uint64_t* mask, int nwords);
+
+/**
+ * C 接口：引用计数和位图一起修改（在分配器锁内完成，与 allocator_alloc_block_goal 把计数置 1 互斥）
+ * allocator_release_block：计数减 1，减到 0 时释放；返回 1 已释放，0 仍有引用，-1 原本就是空闲的
+ * allocator_free_unreferenced_block：块仍已分配且计数为 0 时释放；返回 1 已释放，0 未释放
+ * allocator_free_unreferenced_mask：mask 中仍已分配且计数为 0 的块一次释放，
+ *   freed 非空时写入实际释放的块（nwords 个字）；返回释放的块数
+ * 计数检查和释放之间不会插入别的分配，刚被重新分配出去的块不会被释放第二次
+ */
+int allocator_release_block(int fd, int block_id);
+int allocator_free_unreferenced_block(int fd, int block_id);
+int allocator_free_unreferenced_mask(int fd, const uint64_t* mask, int nwords, uint64_t* freed);
+
+/**
+ * C 接口：查询位图状态（1=已分配，0=空闲，-1=未加载或越界）
+ */
+int allocator_block_allocated(int fd, int block_id);
+int allocator_inode_allocated(int fd, int inode_id);
+
+/**
+ * C 接口：导出当前位图（位图区的块数 × 块大小字节，见 DiskGeometry；供快照保存）
+ */
+int allocator_copy_inode_bitmap(int fd, void* buf);
+int allocator_copy_block_bitmap(int fd, void* buf);
+
+/**
+ * C 接口：读取当前空闲计数（用于覆盖 superblock 中可能尚未写回的值）
+ * @return 1 表示分配器已加载并填充了结果，0 表示未加载
+ */
+int allocator_get_free_counts(int fd, int* free_inodes, int* free_blocks);
+
+/**
+ * C 接口：获取 / 打印统计信息
+ */
+void allocator_get_stats(int fd, AllocatorStats* stats);
+void allocator_print_stats(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include <vector>
+
+/**
+ * BitmapIndex - 单个位图的内存副本 + 空闲索引
+ *
+ * - m_words：与磁盘位图逐位对应（小端，第 i 位 = 字节 i/8 的第 i%8 位）
+ * - m_summary：第 w 位为 1 表示 m_words[w] 中至少有一个空闲位，
+ *   查找时按 64 个字一组跳过已满区域，分配摊还 O(1)
+ * - m_held：暂缓复用的位（hold 释放、unhold 放出）。这些位在 m_words 中仍为 1，查找和分配自然跳过；
+ *   test / store / store_chunk 把它们当作空闲，free_count 也计入
+ * - 两种游标策略：
+ *   FIRST_FIT：释放时把游标回拨到更低的位置，始终返回最小空闲编号（inode 用，保持 inode 表紧凑）
+ *   NEXT_FIT ：游标只向前滚动，绕回后再复用前面释放的位置（数据块用）
+ */
+class BitmapIndex {
+public:
+    enum Policy { FIRST_FIT, NEXT_FIT };
+
+    BitmapIndex() = default;
+
+    /**
+     * 从磁盘位图字节初始化
+     * @param bytes 位图内容
+     * @param nbits 有效位数（超出部分视为已占用）
+     * @param chunk_bits 每个位图块的位数（块大小 × 8），脏标记按它切分
+     */
+    void load(const unsigned char* bytes, int nbits, int chunk_bits, Policy policy);
+
+    /**
+     * 分配一个空闲位
+     * @param words_scanned 累加检查过的字数
+     * @return 位编号，-1 表示已满
+     */
+    int alloc(uint64_t* words_scanned);
+
+    /**
+     * 找 [from, limit) 中第一个空闲位，不分配
+     * @return 位编号，-1 表示范围内没有空闲位
+     */
+    int find_free(int from, int limit, uint64_t* words_scanned) const;
+
+    /**
+     * next-fit 游标：下一次 alloc 的查找起点（位编号）；move_cursor 把它移到 bit 所在的字
+     */
+    int cursor() const { return m_cursor * 64; }
+    void move_cursor(int bit) { m_cursor = bit / 64; }
+
+    /**
+     * 释放一个位
+     * @return true 成功，false 原本就是空闲的或越界
+     */
+    bool release(int bit);
+
+    /**
+     * 占用一个指定的位（恢复子树快照时按原编号重建 inode、就近分配时拿下找到的块）
+     * @return true 成功，false 已被占用或越界
+     */
+    bool claim(int bit);
+
+    /**
+     * 按 64 位字批量释放（第 i 个字对应位 [64i, 64i + 64)）
+     * @param released 非空时写入实际释放的位（nwords 个字）
+     * @return 实际释放的位数
+     */
+    int release_mask(const uint64_t* mask, int nwords, uint64_t* released = nullptr);
+
+    /**
+     * 释放但暂缓复用（参数和返回值同 release / release_mask）；unhold 把暂缓的位放出来，之后可以分配
+     */
+    bool hold(int bit);
+    int hold_mask(const uint64_t* mask, int nwords, uint64_t* held = nullptr);
+    void unhold(int bit);
+
+    bool test(int bit) const;
+    int free_count() const { return m_free + m_held_count; }
+    int available_count() const { return m_free; }  // 现在就能分配的位数（不含暂缓复用的）
+    int held_count() const { return m_held_count; }
+    int nbits() const { return m_nbits; }
+
+    /**
+     * 原始位图字（暂缓复用的位也是 1）
+     */
+    const std::vector<uint64_t>& words() const { return m_words; }
+
+    /**
+     * 导出位图字节（nbytes 之外的部分不写）
+     */
+    void store(unsigned char* bytes, int nbytes) const;
+
+    /**
+     * 导出第 chunk 个位图块（chunk_bits / 8 字节；nbits 之后的位为 0）
+     */
+    void store_chunk(int chunk, unsigned char* bytes) const;
+
+    /**
+     * 脏块跟踪：位图按块切分，返回并清除某块的脏标记
+     */
+    bool take_dirty(int chunk);
+    int chunk_count() const { return (int)m_dirty.size(); }
+
+private:
+    void mark_dirty(int bit);
+    void update_summary(int word);
+
+    std::vector<uint64_t> m_words;
+    std::vector<uint64_t> m_summary;
+    std::vector<uint64_t> m_held;
+    std::vector<bool> m_dirty;
+    int m_nbits = 0;
+    int m_chunk_bits = 0;
+    int m_free = 0;
+    int m_held_count = 0;
+    int m_cursor = 0;        // 下一次查找起点（字编号）
+    Policy m_policy = FIRST_FIT;
+};
+
+#endif // __cplusplus
+
+#endif // FS_ALLOCATOR_H
@@ -2,6 +2,36 @@
 #ifndef FS_BLOCK_CACHE_H
 #define FS_BLOCK_CACHE_H
 
+#include "cache_policy.h"
+
+/**
+ * 块缓存统计信息
+ * 元数据块 = data_block_start 之前的固定区域（superblock、位图、inode 表、快照表、引用计数表、日志，见 DiskGeometry）
+ * 数据块   = 其余块（文件数据、目录块、extent 树节点、快照副本）
+ */
+struct BlockCacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long meta_hits;
+    unsigned long meta_misses;
+    unsigned long data_hits;
+    unsigned long data_misses;
+    unsigned long size;
+    unsigned long capacity;
+    unsigned long replacements;
+    unsigned long dirty;
+    unsigned long writebacks;
+    unsigned long prefetched;      // 预读装入的块数
+    
+    // 替换策略相关（字段含义见 cache_policy.h 中的 PolicyCounters）
+    int policy;                    // BlockCachePolicy
+    unsigned long probation_hits;
+    unsigned long protected_hits;
+    unsigned long ghost_hits;
+    unsigned long promotions;
+    unsigned long second_chances;
+};
+
 // C 接口声明（不依赖 C++ 特性）
 #ifdef __cplusplus
 extern "C" {
@@ -13,6 +43,13 @@ extern "C" {
  */
 void block_cache_init(unsigned long capacity);
 
+/**
+ * C 接口：初始化块缓存并选择替换策略
+ * @param capacity 缓存容量（块数）
+ * @param policy BLOCK_CACHE_POLICY_CLOCK（默认）或 BLOCK_CACHE_POLICY_S3FIFO（抗扫描）
+ */
+void block_cache_init_ex(unsigned long capacity, int policy);
+
 /**
  * C 接口：销毁块缓存
  */
@@ -23,6 +60,21 @@ void block_cache_destroy();
  */
 void read_block_cached(int fd, int block_id, void* buf);
 
+/**
+ * C 接口：批量读取块（带缓存）
+ * 命中的块直接从缓存复制；未命中的块按物理块号切成连续段，每段一次 preadv 读入后装入缓存
+ * @param block_ids 块号数组
+ * @param count 块数
+ * @param bufs 第 i 块的输出缓冲区（每个块大小字节）
+ */
+void read_blocks_cached(int fd, const int* block_ids, int count, void* const* bufs);
+
+/**
+ * C 接口：预读——把尚未缓存的块读入缓存（不复制给调用者，不计入命中 / 未命中）
+ * @return 实际装入缓存的块数
+ */
+int block_cache_prefetch(int fd, const int* block_ids, int count);
+
 /**
  * C 接口：写入块（带缓存）
  */
@@ -33,16 +85,52 @@ void write_block_cached(int fd, int block_id, const void* buf);
  */
 void block_cache_flush(int fd);
 
+/**
+ * C 接口：持久化点——写回 fd 的所有脏块并 fdatasync
+ * 挂了元数据日志的磁盘改为提交当前事务（见 journal_commit）
+ * @param fd 文件描述符（-1 表示所有 fd，只写回不 fdatasync）
+ */
+void block_cache_sync(int fd);
+
+/**
+ * C 接口：切换写回（write-back）模式
+ * @param enabled 1=写回模式（写入只进缓存，由后台线程刷盘），0=写穿模式（默认）
+ * @param max_age_ms 脏块最长驻留时间（毫秒），超时由后台线程写回
+ * @param dirty_ratio 脏块占容量的百分比上限，超过时唤醒后台线程提前写回
+ */
+void block_cache_set_write_back(int enabled, unsigned int max_age_ms, unsigned int dirty_ratio);
+
+/**
+ * C 接口：获取写回统计（当前脏块数、累计写回块数）
+ */
+void block_cache_get_writeback_stats(unsigned long* dirty, unsigned long* writebacks);
+
 /**
  * C 接口：清空缓存
  */
 void block_cache_clear();
 
+/**
+ * C 接口：使单个块的缓存失效（脏块先写回）
+ */
+void block_cache_invalidate(int fd, int block_id);
+
+/**
+ * C 接口：丢弃某个 fd 的全部缓存块，不写回
+ * disk_open 时清理同号 fd 的残留块；disk_close 时在 flush 之后调用
+ */
+void block_cache_discard(int fd);
+
 /**
  * C 接口：获取缓存统计信息
  */
 void block_cache_get_stats(unsigned long* hits, unsigned long* misses, unsigned long* size, unsigned long* capacity);
 
+/**
+ * C 接口：获取完整统计信息（含元数据 / 数据块分类命中率、替换策略计数）
+ */
+void block_cache_get_stats_ex(BlockCacheStats* stats);
+
 /**
  * C 接口：打印缓存统计信息
  */
@@ -56,25 +144,42 @@ void block_cache_print_stats();
 #ifdef __cplusplus
 
 #include "disk.h"
-#include <list>
+#include <vector>
 #include <unordered_map>
 #include <cstring>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 
 /**
- * BlockCache - LRU 块缓存（线程安全）
+ * BlockCache - 分片块缓存（线程安全）
  * 
  * 缓存磁盘块的读写操作，减少实际的磁盘 I/O
- * 使用 LRU (Least Recently Used) 策略进行缓存替换
- * 所有公共方法都是线程安全的
+ * - 按 (fd, block_id) 哈希分成若干分片，每个分片一把读写锁，不同分片互不阻塞
+ * - 每个分片的块数据存放在一整块连续内存（slab）里，按帧号索引，没有链表节点分配
+ * - 替换策略可插拔（见 cache_policy.h），每个分片一个策略实例：
+ *   命中只在共享锁下通知策略（原子操作），淘汰时在独占锁下由策略选出牺牲帧
+ * - 统计计数都是原子变量，不需要加锁
+ * 
+ * 两种写策略：
+ * - 写穿（默认）：写入同时更新缓存和磁盘
+ * - 写回：写入只标记脏块，由后台刷新线程按"脏块年龄"和"脏块比例"两个阈值写回，
+ *   淘汰脏块时同步写回；需要持久化时调用 sync()
  */
 class BlockCache {
 public:
     /**
      * 构造函数
      * @param capacity 缓存容量（块数）
+     * @param policy 替换策略（BlockCachePolicy）
+     * @param shard_count 分片数（0 表示按容量自动选择；小容量缓存只用 1 个分片）
      */
-    explicit BlockCache(size_t capacity);
+    explicit BlockCache(size_t capacity, int policy = BLOCK_CACHE_POLICY_CLOCK, size_t shard_count = 0);
     
     /**
      * 析构函数
@@ -104,10 +209,34 @@ public:
     bool write_block_cached(int fd, int block_id, const void* buf);
     
     /**
-     * 使缓存失效（删除指定块的缓存）
+     * 批量读取块（带缓存），未命中的物理连续段合并成一次 preadv
+     * 读盘不持锁：先在共享锁下记下分片版本号，装入前若版本号变了
+     * （期间有写入或淘汰），刚读到的内容可能已过时，在锁内重读该块
+     * @param fd 文件描述符
+     * @param block_ids 块号数组
+     * @param count 块数
+     * @param bufs 第 i 块的输出缓冲区
+     * @return 是否成功
+     */
+    bool read_blocks_cached(int fd, const int* block_ids, int count, void* const* bufs);
+    
+    /**
+     * 预读：把尚未缓存的块读入缓存
+     * @return 实际装入缓存的块数
+     */
+    size_t prefetch(int fd, const int* block_ids, int count);
+    
+    /**
+     * 使缓存失效（删除指定块的缓存，脏块先写回）
+     * @param fd 文件描述符
      * @param block_id 块 ID
      */
-    void invalidate(int block_id);
+    void invalidate(int fd, int block_id);
+    
+    /**
+     * 丢弃某个 fd 的全部缓存块（不写回）
+     */
+    void discard(int fd);
     
     /**
      * 清空所有缓存
@@ -121,12 +250,30 @@ public:
      */
     bool flush_all(int fd);
     
+    /**
+     * 持久化点：写回脏块并 fdatasync
+     * @param fd 文件描述符（-1 表示所有 fd）
+     */
+    void sync(int fd);
+    
+    /**
+     * 切换写回模式（开启时启动后台刷新线程，关闭时写回全部脏块并停止线程）
+     */
+    void set_write_back(bool enabled, unsigned int max_age_ms, unsigned int dirty_ratio);
+    bool is_write_back() const { return m_write_back.load(std::memory_order_relaxed); }
+    
     // 统计信息
-    size_t get_hits() const { return m_hits; }
-    size_t get_misses() const { return m_misses; }
-    size_t get_size() const { return m_items.size(); }
+    size_t get_hits() const { return m_hits.load(std::memory_order_relaxed); }
+    size_t get_misses() const { return m_misses.load(std::memory_order_relaxed); }
+    size_t get_size() const;
     size_t get_capacity() const { return m_capacity; }
-    size_t get_replacements() const { return m_replacements; }
+    size_t get_shard_count() const { return m_shards.size(); }
+    int get_policy() const { return m_policy; }
+    size_t get_replacements() const { return m_replacements.load(std::memory_order_relaxed); }
+    size_t get_dirty_count() const { return m_dirty_count.load(std::memory_order_relaxed); }
+    size_t get_writebacks() const { return m_writebacks.load(std::memory_order_relaxed); }
+    size_t get_prefetched() const { return m_prefetched.load(std::memory_order_relaxed); }
+    void get_stats(BlockCacheStats* stats) const;
     
     /**
      * 打印缓存统计信息
@@ -134,46 +281,119 @@ public:
     void print_stats() const;
 
 private:
-    // 缓存块结构
-    struct CacheBlock {
+    // 缓存帧元数据（块数据在分片的 slab 中，按帧号定位）
+    struct Frame {
+        uint64_t key;              // make_key(fd, block_id)
         int block_id;
-        char data[1024];  // BLOCK_SIZE
-        bool dirty;  // 是否被修改过
+        int fd;                    // 写回时使用的文件描述符
+        bool valid;                // 帧是否在使用
+        bool dirty;                // 是否被修改过
+        std::chrono::steady_clock::time_point dirty_since;  // 第一次变脏的时间
+        
+        Frame() : key(0), block_id(-1), fd(-1), valid(false), dirty(false) {}
+    };
+    
+    // 分片：一把读写锁 + 连续的帧数组 + 查找表 + 替换策略
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unique_ptr<Frame[]> frames;
+        std::unique_ptr<char[]> slab;  // frame_count * MAX_BLOCK_SIZE 字节（各磁盘的块大小可以不同，只用每帧的前一块）
+        size_t frame_count = 0;
+        size_t used = 0;               // 已使用帧数
+        std::vector<size_t> free_frames;  // 空闲帧（栈，帧号小的先用）
+        uint64_t version = 0;          // 块被写入或移出缓存时加一（独占锁下修改）
+        std::unique_ptr<EvictionPolicy> policy;
+        std::unordered_map<uint64_t, size_t> lookup;  // key -> 帧号
         
-        CacheBlock() : block_id(-1), dirty(false) {
-            memset(data, 0, 1024);
-        }
+        char* data(size_t frame) { return slab.get() + frame * MAX_BLOCK_SIZE; }
     };
     
     size_t m_capacity;  // 缓存容量
+    int m_policy;       // 替换策略
+    std::vector<std::unique_ptr<Shard>> m_shards;
     
-    // LRU 链表：头部是最近使用的，尾部是最久未使用的
-    std::list<CacheBlock> m_items;
+    // 统计信息（原子计数，命中路径不需要独占锁）
+    std::atomic<size_t> m_hits;          // 缓存命中次数
+    std::atomic<size_t> m_misses;        // 缓存未命中次数
+    std::atomic<size_t> m_replacements;  // 缓存替换次数
+    std::atomic<size_t> m_dirty_count;   // 当前脏块数
+    std::atomic<size_t> m_writebacks;    // 累计写回块数
+    std::atomic<size_t> m_prefetched;    // 预读装入的块数
+    std::atomic<size_t> m_meta_hits;     // 元数据块命中 / 未命中
+    std::atomic<size_t> m_meta_misses;
+    std::atomic<size_t> m_data_hits;     // 数据块命中 / 未命中
+    std::atomic<size_t> m_data_misses;
     
-    // 快速查找表：block_id -> 链表迭代器
-    std::unordered_map<int, typename std::list<CacheBlock>::iterator> m_lookup;
+    // 写回模式参数（由 m_flush_mutex 保护，m_write_back 可无锁读取）
+    std::atomic<bool> m_write_back;
+    std::chrono::milliseconds m_max_age;
+    unsigned int m_dirty_ratio;  // 百分比
     
-    // 统计信息
-    size_t m_hits;          // 缓存命中次数
-    size_t m_misses;        // 缓存未命中次数
-    size_t m_replacements;  // 缓存替换次数
+    // 后台刷新线程
+    std::mutex m_flush_mutex;
+    std::thread m_flusher;
+    std::condition_variable m_flush_cv;
+    bool m_stop_flusher;
     
-    // 线程安全锁
-    mutable std::mutex m_mutex;
+    static uint64_t make_key(int fd, int block_id) {
+        return ((uint64_t)(uint32_t)fd << 32) | (uint32_t)block_id;
+    }
+    
+    Shard& shard_for(int fd, int block_id) {
+        // 相邻块号落在不同分片，顺序访问也能分散到各个锁上
+        size_t h = (size_t)(uint32_t)block_id ^ ((size_t)(uint32_t)fd * 0x9E3779B1u);
+        return *m_shards[h % m_shards.size()];
+    }
     
     /**
-     * 将块移动到链表头部（标记为最近使用）
-     * 注意：调用者必须持有 m_mutex
+     * 记录一次命中 / 未命中（按元数据 / 数据块分类）
      */
-    void touch(typename std::list<CacheBlock>::iterator it);
+    void count_access(int fd, int block_id, bool hit);
     
     /**
-     * 淘汰最久未使用的块
-     * 注意：调用者必须持有 m_mutex
-     * @param fd 文件描述符
-     * @return 是否成功
+     * 为新块分配一个帧：有空帧直接用，否则由替换策略选出牺牲帧（脏块先写回）
+     * 注意：调用者必须持有 shard.mutex 的独占锁
+     * @return 帧号（已从查找表中移除旧块）
+     */
+    size_t acquire_frame(Shard& shard);
+    
+    /**
+     * 从分片中移除一个帧
+     * 注意：调用者必须持有 shard.mutex 的独占锁
+     */
+    void release_frame(Shard& shard, size_t frame);
+    
+    /**
+     * 把一块已读入的干净数据装入分片（分配帧、登记到查找表和替换策略）
+     * 注意：调用者必须持有 shard.mutex 的独占锁，且该块不在缓存中
+     */
+    void install_clean(Shard& shard, uint64_t key, int fd, int block_id, const void* data);
+    
+    /**
+     * 标记脏块 / 写回单个脏块
+     * 注意：调用者必须持有 shard.mutex 的独占锁
+     */
+    void mark_dirty(Frame& frame, int fd);
+    void write_back(Shard& shard, size_t frame);
+    
+    /**
+     * 写回一个分片中满足条件的脏块（按块号排序，让磁盘写尽量顺序）
+     * 注意：调用者必须持有 shard.mutex 的独占锁
+     */
+    template <typename Pred>
+    void write_back_if(Shard& shard, Pred pred);
+    
+    /**
+     * 脏块是否超过比例阈值
+     */
+    bool over_dirty_ratio() const;
+    
+    /**
+     * 后台刷新线程主循环 / 停止线程
      */
-    bool evict_lru(int fd);
+    void flusher_loop();
+    void flush_expired_and_excess();
+    void stop_flusher();
 };
 
 #endif // __cplusplus
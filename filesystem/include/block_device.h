@@ -0,0 +1,229 @@
+// block_device.h - 块设备后端（可插拔）
+#ifndef FS_BLOCK_DEVICE_H
+#define FS_BLOCK_DEVICE_H
+
+/**
+ * 后端编号（disk_open_with 的 type 参数）
+ */
+enum BlockDeviceType {
+    BLOCK_DEVICE_PREAD = 0,     // pread / pwrite 直接读写镜像文件（默认）
+    BLOCK_DEVICE_MMAP = 1,      // 镜像文件整体映射进内存，读写是内存复制，flush 时 msync
+    BLOCK_DEVICE_MEMORY = 2     // 纯内存盘：进程内按路径保存，第一次打开时从镜像文件读入（文件存在时），之后不写回文件
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：进程的默认后端（disk_open / disk_format 使用）
+ * 初始值取环境变量 FS_BLOCK_DEVICE（pread / mmap / memory），没有设置或无法识别时为 pread
+ */
+int block_device_default_type(void);
+void block_device_set_default_type(int type);
+
+/**
+ * C 接口：后端名称 / 按名称查编号（未知名称返回 -1）
+ */
+const char* block_device_type_name(int type);
+int block_device_parse_type(const char* name);
+
+/**
+ * C 接口：打开一个块设备并登记到返回的句柄上（disk_open / disk_format 调用）
+ * 文件后端的句柄就是镜像文件的 fd；内存盘占用一个 /dev/null 的 fd 作为句柄，保证编号与真实文件不冲突
+ * 同号句柄上残留的设备（上次没有正常关闭）直接丢弃
+ * @return 句柄，-1 失败
+ */
+int block_device_open(const char* path, int type);
+
+/**
+ * C 接口：注销并关闭句柄上的设备（内存盘的内容保留在进程内，下次打开同一路径时还在）
+ */
+void block_device_close(int fd);
+
+/**
+ * C 接口：句柄上设备的后端编号，-1 表示没有登记
+ */
+int block_device_type(int fd);
+
+/**
+ * C 接口：设备大小（字节）；改变大小（新增部分读出为 0）：0 成功，-1 失败
+ */
+long long block_device_size(int fd);
+int block_device_resize(int fd, long long bytes);
+
+/**
+ * C 接口：按字节读写；返回读 / 写的字节数（读到末尾之后为短读），-1 失败
+ */
+long long block_device_read(int fd, void* buf, long long len, long long offset);
+long long block_device_write(int fd, const void* buf, long long len, long long offset);
+
+/**
+ * C 接口：把已写入的内容持久化（pread：fdatasync，mmap：msync，内存盘：无操作）
+ * @return 0 成功，-1 失败
+ */
+int block_device_flush(int fd);
+
+/**
+ * C 接口：声明一段内容不再需要，之后读出为 0（pread / mmap：打洞，内存盘：清零）
+ * @return 0 成功，-1 失败
+ */
+int block_device_discard(int fd, long long offset, long long len);
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include <sys/uio.h>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+/**
+ * BlockDevice - 块设备接口
+ *
+ * 按字节偏移读写（块大小由上层的 DiskGeometry 决定）；所有方法可以并发调用，
+ * 同一区域的并发读写由上层（块缓存分片锁、日志）保证不会发生
+ */
+class BlockDevice {
+public:
+    virtual ~BlockDevice() = default;
+
+    virtual const char* name() const = 0;
+    virtual int type() const = 0;
+
+    // 句柄（登记时使用的编号）
+    virtual int handle() const = 0;
+
+    virtual long long size() const = 0;
+    virtual int resize(long long bytes) = 0;
+
+    // 单段读写：返回字节数，-1 失败
+    virtual long long read(void* buf, size_t len, long long offset) = 0;
+    virtual long long write(const void* buf, size_t len, long long offset) = 0;
+
+    // 向量读写（连续的设备区域，分散在多个缓冲区）：返回字节数，-1 失败
+    virtual long long readv(const struct iovec* iov, int count, long long offset) = 0;
+    virtual long long writev(const struct iovec* iov, int count, long long offset) = 0;
+
+    virtual int flush() = 0;
+    virtual int discard(long long offset, long long len) = 0;
+
+    // 句柄已被外部关闭、编号又被重新打开时（模拟崩溃的测试直接 close）：析构时不再关闭它
+    void disown() { m_owns = false; }
+
+protected:
+    bool m_owns = true;
+};
+
+/**
+ * 创建块设备实例（不登记；block_device_open 用它创建后登记）
+ * @param type BlockDeviceType 编号（未知编号返回空指针）
+ * @return 打开失败返回空指针
+ */
+std::unique_ptr<BlockDevice> make_block_device(const char* path, int type);
+
+/**
+ * 句柄上登记的设备，没有登记时返回空指针（调用者按原始 fd 的 pread / pwrite 处理）
+ * 返回的指针在 block_device_close 之前有效
+ */
+BlockDevice* block_device_get(int fd);
+
+/**
+ * PreadDevice - pread / pwrite / preadv / pwritev
+ * owns = false 时只借用 fd（没有登记的原始 fd），析构时不关闭
+ */
+class PreadDevice : public BlockDevice {
+public:
+    PreadDevice(int fd, bool owns);
+    ~PreadDevice() override;
+
+    const char* name() const override { return "pread"; }
+    int type() const override { return BLOCK_DEVICE_PREAD; }
+    int handle() const override { return m_fd; }
+    long long size() const override;
+    int resize(long long bytes) override;
+    long long read(void* buf, size_t len, long long offset) override;
+    long long write(const void* buf, size_t len, long long offset) override;
+    long long readv(const struct iovec* iov, int count, long long offset) override;
+    long long writev(const struct iovec* iov, int count, long long offset) override;
+    int flush() override;
+    int discard(long long offset, long long len) override;
+
+private:
+    int m_fd;
+};
+
+/**
+ * MmapDevice - 镜像文件 MAP_SHARED 映射进内存
+ * 读写是内存复制，不经过系统调用；改变大小时重新映射（持有独占锁，其余操作持共享锁）
+ */
+class MmapDevice : public BlockDevice {
+public:
+    explicit MmapDevice(int fd);
+    ~MmapDevice() override;
+
+    bool mapped_ok() const { return m_ok; }
+
+    const char* name() const override { return "mmap"; }
+    int type() const override { return BLOCK_DEVICE_MMAP; }
+    int handle() const override { return m_fd; }
+    long long size() const override;
+    int resize(long long bytes) override;
+    long long read(void* buf, size_t len, long long offset) override;
+    long long write(const void* buf, size_t len, long long offset) override;
+    long long readv(const struct iovec* iov, int count, long long offset) override;
+    long long writev(const struct iovec* iov, int count, long long offset) override;
+    int flush() override;
+    int discard(long long offset, long long len) override;
+
+private:
+    bool map(long long bytes);
+    void unmap();
+
+    int m_fd;
+    bool m_ok = false;
+    char* m_base = nullptr;
+    long long m_size = 0;
+    mutable std::shared_mutex m_mutex;
+};
+
+/**
+ * MemoryImage - 内存盘的内容（按路径保存在进程内，多次打开共享）
+ */
+struct MemoryImage {
+    std::shared_mutex mutex;
+    std::vector<char> data;
+};
+
+/**
+ * MemoryDevice - 纯内存块设备，句柄是一个 /dev/null 的 fd
+ */
+class MemoryDevice : public BlockDevice {
+public:
+    MemoryDevice(int handle, std::shared_ptr<MemoryImage> image);
+    ~MemoryDevice() override;
+
+    const char* name() const override { return "memory"; }
+    int type() const override { return BLOCK_DEVICE_MEMORY; }
+    int handle() const override { return m_handle; }
+    long long size() const override;
+    int resize(long long bytes) override;
+    long long read(void* buf, size_t len, long long offset) override;
+    long long write(const void* buf, size_t len, long long offset) override;
+    long long readv(const struct iovec* iov, int count, long long offset) override;
+    long long writev(const struct iovec* iov, int count, long long offset) override;
+    int flush() override { return 0; }
+    int discard(long long offset, long long len) override;
+
+private:
+    int m_handle;
+    std::shared_ptr<MemoryImage> m_image;
+};
+
+#endif // __cplusplus
+
+#endif // FS_BLOCK_DEVICE_H
@@ -0,0 +1,103 @@
+// bmap_cache.h - 逻辑块 → 物理块映射缓存（extent 树节点解码缓存）
+#ifndef FS_BMAP_CACHE_H
+#define FS_BMAP_CACHE_H
+
+/**
+ * bmap 缓存统计信息
+ */
+struct BmapCacheStats {
+    unsigned long hits;           // 直接从解码数组得到映射
+    unsigned long misses;         // 需要读取并解码树节点
+    unsigned long invalidations;  // 树节点被改写后作废的条目数
+    unsigned long entries;        // 当前缓存的树节点数
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：读取 extent 树节点的内容
+ * 第一次访问某个节点时读入整块并按 int 数组保存，之后直接复制
+ * @param node_block 节点的物理块号
+ * @param first 起始下标（int 为单位，节点头占前 4 个）
+ * @param count 个数
+ * @param out 输出
+ * @return 0 成功，-1 参数错误
+ */
+int bmap_cache_lookup(int fd, int node_block, int first, int count, int* out);
+
+/**
+ * C 接口：节点被改写（追加 / COW 拆分 extent / 释放）后使对应条目作废
+ */
+void bmap_cache_invalidate(int fd, int node_block);
+
+/**
+ * C 接口：丢弃某个 fd 的全部条目（挂载、卸载、快照恢复整体改写 inode 表时调用）
+ */
+void bmap_cache_discard(int fd);
+
+/**
+ * C 接口：获取 / 打印统计信息
+ */
+void bmap_cache_get_stats(BmapCacheStats* stats);
+void bmap_cache_print_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include "disk.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+
+/**
+ * BmapCache - extent 树节点解码缓存（线程安全）
+ *
+ * 以 (fd, 节点块号) 为键缓存节点内容：
+ * - 块号相同内容就相同，快照副本与当前文件共享同一个节点时也共享同一个条目
+ * - 树根在 Inode 结构中，映射一段逻辑块只需从缓存取路径上的节点，不经过块缓存
+ * - 所有改写节点的路径都在 extent.cpp 中，改写后调用 invalidate
+ * - 读盘不持锁：装入前检查期间是否发生过作废，发生过就不装入（本次结果照常返回）
+ */
+class BmapCache {
+public:
+    explicit BmapCache(size_t capacity);
+
+    BmapCache(const BmapCache&) = delete;
+    BmapCache& operator=(const BmapCache&) = delete;
+
+    bool lookup(int fd, int node_block, int first, int count, int* out);
+    void invalidate(int fd, int node_block);
+    void discard(int fd);
+    void get_stats(BmapCacheStats* stats) const;
+    void print_stats() const;
+
+private:
+    struct Entry {
+        int pointers[MAX_POINTERS_PER_BLOCK];  // 按最大块大小分配，只用前 block_size / sizeof(int) 个
+    };
+
+    size_t m_capacity;  // 最多缓存的节点数
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<uint64_t, std::unique_ptr<Entry>> m_entries;
+    uint64_t m_generation;  // 每次作废加一（m_mutex 保护）
+
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_misses;
+    std::atomic<size_t> m_invalidations;
+
+    static uint64_t make_key(int fd, int block_id) {
+        return ((uint64_t)(uint32_t)fd << 32) | (uint32_t)block_id;
+    }
+};
+
+#endif // __cplusplus
+
+#endif // FS_BMAP_CACHE_H
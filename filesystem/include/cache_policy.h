@@ -0,0 +1,163 @@
+// cache_policy.h - 块缓存替换策略（可插拔）
+#ifndef FS_CACHE_POLICY_H
+#define FS_CACHE_POLICY_H
+
+/**
+ * 替换策略编号（block_cache_init_ex 的 policy 参数）
+ */
+enum BlockCachePolicy {
+    BLOCK_CACHE_POLICY_CLOCK = 0,   // CLOCK（近似 LRU，默认）
+    BLOCK_CACHE_POLICY_S3FIFO = 1   // S3-FIFO（抗扫描）
+};
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+/**
+ * 替换策略的累计计数（各分片求和后放进 BlockCacheStats）
+ * 不同策略只填写自己有意义的字段
+ */
+struct PolicyCounters {
+    size_t probation_hits = 0;   // S3-FIFO：命中小队列（新进入、尚未证明是热块）
+    size_t protected_hits = 0;   // S3-FIFO：命中主队列；CLOCK：全部命中
+    size_t ghost_hits = 0;       // S3-FIFO：装入时命中幽灵队列，直接进入主队列
+    size_t promotions = 0;       // S3-FIFO：小队列 → 主队列
+    size_t second_chances = 0;   // CLOCK：引用位清零次数；S3-FIFO：主队列重新插入次数
+};
+
+/**
+ * EvictionPolicy - 替换策略接口
+ *
+ * 每个缓存分片持有一个策略实例，按帧号（0..frame_count-1）管理。
+ * 调用约定（由 BlockCache 保证）：
+ * - on_access 在分片共享锁下调用，可能并发，只能做原子操作
+ * - 其余方法在分片独占锁下调用
+ * - pick_victim 只在分片已满时调用，返回的帧已从策略中移除
+ */
+class EvictionPolicy {
+public:
+    virtual ~EvictionPolicy() = default;
+
+    virtual const char* name() const = 0;
+
+    // 新块装入帧 f
+    virtual void on_insert(size_t f, uint64_t key) = 0;
+
+    // 命中帧 f
+    virtual void on_access(size_t f) = 0;
+
+    // 帧 f 被主动移除（失效 / 丢弃 / 清空）
+    virtual void on_remove(size_t f) = 0;
+
+    // 选出牺牲帧
+    virtual size_t pick_victim() = 0;
+
+    // 累加计数
+    virtual void add_counters(PolicyCounters& counters) const = 0;
+};
+
+/**
+ * 创建替换策略实例
+ * @param policy BlockCachePolicy 编号（未知编号按 CLOCK 处理）
+ * @param frame_count 分片帧数
+ */
+std::unique_ptr<EvictionPolicy> make_eviction_policy(int policy, size_t frame_count);
+
+/**
+ * 策略名称（用于打印统计）
+ */
+const char* eviction_policy_name(int policy);
+
+/**
+ * ClockPolicy - CLOCK（第二次机会）
+ * 命中置引用位；淘汰时指针扫过引用位为 1 的帧并清零，遇到引用位为 0 的帧即替换
+ */
+class ClockPolicy : public EvictionPolicy {
+public:
+    explicit ClockPolicy(size_t frame_count);
+
+    const char* name() const override { return "CLOCK"; }
+    void on_insert(size_t f, uint64_t key) override;
+    void on_access(size_t f) override;
+    void on_remove(size_t f) override;
+    size_t pick_victim() override;
+    void add_counters(PolicyCounters& counters) const override;
+
+private:
+    size_t m_frame_count;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_ref;
+    size_t m_hand = 0;
+    std::atomic<size_t> m_hits{0};
+    size_t m_second_chances = 0;
+};
+
+/**
+ * S3FifoPolicy - S3-FIFO（Small / Main / Ghost 三个 FIFO 队列）
+ *
+ * - 新块进入小队列 S（约 10% 帧）；命中只把频率加一（上限 3），不移动节点
+ * - S 超过目标大小时从 S 尾部淘汰：被访问过的块晋升到主队列 M，
+ *   没被访问过的直接淘汰，并把键记入幽灵队列 G
+ * - 从 M 尾部淘汰时，频率大于 0 的块减一后重新插回 M 头部
+ * - 装入时键在 G 中（最近被挤出过）则直接进入 M
+ *
+ * 快照 / fsck 对引用计数表和位图的一次性扫描只经过 S，不会冲掉 M 中的
+ * inode 表和目录块
+ */
+class S3FifoPolicy : public EvictionPolicy {
+public:
+    explicit S3FifoPolicy(size_t frame_count);
+
+    const char* name() const override { return "S3-FIFO"; }
+    void on_insert(size_t f, uint64_t key) override;
+    void on_access(size_t f) override;
+    void on_remove(size_t f) override;
+    size_t pick_victim() override;
+    void add_counters(PolicyCounters& counters) const override;
+
+private:
+    enum Queue : uint8_t { NONE = 0, SMALL = 1, MAIN = 2 };
+
+    // 队列元素带代数，帧被移除或复用后旧元素自动作废（惰性删除）
+    struct Entry {
+        size_t frame;
+        uint32_t gen;
+    };
+
+    bool pop_valid(std::deque<Entry>& queue, uint8_t which, size_t& frame);
+    void push_ghost(uint64_t key);
+    void detach(size_t f);
+
+    size_t m_frame_count;
+    size_t m_small_target;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_freq;
+    std::unique_ptr<uint8_t[]> m_queue;
+    std::unique_ptr<uint32_t[]> m_gen;
+    std::unique_ptr<uint64_t[]> m_key;
+
+    std::deque<Entry> m_small;
+    std::deque<Entry> m_main;
+    size_t m_small_size = 0;
+    size_t m_main_size = 0;
+
+    // 幽灵队列：只记键；键 -> 序号，序号不匹配的队列元素视为已作废
+    std::deque<std::pair<uint64_t, uint64_t>> m_ghost;
+    std::unordered_map<uint64_t, uint64_t> m_ghost_index;
+    uint64_t m_ghost_seq = 0;
+
+    std::atomic<size_t> m_probation_hits{0};
+    std::atomic<size_t> m_protected_hits{0};
+    size_t m_ghost_hits = 0;
+    size_t m_promotions = 0;
+    size_t m_second_chances = 0;
+};
+
+#endif // __cplusplus
+
+#endif // FS_CACHE_POLICY_H
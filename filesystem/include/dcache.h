@@ -0,0 +1,186 @@
+// dcache.h - 路径解析目录项缓存（dentry cache）
+#ifndef FS_DCACHE_H
+#define FS_DCACHE_H
+
+#include <cstdint>
+
+/**
+ * 缓存版本快照
+ * 未命中时先取快照，再走慢路径（read_inode + dir_find_entry），最后用快照插入：
+ * 慢路径期间若目录发生了变化，插入的条目一开始就是失效的，不会把旧结果留在缓存里
+ */
+struct DcacheToken {
+    uint32_t epoch;       // 整体作废（挂载 / 卸载 / 快照恢复）
+    uint32_t add_gen;     // 目录项增加次数：负条目（不存在）依赖它
+    uint32_t remove_gen;  // 目录项删除次数：正条目依赖它
+};
+
+/**
+ * dentry 缓存统计信息
+ */
+struct DcacheStats {
+    unsigned long hits;            // (父目录, 名字) 命中
+    unsigned long negative_hits;   // 其中命中负条目的次数
+    unsigned long misses;
+    unsigned long path_hits;       // 完整路径命中
+    unsigned long path_misses;
+    unsigned long invalidations;   // 版本号递增次数
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：取当前版本快照（在慢路径之前调用）
+ */
+void dcache_snapshot(DcacheToken* token);
+
+/**
+ * C 接口：查找 (父目录 inode, 名字)
+ * @param inode_id 命中时输出 inode 编号（-1 表示负条目：确定不存在）
+ * @return 1 命中，0 未命中
+ */
+int dcache_lookup(int fd, int parent_id, const char* name, int* inode_id);
+
+/**
+ * C 接口：插入 (父目录 inode, 名字) → inode（inode_id = -1 表示不存在）
+ */
+void dcache_insert(int fd, int parent_id, const char* name, int inode_id, const DcacheToken* token);
+
+/**
+ * C 接口：查找 / 插入完整路径（调用者传入规范化路径，键就是路径字符串本身）
+ */
+int dcache_lookup_path(int fd, const char* path, int* inode_id);
+void dcache_insert_path(int fd, const char* path, int inode_id, const DcacheToken* token);
+
+/**
+ * C 接口：目录项变化通知（dir_add_entry / dir_remove_entry 成功后调用）
+ * 增加：所有负条目作废，并直接插入新的正条目
+ * 删除：所有正条目作废，并直接插入负条目
+ */
+void dcache_note_add(int fd, int parent_id, const char* name, int inode_id);
+void dcache_note_remove(int fd, int parent_id, const char* name);
+
+/**
+ * C 接口：整体作废（disk_open / disk_close / 快照恢复 / 目录树恢复）
+ */
+void dcache_invalidate(int fd);
+
+/**
+ * C 接口：获取 / 打印统计信息
+ */
+void dcache_get_stats(DcacheStats* stats);
+void dcache_print_stats();
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在C++ 编译时可用）
+#ifdef __cplusplus
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+/**
+ * SeqlockTable - 直接映射的定长键值表，读无锁
+ *
+ * 每个槽位带一个序列号（seqlock）：写者持互斥锁，写前把序列号加一（奇数 = 正在写），
+ * 写完再加一；读者读序列号 → 读字段 → 再读序列号，两次相同且为偶数才算读到完整条目。
+ * 所有字段都是原子变量（relaxed），读者永远不会阻塞，也没有数据竞争。
+ * 槽位冲突时新条目直接覆盖旧条目（缓存语义）。
+ *
+ * @tparam KeyWords 键的长度（64 位字数）
+ */
+template <size_t KeyWords>
+class SeqlockTable {
+public:
+    struct Key {
+        uint64_t words[KeyWords];
+    };
+
+    explicit SeqlockTable(size_t slot_count);
+
+    // 读：命中时返回 true 并输出 value / stamp
+    bool lookup(const Key& key, uint64_t hash, int* value, uint64_t* stamp) const;
+
+    // 写：覆盖 hash 对应的槽位
+    void insert(const Key& key, uint64_t hash, int value, uint64_t stamp);
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint64_t> hash{0};
+        std::atomic<uint64_t> key[KeyWords];
+        std::atomic<int> value{0};
+        std::atomic<uint64_t> stamp{0};
+    };
+
+    size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    std::mutex m_write_mutex;
+};
+
+/**
+ * DentryCache - 路径解析缓存
+ *
+ * 两张表：
+ * - (fd, 父目录 inode, 名字) → inode，parse_path 逐级解析时使用
+ * - (fd, 完整路径) → inode，get_inode_by_path 使用
+ * 两张表都可以存负条目（inode = -1）。
+ *
+ * 失效用三个版本号，条目记录插入时的版本（stamp）：
+ * - 正条目在 remove_gen 变化后失效（删除可能让路径不再存在）
+ * - 负条目在 add_gen 变化后失效（增加可能让路径开始存在）
+ * - 所有条目在 epoch 变化后失效
+ * 上传只会增加目录项，不会冲掉已缓存的正路径。
+ */
+class DentryCache {
+public:
+    DentryCache(size_t component_slots, size_t path_slots);
+
+    DentryCache(const DentryCache&) = delete;
+    DentryCache& operator=(const DentryCache&) = delete;
+
+    void snapshot(DcacheToken* token) const;
+    bool lookup(int fd, int parent_id, const char* name, int* inode_id);
+    void insert(int fd, int parent_id, const char* name, int inode_id, const DcacheToken& token);
+    bool lookup_path(int fd, const char* path, int* inode_id);
+    void insert_path(int fd, const char* path, int inode_id, const DcacheToken& token);
+    void note_add(int fd, int parent_id, const char* name, int inode_id);
+    void note_remove(int fd, int parent_id, const char* name);
+    void invalidate();
+    void get_stats(DcacheStats* stats) const;
+    void print_stats() const;
+
+private:
+    // 名字最多 DIR_NAME_SIZE - 1 = 59 字节：1 个字存 (fd, 父目录)，8 个字存名字
+    static const size_t COMPONENT_KEY_WORDS = 9;
+    // 路径最多 MAX_PATH_LENGTH - 1 = 255 字节：1 个字存 fd，32 个字存路径
+    static const size_t PATH_KEY_WORDS = 33;
+
+    SeqlockTable<COMPONENT_KEY_WORDS> m_components;
+    SeqlockTable<PATH_KEY_WORDS> m_paths;
+
+    std::atomic<uint32_t> m_epoch;
+    std::atomic<uint32_t> m_add_gen;
+    std::atomic<uint32_t> m_remove_gen;
+
+    std::atomic<size_t> m_hits;
+    std::atomic<size_t> m_negative_hits;
+    std::atomic<size_t> m_misses;
+    std::atomic<size_t> m_path_hits;
+    std::atomic<size_t> m_path_misses;
+    std::atomic<size_t> m_invalidations;
+
+    // 条目版本：高 32 位 epoch，低 32 位为正 / 负条目各自依赖的版本号
+    static uint64_t make_stamp(const DcacheToken& token, int inode_id);
+    bool stamp_valid(uint64_t stamp, int inode_id) const;
+};
+
+#endif // __cplusplus
+
+#endif // FS_DCACHE_H
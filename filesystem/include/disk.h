@@ -4,35 +4,82 @@
 
 #include <cstdint>
 
-const int BLOCK_SIZE = 1024;               // 1KB block
-const int DISK_SIZE  = 8 * 1024 * 1024;     // 8MB
-const int BLOCK_COUNT = DISK_SIZE / BLOCK_SIZE;
+struct Inode;
 
-const int POINTERS_PER_BLOCK = BLOCK_SIZE / sizeof(int);  // 每个块能存放多少个块指针
-// layout
+// 块大小（v9 起由 mkfs 选择，记录在 superblock 中）
+// 栈上的块缓冲区按 MAX_BLOCK_SIZE 分配，实际读写 disk_block_size(fd) 字节
+const int MIN_BLOCK_SIZE = 1024;
+const int MAX_BLOCK_SIZE = 4096;
+const int MAX_POINTERS_PER_BLOCK = MAX_BLOCK_SIZE / sizeof(int);  // 一个块最多能存放多少个块指针
+
+// disk_open 自动格式化（新建的空镜像）时使用的默认值，与 mkfs 不带参数时相同
+const int DEFAULT_BLOCK_SIZE = 1024;
+const long long DEFAULT_DISK_SIZE = 8 * 1024 * 1024;  // 8MB
+
+// layout：superblock 固定在第 0 块（读 superblock 时只读前 MIN_BLOCK_SIZE 字节），
+// 其余区域的位置和大小都在 DiskGeometry 里（见 disk_plan_geometry）
 const int SUPERBLOCK_BLOCK = 0;
-const int INODE_BITMAP_BLOCK = 1;
-const int BLOCK_BITMAP_BLOCK = 2;
-const int INODE_TABLE_START = 3;
-const int INODE_TABLE_BLOCK_COUNT = 16;
 
-// 快照相关常量
-const int SNAPSHOT_TABLE_START = INODE_TABLE_START + INODE_TABLE_BLOCK_COUNT;
-const int SNAPSHOT_TABLE_BLOCKS = 4;  // 4个块用于快照表
+// 快照目录区的块数（v6 起这个区域存快照目录的块号，表项本身放在按需分配的数据块里，见 snapshot_catalog.h）
+const int SNAPSHOT_TABLE_BLOCKS = 4;
 
-// 引用计数块
-const int REF_COUNT_TABLE_START = SNAPSHOT_TABLE_START + SNAPSHOT_TABLE_BLOCKS;
-const int REF_COUNT_TABLE_BLOCKS = 100;  // 每个块能存100个块的ref_count，100个块支持10000个数据块
+/**
+ * 磁盘布局（v9）
+ *
+ * 依次是：superblock | inode 位图 | 块位图 | inode 表 | 快照目录 | 引用计数表 | 出生 epoch 表 | 元数据日志 | 数据区
+ * - 位图、inode 表、引用计数表、出生 epoch 表都按磁盘大小和 inode 数占用多个块
+ * - 日志保护的是它之前的全部元数据块 [0, journal_start)（见 journal.h）
+ * mkfs 选定后写入 superblock，挂载时读入，之后不再改变
+ */
+struct DiskGeometry {
+    int block_size;             // 块大小（1024 / 2048 / 4096）
+    int block_count;            // 总块数
+    int inode_count;            // inode 数（填满 inode 表的整块）
+    int inode_bitmap_start;
+    int inode_bitmap_blocks;
+    int block_bitmap_start;
+    int block_bitmap_blocks;
+    int inode_table_start;
+    int inode_table_blocks;
+    int snapshot_table_start;
+    int snapshot_table_blocks;
+    int ref_count_start;        // 引用计数：每块一个字节
+    int ref_count_blocks;
+    int birth_table_start;      // 出生 epoch（v4）：每块一个 uint32_t
+    int birth_table_blocks;
+    int journal_start;          // 元数据日志（v7）：第一块是日志头，其余是循环写入的日志
+    int journal_blocks;
+    int data_block_start;
+};
 
-// 数据块区域相应调整
-const int DATA_BLOCK_START = REF_COUNT_TABLE_START + REF_COUNT_TABLE_BLOCKS;
+// 覆盖全部块的位图掩码长度（64 位字），批量引用计数接口使用
+static inline int disk_mask_words(const DiskGeometry* geometry) {
+    return (geometry->block_count + 63) / 64;
+}
 
 // 先定义 Superblock 结构体
 // 说明：
 // - 早期版本没有 magic/version 字段；升级后用它来检测磁盘格式是否与当前代码匹配。
 // - 若检测到旧格式（magic 不匹配），disk_open 会自动重新格式化磁盘镜像（数据会被清空）。
+// - v3：Inode 增加 dir_index（目录哈希索引），inode 大小变为 64 字节。
+// - v4：快照改用出生 epoch：superblock 记录当前 epoch 和最新快照的 epoch，
+//       每个块记录分配时的 epoch；创建快照不再逐块增加引用计数。
+// - v5：快照表项增加 scope（整盘 / 子树快照）。
+// - v6：快照表改为可扩展的快照目录：快照表区保存目录块号，表项放在数据块里。
+// - v7：元数据修改先写入日志区（journal_start），挂载时重放已提交的事务。
+// - v8：superblock 记录挂载状态，正常关闭的磁盘挂载时跳过一致性检查。
+// - v9：布局（块大小、各区域的位置和大小）由 mkfs 选择并记录在 superblock 中；
+//       快照的位图 / inode 表副本改为经副本块号表记录，不再限定块数。
+// - v10：inode 的直接块 / 间接块指针换成 extent 映射（见 extent.h），文件大小不再受间接块限制。
+// - v11：inode 扩大到 128 字节，小文件内容直接存放在 inode 中（INODE_FLAG_INLINE）。
+// - v12：子树快照保存钉住的块号列表而不是整盘块位图，创建 / 恢复 / 删除的开销只与子树大小有关。
 static const uint32_t FS_SUPERBLOCK_MAGIC = 0x4F534653; // 'OSFS'
-static const uint32_t FS_VERSION = 2;
+static const uint32_t FS_VERSION = 12;
+
+// 挂载状态（Superblock::state）：挂载后立即写为 DIRTY，disk_close 最后写为 CLEAN
+// 0 是 DIRTY：没有这个字段的镜像、或者上次没有正常关闭，挂载时都做一致性检查
+static const uint32_t FS_STATE_DIRTY = 0;
+static const uint32_t FS_STATE_CLEAN = 1;
 
 struct Superblock {
     int block_size;
@@ -45,28 +92,60 @@ struct Superblock {
     uint32_t magic;
     uint32_t version;
     uint32_t dirent_size;
-    uint32_t reserved; // 保留，便于未来扩展（对齐到 16 字节）
+    uint32_t received_epoch; // 接收快照流的副本：最近一次接收的快照 epoch，下一次增量流的基准（0 = 无）
+
+    // v4 fields
+    uint32_t epoch;           // 当前 epoch：新分配的块以它为出生 epoch，每创建一个快照加一
+    uint32_t snapshot_epoch;  // 最新激活快照的 epoch（0 = 没有快照）
+
+    // v8 fields
+    uint32_t state;           // FS_STATE_DIRTY / FS_STATE_CLEAN
+
+    // v9 fields
+    DiskGeometry geometry;    // 布局（block_size / block_count / inode_count 与上面的字段相同）
 };
 
+// 快照的位图 / inode 表副本（v9）：副本块号依次记在最多 SNAPSHOT_MAP_BLOCKS 个块号表块里
+// mkfs 保证整盘快照的副本（两张位图 + inode 表）放得下
+const int SNAPSHOT_MAP_BLOCKS = 16;
+
 // 再定义 Snapshot 结构体
 struct Snapshot {
     int id;              // 快照ID
-    int active;          // 是否激活 (1=active, 0=inactive)
+    int active;          // 表项状态（SNAPSHOT_FREE / SNAPSHOT_ACTIVE / SNAPSHOT_DELETING）
     int timestamp;       // 时间戳
     int root_inode_id;   // 快照时的根inode ID
     char name[32];       // 快照名称
     
     // 新增字段：保存快照时的元数据信息
     Superblock sb_at_snapshot;  // 快照时的superblock状态
-    int inode_bitmap_block;     // 快照时的inode位图块ID
-    int block_bitmap_block;     // 快照时的块位图块ID
-    int inode_table_blocks[16]; // 快照时的inode表块ID
+    int map_blocks[SNAPSHOT_MAP_BLOCKS];  // 副本块号表所在的块（int 数组，按顺序，0 = 未使用；v9）
+    int copy_blocks;            // 副本块总数（v9）
     int total_inodes_used;      // 快照时使用的inode数量
     int total_blocks_used;      // 快照时使用的块数量
+    uint32_t epoch;             // 创建快照时的 epoch：出生 epoch 不大于它的块属于这个快照
+
+    // v5 fields
+    int scope;                  // SNAPSHOT_SCOPE_FULL / SNAPSHOT_SCOPE_SUBTREE
 };
 
-// 现在可以安全地定义MAX_SNAPSHOTS
-const int MAX_SNAPSHOTS = (SNAPSHOT_TABLE_BLOCKS * BLOCK_SIZE) / sizeof(Snapshot);
+// 快照表项状态：删除后先进入 DELETING，块回收完成后才变回 FREE（槽位此时才可复用）
+// DELETING 的快照对外不可见，但它的位图和元数据块仍然有效，崩溃后挂载时继续回收
+const int SNAPSHOT_FREE = 0;
+const int SNAPSHOT_ACTIVE = 1;
+const int SNAPSHOT_DELETING = 2;
+
+// 快照范围
+// 副本块分三段，块数取决于范围：
+// FULL：inode 位图 | 块位图 | inode 表（各段块数与布局相同），块由出生 epoch 保护（见 v4 说明）
+// SUBTREE：只保存 root_inode_id 之下的 inode，开销与子树大小成正比；三段和字段的含义随之变化：
+//   第一段   子树 inode 编号列表（int 数组，root 在第一个，共 total_inodes_used 个）
+//   第二段   子树引用的块号列表（int 数组，升序，共 total_blocks_used 个，v12 之前是整盘大小的块位图）；
+//            每块的引用计数额外加一（"钉住"），写入时照常 COW
+//   第三段   按列表顺序保存的 inode 副本
+//   epoch    0（不推进 epoch，不影响子树之外的写入）
+const int SNAPSHOT_SCOPE_FULL = 0;
+const int SNAPSHOT_SCOPE_SUBTREE = 1;
 
 // 添加到disk.h的结构体定义部分
 
@@ -77,28 +156,97 @@ struct BlockBitmapEntry {
     unsigned char ref_count;      // 引用计数 (最多255个引用)
 };
 
+// disk_open 的挂载过程
+struct DiskMountInfo {
+    uint64_t mount_ns;      // disk_open 耗时（纳秒）
+    int formatted;          // 是否重新格式化
+    int replayed;           // 重放的日志事务数
+    int checked;            // 是否做了一致性检查（上次没有正常关闭）
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 // 快照操作函数声明
 int create_snapshot(int fd, const char* name);
+// 子树快照：root_inode_id 必须是目录；恢复时只改写这棵子树（见 SNAPSHOT_SCOPE_SUBTREE）
+int create_subtree_snapshot(int fd, int root_inode_id, const char* name);
 int restore_snapshot(int fd, int snapshot_id);
 int delete_snapshot(int fd, int snapshot_id);
 int list_snapshots(int fd, Snapshot* snapshots, int max_count);
 
+// 快照目录查询（内存索引，不做 I/O）
+// find_snapshot：按名称查找激活的快照，返回编号（同名时取编号最小的），-1 表示不存在
+// get_snapshot：读取激活的快照，0 成功，-1 表示不存在
+// count_snapshots：激活快照的数量（list_snapshots 需要的数组大小）
+int find_snapshot(int fd, const char* name);
+int get_snapshot(int fd, int snapshot_id, Snapshot* snapshot);
+int count_snapshots(int fd);
+
+// 只读快照视图：按快照保存的 inode 表解析路径，经共享块读取数据，不修改活跃文件系统
+// 整盘快照的路径从根目录开始；子树快照的路径相对于快照的根目录（"/" 即根目录本身）
+// stat：快照中的 inode 写入 *inode，返回它的编号；-1 表示快照或路径不存在
+// read_file：返回读取的字节数（offset 超出文件大小时为 0）；-1 表示快照或路径不存在、不是普通文件
+int snapshot_stat(int fd, int snapshot_id, const char* path, Inode* inode);
+int snapshot_read_file(int fd, int snapshot_id, const char* path, char* buf, int offset, int size);
+
+// 快照表锁：exclusive 为 0 时加共享锁（读取快照内容期间快照不会被删除回收），否则加独占锁
+// 供 filesystem 内部的其他模块（如快照流）使用；持有期间不要再调用上面的快照函数
+void snapshot_table_lock(int exclusive);
+void snapshot_table_unlock(int exclusive);
+// 读取整盘快照保存的 inode 位图（inode_bitmap_blocks 块）和 inode 表（inode_table_blocks 块），调用者持有快照表锁
+// @return 0 成功，-1 表示快照不存在或不是整盘快照
+int snapshot_read_inode_tables(int fd, int snapshot_id, void* inode_bitmap, void* inode_table);
+
+// 删除快照的块回收（delete_snapshot 只把快照标记为 DELETING；见 reclaimer.h）
+// reclaim_chunk：回收 [first_block, first_block + count) 范围内只属于该快照的块，范围按 64 块对齐
+//   @return 释放的块数，-1 表示该快照不处于 DELETING 状态
+// reclaim_finish：释放快照自身的位图 / inode 表副本并把表项置为 FREE
+int snapshot_reclaim_chunk(int fd, int snapshot_id, int first_block, int count);
+int snapshot_reclaim_finish(int fd, int snapshot_id);
+
 // Bitmap 操作函数声明
 int alloc_inode(int fd);
 void free_inode(int fd, int inode_id);
 int alloc_block(int fd);
 void free_block(int fd, int block_id);
+// 就近分配（见 allocator_alloc_block_goal）：goal 为希望拿到的块号，owner 为所属 inode；alloc_block 即 goal = owner = -1
+int alloc_block_goal(int fd, int goal, int owner);
 
 int disk_open(const char* path);
+// 指定块设备后端打开（BlockDeviceType，见 block_device.h）；disk_open 使用进程默认后端（环境变量 FS_BLOCK_DEVICE）
+// 返回的 fd 是这个磁盘的句柄：各模块的状态都按它登记，块读写经过其上的后端
+int disk_open_with(const char* path, int device_type);
 void disk_close(int fd);
 
+// 布局（geometry.cpp）
+// plan：按磁盘大小、块大小和 inode 数（0 = 按磁盘大小选择）计算布局，0 成功，-1 参数不合法或磁盘太小
+// format：新建（或清空）镜像文件，按 geometry 写入空文件系统（只有根目录），0 成功，-1 失败
+// valid：各区域按顺序相接、大小足够（挂载时检查 superblock 中的布局），1 合法，0 不合法
+// disk_geometry：已挂载磁盘的布局，挂载期间不变、不加锁；未挂载的 fd 返回全 0 的布局
+// disk_block_size：disk_geometry(fd)->block_size
+int disk_plan_geometry(long long disk_size, int block_size, int inode_count, DiskGeometry* geometry);
+int disk_format(const char* path, const DiskGeometry* geometry);
+int disk_geometry_valid(const DiskGeometry* geometry);
+const DiskGeometry* disk_geometry(int fd);
+int disk_block_size(int fd);
+// 登记 / 注销一个 fd 的布局（disk_open / disk_close 调用）
+void geometry_load(int fd, const DiskGeometry* geometry);
+void geometry_discard(int fd);
+
+// 最近一次 disk_open 的情况（启动日志使用）：0 成功，-1 该 fd 未挂载
+int disk_get_mount_info(int fd, DiskMountInfo* info);
+
 void read_block(int fd, int block_id, void* buf);
 void write_block(int fd, int block_id, const void* buf);
 
+// 读取物理上连续的 count 个块（从 start_block 开始），第 i 块写入 bufs[i]
+// 整段只发一次 preadv；读取失败的块填充 0（与 read_block 一致）
+void read_block_run(int fd, int start_block, int count, void* const* bufs);
+// 写入物理上连续的 count 个块，整段只发一次 pwritev（日志提交使用）
+void write_block_run(int fd, int start_block, int count, const void* const* bufs);
+
 // 新增数据块操作函数声明
 int read_data_block(int fd, int block_id, void* buf, int offset, int size);
 int write_data_block(int fd, int block_id, const void* data, int offset, int size);
@@ -112,6 +260,26 @@ int increment_block_ref_count(int fd, int block_id);
 int decrement_block_ref_count(int fd, int block_id);
 int get_block_ref_count(int fd, int block_id);
 int copy_on_write_block(int fd, int block_id);
+// 同 copy_on_write_block，副本按 alloc_block_goal 放在 goal 附近
+int copy_on_write_block_goal(int fd, int block_id, int goal, int owner);
+
+// 快照共享判断（v4）：引用计数 > 1，或出生 epoch 不晚于最新快照时返回 1，写入前需要 COW
+int block_needs_cow(int fd, int block_id);
+// 释放一个活跃引用：计数归零且块不属于任何快照时真正释放并返回 1，否则返回 0（出错 -1）
+int release_block(int fd, int block_id);
+
+// 批量引用计数：mask 为 disk_mask_words 个 64 位字的块位图，只处理数据块区域
+// 每个引用计数表块只读写一次，块内用 SIMD 批量处理（见 ref_kernels.h）；调用者保证 mask 中的块已分配
+// 加一 / 减一，返回被饱和挡住（已是 255 / 0）的块数
+int ref_count_add_mask(int fd, const uint64_t* mask, int delta);
+// 同上，blocked 输出被挡住的块（disk_mask_words 个字，调用者清零），用于精确回滚
+int ref_count_add_mask_blocked(int fd, const uint64_t* mask, int delta, uint64_t* blocked);
+// zero 输出 mask 中计数为 0 的块，返回块数
+int ref_count_zero_mask(int fd, const uint64_t* mask, uint64_t* zero);
+// 计数清零
+void ref_count_clear_mask(int fd, const uint64_t* mask);
+// 计数清零并释放这些块，返回实际释放的块数
+int free_block_mask(int fd, const uint64_t* mask);
 int restore_directory_tree(int fd, int source_inode_id, int target_inode_id);
 
 #ifdef __cplusplus
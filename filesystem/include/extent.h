@@ -0,0 +1,101 @@
+// extent.h - inode 的 extent 映射（逻辑块 → 物理块）
+#ifndef FS_EXTENT_H
+#define FS_EXTENT_H
+
+#include "inode.h"
+
+/*
+ * 一个文件的映射是按逻辑块排序、互不重叠的 Extent 列表，物理连续的相邻段合并成一项。
+ * 不超过 INODE_EXTENT_COUNT 项时直接放在 inode 里（extent_depth = 0）；
+ * 更多时放进 extent 树：inode 里是树根的索引项，树的每个节点占一个数据块：
+ *   节点头（magic、深度、项数） | Extent × 项数
+ * 深度 0 的节点（叶子）存数据 extent，其他节点存索引项（子节点覆盖的第一个逻辑块 + 子节点块号）。
+ * 节点块在数据区，和数据块一样按快照 / 引用计数做 COW：修改叶子时从叶子到根逐个复制被共享的节点。
+ */
+
+// 节点头
+struct ExtentNodeHeader {
+    uint32_t magic;                     // EXTENT_NODE_MAGIC
+    int depth;                          // 0：叶子
+    int count;                          // 项数
+    int reserved;
+};
+
+static const uint32_t EXTENT_NODE_MAGIC = 0x45585431; // 'EXT1'
+
+// 一个节点最多的项数：(块大小 - 节点头) / sizeof(Extent)，1KB 块是 84 项
+static inline int extent_node_capacity(int block_size) {
+    return (block_size - (int)sizeof(ExtentNodeHeader)) / (int)sizeof(Extent);
+}
+
+/**
+ * 碎片报告（extent_fragmentation_report）：只统计占用数据块的普通文件，内联的小文件不计
+ */
+struct FragmentationReport {
+    int files;                          // 文件数
+    int fragmented_files;               // 多于一个 extent 的文件数
+    long long blocks;                   // 数据块总数
+    long long extents;                  // 数据 extent 总数
+    double avg_extent_blocks;           // 平均 extent 长度（块）= blocks / extents
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：把逻辑块 [first, first + count) 映射为物理块号，没有映射的位置为 -1
+ * 只访问与范围相交的子树；节点经过 bmap 缓存（解码后的节点内容）
+ * @return 0 成功，-1 参数错误或树节点损坏（损坏的部分按没有映射处理）
+ */
+int extent_map(int fd, const Inode* inode, int first, int count, int* out);
+
+/**
+ * C 接口：把逻辑块 [logical, logical + count) 映射到物理块 [start, start + count)
+ * 用于追加（logical 不小于已映射的末尾）和 COW 后替换单个块（count = 1）；与相邻 extent 物理连续时合并
+ * 被替换的旧数据块由调用者处理（copy_on_write_block 已经释放了它的引用）
+ * 只修改内存中的 inode，调用者负责写回
+ * @return 0 成功，-1 分配 / 复制树节点失败
+ */
+int extent_insert(int fd, Inode* inode, int logical, int start, int count);
+
+/**
+ * C 接口：释放全部数据块和树节点（每块 release_block 一次），映射清空
+ */
+void extent_release_all(int fd, Inode* inode);
+
+/**
+ * C 接口：全部数据块和树节点的引用计数各加一（另一个 inode 开始共享这份映射）
+ */
+void extent_share_all(int fd, const Inode* inode);
+
+/**
+ * C 接口：数据 extent 的个数（碎片程度：文件越连续越少）
+ */
+int extent_count_extents(int fd, const Inode* inode);
+
+/**
+ * C 接口：扫描 inode 表，统计每个文件的 extent 数（平均 extent 越长，顺序读越能合并成大 I/O）
+ * @return 0 成功，-1 磁盘未挂载
+ */
+int extent_fragmentation_report(int fd, FragmentationReport* report);
+void extent_print_fragmentation(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 接口（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include <vector>
+
+/**
+ * 按逻辑块顺序列出全部数据 extent，nodes 不为空时同时列出树节点块号
+ * 损坏的节点（块号越界、magic / 深度不对）跳过
+ */
+void extent_collect(int fd, const Inode* inode, std::vector<Extent>* extents, std::vector<int>* nodes);
+
+#endif // __cplusplus
+
+#endif // FS_EXTENT_H
@@ -10,8 +10,25 @@
 const int INODE_TYPE_FILE = 1;
 const int INODE_TYPE_DIR = 2;
 
-// 每个inode中直接块的数量
-const int DIRECT_BLOCK_COUNT = 10;
+// 一段物理连续的数据块：逻辑块 [logical, logical + length) 存放在物理块 [start, start + length)
+// extent 树的索引项也用这个结构：logical 是子节点覆盖的第一个逻辑块，start 是子节点块号，length 不用
+struct Extent {
+    int logical;                        // 起始逻辑块
+    int start;                          // 起始物理块
+    int length;                         // 块数
+};
+
+// inode 中直接存放的 extent（或 extent 树根的索引项）个数
+const int INODE_EXTENT_COUNT = 3;
+
+// 文件大小是 int，单个文件最大 2GB - 1 字节；映射本身不限块数（extent 树按需加高）
+const int MAX_FILE_SIZE = 0x7FFFFFFF;
+
+// 不超过这个大小的普通文件内容直接放在 inode 里（与 extent 共用空间），读写都不经过数据块
+const int INODE_INLINE_SIZE = 100;
+
+// Inode::flags
+const int INODE_FLAG_INLINE = 0x1;      // 内容在 inline_data 中，没有数据块（block_count = 0）
 
 // 目录项结构
 // 注意：目录项名长度需要覆盖上层业务的 paperId（例如 concurrent_paper_*_timestamp）。
@@ -22,18 +39,32 @@ struct DirEntry {
     char name[DIR_NAME_SIZE];          // 文件或目录名
 };
 
-const int DIRENT_PER_BLOCK = BLOCK_SIZE / sizeof(DirEntry);
+// 每块目录项数随块大小变化（块大小 / sizeof(DirEntry)），这里是上限，用于栈上缓冲区
+const int MAX_DIRENT_PER_BLOCK = MAX_BLOCK_SIZE / sizeof(DirEntry);
 
-// inode结构定义
+// inode结构定义（v11 起 128 字节）
 struct Inode {
     int type;                           // 文件类型
     int size;                           // 文件大小(字节)
-    int block_count;                    // 占用的数据块数量
-    int direct_blocks[DIRECT_BLOCK_COUNT]; // 直接数据块指针
-    int indirect_block;                 // 一级间接块指针
+    int block_count;                    // 占用的数据块数量（逻辑块 [0, block_count) 都有映射）
+    
+    // v10：extent 映射（见 extent.h）
+    int extent_depth;                   // 0：extents 就是数据 extent；> 0：extents 是树根的索引项，值为树高
+    int extent_count;                   // extents 中已用的项数（内联时为 0）
+    union {
+        Extent extents[INODE_EXTENT_COUNT];
+        char inline_data[INODE_INLINE_SIZE]; // v11：INODE_FLAG_INLINE 时的文件内容，size 之后的字节为 0
+    };
+    
+    // v3+ fields
+    int dir_index;                      // 目录：哈希索引所在的隐藏 inode（-1 表示没有索引，按线性扫描）
+    int flags;                          // INODE_FLAG_*（v11 之前是保留字段）
     // 可以添加更多字段如权限、时间戳等
 };
 
+// 目录项数达到这个值时为目录建立哈希索引，更小的目录线性扫描就够了
+const int DIR_INDEX_MIN_ENTRIES = 64;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -49,12 +80,20 @@ void inode_free_blocks(int fd, Inode* inode);
 int inode_write_data(int fd, Inode* inode, int inode_id, const char* data, int offset, int size);
 int inode_read_data(int fd, const Inode* inode, char* buffer, int offset, int size);
 
+// 写入期间的预留窗口（见 allocator_reserve_begin）：begin / end 之间这个文件的新块从它自己的窗口里分配，
+// 同时写入的多个文件各自连续、不交错；可嵌套，须成对调用
+void inode_write_begin(int fd, int inode_id);
+void inode_write_end(int fd, int inode_id);
+
 // 新增目录操作函数声明
 int dir_add_entry(int fd, Inode* dir_inode, int dir_inode_id, const char* name, int inode_id);
 int dir_find_entry(int fd, const Inode* dir_inode, const char* name);
 int dir_get_entry(int fd, const Inode* dir_inode, int index, DirEntry* entry);
 int dir_remove_entry(int fd, Inode* dir_inode, int dir_inode_id, const char* name);
 
+// 释放目录的哈希索引（隐藏 inode 及其数据块），dir_index 置为 -1；调用者负责写回目录 inode
+void dir_index_drop(int fd, Inode* dir_inode);
+
 #ifdef __cplusplus
 }
 #endif
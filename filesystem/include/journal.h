@@ -0,0 +1,184 @@
+// journal.h - 元数据日志（预写日志 + 组提交）
+#ifndef FS_JOURNAL_H
+#define FS_JOURNAL_H
+
+#include "disk.h"
+
+/*
+ * 元数据块 [0, journal_start) 的修改先记入内存中的当前事务，提交时写入日志区，之后再择机写回原位置。
+ * 数据区里的结构块（目录项块、目录哈希索引块、extent 树节点、快照目录表项块）同样经过日志：
+ * 在 JournalMetadataScope 之内写的数据区块，以及已经有日志映像的数据区块，都记入当前事务，
+ * 不会在分配它们所指向的块的事务提交之前被块缓存写回原位置。
+ *
+ * 布局：日志区第一块是日志头（magic + 日志中第一个事务的序号），其余 journal_blocks - 1 块按顺序写入事务（位置和大小见 DiskGeometry）：
+ *   描述块（序号 + 块号列表） | 块映像 × n | 提交块（序号 + 校验和）
+ * 一个事务整段一次 pwritev + 一次 fdatasync；提交块校验通过的事务才算提交。
+ * 事务只在操作边界切分：当前事务超过日志容量的一半时，新的 journal_begin 先提交它。
+ * 单个操作仍超过日志容量时，映像先写到数据区的空闲块（暂存块，位图上仍是空闲），日志里只记
+ *   远端描述块（原块号 + 暂存块号）× m | 提交块
+ * 提交后立即检查点，暂存块随即放回；这样的事务同样是原子的。
+ * 日志写满时（以及关闭时）做检查点：已提交的映像写回原位置，日志头序号前移，日志从头开始；
+ * 写回后内存中的映像随即释放，这些块之后经块缓存读取（常驻内存的只有两次检查点之间修改过的块）。
+ * 数据块不进日志，只保证在引用它们的元数据提交之前落盘。
+ *
+ * 块的复用（见 allocator.h）：释放的块在释放它的事务提交之前不再分配；日志里有映像的块要等到检查点，
+ * 否则重放 / 检查点写回的旧映像会覆盖新主人的内容。
+ */
+
+/**
+ * 日志统计信息（累计值）
+ */
+struct JournalStats {
+    uint64_t commits;           // 写入日志的事务数
+    uint64_t commit_requests;   // journal_commit 调用次数（减去 commits 即被合并的提交）
+    uint64_t blocks_logged;     // 写入日志的块映像数
+    uint64_t checkpoints;       // 检查点次数
+    uint64_t overflows;         // 超出日志容量、映像暂存到数据区的事务数
+    uint64_t unlogged;          // 暂存块也不够、只能直接写回原位置的事务数（没有原子性）
+    uint64_t commit_ns;         // 提交（写日志 + fdatasync）累计耗时（纳秒）
+    int log_used;               // 当前日志已用块数
+    int pending_blocks;         // 当前事务已修改的块数
+    int resident_images;        // 内存中尚未写回原位置的元数据块映像数（检查点后释放）
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：重放日志中已提交的事务（disk_open 在读 superblock 之前调用）
+ * 只用原始块 I/O，不经过块缓存；最多扫描 journal_blocks 块（布局已由 geometry_load 装入）
+ * @return 重放的事务数，日志头无效（未格式化 / 旧版本镜像）时为 0
+ */
+int journal_recover(int fd);
+
+/**
+ * C 接口：开始记录该磁盘的元数据修改（disk_open 在格式化或重放之后调用）
+ * 日志头无效时重新写入；块缓存中的脏块先写回
+ * @return 0 成功
+ */
+int journal_load(int fd);
+
+/**
+ * C 接口：提交当前事务并做检查点，然后释放内存状态（disk_close 调用）
+ */
+void journal_unload(int fd);
+
+/**
+ * C 接口：丢弃内存状态，不提交（disk_open 时清理同号 fd 的残留状态）
+ */
+void journal_discard(int fd);
+
+/**
+ * C 接口：该磁盘是否挂了日志（1 = 是）
+ */
+int journal_attached(int fd);
+
+/**
+ * C 接口：块缓存的读写入口调用
+ * read：块在日志中有更新的映像时复制到 buf 并返回 1，否则返回 0（由块缓存读取）
+ * write：元数据块、结构块（见上）记入当前事务并返回 1；其余数据块返回 0（由块缓存写入），同时记下有数据写入
+ * may_hold：count 个块中可能有块在日志中有映像时返回 1（不加锁的粗略判断，批量读取用它决定是否逐块查日志）
+ * 该 fd 没有日志时都返回 0
+ */
+int journal_read_block(int fd, int block_id, void* buf);
+int journal_write_block(int fd, int block_id, const void* buf);
+int journal_may_hold(int fd, const int* block_ids, int count);
+
+/**
+ * C 接口：当前线程接下来写的数据区块是结构块，记入日志（可嵌套，对所有磁盘有效）
+ */
+void journal_metadata_begin();
+void journal_metadata_end();
+
+/**
+ * C 接口：提交当前事务，返回时此前的修改已经持久化
+ * 并发调用的线程合并成一次提交：一个线程写日志，其余线程等它完成
+ * 提交前写回分配器状态和块缓存中的脏数据块（数据块先于日志落盘）
+ * 不能在 journal_begin / journal_end 之间调用
+ * @return 0 成功，-1 该 fd 没有日志
+ */
+int journal_commit(int fd);
+
+/**
+ * C 接口：把一组修改标记为一个操作（事务句柄）
+ * 提交等所有进行中的操作结束后才截取事务，操作不会被拆到两个事务里；
+ * 提交截取事务期间新的 journal_begin 等待；当前事务已超过日志容量的一半时 journal_begin 先提交它
+ * 可以嵌套：同一线程已持有句柄时不等待、也不提交
+ */
+void journal_begin(int fd);
+void journal_end(int fd);
+
+/**
+ * C 接口：当前线程是否在某个 journal_begin / journal_end 之间（1 = 是；这时不能调用 journal_commit）
+ */
+int journal_in_handle();
+
+/**
+ * C 接口：提交当前事务并做检查点（日志清空，日志中有映像的已释放块随之可以复用）
+ * 和 journal_commit 一样不能在 journal_begin / journal_end 之间调用
+ * @return 0 成功，-1 该 fd 没有日志
+ */
+int journal_checkpoint(int fd);
+
+/**
+ * C 接口：获取 / 打印统计信息
+ */
+void journal_get_stats(int fd, JournalStats* stats);
+void journal_print_stats(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+/**
+ * JournalTransaction - 一个文件系统操作（RAII）
+ *
+ * 构造时 journal_begin，析构时 journal_end 并提交。提交要等进行中的操作结束，所以持有句柄的线程
+ * 不能去等可能正在提交的线程持有的锁：在快照屏障之后、目录结构锁和文件锁之前构造（见 RealFileSystemAdapter）
+ */
+class JournalTransaction {
+public:
+    explicit JournalTransaction(int fd, bool commit = true) : m_fd(fd), m_commit(commit) { journal_begin(fd); }
+    ~JournalTransaction() {
+        journal_end(m_fd);
+        // 嵌套在外层操作里时由外层提交
+        if (m_commit && !journal_in_handle()) {
+            journal_commit(m_fd);
+        }
+    }
+
+    JournalTransaction(const JournalTransaction&) = delete;
+    JournalTransaction& operator=(const JournalTransaction&) = delete;
+
+private:
+    int m_fd;
+    bool m_commit;   // false：只把操作放进同一个事务，不等提交（后台回收）
+};
+
+/**
+ * JournalMetadataScope - 结构块的写入范围（RAII，见 journal_metadata_begin）
+ * enabled 为 false 时什么也不做（inode_write_data 只对目录打开）
+ */
+class JournalMetadataScope {
+public:
+    explicit JournalMetadataScope(bool enabled = true) : m_enabled(enabled) {
+        if (m_enabled) journal_metadata_begin();
+    }
+    ~JournalMetadataScope() {
+        if (m_enabled) journal_metadata_end();
+    }
+
+    JournalMetadataScope(const JournalMetadataScope&) = delete;
+    JournalMetadataScope& operator=(const JournalMetadataScope&) = delete;
+
+private:
+    bool m_enabled;
+};
+
+#endif // __cplusplus
+
+#endif // FS_JOURNAL_H
@@ -0,0 +1,141 @@
+// reclaimer.h - 已删除快照的后台块回收
+#ifndef FS_RECLAIMER_H
+#define FS_RECLAIMER_H
+
+/**
+ * 回收状态（计数为累计值）
+ */
+struct SnapshotReclaimStatus {
+    int running;                      // 后台线程是否在运行
+    int pending;                      // 排队等待回收的快照数（不含正在回收的）
+    int current_fd;                   // 正在回收的快照所在磁盘（-1 = 空闲）
+    int current_snapshot;             // 正在回收的快照 ID（-1 = 空闲）
+    int current_scanned;              // 当前快照已扫描的块数
+    int current_total;                // 当前快照需要扫描的块数
+    unsigned long snapshots_reclaimed;
+    unsigned long blocks_freed;
+    unsigned long chunks;             // 已处理的批次数
+    unsigned long yields;             // 因前台 I/O 推迟下一批次的次数
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：启动后台回收线程
+ * 启动后 delete_snapshot 只把快照标记为 DELETING 就返回，块由后台线程分批释放；
+ * 未启动时 delete_snapshot 就地回收（与之前的行为相同）
+ * @param chunk_blocks 每批扫描的块数（按 64 对齐，0 = 默认 1024）
+ * @param pause_ms     两批之间的间隔（0 = 默认 2ms）；间隔内有前台块 I/O 时继续推迟，最多推迟 8 次
+ */
+void snapshot_reclaimer_start(unsigned int chunk_blocks, unsigned int pause_ms);
+
+/**
+ * C 接口：停止后台回收线程（等待当前批次结束）
+ * 没有回收完的快照保持 DELETING 状态，下次挂载时继续回收
+ */
+void snapshot_reclaimer_stop();
+
+/**
+ * C 接口：把一个 DELETING 快照交给后台线程
+ * @return 0 已排队，-1 后台线程未运行（调用者应就地回收）
+ */
+int snapshot_reclaim_enqueue(int fd, int snapshot_id);
+
+/**
+ * C 接口：等待该磁盘上排队和正在进行的回收全部完成
+ */
+void snapshot_reclaim_wait(int fd);
+
+/**
+ * C 接口：取消该磁盘上的回收（disk_close / disk_open 调用）
+ * 移除排队项并等待正在进行的批次结束，快照保持 DELETING 状态
+ */
+void snapshot_reclaim_cancel(int fd);
+
+/**
+ * C 接口：获取 / 打印回收状态
+ */
+void snapshot_reclaim_get_status(SnapshotReclaimStatus* status);
+void snapshot_reclaim_print_status();
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+
+/**
+ * SnapshotReclaimer - 后台回收线程
+ *
+ * - 每个快照按 chunk_blocks 分批调用 snapshot_reclaim_chunk，全部扫描完后调用 snapshot_reclaim_finish
+ * - 每批只短暂持有快照锁，批次之间前台读写和快照操作都可以进行
+ * - 让步：两批之间等待 pause；等待期间块缓存有新的访问（前台 I/O）时继续等待，
+ *   连续推迟 MAX_YIELDS 次后不再等待，保证回收总能推进
+ */
+class SnapshotReclaimer {
+public:
+    SnapshotReclaimer();
+    ~SnapshotReclaimer();
+
+    SnapshotReclaimer(const SnapshotReclaimer&) = delete;
+    SnapshotReclaimer& operator=(const SnapshotReclaimer&) = delete;
+
+    void start(unsigned int chunk_blocks, unsigned int pause_ms);
+    void stop();
+    bool enqueue(int fd, int snapshot_id);
+    void wait(int fd);
+    void cancel(int fd);
+    void get_status(SnapshotReclaimStatus* status);
+
+private:
+    static const int MAX_YIELDS = 8;
+
+    struct Job {
+        int fd;
+        int snapshot_id;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;   // 有新任务 / 停止 / 取消
+    std::condition_variable m_idle_cv;   // 一个任务结束
+    std::thread m_worker;
+    bool m_running;                      // 接受新任务（start 之后、stop 之前）
+    bool m_stop;
+    std::deque<Job> m_queue;
+
+    // 正在回收的快照（m_mutex 保护）
+    bool m_busy;
+    Job m_current;
+    int m_scanned;
+    std::multiset<int> m_cancelling;     // 正在取消的磁盘，当前任务在下一批之前退出
+
+    int m_chunk_blocks;
+    std::chrono::milliseconds m_pause;
+
+    std::atomic<unsigned long> m_snapshots_reclaimed;
+    std::atomic<unsigned long> m_blocks_freed;
+    std::atomic<unsigned long> m_chunks;
+    std::atomic<unsigned long> m_yields;
+
+    void worker_loop();
+    // 回收一个快照；返回 false 表示被停止 / 取消（快照保持 DELETING）
+    bool reclaim(std::unique_lock<std::mutex>& lock, const Job& job);
+    // 批次之间的让步等待；返回 false 表示等待期间被停止 / 取消
+    bool pause_between_chunks(std::unique_lock<std::mutex>& lock, const Job& job);
+    bool interrupted(const Job& job) const { return m_stop || m_cancelling.count(job.fd) != 0; }
+};
+
+#endif // __cplusplus
+
+#endif // FS_RECLAIMER_H
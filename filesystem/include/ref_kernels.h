@@ -0,0 +1,42 @@
+// ref_kernels.h - 引用计数表的批量位图掩码内核
+#ifndef FS_REF_KERNELS_H
+#define FS_REF_KERNELS_H
+
+#include <cstdint>
+
+/**
+ * 引用计数表是按块号排列的字节数组，块位图按 64 位字排列（第 i 位 = 块 i）。
+ * 下面的内核对 counts[0 .. nwords * 64) 中掩码位为 1 的计数做批量操作：
+ * 每个掩码字对应 64 个计数，x86-64 上用 SSE2 一次处理 16 个字节，
+ * 其他平台退化为逐位循环（结果相同）。全 0 的掩码字直接跳过。
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：掩码位对应的计数加一（delta = 1）或减一（delta = -1）
+ * 饱和：已经是 255 的计数不再加，已经是 0 的计数不再减，这些计数保持不变
+ * @param blocked 不为空时把被挡住的块在对应位置位（nwords 个字，只置位不清零）
+ * @return 被饱和挡住的计数个数（对应逐块接口返回 -1 的次数）
+ */
+int ref_kernel_add_mask(unsigned char* counts, const uint64_t* mask, int nwords, int delta, uint64_t* blocked);
+
+/**
+ * C 接口：找出掩码范围内计数为 0 的块
+ * @param zero 输出位图（nwords 个字），第 i 位 = mask 第 i 位 && counts[i] == 0
+ * @return zero 中置位的个数
+ */
+int ref_kernel_zero_mask(const unsigned char* counts, const uint64_t* mask, int nwords, uint64_t* zero);
+
+/**
+ * C 接口：掩码位对应的计数清零
+ */
+void ref_kernel_clear_mask(unsigned char* counts, const uint64_t* mask, int nwords);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FS_REF_KERNELS_H
@@ -0,0 +1,154 @@
+// ref_table.h - 内存引用计数表 / 出生 epoch 表（惰性写回）
+#ifndef FS_REF_TABLE_H
+#define FS_REF_TABLE_H
+
+#include <cstdint>
+
+/**
+ * 引用计数表统计信息（累计值）
+ */
+struct RefTableStats {
+    unsigned long lookups;       // 读取计数 / 出生 epoch 的次数（全部命中内存）
+    unsigned long updates;       // 单块修改次数
+    unsigned long mask_updates;  // 批量掩码修改次数
+    unsigned long page_flushes;  // 写回的表块数
+    unsigned long dirty_pages;   // 当前尚未写回的表块数
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：从磁盘装入引用计数表和出生 epoch 表（disk_open 调用）
+ * @return 0 成功
+ */
+int ref_table_load(int fd);
+
+/**
+ * C 接口：写回脏表块并释放内存状态（disk_close 调用，在分配器写回位图之前）
+ */
+void ref_table_unload(int fd);
+
+/**
+ * C 接口：丢弃内存状态，不写回（disk_open 时清理同号 fd 的残留状态）
+ */
+void ref_table_discard(int fd);
+
+/**
+ * C 接口：把脏表块写入块缓存
+ * 分配器写回位图和 superblock 之前调用，计数总是先于位图 / 提交点落盘
+ */
+void ref_table_flush(int fd);
+
+/**
+ * C 接口：单块读写（未装入或越界时读取返回 -1 / 0，修改返回 -1）
+ * add：饱和加减（255 不再加、0 不再减），返回新值，被挡住时返回 -1
+ * drop：计数 > 1 时减一并返回新值，否则清零并返回 0（free_block 使用）
+ */
+int ref_table_get(int fd, int block_id);
+int ref_table_set(int fd, int block_id, int count);
+int ref_table_add(int fd, int block_id, int delta);
+int ref_table_drop(int fd, int block_id);
+uint32_t ref_table_birth(int fd, int block_id);
+int ref_table_set_birth(int fd, int block_id, uint32_t epoch);
+
+/**
+ * C 接口：批量掩码操作（mask 为 disk_mask_words 个 64 位字，含义见 ref_kernels.h）
+ */
+int ref_table_add_mask(int fd, const uint64_t* mask, int delta);
+// 同上，blocked 输出被饱和挡住的块（mask 同样大小，调用者清零）
+int ref_table_add_mask_blocked(int fd, const uint64_t* mask, int delta, uint64_t* blocked);
+int ref_table_zero_mask(int fd, const uint64_t* mask, uint64_t* zero);
+void ref_table_clear_mask(int fd, const uint64_t* mask);
+void ref_table_set_birth_mask(int fd, const uint64_t* mask, uint32_t epoch);
+
+/**
+ * C 接口：获取 / 打印统计信息
+ */
+void ref_table_get_stats(int fd, RefTableStats* stats);
+void ref_table_print_stats(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include "disk.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+/**
+ * RefTable - 一个磁盘的引用计数表和出生 epoch 表的内存权威副本
+ *
+ * - 表按磁盘上的表块切分成页：前 ref_count_blocks 页是引用计数（页 p 对应 ref_count_start + p），
+ *   其后 birth_table_blocks 页是出生 epoch（对应 birth_table_start 起的块），页数和页大小取自布局
+ * - 读取无锁（原子变量），COW 判断不再读盘
+ * - 修改按页加锁，改完置脏标记；写回时先清脏标记再读取整页，
+ *   期间并发的修改会重新置脏，下一次写回时补上
+ * - 写回时机跟随分配器：位图写回之前先写回脏页，与位图、superblock 进入同一个日志事务
+ */
+class RefTable {
+public:
+    explicit RefTable(const DiskGeometry& geometry);
+
+    RefTable(const RefTable&) = delete;
+    RefTable& operator=(const RefTable&) = delete;
+
+    void load(int fd);
+    void flush(int fd);
+
+    int get(int block_id) const;
+    void set(int block_id, int count);
+    int add(int block_id, int delta);
+    int drop(int block_id);
+    uint32_t birth(int block_id) const;
+    void set_birth(int block_id, uint32_t epoch);
+
+    int add_mask(const uint64_t* mask, int delta, uint64_t* blocked_mask);
+    int zero_mask(const uint64_t* mask, uint64_t* zero) const;
+    void clear_mask(const uint64_t* mask);
+    void set_birth_mask(const uint64_t* mask, uint32_t epoch);
+
+    void get_stats(RefTableStats* stats) const;
+
+    bool valid_block(int block_id) const { return block_id >= 0 && block_id < m_geometry.block_count; }
+    int mask_words() const { return m_mask_words; }
+
+private:
+    const DiskGeometry m_geometry;
+    const int m_count_pages;           // 引用计数页数（每页 block_size 个计数）
+    const int m_page_count;            // 计数页 + 出生 epoch 页
+    const int m_births_per_page;
+    const int m_mask_words_per_count_page;
+    const int m_mask_words;
+
+    std::unique_ptr<std::atomic<unsigned char>[]> m_counts;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_births;
+    std::unique_ptr<std::mutex[]> m_page_locks;
+    std::unique_ptr<std::atomic<bool>[]> m_dirty;
+
+    mutable std::atomic<size_t> m_lookups;
+    std::atomic<size_t> m_updates;
+    std::atomic<size_t> m_mask_updates;
+    std::atomic<size_t> m_page_flushes;
+
+    void mark_dirty(int page) { m_dirty[page].store(true, std::memory_order_release); }
+    int count_page(int block_id) const { return block_id / m_geometry.block_size; }
+    int birth_page(int block_id) const { return m_count_pages + block_id / m_births_per_page; }
+    int page_block(int page) const {
+        return page < m_count_pages ? m_geometry.ref_count_start + page
+                                    : m_geometry.birth_table_start + (page - m_count_pages);
+    }
+
+    // 对掩码覆盖到的每个计数页调用 fn(页内计数副本, 掩码, 字数)；fn 返回 true 时写回该页
+    template <typename Fn>
+    void for_each_count_page(const uint64_t* mask, Fn fn);
+};
+
+#endif // __cplusplus
+
+#endif // FS_REF_TABLE_H
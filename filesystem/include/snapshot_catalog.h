@@ -0,0 +1,125 @@
+// snapshot_catalog.h - 可扩展的快照目录（名称索引 + 空闲槽位）
+#ifndef FS_SNAPSHOT_CATALOG_H
+#define FS_SNAPSHOT_CATALOG_H
+
+#include "disk.h"
+
+// snapshot_catalog_count / list 的 state 参数：所有非 FREE 的表项（ACTIVE 和 DELETING）
+const int SNAPSHOT_STATE_ANY = -1;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：从磁盘装入快照目录，建立名称索引和空闲槽位表（disk_open 调用）
+ * @return 0 成功
+ */
+int snapshot_catalog_load(int fd);
+
+/**
+ * C 接口：丢弃内存状态（表项总是直写，不需要写回）
+ */
+void snapshot_catalog_discard(int fd);
+
+/**
+ * C 接口：清空快照目录（目录块置零，表项块不释放，由调用者整体改写块位图）
+ * 快照流接收到没有快照的副本上时使用
+ */
+void snapshot_catalog_reset(int fd);
+
+/**
+ * C 接口：读取 / 写入一个表项（任意状态）
+ * 写入直写到块缓存，同时更新名称索引和空闲槽位表
+ * @return 0 成功，-1 槽位不存在
+ */
+int snapshot_catalog_get(int fd, int snapshot_id, Snapshot* snapshot);
+int snapshot_catalog_put(int fd, const Snapshot* snapshot);
+
+/**
+ * C 接口：编号最小的空闲槽位；没有时分配一个数据块扩展目录
+ * 槽位在写入非 FREE 状态之前仍然是空闲的
+ * @return 槽位编号，-1 表示目录已满或空间耗尽
+ */
+int snapshot_catalog_alloc_slot(int fd);
+
+/**
+ * C 接口：按名称查找激活的快照（同名时返回编号最小的）
+ * @return 快照编号，-1 表示不存在
+ */
+int snapshot_catalog_find(int fd, const char* name);
+
+/**
+ * C 接口：统计 / 按编号顺序列出处于 state 的表项（SNAPSHOT_STATE_ANY = 非 FREE）
+ * list 返回写入的表项数
+ */
+int snapshot_catalog_count(int fd, int state);
+int snapshot_catalog_list(int fd, int state, Snapshot* snapshots, int max_count);
+
+/**
+ * C 接口：目录占用的数据块（words 为 disk_mask_words 个 64 位字，置位不清零）
+ * 快照恢复重建块位图时这些块必须保留
+ * @return 块数
+ */
+int snapshot_catalog_mark_blocks(int fd, uint64_t* words);
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * SnapshotCatalog - 一个磁盘的快照目录的内存副本
+ *
+ * - 原来的快照表区（snapshot_table_blocks 个块）改存目录块号（int 数组，0 = 未使用），
+ *   表项放在按需分配的数据块里，每块 block_size / sizeof(Snapshot) 个：槽位 id 在第 id / 每块表项数 块
+ * - 装入时读一遍所有目录块，之后读取、按名称查找、取空闲槽位都不做 I/O
+ * - 写入直写：整块从内存副本序列化后写入块缓存，目录块不会比磁盘更新
+ * - 目录只增长不收缩：删除快照后槽位进入空闲表，下一次创建复用
+ */
+class SnapshotCatalog {
+public:
+    void load(int fd);
+    void reset(int fd);
+
+    bool get(int snapshot_id, Snapshot* snapshot) const;
+    bool put(int fd, const Snapshot& snapshot);
+    int alloc_slot(int fd);
+    int find(const char* name) const;
+    int count(int state) const;
+    std::vector<Snapshot> list(int state) const;
+    int mark_blocks(uint64_t* words) const;
+
+private:
+    mutable std::shared_mutex m_mutex;
+    DiskGeometry m_geometry{};                                 // 装入时的布局
+    int m_ids_per_block = 0;                                   // 每个目录块记录的块号数
+    int m_snapshots_per_block = 0;                             // 每个表项块的表项数
+    std::vector<int> m_blocks;                                 // 目录块号，按顺序
+    std::vector<Snapshot> m_entries;                           // 全部槽位
+    std::unordered_map<std::string, std::set<int>> m_by_name;  // 激活快照：名称 -> 编号
+    std::set<int> m_free;                                      // 空闲槽位（FREE）
+    int m_counts[3] = {0, 0, 0};                               // 各状态的表项数
+
+    static bool matches(const Snapshot& snapshot, int state);
+    void index(int snapshot_id, const Snapshot& snapshot);
+    void unindex(int snapshot_id, const Snapshot& snapshot);
+    void write_directory_block(int fd, int index) const;
+};
+
+/**
+ * C++ 接口：按编号顺序取出处于 state 的表项（disk.cpp 内部遍历快照时使用）
+ */
+std::vector<Snapshot> snapshot_catalog_entries(int fd, int state);
+
+#endif // __cplusplus
+
+#endif // FS_SNAPSHOT_CATALOG_H
@@ -0,0 +1,109 @@
+// snapshot_stream.h - 快照差异与流式发送 / 接收（异地备份）
+#ifndef FS_SNAPSHOT_STREAM_H
+#define FS_SNAPSHOT_STREAM_H
+
+#include "disk.h"
+
+// to_id 取这个值时以活跃文件系统为发送目标（调用者保证发送期间没有写入）
+const int SNAPSHOT_STREAM_LIVE = -1;
+
+/**
+ * 一次差异计算 / 发送 / 接收的统计
+ */
+struct SnapshotStreamStats {
+    int incremental;              // 1 = 增量流（相对 from 快照），0 = 完整流
+    uint32_t base_epoch;          // 增量流的基准快照 epoch（完整流为 0）
+    uint32_t target_epoch;        // 目标快照 epoch（活跃文件系统为 0）
+    int inodes_sent;              // 新建或修改的 inode
+    int inodes_removed;           // 删除的 inode
+    int blocks_referenced;        // 目标引用的数据块
+    int blocks_sent;              // 需要传输的数据块
+    long long stream_bytes;       // 流的总字节数
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * C 接口：计算两个整盘快照（或快照与活跃文件系统）之间的差异，只统计不输出
+ * @param from_id 基准快照（-1 = 完整流，相当于与空文件系统比较）
+ * @param to_id   目标快照，SNAPSHOT_STREAM_LIVE = 活跃文件系统
+ * @return 0 成功，-1 快照不存在或不是整盘快照
+ */
+int snapshot_diff(int fd, int from_id, int to_id, SnapshotStreamStats* stats);
+
+/**
+ * C 接口：把差异写成快照流（out_fd 为已打开的文件 / 管道）
+ * 流中只有目标里新建 / 修改 / 删除的 inode、目标的块位图和变化的数据块，
+ * 大小与两次快照之间的变化量成正比，与磁盘大小无关
+ * @return 0 成功，-1 快照无效或写出失败
+ */
+int snapshot_send(int fd, int from_id, int to_id, int out_fd, SnapshotStreamStats* stats);
+
+/**
+ * C 接口：把快照流应用到另一个磁盘镜像（副本）
+ * - 完整流：清空副本的 inode 表后整体写入
+ * - 增量流：副本最近接收的快照（superblock.received_epoch）必须是流的基准快照，
+ *   且两次接收之间副本没有被修改（块位图、inode 位图和 inode 表与流头部的基准摘要一致）
+ * 副本上不能有快照（接收会改写任意数据块）。先顺序读完整个流校验，再读一遍逐条应用；
+ * in_fd 不是普通文件（管道）时第一遍转存到临时文件。内存占用与流的大小无关
+ * @return 0 成功，-1 流损坏 / 基准不匹配 / 副本被修改过 / 副本上有快照
+ */
+int snapshot_receive(int fd, int in_fd, SnapshotStreamStats* stats);
+
+/**
+ * C 接口：打印统计信息
+ */
+void snapshot_stream_print_stats(const SnapshotStreamStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+// C++ 类定义（仅在 C++ 编译时可用）
+#ifdef __cplusplus
+
+#include "inode.h"
+#include <vector>
+
+/**
+ * SnapshotImage - 一个整盘快照（或活跃文件系统）的 inode 表视图
+ *
+ * - inodes / inode_bitmap：快照保存的 inode 表和 inode 位图
+ * - blocks：这些 inode 引用的数据块（数据 extent 和 extent 树节点），即接收端的块位图
+ * - epoch：快照 epoch；活跃文件系统为 0
+ */
+struct SnapshotImage {
+    uint32_t epoch = 0;
+    int timestamp = 0;
+    char name[32] = {0};
+    std::vector<unsigned char> inode_bitmap;
+    std::vector<Inode> inodes;
+    std::vector<uint64_t> blocks;
+
+    // 从快照表装入（调用者持有快照表共享锁）；快照不存在或不是整盘快照时返回 false
+    bool load(int fd, int snapshot_id);
+    // 空文件系统（完整流的基准），大小按 fd 的布局
+    void load_empty(int fd);
+    bool has_inode(int inode_id) const;
+};
+
+/**
+ * SnapshotDiff - from -> to 的差异
+ *
+ * 数据块按出生 epoch 判断：from 快照存在期间，出生 epoch 不大于它的块写入前都会 COW，
+ * 因此目标中出生 epoch 不大于 from.epoch、且 from 也引用的块内容与 from 时相同，不需要传输；
+ * 其余目标块（之后出生的、或 from 没有引用的，例如恢复了更早的快照之后）都要传输
+ */
+struct SnapshotDiff {
+    std::vector<int> changed_inodes;   // 目标中新建或内容不同的 inode
+    std::vector<int> removed_inodes;   // from 中有、目标中没有的 inode
+    std::vector<uint64_t> changed_blocks;
+
+    void compute(int fd, const SnapshotImage& from, const SnapshotImage& to);
+};
+
+#endif // __cplusplus
+
+#endif // FS_SNAPSHOT_STREAM_H
@@ -1,106 +1,90 @@
-// 修改 scripts/mkfs.cpp
+// scripts/mkfs.cpp
 #include "../include/disk.h"
 #include "../include/inode.h"
-#include <unistd.h>
+#include "../include/block_device.h"
 #include <iostream>
+#include <cstdlib>
 #include <cstring>
 using namespace std;
 
-// ...前面的代码...
+void print_usage(const char* prog_name) {
+    cout << "用法: " << prog_name << " [-s <size>] [-b <block_size>] [-i <inodes>] [disk.img]" << endl;
+    cout << "选项:" << endl;
+    cout << "  -s <size>         磁盘大小，可带 K / M / G 后缀（默认 8M）" << endl;
+    cout << "  -b <block_size>   块大小：1024 / 2048 / 4096（默认 1024）" << endl;
+    cout << "  -i <inodes>       inode 数（默认每 16KB 一个，至少 64）" << endl;
+    cout << endl;
+    cout << "示例:" << endl;
+    cout << "  " << prog_name << endl;
+    cout << "  " << prog_name << " -s 256M -b 4096 ../disk/big.img" << endl;
+}
 
-// 修改 scripts/mkfs.cpp 中的main函数:
-
-int main() {
-    // 第1步：创建/打开文件（不扩展）
-    int fd = disk_open("../disk/disk.img");
-
-    char buf[BLOCK_SIZE];
-
-    // ---- Superblock ----
-    Superblock sb{};
-    sb.block_size = BLOCK_SIZE;
-    sb.block_count = BLOCK_COUNT;
-    sb.inode_count = BLOCK_SIZE * 8;
-    sb.free_inode_count = BLOCK_SIZE * 8 - 1;
-    sb.free_block_count = BLOCK_COUNT - DATA_BLOCK_START - 1;
-    sb.magic = FS_SUPERBLOCK_MAGIC;
-    sb.version = FS_VERSION;
-    sb.dirent_size = (uint32_t)sizeof(DirEntry);
-    sb.reserved = 0;
-
-    // ---- 初始化阶段：直接写块，不用alloc ----
-    
-    memset(buf, 0, BLOCK_SIZE);
-    memcpy(buf, &sb, sizeof(sb));
-    write_block(fd, SUPERBLOCK_BLOCK, buf);
+// "64M" -> 字节数；格式不对返回 -1
+static long long parse_size(const char* arg) {
+    char* end = nullptr;
+    long long value = strtoll(arg, &end, 10);
+    if (end == arg || value <= 0) {
+        return -1;
+    }
+    switch (*end) {
+        case '\0': return value;
+        case 'k': case 'K': value <<= 10; break;
+        case 'm': case 'M': value <<= 20; break;
+        case 'g': case 'G': value <<= 30; break;
+        default: return -1;
+    }
+    return end[1] == '\0' ? value : -1;
+}
 
-    // ---- inode bitmap ----
-    memset(buf, 0, BLOCK_SIZE);
-    write_block(fd, INODE_BITMAP_BLOCK, buf);
+int main(int argc, char* argv[]) {
+    const char* disk_path = "../disk/disk.img";
+    long long disk_size = DEFAULT_DISK_SIZE;
+    int block_size = DEFAULT_BLOCK_SIZE;
+    int inode_count = 0;
 
-    // ---- block bitmap ----
-    memset(buf, 0, BLOCK_SIZE);
-    for (int i = 0; i < DATA_BLOCK_START + 1; i++) {  // +1 for root dir block
-        buf[i / 8] |= (1 << (i % 8));
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+            disk_size = parse_size(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-b") == 0) {
+            block_size = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "-i") == 0) {
+            inode_count = atoi(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            disk_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
     }
-    write_block(fd, BLOCK_BITMAP_BLOCK, buf);
 
-    // ---- ref_count table ----
-    memset(buf, 0, BLOCK_SIZE);
-    for (int i = 0; i < REF_COUNT_TABLE_BLOCKS; i++) {
-        write_block(fd, REF_COUNT_TABLE_START + i, buf);
+    DiskGeometry g;
+    if (disk_size <= 0 || disk_plan_geometry(disk_size, block_size, inode_count, &g) != 0) {
+        cout << "✗ 无法按这些参数布局磁盘（块大小须为 1024 / 2048 / 4096，磁盘须放得下元数据区）" << endl;
+        return 1;
     }
-    
-    // 设置元数据块ref_count=1
-    for (int i = 0; i <= DATA_BLOCK_START; i++) {
-        int block_offset = i / BLOCK_SIZE;
-        int block_index = i % BLOCK_SIZE;
-        
-        read_block(fd, REF_COUNT_TABLE_START + block_offset, buf);
-        buf[block_index] = 1;
-        write_block(fd, REF_COUNT_TABLE_START + block_offset, buf);
+    // mkfs 的结果要落在镜像文件里：默认后端是内存盘（FS_BLOCK_DEVICE=memory）时改用 pread
+    if (block_device_default_type() == BLOCK_DEVICE_MEMORY) {
+        block_device_set_default_type(BLOCK_DEVICE_PREAD);
     }
-
-    // ---- inode table ----
-    memset(buf, 0, BLOCK_SIZE);
-    for (int i = 0; i < INODE_TABLE_BLOCK_COUNT; i++) {
-        write_block(fd, INODE_TABLE_START + i, buf);
-    }
-    
-    // ---- snapshot table ----
-    memset(buf, 0, BLOCK_SIZE);
-    for (int i = 0; i < SNAPSHOT_TABLE_BLOCKS; i++) {
-        write_block(fd, SNAPSHOT_TABLE_START + i, buf);
+    if (disk_format(disk_path, &g) != 0) {
+        cout << "✗ 无法写入磁盘文件: " << disk_path << endl;
+        return 1;
     }
 
-    // ---- 创建根目录inode（标记bitmap）----
-    memset(buf, 0, BLOCK_SIZE);
-    buf[0 / 8] |= (1 << (0 % 8));  // inode 0已占用
-    write_block(fd, INODE_BITMAP_BLOCK, buf);
-    
-    Inode root_inode;
-    init_inode(&root_inode, INODE_TYPE_DIR);
-    root_inode.direct_blocks[0] = DATA_BLOCK_START;
-    write_inode(fd, 0, &root_inode);
-
-    // ---- 更新SB的free_inode_count ----
-    sb.free_inode_count = BLOCK_SIZE * 8 - 1;
-    memset(buf, 0, BLOCK_SIZE);
-    memcpy(buf, &sb, sizeof(sb));
-    write_block(fd, SUPERBLOCK_BLOCK, buf);
-
-    // 现在扩展文件到完整大小
-    lseek(fd, DISK_SIZE - 1, SEEK_SET);
-    write(fd, "\0", 1);
-
-    cout << "✓ disk.img 格式化完成！" << endl;
-    cout << "  总块数: " << sb.block_count << endl;
-    cout << "  元数据块: " << DATA_BLOCK_START << endl;
-    cout << "  数据块: " << sb.free_block_count << endl;
-    cout << "  总inode数: " << sb.inode_count << endl;
-    cout << "  空闲inode数: " << sb.free_inode_count << endl;
+    cout << "✓ " << disk_path << " 格式化完成！" << endl;
+    cout << "  块大小: " << g.block_size << endl;
+    cout << "  总块数: " << g.block_count << endl;
+    cout << "  总inode数: " << g.inode_count << endl;
+    cout << "  布局（起始块 / 块数）:" << endl;
+    cout << "    inode 位图:    " << g.inode_bitmap_start << " / " << g.inode_bitmap_blocks << endl;
+    cout << "    块位图:        " << g.block_bitmap_start << " / " << g.block_bitmap_blocks << endl;
+    cout << "    inode 表:      " << g.inode_table_start << " / " << g.inode_table_blocks << endl;
+    cout << "    快照目录:      " << g.snapshot_table_start << " / " << g.snapshot_table_blocks << endl;
+    cout << "    引用计数表:    " << g.ref_count_start << " / " << g.ref_count_blocks << endl;
+    cout << "    出生 epoch 表: " << g.birth_table_start << " / " << g.birth_table_blocks << endl;
+    cout << "    元数据日志:    " << g.journal_start << " / " << g.journal_blocks << endl;
+    cout << "  元数据块: " << g.data_block_start << endl;
+    cout << "  数据块: " << g.block_count - g.data_block_start - 1 << endl;
     cout << "✓ 根目录创建成功！" << endl;
-
-    disk_close(fd);
     return 0;
-}
\ No newline at end of file
+}
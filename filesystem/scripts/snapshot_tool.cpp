@@ -1,31 +1,53 @@
 // scripts/snapshot_tool.cpp
 #include "../include/disk.h"
 #include "../include/inode.h"
+#include "../include/snapshot_stream.h"
+#include <fcntl.h>
+#include <unistd.h>
 #include <iostream>
 #include <cstring>
+#include <vector>
+#include <algorithm>
 using namespace std;
 
 void print_usage(const char* prog_name) {
-    cout << "用法: " << prog_name << " <command> [options]" << endl;
+    cout << "用法: " << prog_name << " [-d <disk.img>] <command> [options]" << endl;
     cout << "命令:" << endl;
     cout << "  create <name>     创建快照" << endl;
     cout << "  delete <id>       删除快照" << endl;
     cout << "  list             列出所有快照" << endl;
     cout << "  restore <id>      恢复快照" << endl;
+    cout << "  diff <id|live> [base_id]         统计与基准快照的差异（不指定基准 = 完整）" << endl;
+    cout << "  send <id|live> <file> [base_id]  把快照（增量）写成快照流文件" << endl;
+    cout << "  receive <file>                   把快照流应用到磁盘（副本）" << endl;
     cout << endl;
     cout << "示例:" << endl;
     cout << "  " << prog_name << " create my_backup" << endl;
     cout << "  " << prog_name << " list" << endl;
     cout << "  " << prog_name << " delete 0" << endl;
+    cout << "  " << prog_name << " send 1 ../disk/s1.stream 0" << endl;
+    cout << "  " << prog_name << " -d ../disk/replica.img receive ../disk/s1.stream" << endl;
+}
+
+// "live" = 活跃文件系统
+static int parse_snapshot_arg(const char* arg) {
+    return strcmp(arg, "live") == 0 ? SNAPSHOT_STREAM_LIVE : atoi(arg);
 }
 
 int main(int argc, char* argv[]) {
+    const char* disk_path = "../disk/disk.img";
+    const char* prog_name = argv[0];
+    if (argc >= 3 && strcmp(argv[1], "-d") == 0) {
+        disk_path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
     if (argc < 2) {
-        print_usage(argv[0]);
+        print_usage(prog_name);
         return 1;
     }
     
-    const char* disk_path = "../disk/disk.img";
     int fd = disk_open(disk_path);
     if (fd < 0) {
         cout << "无法打开磁盘文件: " << disk_path << endl;
@@ -65,8 +87,8 @@ int main(int argc, char* argv[]) {
     }
     // 替换 scripts/snapshot_tool.cpp 中 list 命令的处理部分
 else if (strcmp(command, "list") == 0) {
-    Snapshot snapshots[MAX_SNAPSHOTS];
-    int count = list_snapshots(fd, snapshots, MAX_SNAPSHOTS);
+    std::vector<Snapshot> snapshots(std::max(count_snapshots(fd), 1));
+    int count = list_snapshots(fd, snapshots.data(), (int)snapshots.size());
     
     if (count < 0) {
         cout << "获取快照列表失败" << endl;
@@ -102,9 +124,71 @@ else if (strcmp(command, "list") == 0) {
             cout << "快照恢复失败" << endl;
         }
     }
+    else if (strcmp(command, "diff") == 0) {
+        if (argc < 3) {
+            cout << "错误: diff命令需要指定目标快照ID（或 live）" << endl;
+            disk_close(fd);
+            return 1;
+        }
+
+        int base_id = argc >= 4 ? atoi(argv[3]) : -1;
+        SnapshotStreamStats stats;
+        if (snapshot_diff(fd, base_id, parse_snapshot_arg(argv[2]), &stats) == 0) {
+            snapshot_stream_print_stats(&stats);
+        } else {
+            cout << "差异计算失败（快照不存在或不是整盘快照）" << endl;
+        }
+    }
+    else if (strcmp(command, "send") == 0) {
+        if (argc < 4) {
+            cout << "错误: send命令需要指定目标快照ID（或 live）和输出文件" << endl;
+            disk_close(fd);
+            return 1;
+        }
+
+        int out_fd = open(argv[3], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0) {
+            cout << "无法创建输出文件: " << argv[3] << endl;
+            disk_close(fd);
+            return 1;
+        }
+        int base_id = argc >= 5 ? atoi(argv[4]) : -1;
+        SnapshotStreamStats stats;
+        int result = snapshot_send(fd, base_id, parse_snapshot_arg(argv[2]), out_fd, &stats);
+        close(out_fd);
+        if (result == 0) {
+            cout << "快照流已写入: " << argv[3] << endl;
+            snapshot_stream_print_stats(&stats);
+        } else {
+            cout << "快照流发送失败" << endl;
+        }
+    }
+    else if (strcmp(command, "receive") == 0) {
+        if (argc < 3) {
+            cout << "错误: receive命令需要指定快照流文件" << endl;
+            disk_close(fd);
+            return 1;
+        }
+
+        int in_fd = open(argv[2], O_RDONLY);
+        if (in_fd < 0) {
+            cout << "无法打开快照流文件: " << argv[2] << endl;
+            disk_close(fd);
+            return 1;
+        }
+        SnapshotStreamStats stats;
+        int result = snapshot_receive(fd, in_fd, &stats);
+        close(in_fd);
+        if (result == 0) {
+            cout << "快照流接收成功" << endl;
+            snapshot_stream_print_stats(&stats);
+        } else {
+            cout << "快照流接收失败" << endl;
+        }
+    }
     else {
         cout << "未知命令: " << command << endl;
-        print_usage(argv[0]);
+        print_usage(prog_name);
         disk_close(fd);
         return 1;
     }
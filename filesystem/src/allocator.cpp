@@ -0,0 +1,994 @@
+// allocator.cpp - 内存位图分配器实现
+#include "../include/allocator.h"
+#include "../include/disk.h"
+#include "../include/block_cache.h"
+#include "../include/journal.h"
+#include "../include/ref_table.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+// 自上次写回以来累计多少次位图修改后强制写回一次（惰性持久化的上限）
+static const int ALLOCATOR_SYNC_INTERVAL = 64;
+
+// 预留窗口的大小范围（块）：第一个窗口 MIN 块，顺序写满一个再开下一个时加倍
+static const int ALLOCATOR_WINDOW_MIN = 16;
+static const int ALLOCATOR_WINDOW_MAX = 1024;
+
+// 最多记住多少个 inode 的第一块目标位置（超出时整体清空：目标只是提示）
+static const size_t ALLOCATOR_MAX_GOALS = 4096;
+
+// ==================== BitmapIndex 实现 ====================
+
+void BitmapIndex::load(const unsigned char* bytes, int nbits, int chunk_bits, Policy policy) {
+    m_nbits = nbits;
+    m_chunk_bits = chunk_bits;
+    m_policy = policy;
+    m_cursor = 0;
+
+    int nwords = (nbits + 63) / 64;
+    m_words.assign(nwords, ~0ULL);  // 超出 nbits 的位视为已占用
+    m_summary.assign((nwords + 63) / 64, 0);
+    m_held.assign(nwords, 0);
+    m_dirty.assign((nbits + chunk_bits - 1) / chunk_bits, false);
+
+    m_free = 0;
+    m_held_count = 0;
+    for (int w = 0; w < nwords; w++) {
+        uint64_t word = 0;
+        int first_bit = w * 64;
+        int valid = (nbits - first_bit < 64) ? (nbits - first_bit) : 64;
+        memcpy(&word, bytes + w * 8, (valid + 7) / 8);
+        if (valid < 64) {
+            word |= ~0ULL << valid;
+        }
+        m_words[w] = word;
+        m_free += 64 - __builtin_popcountll(word);
+        update_summary(w);
+    }
+}
+
+void BitmapIndex::update_summary(int word) {
+    uint64_t bit = 1ULL << (word % 64);
+    if (~m_words[word]) {
+        m_summary[word / 64] |= bit;
+    } else {
+        m_summary[word / 64] &= ~bit;
+    }
+}
+
+void BitmapIndex::mark_dirty(int bit) {
+    m_dirty[bit / m_chunk_bits] = true;
+}
+
+int BitmapIndex::alloc(uint64_t* words_scanned) {
+    if (m_free == 0) {
+        return -1;
+    }
+
+    int nsummary = (int)m_summary.size();
+    int start = m_cursor / 64;
+
+    // 从游标所在的 summary 字开始找第一个"非满"的位图字，必要时绕回
+    for (int i = 0; i <= nsummary; i++) {
+        int s = (start + i) % nsummary;
+        uint64_t candidates = m_summary[s];
+        if (i == 0) {
+            candidates &= ~0ULL << (m_cursor % 64);
+        }
+        if (words_scanned) (*words_scanned)++;
+        if (!candidates) {
+            continue;
+        }
+
+        int w = s * 64 + __builtin_ctzll(candidates);
+        int b = __builtin_ctzll(~m_words[w]);
+        m_words[w] |= 1ULL << b;
+        update_summary(w);
+        m_free--;
+        m_cursor = w;
+
+        int bit = w * 64 + b;
+        mark_dirty(bit);
+        return bit;
+    }
+
+    return -1;
+}
+
+int BitmapIndex::find_free(int from, int limit, uint64_t* words_scanned) const {
+    if (limit > m_nbits) {
+        limit = m_nbits;
+    }
+    if (from < 0) {
+        from = 0;
+    }
+    const int nsummary = (int)m_summary.size();
+    while (from < limit) {
+        int w = from / 64;
+        if (words_scanned) (*words_scanned)++;
+        uint64_t free_bits = ~m_words[w] & (~0ULL << (from % 64));
+        if (free_bits) {
+            int bit = w * 64 + __builtin_ctzll(free_bits);
+            return bit < limit ? bit : -1;
+        }
+
+        // 当前字已满：按 summary 跳到下一个有空闲位的字
+        int next = w + 1;
+        int s = next / 64;
+        uint64_t candidates = s < nsummary ? m_summary[s] & (~0ULL << (next % 64)) : 0;
+        while (!candidates && ++s < nsummary) {
+            if (words_scanned) (*words_scanned)++;
+            candidates = m_summary[s];
+        }
+        if (!candidates) {
+            return -1;
+        }
+        from = (s * 64 + __builtin_ctzll(candidates)) * 64;
+    }
+    return -1;
+}
+
+bool BitmapIndex::release(int bit) {
+    if (bit < 0 || bit >= m_nbits || !test(bit)) {
+        return false;
+    }
+
+    int w = bit / 64;
+    m_words[w] &= ~(1ULL << (bit % 64));
+    update_summary(w);
+    m_free++;
+    mark_dirty(bit);
+
+    // 首次适配：游标回拨，保证下一次返回最小的空闲编号
+    if (m_policy == FIRST_FIT && w < m_cursor) {
+        m_cursor = w;
+    }
+    return true;
+}
+
+bool BitmapIndex::claim(int bit) {
+    // 暂缓复用的位也不能占用
+    if (bit < 0 || bit >= m_nbits || ((m_words[bit / 64] >> (bit % 64)) & 1ULL)) {
+        return false;
+    }
+
+    int w = bit / 64;
+    m_words[w] |= 1ULL << (bit % 64);
+    update_summary(w);
+    m_free--;
+    mark_dirty(bit);
+    return true;
+}
+
+int BitmapIndex::release_mask(const uint64_t* mask, int nwords, uint64_t* released_bits) {
+    int limit = nwords < (int)m_words.size() ? nwords : (int)m_words.size();
+    int released = 0;
+    if (released_bits) {
+        memset(released_bits, 0, (size_t)nwords * sizeof(uint64_t));
+    }
+    for (int w = 0; w < limit; w++) {
+        uint64_t bits = mask[w] & m_words[w] & ~m_held[w];
+        if (w == (int)m_words.size() - 1 && m_nbits % 64 != 0) {
+            bits &= ~(~0ULL << (m_nbits % 64));  // 超出 nbits 的位始终保持占用
+        }
+        if (released_bits) {
+            released_bits[w] = bits;
+        }
+        if (bits == 0) {
+            continue;
+        }
+        m_words[w] &= ~bits;
+        update_summary(w);
+        m_free += __builtin_popcountll(bits);
+        released += __builtin_popcountll(bits);
+        mark_dirty(w * 64);
+
+        if (m_policy == FIRST_FIT && w < m_cursor) {
+            m_cursor = w;
+        }
+    }
+    return released;
+}
+
+bool BitmapIndex::hold(int bit) {
+    if (!test(bit)) {
+        return false;
+    }
+
+    // m_words 中的位保持为 1：查找和分配照常跳过它，导出时按空闲写出
+    m_held[bit / 64] |= 1ULL << (bit % 64);
+    m_held_count++;
+    mark_dirty(bit);
+    return true;
+}
+
+int BitmapIndex::hold_mask(const uint64_t* mask, int nwords, uint64_t* held_bits) {
+    int limit = nwords < (int)m_words.size() ? nwords : (int)m_words.size();
+    int held = 0;
+    if (held_bits) {
+        memset(held_bits, 0, (size_t)nwords * sizeof(uint64_t));
+    }
+    for (int w = 0; w < limit; w++) {
+        uint64_t bits = mask[w] & m_words[w] & ~m_held[w];
+        if (w == (int)m_words.size() - 1 && m_nbits % 64 != 0) {
+            bits &= ~(~0ULL << (m_nbits % 64));
+        }
+        if (held_bits) {
+            held_bits[w] = bits;
+        }
+        if (bits == 0) {
+            continue;
+        }
+        m_held[w] |= bits;
+        m_held_count += __builtin_popcountll(bits);
+        held += __builtin_popcountll(bits);
+        mark_dirty(w * 64);
+    }
+    return held;
+}
+
+void BitmapIndex::unhold(int bit) {
+    if (bit < 0 || bit >= m_nbits) {
+        return;
+    }
+    int w = bit / 64;
+    uint64_t b = 1ULL << (bit % 64);
+    if (!(m_held[w] & b)) {
+        return;
+    }
+
+    // 位图上早已是空闲，不必再写回
+    m_held[w] &= ~b;
+    m_held_count--;
+    m_words[w] &= ~b;
+    update_summary(w);
+    m_free++;
+
+    if (m_policy == FIRST_FIT && w < m_cursor) {
+        m_cursor = w;
+    }
+}
+
+bool BitmapIndex::test(int bit) const {
+    if (bit < 0 || bit >= m_nbits) {
+        return false;
+    }
+    return ((m_words[bit / 64] & ~m_held[bit / 64]) >> (bit % 64)) & 1ULL;
+}
+
+void BitmapIndex::store(unsigned char* bytes, int nbytes) const {
+    int avail = (int)m_words.size() * 8;
+    int n = nbytes < avail ? nbytes : avail;
+    for (int off = 0; off < n; off += 8) {
+        uint64_t word = m_words[off / 8] & ~m_held[off / 8];
+        memcpy(bytes + off, &word, n - off < 8 ? n - off : 8);
+    }
+}
+
+void BitmapIndex::store_chunk(int chunk, unsigned char* bytes) const {
+    const int chunk_bytes = m_chunk_bits / 8;
+    memset(bytes, 0, chunk_bytes);
+    int first_bit = chunk * m_chunk_bits;
+    int valid = m_nbits - first_bit < m_chunk_bits ? m_nbits - first_bit : m_chunk_bits;
+    if (valid <= 0) {
+        return;
+    }
+    const int first_word = first_bit / 64;
+    const int nbytes = (valid + 7) / 8;
+    for (int off = 0; off < nbytes; off += 8) {
+        uint64_t word = m_words[first_word + off / 8] & ~m_held[first_word + off / 8];
+        memcpy(bytes + off, &word, nbytes - off < 8 ? nbytes - off : 8);
+    }
+    if (valid % 8 != 0) {
+        bytes[valid / 8] &= (unsigned char)((1 << (valid % 8)) - 1);  // 超出 nbits 的位不写到磁盘上
+    }
+}
+
+bool BitmapIndex::take_dirty(int chunk) {
+    bool dirty = m_dirty[chunk];
+    m_dirty[chunk] = false;
+    return dirty;
+}
+
+// ==================== 每个磁盘的分配器状态 ====================
+
+namespace {
+
+// 一个正在写入的 inode 的预留窗口 [start, end)：别的分配跳过这段，inode 自己的新块从 next 开始取
+struct WriteWindow {
+    int opens = 0;            // allocator_reserve_begin 的嵌套次数
+    int start = -1;           // -1 = 还没有窗口
+    int end = -1;
+    int next = -1;
+    int size = ALLOCATOR_WINDOW_MIN;
+};
+
+struct FsAllocator {
+    std::mutex mutex;
+    BitmapIndex inodes;
+    BitmapIndex blocks;
+    int pending_ops = 0;      // 自上次写回以来的修改次数
+    AllocatorStats stats{};
+    std::unordered_map<int, WriteWindow> windows;   // owner -> 预留窗口
+    std::map<int, int> window_starts;               // 窗口起点 -> owner（窗口互不重叠）
+    std::unordered_map<int, int> goals;             // owner -> 第一个数据块的目标位置
+
+    // 暂缓复用（挂了日志时，见 allocator.h）：按释放它们的事务分组
+    bool defer_frees = false;
+    std::vector<int> freed_open;     // 当前事务释放的块
+    std::vector<int> freed_sealed;   // 正在提交的事务释放的块
+    std::vector<int> freed_logged;   // 日志中有映像，等检查点
+};
+
+std::shared_mutex g_registry_mutex;
+std::unordered_map<int, std::unique_ptr<FsAllocator>> g_allocators;
+
+FsAllocator* find_allocator(int fd) {
+    std::shared_lock<std::shared_mutex> lock(g_registry_mutex);
+    auto it = g_allocators.find(fd);
+    return (it != g_allocators.end()) ? it->second.get() : nullptr;
+}
+
+uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 读出从 start 开始的 blocks 个位图块，装入 index
+void load_bitmap(int fd, BitmapIndex& index, int start, int blocks, int nbits, BitmapIndex::Policy policy) {
+    int block_size = disk_block_size(fd);
+    std::vector<unsigned char> bytes((size_t)blocks * block_size);
+    for (int i = 0; i < blocks; i++) {
+        read_block_cached(fd, start + i, bytes.data() + (size_t)i * block_size);
+    }
+    index.load(bytes.data(), nbits, block_size * 8, policy);
+}
+
+void load_state(int fd, FsAllocator* a) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    load_bitmap(fd, a->inodes, g.inode_bitmap_start, g.inode_bitmap_blocks, g.inode_count, BitmapIndex::FIRST_FIT);
+    load_bitmap(fd, a->blocks, g.block_bitmap_start, g.block_bitmap_blocks, g.block_count, BitmapIndex::NEXT_FIT);
+    a->pending_ops = 0;
+    a->freed_open.clear();
+    a->freed_sealed.clear();
+    a->freed_logged.clear();
+}
+
+// 释放一个数据块（挂了日志时暂缓复用，记入当前事务）
+// 注意：调用者必须持有 a->mutex
+bool free_block_locked(FsAllocator* a, int block_id) {
+    if (!a->defer_frees) {
+        return a->blocks.release(block_id);
+    }
+    if (!a->blocks.hold(block_id)) {
+        return false;
+    }
+    a->freed_open.push_back(block_id);
+    return true;
+}
+
+// 按位图批量释放数据块，语义同 BitmapIndex::release_mask
+// 注意：调用者必须持有 a->mutex
+int free_mask_locked(FsAllocator* a, const uint64_t* mask, int nwords, uint64_t* freed_bits) {
+    if (!a->defer_frees) {
+        return a->blocks.release_mask(mask, nwords, freed_bits);
+    }
+    std::vector<uint64_t> bits(nwords);
+    int freed = a->blocks.hold_mask(mask, nwords, bits.data());
+    for (int w = 0; w < nwords && freed > 0; w++) {
+        for (uint64_t word = bits[w]; word; word &= word - 1) {
+            a->freed_open.push_back(w * 64 + __builtin_ctzll(word));
+        }
+    }
+    if (freed_bits) {
+        memcpy(freed_bits, bits.data(), (size_t)nwords * sizeof(uint64_t));
+    }
+    return freed;
+}
+
+// 写回脏位图块和 superblock 计数（挂了日志的磁盘上这些写入进入当前事务，由日志提交保证原子性）
+// 注意：调用者必须持有 a->mutex
+void flush_locked(int fd, FsAllocator* a) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    unsigned char buf[MAX_BLOCK_SIZE];
+    bool any = false;
+
+    // 引用计数表先于位图写回：没有日志时（如 disk_open 之前），位图 / superblock 落盘时其中分配的块的计数一定已在块缓存中
+    ref_table_flush(fd);
+
+    for (int c = 0; c < a->inodes.chunk_count(); c++) {
+        if (a->inodes.take_dirty(c)) {
+            a->inodes.store_chunk(c, buf);
+            write_block_cached(fd, g.inode_bitmap_start + c, buf);
+            a->stats.bitmap_flushes++;
+            any = true;
+        }
+    }
+    for (int c = 0; c < a->blocks.chunk_count(); c++) {
+        if (a->blocks.take_dirty(c)) {
+            a->blocks.store_chunk(c, buf);
+            write_block_cached(fd, g.block_bitmap_start + c, buf);
+            a->stats.bitmap_flushes++;
+            any = true;
+        }
+    }
+
+    if (any) {
+        // 不走 read_superblock，避免它回调分配器造成重入
+        read_block_cached(fd, SUPERBLOCK_BLOCK, buf);
+        Superblock sb;
+        memcpy(&sb, buf, sizeof(Superblock));
+        sb.free_inode_count = a->inodes.free_count();
+        sb.free_block_count = a->blocks.free_count();
+        memcpy(buf, &sb, sizeof(Superblock));
+        write_block_cached(fd, SUPERBLOCK_BLOCK, buf);
+        a->stats.superblock_flushes++;
+    }
+
+    a->pending_ops = 0;
+}
+
+// 修改后调用：累计到阈值就写回
+void note_change_locked(int fd, FsAllocator* a) {
+    if (++a->pending_ops >= ALLOCATOR_SYNC_INTERVAL) {
+        flush_locked(fd, a);
+    }
+}
+
+// 覆盖 block 的预留窗口的 owner，-1 表示不在任何窗口里
+int window_owner_at(FsAllocator* a, int block) {
+    auto it = a->window_starts.upper_bound(block);
+    if (it == a->window_starts.begin()) {
+        return -1;
+    }
+    --it;
+    auto w = a->windows.find(it->second);
+    return (w != a->windows.end() && block < w->second.end) ? it->second : -1;
+}
+
+// [from, limit) 中第一个不在别人窗口里的空闲块
+int find_unreserved(FsAllocator* a, int from, int limit, int owner) {
+    while (from < limit) {
+        int b = a->blocks.find_free(from, limit, &a->stats.words_scanned);
+        if (b < 0) {
+            return -1;
+        }
+        int holder = window_owner_at(a, b);
+        if (holder < 0 || holder == owner) {
+            return b;
+        }
+        from = a->windows[holder].end;
+    }
+    return -1;
+}
+
+// 从 goal 向后找，到末尾后绕回；窗口外都满了才占用别人的窗口
+int find_near(FsAllocator* a, int goal, int owner) {
+    const int n = a->blocks.nbits();
+    int b = find_unreserved(a, goal, n, owner);
+    if (b < 0) b = find_unreserved(a, 0, goal, owner);
+    if (b < 0) b = a->blocks.find_free(goal, n, &a->stats.words_scanned);
+    if (b < 0) b = a->blocks.find_free(0, goal, &a->stats.words_scanned);
+    return b;
+}
+
+void drop_window(FsAllocator* a, WriteWindow* w) {
+    if (w->start >= 0) {
+        a->window_starts.erase(w->start);
+    }
+    w->start = w->end = w->next = -1;
+}
+
+// 在 b 处为 owner 开一个窗口，不越过下一个窗口的起点（b 在别人的窗口里时不开）
+void open_window(FsAllocator* a, int owner, WriteWindow* w, int b) {
+    if (window_owner_at(a, b) >= 0) {
+        return;
+    }
+    int end = std::min(b + w->size, a->blocks.nbits());
+    auto next = a->window_starts.upper_bound(b);
+    if (next != a->window_starts.end()) {
+        end = std::min(end, next->first);
+    }
+    w->start = b;
+    w->end = end;
+    a->window_starts[b] = owner;
+    a->stats.windows_opened++;
+}
+
+// 注意：调用者必须持有 a->mutex
+int alloc_block_locked(FsAllocator* a, int goal, int owner) {
+    if (a->blocks.available_count() == 0) {
+        return -1;
+    }
+    if (goal >= a->blocks.nbits()) {
+        goal = -1;
+    }
+
+    WriteWindow* w = nullptr;
+    bool from_hint = false;
+    if (owner >= 0) {
+        auto it = a->windows.find(owner);
+        if (it != a->windows.end()) {
+            w = &it->second;
+        }
+        if (goal < 0 && w && w->start >= 0) {
+            goal = w->next;
+        } else if (goal < 0) {
+            auto hint = a->goals.find(owner);
+            if (hint != a->goals.end() && hint->second < a->blocks.nbits()) {
+                goal = hint->second;
+                from_hint = true;
+            }
+        }
+    }
+    if (goal >= 0) {
+        a->stats.goal_allocs++;
+    }
+
+    int b = -1;
+    if (w) {
+        // 先在自己的窗口里取；窗口用完或目标不在窗口里时在目标处重开，顺着写下去时窗口加倍
+        if (w->start >= 0 && goal >= w->start && goal < w->end) {
+            b = a->blocks.find_free(goal, w->end, &a->stats.words_scanned);
+        }
+        if (b < 0) {
+            bool sequential = w->start >= 0 && goal == w->end;
+            drop_window(a, w);
+            b = find_near(a, goal >= 0 ? goal : a->blocks.cursor(), owner);
+            if (b < 0) {
+                return -1;
+            }
+            if (sequential) {
+                w->size = std::min(w->size * 2, ALLOCATOR_WINDOW_MAX);
+            }
+            open_window(a, owner, w, b);
+        }
+        w->next = b + 1;
+    } else if (goal < 0 && a->window_starts.empty()) {
+        // 没有目标也没有窗口：和以前一样按 next-fit 游标分配
+        return a->blocks.alloc(&a->stats.words_scanned);
+    } else {
+        b = find_near(a, goal >= 0 ? goal : a->blocks.cursor(), owner);
+        if (b < 0) {
+            return -1;
+        }
+        if (goal < 0) {
+            a->blocks.move_cursor(b);
+        }
+    }
+
+    a->blocks.claim(b);
+    if (b == goal) {
+        a->stats.goal_hits++;
+    }
+    if (from_hint) {
+        a->goals.erase(owner);
+    }
+    return b;
+}
+
+}  // namespace
+
+// ==================== C 接口实现 ====================
+
+int allocator_load(int fd) {
+    auto a = std::make_unique<FsAllocator>();
+    a->defer_frees = journal_attached(fd) != 0;
+    load_state(fd, a.get());
+
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_allocators[fd] = std::move(a);
+    return 0;
+}
+
+void allocator_unload(int fd) {
+    std::unique_ptr<FsAllocator> a;
+    {
+        std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+        auto it = g_allocators.find(fd);
+        if (it == g_allocators.end()) {
+            return;
+        }
+        a = std::move(it->second);
+        g_allocators.erase(it);
+    }
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    flush_locked(fd, a.get());
+}
+
+void allocator_discard(int fd) {
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_allocators.erase(fd);
+}
+
+int allocator_reload(int fd) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) {
+        return allocator_load(fd);
+    }
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    std::vector<uint64_t> before = a->blocks.words();
+    load_state(fd, a);
+    if (!a->defer_frees) {
+        return 0;
+    }
+
+    // 新位图里不再占用的块（包括原先暂缓复用的）在当前事务提交之前仍不能分配：
+    // 占用后立即按暂缓复用释放，位图内容不变
+    const std::vector<uint64_t>& after = a->blocks.words();
+    for (size_t w = 0; w < before.size() && w < after.size(); w++) {
+        for (uint64_t word = before[w] & ~after[w]; word; word &= word - 1) {
+            int b = (int)w * 64 + __builtin_ctzll(word);
+            a->blocks.claim(b);
+            free_block_locked(a, b);
+        }
+    }
+    return 0;
+}
+
+void allocator_sync(int fd) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    flush_locked(fd, a);
+}
+
+void allocator_commit_prepare(int fd) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return;
+
+    // 写回和归组在同一次加锁内：归入这个事务的块，释放它们的位图修改一定也在这个事务里
+    std::lock_guard<std::mutex> lock(a->mutex);
+    flush_locked(fd, a);
+    a->freed_sealed.insert(a->freed_sealed.end(), a->freed_open.begin(), a->freed_open.end());
+    a->freed_open.clear();
+}
+
+void allocator_commit_done(int fd, const int* logged, int count) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    for (int b : a->freed_sealed) {
+        if (std::binary_search(logged, logged + count, b)) {
+            a->freed_logged.push_back(b);
+        } else {
+            a->blocks.unhold(b);
+        }
+    }
+    a->freed_sealed.clear();
+}
+
+void allocator_checkpoint_done(int fd) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    for (int b : a->freed_logged) {
+        a->blocks.unhold(b);
+    }
+    a->freed_logged.clear();
+}
+
+int allocator_held_blocks(int fd) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return 0;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    return a->blocks.held_count();
+}
+
+int allocator_alloc_spill(int fd, int count, int* block_ids) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    // 占用后立即暂缓复用：位图导出时仍是空闲，崩溃后不需要回收
+    std::lock_guard<std::mutex> lock(a->mutex);
+    if (a->blocks.available_count() < count) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        block_ids[i] = a->blocks.alloc(&a->stats.words_scanned);
+        a->blocks.hold(block_ids[i]);
+    }
+    return 0;
+}
+
+void allocator_release_spill(int fd, const int* block_ids, int count) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    for (int i = 0; i < count; i++) {
+        a->blocks.unhold(block_ids[i]);
+    }
+}
+
+int allocator_alloc_inode(int fd) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    uint64_t start = now_ns();
+    int id = a->inodes.alloc(&a->stats.words_scanned);
+    if (id < 0) {
+        a->stats.alloc_failures++;
+    } else {
+        a->stats.inode_allocs++;
+        note_change_locked(fd, a);
+    }
+    a->stats.alloc_ns += now_ns() - start;
+    return id;
+}
+
+int allocator_free_inode(int fd, int inode_id) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    uint64_t start = now_ns();
+    bool freed = a->inodes.release(inode_id);
+    if (freed) {
+        // 编号之后会分给别的文件：这个 inode 的目标位置和预留窗口一并清除
+        a->goals.erase(inode_id);
+        auto it = a->windows.find(inode_id);
+        if (it != a->windows.end()) {
+            drop_window(a, &it->second);
+            a->windows.erase(it);
+        }
+        a->stats.inode_frees++;
+        note_change_locked(fd, a);
+    }
+    a->stats.alloc_ns += now_ns() - start;
+    return freed ? 0 : -1;
+}
+
+int allocator_claim_inode(int fd, int inode_id) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    bool claimed = a->inodes.claim(inode_id);
+    if (claimed) {
+        a->stats.inode_allocs++;
+        note_change_locked(fd, a);
+    }
+    return claimed ? 0 : -1;
+}
+
+int allocator_alloc_block(int fd) {
+    return allocator_alloc_block_goal(fd, -1, -1);
+}
+
+int allocator_alloc_block_goal(int fd, int goal, int owner) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    uint64_t start = now_ns();
+    int id = alloc_block_locked(a, goal, owner);
+    if (id < 0) {
+        a->stats.alloc_failures++;
+    } else {
+        // 计数在锁内置 1：按"已分配且计数为 0"释放的一方不会看到刚分配出去的块
+        ref_table_set(fd, id, 1);
+        a->stats.block_allocs++;
+        note_change_locked(fd, a);
+    }
+    a->stats.alloc_ns += now_ns() - start;
+    return id;
+}
+
+void allocator_reserve_begin(int fd, int owner) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a || owner < 0) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    a->windows[owner].opens++;
+}
+
+void allocator_reserve_end(int fd, int owner) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    auto it = a->windows.find(owner);
+    if (it == a->windows.end() || --it->second.opens > 0) {
+        return;
+    }
+    // 窗口里没用完的块本来就没有在位图中占用，撤销窗口即可
+    drop_window(a, &it->second);
+    a->windows.erase(it);
+}
+
+void allocator_set_goal(int fd, int owner, int goal) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a || owner < 0 || goal < 0) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    if (a->goals.size() >= ALLOCATOR_MAX_GOALS) {
+        a->goals.clear();
+    }
+    a->goals[owner] = goal;
+}
+
+int allocator_free_block(int fd, int block_id) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    uint64_t start = now_ns();
+    bool freed = free_block_locked(a, block_id);
+    if (freed) {
+        a->stats.block_frees++;
+        note_change_locked(fd, a);
+    }
+    a->stats.alloc_ns += now_ns() - start;
+    return freed ? 0 : -1;
+}
+
+int allocator_free_block_mask(int fd, const uint64_t* mask, int nwords) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return 0;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    uint64_t start = now_ns();
+    int freed = free_mask_locked(a, mask, nwords, nullptr);
+    if (freed > 0) {
+        a->stats.block_frees += freed;
+        note_change_locked(fd, a);
+    }
+    a->stats.alloc_ns += now_ns() - start;
+    return freed;
+}
+
+int allocator_release_block(int fd, int block_id) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    if (!a->blocks.test(block_id)) {
+        return -1;
+    }
+    // 计数 > 1 时只减少计数；== 1 或 0 时清零并释放
+    if (ref_table_drop(fd, block_id) > 0) {
+        return 0;
+    }
+    uint64_t start = now_ns();
+    free_block_locked(a, block_id);
+    a->stats.block_frees++;
+    note_change_locked(fd, a);
+    a->stats.alloc_ns += now_ns() - start;
+    return 1;
+}
+
+int allocator_free_unreferenced_block(int fd, int block_id) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return 0;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    if (!a->blocks.test(block_id) || ref_table_get(fd, block_id) != 0) {
+        return 0;
+    }
+    uint64_t start = now_ns();
+    free_block_locked(a, block_id);
+    a->stats.block_frees++;
+    note_change_locked(fd, a);
+    a->stats.alloc_ns += now_ns() - start;
+    return 1;
+}
+
+int allocator_free_unreferenced_mask(int fd, const uint64_t* mask, int nwords, uint64_t* freed_bits) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) {
+        if (freed_bits) {
+            memset(freed_bits, 0, (size_t)nwords * sizeof(uint64_t));
+        }
+        return 0;
+    }
+
+    std::vector<uint64_t> zero(nwords);
+    std::lock_guard<std::mutex> lock(a->mutex);
+    uint64_t start = now_ns();
+    ref_table_zero_mask(fd, mask, zero.data());
+    int freed = free_mask_locked(a, zero.data(), nwords, freed_bits);
+    if (freed > 0) {
+        a->stats.block_frees += freed;
+        note_change_locked(fd, a);
+    }
+    a->stats.alloc_ns += now_ns() - start;
+    return freed;
+}
+
+int allocator_block_allocated(int fd, int block_id) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a || block_id < 0 || block_id >= a->blocks.nbits()) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    return a->blocks.test(block_id) ? 1 : 0;
+}
+
+int allocator_inode_allocated(int fd, int inode_id) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a || inode_id < 0 || inode_id >= a->inodes.nbits()) return -1;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    return a->inodes.test(inode_id) ? 1 : 0;
+}
+
+int allocator_copy_inode_bitmap(int fd, void* buf) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    const DiskGeometry& g = *disk_geometry(fd);
+    std::lock_guard<std::mutex> lock(a->mutex);
+    memset(buf, 0, (size_t)g.inode_bitmap_blocks * g.block_size);
+    a->inodes.store((unsigned char*)buf, (a->inodes.nbits() + 7) / 8);
+    return 0;
+}
+
+int allocator_copy_block_bitmap(int fd, void* buf) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return -1;
+
+    const DiskGeometry& g = *disk_geometry(fd);
+    std::lock_guard<std::mutex> lock(a->mutex);
+    memset(buf, 0, (size_t)g.block_bitmap_blocks * g.block_size);
+    a->blocks.store((unsigned char*)buf, (a->blocks.nbits() + 7) / 8);
+    return 0;
+}
+
+int allocator_get_free_counts(int fd, int* free_inodes, int* free_blocks) {
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return 0;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    if (free_inodes) *free_inodes = a->inodes.free_count();
+    if (free_blocks) *free_blocks = a->blocks.free_count();
+    return 1;
+}
+
+void allocator_get_stats(int fd, AllocatorStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(AllocatorStats));
+
+    FsAllocator* a = find_allocator(fd);
+    if (!a) return;
+
+    std::lock_guard<std::mutex> lock(a->mutex);
+    *stats = a->stats;
+    stats->free_inodes = a->inodes.free_count();
+    stats->free_blocks = a->blocks.free_count();
+    stats->held_blocks = a->blocks.held_count();
+}
+
+void allocator_print_stats(int fd) {
+    AllocatorStats s;
+    allocator_get_stats(fd, &s);
+
+    uint64_t ops = s.inode_allocs + s.inode_frees + s.block_allocs + s.block_frees;
+    double avg_ns = ops ? (double)s.alloc_ns / ops : 0.0;
+
+    std::cout << "\n📊 Allocator Statistics:" << std::endl;
+    std::cout << "   Inode allocs/frees: " << s.inode_allocs << " / " << s.inode_frees << std::endl;
+    std::cout << "   Block allocs/frees: " << s.block_allocs << " / " << s.block_frees << std::endl;
+    std::cout << "   Alloc failures:     " << s.alloc_failures << std::endl;
+    std::cout << "   Words scanned:      " << s.words_scanned << std::endl;
+    std::cout << "   Goal allocs/hits:   " << s.goal_allocs << " / " << s.goal_hits << std::endl;
+    std::cout << "   Windows opened:     " << s.windows_opened << std::endl;
+    std::cout << "   Bitmap flushes:     " << s.bitmap_flushes << std::endl;
+    std::cout << "   SB flushes:         " << s.superblock_flushes << std::endl;
+    std::cout << "   Avg op latency:     " << avg_ns << " ns" << std::endl;
+    std::cout << "   Free inodes/blocks: " << s.free_inodes << " / " << s.free_blocks << std::endl;
+    std::cout << "   Held blocks:        " << s.held_blocks << std::endl;
+}
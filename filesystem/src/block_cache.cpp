@@ -1,54 +1,158 @@
-// block_cache.cpp - LRU 块缓存实现
+// block_cache.cpp - 分片块缓存实现
 #include "../include/block_cache.h"
+#include "../include/block_device.h"
+#include "../include/journal.h"
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <unistd.h>
 
 // 全局缓存实例
 static BlockCache* g_block_cache = nullptr;
 
+// 自动选择分片数时，每个分片至少容纳的块数
+static const size_t MIN_FRAMES_PER_SHARD = 64;
+static const size_t MAX_SHARDS = 16;
+
 // ==================== BlockCache 类实现 ====================
 
-BlockCache::BlockCache(size_t capacity) 
-    : m_capacity(capacity), m_hits(0), m_misses(0), m_replacements(0) {
-    if (capacity > 0) {
-        std::cout << "✅ Block cache initialized with capacity: " << capacity << " blocks" << std::endl;
+BlockCache::BlockCache(size_t capacity, int policy, size_t shard_count) 
+    : m_capacity(capacity), m_policy(policy), m_hits(0), m_misses(0), m_replacements(0),
+      m_dirty_count(0), m_writebacks(0), m_prefetched(0),
+      m_meta_hits(0), m_meta_misses(0), m_data_hits(0), m_data_misses(0),
+      m_write_back(false), m_max_age(1000), m_dirty_ratio(50),
+      m_stop_flusher(false) {
+    if (capacity == 0) {
+        return;
     }
+    
+    // 分片数取 2 的幂；小容量缓存只用一个分片，替换顺序与不分片时完全一致
+    if (shard_count == 0) {
+        shard_count = 1;
+        while (shard_count * 2 <= MAX_SHARDS && capacity / (shard_count * 2) >= MIN_FRAMES_PER_SHARD) {
+            shard_count *= 2;
+        }
+    }
+    if (shard_count > capacity) {
+        shard_count = capacity;
+    }
+    
+    for (size_t i = 0; i < shard_count; i++) {
+        auto shard = std::make_unique<Shard>();
+        shard->frame_count = capacity / shard_count + (i < capacity % shard_count ? 1 : 0);
+        shard->frames.reset(new Frame[shard->frame_count]);
+        shard->slab.reset(new char[shard->frame_count * MAX_BLOCK_SIZE]);
+        shard->lookup.reserve(shard->frame_count);
+        for (size_t f = shard->frame_count; f > 0; f--) {
+            shard->free_frames.push_back(f - 1);
+        }
+        shard->policy = make_eviction_policy(policy, shard->frame_count);
+        m_shards.push_back(std::move(shard));
+    }
+    
+    std::cout << "✅ Block cache initialized with capacity: " << capacity << " blocks ("
+              << shard_count << " shard" << (shard_count > 1 ? "s" : "") << ", "
+              << eviction_policy_name(policy) << ")" << std::endl;
 }
 
 BlockCache::~BlockCache() {
+    // 停止后台线程并写回剩余脏块，避免丢数据
+    stop_flusher();
+    flush_all(-1);
+    
     // 析构时打印统计信息
     if (m_capacity > 0) {
         print_stats();
     }
 }
 
-void BlockCache::touch(typename std::list<CacheBlock>::iterator it) {
-    // 将块移动到链表头部
-    m_items.splice(m_items.begin(), m_items, it);
+size_t BlockCache::get_size() const {
+    size_t total = 0;
+    for (const auto& shard : m_shards) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        total += shard->used;
+    }
+    return total;
 }
 
-bool BlockCache::evict_lru(int fd) {
-    if (m_items.empty()) {
-        return true;
+void BlockCache::count_access(int fd, int block_id, bool hit) {
+    if (hit) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        (block_id < disk_geometry(fd)->data_block_start ? m_meta_hits : m_data_hits).fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        (block_id < disk_geometry(fd)->data_block_start ? m_meta_misses : m_data_misses).fetch_add(1, std::memory_order_relaxed);
     }
-    
-    // 获取最久未使用的块（链表尾部）
-    auto& lru_block = m_items.back();
-    
-    // 如果是脏块，先写回磁盘
-    if (lru_block.dirty) {
-        read_block(fd, lru_block.block_id, nullptr);  // 确保块存在
-        write_block(fd, lru_block.block_id, lru_block.data);
+}
+
+size_t BlockCache::acquire_frame(Shard& shard) {
+    // 还有空帧：直接用（只在缓存填满之前或有块被移除后发生）
+    if (!shard.free_frames.empty()) {
+        size_t f = shard.free_frames.back();
+        shard.free_frames.pop_back();
+        shard.used++;
+        return f;
     }
     
-    // 从查找表中删除
-    m_lookup.erase(lru_block.block_id);
-    
-    // 从链表中删除
-    m_items.pop_back();
+    // 由替换策略选出牺牲帧
+    size_t f = shard.policy->pick_victim();
+    Frame& frame = shard.frames[f];
     
-    m_replacements++;
-    return true;
+    // 如果是脏块，先写回磁盘（用块自己记录的 fd）
+    if (frame.dirty) {
+        write_back(shard, f);
+    }
+    shard.lookup.erase(frame.key);
+    frame.valid = false;
+    shard.version++;
+    m_replacements.fetch_add(1, std::memory_order_relaxed);
+    return f;
+}
+
+void BlockCache::release_frame(Shard& shard, size_t f) {
+    Frame& frame = shard.frames[f];
+    if (frame.dirty) {
+        frame.dirty = false;
+        m_dirty_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    shard.lookup.erase(frame.key);
+    frame.valid = false;
+    shard.policy->on_remove(f);
+    shard.free_frames.push_back(f);
+    shard.used--;
+    shard.version++;
+}
+
+void BlockCache::install_clean(Shard& shard, uint64_t key, int fd, int block_id, const void* data) {
+    size_t f = acquire_frame(shard);
+    Frame& frame = shard.frames[f];
+    memcpy(shard.data(f), data, disk_block_size(fd));
+    frame.key = key;
+    frame.block_id = block_id;
+    frame.fd = fd;
+    frame.valid = true;
+    frame.dirty = false;
+    shard.lookup[key] = f;
+    shard.policy->on_insert(f, key);
+}
+
+// 把 pending 中的块按物理块号切成连续段，每段一次 preadv
+static void read_pending_runs(int fd, const int* block_ids, void* const* bufs,
+                              const std::vector<int>& pending) {
+    std::vector<void*> run_bufs;
+    size_t i = 0;
+    while (i < pending.size()) {
+        int start = block_ids[pending[i]];
+        run_bufs.clear();
+        run_bufs.push_back(bufs[pending[i]]);
+        size_t j = i + 1;
+        while (j < pending.size() && block_ids[pending[j]] == start + (int)(j - i)) {
+            run_bufs.push_back(bufs[pending[j]]);
+            j++;
+        }
+        read_block_run(fd, start, (int)run_bufs.size(), run_bufs.data());
+        i = j;
+    }
 }
 
 bool BlockCache::read_block_cached(int fd, int block_id, void* buf) {
@@ -58,52 +162,154 @@ bool BlockCache::read_block_cached(int fd, int block_id, void* buf) {
         return true;
     }
     
-    std::lock_guard<std::mutex> lock(m_mutex);
+    Shard& shard = shard_for(fd, block_id);
+    uint64_t key = make_key(fd, block_id);
+    
+    // 快路径：共享锁下查找，命中只通知策略（原子操作），不移动任何节点
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.lookup.find(key);
+        if (it != shard.lookup.end()) {
+            shard.policy->on_access(it->second);
+            memcpy(buf, shard.data(it->second), disk_block_size(fd));
+            count_access(fd, block_id, true);
+            return true;
+        }
+    }
     
-    // 查找缓存
-    auto it = m_lookup.find(block_id);
+    // 慢路径：独占锁，重新检查（其他线程可能刚刚装入）
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.lookup.find(key);
+    if (it != shard.lookup.end()) {
+        shard.policy->on_access(it->second);
+        memcpy(buf, shard.data(it->second), disk_block_size(fd));
+        count_access(fd, block_id, true);
+        return true;
+    }
     
-    if (it != m_lookup.end()) {
-        // 缓存命中
-        m_hits++;
-        
-        // 将块移动到链表头部
-        touch(it->second);
-        
-        // 复制数据
-        memcpy(buf, it->second->data, BLOCK_SIZE);
+    // 缓存未命中：选帧并从磁盘读入
+    count_access(fd, block_id, false);
+    size_t f = acquire_frame(shard);
+    Frame& frame = shard.frames[f];
+    read_block(fd, block_id, shard.data(f));
+    
+    frame.key = key;
+    frame.block_id = block_id;
+    frame.fd = fd;
+    frame.valid = true;
+    frame.dirty = false;
+    shard.lookup[key] = f;
+    shard.policy->on_insert(f, key);
+    
+    // 复制数据到输出缓冲区
+    memcpy(buf, shard.data(f), disk_block_size(fd));
+    return true;
+}
+
+bool BlockCache::read_blocks_cached(int fd, const int* block_ids, int count, void* const* bufs) {
+    if (count <= 0) {
         return true;
     }
     
-    // 缓存未命中
-    m_misses++;
+    std::vector<int> pending;
+    std::vector<uint64_t> versions;
+    if (m_capacity == 0) {
+        // 缓存被禁用：全部直接读盘，但仍然合并连续段
+        for (int i = 0; i < count; i++) {
+            pending.push_back(i);
+        }
+        read_pending_runs(fd, block_ids, bufs, pending);
+        return true;
+    }
     
-    // 检查缓存是否已满
-    if (m_items.size() >= m_capacity) {
-        // 淘汰最久未使用的块
-        if (!evict_lru(fd)) {
-            return false;
+    // 1. 共享锁下复制命中的块，记下未命中的块及其分片版本号
+    for (int i = 0; i < count; i++) {
+        Shard& shard = shard_for(fd, block_ids[i]);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.lookup.find(make_key(fd, block_ids[i]));
+        if (it != shard.lookup.end()) {
+            shard.policy->on_access(it->second);
+            memcpy(bufs[i], shard.data(it->second), disk_block_size(fd));
+            count_access(fd, block_ids[i], true);
+        } else {
+            pending.push_back(i);
+            versions.push_back(shard.version);
         }
     }
+    if (pending.empty()) {
+        return true;
+    }
     
-    // 从磁盘读取块
-    char temp_buf[BLOCK_SIZE];
-    read_block(fd, block_id, temp_buf);
+    // 2. 不持锁，连续段合并读盘
+    read_pending_runs(fd, block_ids, bufs, pending);
     
-    // 添加到缓存（链表头部）
-    m_items.emplace_front();
-    auto& new_block = m_items.front();
-    new_block.block_id = block_id;
-    memcpy(new_block.data, temp_buf, BLOCK_SIZE);
-    new_block.dirty = false;
+    // 3. 逐块装入缓存
+    for (size_t k = 0; k < pending.size(); k++) {
+        int i = pending[k];
+        int block_id = block_ids[i];
+        uint64_t key = make_key(fd, block_id);
+        Shard& shard = shard_for(fd, block_id);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        count_access(fd, block_id, false);
+        
+        auto it = shard.lookup.find(key);
+        if (it != shard.lookup.end()) {
+            // 其他线程刚刚装入或写入了这块：以缓存中的内容为准（可能是尚未落盘的脏块）
+            shard.policy->on_access(it->second);
+            memcpy(bufs[i], shard.data(it->second), disk_block_size(fd));
+            continue;
+        }
+        if (shard.version != versions[k]) {
+            // 读盘期间分片有写入或淘汰，刚读到的内容可能过时，锁内重读
+            read_block(fd, block_id, bufs[i]);
+        }
+        install_clean(shard, key, fd, block_id, bufs[i]);
+    }
+    return true;
+}
+
+size_t BlockCache::prefetch(int fd, const int* block_ids, int count) {
+    if (m_capacity == 0 || count <= 0) {
+        return 0;
+    }
     
-    // 更新查找表
-    m_lookup[block_id] = m_items.begin();
+    std::vector<int> pending;
+    std::vector<uint64_t> versions;
+    for (int i = 0; i < count; i++) {
+        Shard& shard = shard_for(fd, block_ids[i]);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.lookup.find(make_key(fd, block_ids[i])) == shard.lookup.end()) {
+            pending.push_back(i);
+            versions.push_back(shard.version);
+        }
+    }
+    if (pending.empty()) {
+        return 0;
+    }
     
-    // 复制数据到输出缓冲区
-    memcpy(buf, temp_buf, BLOCK_SIZE);
+    // 读入暂存区（预读只是提示：装入前分片有变化就放弃这一块）
+    const int block_size = disk_block_size(fd);
+    std::vector<char> staging((size_t)count * block_size);
+    std::vector<void*> bufs(count);
+    for (int i = 0; i < count; i++) {
+        bufs[i] = staging.data() + (size_t)i * block_size;
+    }
+    read_pending_runs(fd, block_ids, bufs.data(), pending);
     
-    return true;
+    size_t installed = 0;
+    for (size_t k = 0; k < pending.size(); k++) {
+        int i = pending[k];
+        uint64_t key = make_key(fd, block_ids[i]);
+        Shard& shard = shard_for(fd, block_ids[i]);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.version != versions[k] || shard.lookup.find(key) != shard.lookup.end()) {
+            continue;
+        }
+        install_clean(shard, key, fd, block_ids[i], bufs[i]);
+        installed++;
+    }
+    m_prefetched.fetch_add(installed, std::memory_order_relaxed);
+    return installed;
 }
 
 bool BlockCache::write_block_cached(int fd, int block_id, const void* buf) {
@@ -113,112 +319,349 @@ bool BlockCache::write_block_cached(int fd, int block_id, const void* buf) {
         return true;
     }
     
-    // 必须先获取锁再写入，确保缓存和磁盘的一致性
-    std::lock_guard<std::mutex> lock(m_mutex);
+    Shard& shard = shard_for(fd, block_id);
+    uint64_t key = make_key(fd, block_id);
+    bool write_back_mode = m_write_back.load(std::memory_order_relaxed);
     
-    // 写穿策略：同时更新缓存和磁盘
-    write_block(fd, block_id, buf);
-    
-    // 查找缓存
-    auto it = m_lookup.find(block_id);
-    
-    if (it != m_lookup.end()) {
-        // 缓存命中，更新缓存中的数据
-        m_hits++;
+    {
+        // 必须先获取锁再写入，确保缓存和磁盘的一致性
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
         
-        // 将块移动到链表头部
-        touch(it->second);
+        // 写穿策略：同时更新缓存和磁盘；写回策略：只更新缓存
+        if (!write_back_mode) {
+            write_block(fd, block_id, buf);
+        }
         
-        // 更新缓存数据（已写入磁盘，不需要标记为脏）
-        memcpy(it->second->data, buf, BLOCK_SIZE);
-        it->second->dirty = false;
+        size_t f;
+        auto it = shard.lookup.find(key);
+        if (it != shard.lookup.end()) {
+            // 缓存命中，更新缓存中的数据
+            count_access(fd, block_id, true);
+            f = it->second;
+            shard.policy->on_access(f);
+        } else {
+            // 缓存未命中：选帧
+            count_access(fd, block_id, false);
+            f = acquire_frame(shard);
+            Frame& frame = shard.frames[f];
+            frame.key = key;
+            frame.block_id = block_id;
+            frame.fd = fd;
+            frame.valid = true;
+            frame.dirty = false;
+            shard.lookup[key] = f;
+            shard.policy->on_insert(f, key);
+        }
         
-        return true;
+        Frame& frame = shard.frames[f];
+        memcpy(shard.data(f), buf, disk_block_size(fd));
+        shard.version++;
+        if (write_back_mode) {
+            mark_dirty(frame, fd);
+        }
+        // 写穿模式下块已在磁盘上：若它原来是脏的，磁盘内容现在已是最新
+        else if (frame.dirty) {
+            frame.dirty = false;
+            m_dirty_count.fetch_sub(1, std::memory_order_relaxed);
+        }
     }
     
-    // 缓存未命中
-    m_misses++;
-    
-    // 检查缓存是否已满
-    if (m_items.size() >= m_capacity) {
-        // 淘汰最久未使用的块
-        if (!evict_lru(fd)) {
-            return false;
-        }
+    // 脏块过多时提前唤醒后台线程
+    if (write_back_mode && over_dirty_ratio()) {
+        m_flush_cv.notify_one();
     }
+    return true;
+}
+
+void BlockCache::invalidate(int fd, int block_id) {
+    if (m_capacity == 0) return;
     
-    // 添加到缓存（链表头部）
-    m_items.emplace_front();
-    auto& new_block = m_items.front();
-    new_block.block_id = block_id;
-    memcpy(new_block.data, buf, BLOCK_SIZE);
-    new_block.dirty = false;  // 已写入磁盘，不是脏块
+    Shard& shard = shard_for(fd, block_id);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    
+    auto it = shard.lookup.find(make_key(fd, block_id));
+    if (it == shard.lookup.end()) {
+        return;
+    }
     
-    // 更新查找表
-    m_lookup[block_id] = m_items.begin();
+    // 脏块先写回，失效只丢弃缓存副本，不丢数据
+    size_t f = it->second;
+    if (shard.frames[f].dirty) {
+        write_back(shard, f);
+    }
+    release_frame(shard, f);
+}
+
+void BlockCache::discard(int fd) {
+    for (auto& shard : m_shards) {
+        std::unique_lock<std::shared_mutex> lock(shard->mutex);
+        for (size_t f = 0; f < shard->frame_count; f++) {
+            if (shard->frames[f].valid && shard->frames[f].fd == fd) {
+                release_frame(*shard, f);
+            }
+        }
+    }
+}
+
+void BlockCache::clear() {
+    for (auto& shard : m_shards) {
+        std::unique_lock<std::shared_mutex> lock(shard->mutex);
+        
+        // 清空前写回脏块
+        write_back_if(*shard, [](const Frame&) { return true; });
+        for (size_t f = 0; f < shard->frame_count; f++) {
+            if (shard->frames[f].valid) {
+                release_frame(*shard, f);
+            }
+        }
+        
+        // 重建策略（清掉幽灵队列等历史状态），空闲帧恢复为帧号小的先用
+        shard->policy = make_eviction_policy(m_policy, shard->frame_count);
+        shard->free_frames.clear();
+        for (size_t f = shard->frame_count; f > 0; f--) {
+            shard->free_frames.push_back(f - 1);
+        }
+    }
+}
+
+bool BlockCache::flush_all(int fd) {
+    if (m_dirty_count.load(std::memory_order_relaxed) == 0) {
+        return true;
+    }
     
+    for (auto& shard : m_shards) {
+        std::unique_lock<std::shared_mutex> lock(shard->mutex);
+        write_back_if(*shard, [fd](const Frame& frame) {
+            return fd < 0 || frame.fd == fd;
+        });
+    }
     return true;
 }
 
-void BlockCache::invalidate(int block_id) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+void BlockCache::sync(int fd) {
+    flush_all(fd);
+    if (fd >= 0) {
+        block_device_flush(fd);
+    }
+}
+
+void BlockCache::mark_dirty(Frame& frame, int fd) {
+    frame.fd = fd;
+    if (!frame.dirty) {
+        frame.dirty = true;
+        frame.dirty_since = std::chrono::steady_clock::now();
+        m_dirty_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BlockCache::write_back(Shard& shard, size_t f) {
+    Frame& frame = shard.frames[f];
+    write_block(frame.fd, frame.block_id, shard.data(f));
+    frame.dirty = false;
+    m_dirty_count.fetch_sub(1, std::memory_order_relaxed);
+    m_writebacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Pred>
+void BlockCache::write_back_if(Shard& shard, Pred pred) {
+    std::vector<size_t> batch;
+    for (size_t f = 0; f < shard.frame_count; f++) {
+        const Frame& frame = shard.frames[f];
+        if (frame.valid && frame.dirty && pred(frame)) {
+            batch.push_back(f);
+        }
+    }
+    std::sort(batch.begin(), batch.end(), [&shard](size_t a, size_t b) {
+        return shard.frames[a].block_id < shard.frames[b].block_id;
+    });
+    for (size_t f : batch) {
+        write_back(shard, f);
+    }
+}
+
+bool BlockCache::over_dirty_ratio() const {
+    return m_dirty_count.load(std::memory_order_relaxed) * 100 > m_capacity * m_dirty_ratio;
+}
+
+void BlockCache::set_write_back(bool enabled, unsigned int max_age_ms, unsigned int dirty_ratio) {
+    if (m_capacity == 0) {
+        return;  // 缓存被禁用时没有写回可言
+    }
     
-    auto it = m_lookup.find(block_id);
-    if (it == m_lookup.end()) {
+    if (!enabled) {
+        stop_flusher();
+        m_write_back.store(false);
+        flush_all(-1);
         return;
     }
     
-    // 从链表和查找表中删除
-    m_items.erase(it->second);
-    m_lookup.erase(it);
+    {
+        std::lock_guard<std::mutex> lock(m_flush_mutex);
+        m_max_age = std::chrono::milliseconds(max_age_ms > 0 ? max_age_ms : 1);
+        m_dirty_ratio = (dirty_ratio > 0 && dirty_ratio <= 100) ? dirty_ratio : 50;
+        m_write_back.store(true);
+    }
+    
+    if (!m_flusher.joinable()) {
+        m_flusher = std::thread(&BlockCache::flusher_loop, this);
+    } else {
+        m_flush_cv.notify_one();  // 让后台线程按新参数重新计时
+    }
 }
 
-void BlockCache::clear() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+void BlockCache::stop_flusher() {
+    if (!m_flusher.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_flush_mutex);
+        m_stop_flusher = true;
+    }
+    m_flush_cv.notify_all();
+    m_flusher.join();
+    m_stop_flusher = false;
+}
+
+void BlockCache::flusher_loop() {
+    std::unique_lock<std::mutex> lock(m_flush_mutex);
     
-    m_items.clear();
-    m_lookup.clear();
+    while (!m_stop_flusher) {
+        // 每半个最大年龄醒来一次；脏块比例超限或参数变化时被提前唤醒
+        auto interval = std::max(m_max_age / 2, std::chrono::milliseconds(10));
+        if (!over_dirty_ratio()) {
+            m_flush_cv.wait_for(lock, interval);
+        }
+        if (m_stop_flusher || m_dirty_count.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        flush_expired_and_excess();
+    }
 }
 
-bool BlockCache::flush_all(int fd) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+// 注意：调用者持有 m_flush_mutex
+void BlockCache::flush_expired_and_excess() {
+    auto now = std::chrono::steady_clock::now();
+    auto max_age = m_max_age;
+    
+    // 1. 年龄阈值：超时的脏块全部写回（逐个分片加锁，不会同时阻塞所有分片）
+    for (auto& shard : m_shards) {
+        std::unique_lock<std::shared_mutex> shard_lock(shard->mutex);
+        write_back_if(*shard, [now, max_age](const Frame& frame) {
+            return now - frame.dirty_since >= max_age;
+        });
+    }
+    
+    // 2. 比例阈值：仍超限时，从最老的开始写回，直到降到阈值的一半
+    if (!over_dirty_ratio()) {
+        return;
+    }
     
-    for (auto& block : m_items) {
-        if (block.dirty) {
-            write_block(fd, block.block_id, block.data);
-            block.dirty = false;
+    struct Candidate {
+        std::chrono::steady_clock::time_point since;
+        size_t shard;
+        size_t frame;
+        uint64_t key;
+    };
+    std::vector<Candidate> candidates;
+    for (size_t s = 0; s < m_shards.size(); s++) {
+        std::shared_lock<std::shared_mutex> shard_lock(m_shards[s]->mutex);
+        for (size_t f = 0; f < m_shards[s]->frame_count; f++) {
+            const Frame& frame = m_shards[s]->frames[f];
+            if (frame.valid && frame.dirty) {
+                candidates.push_back({frame.dirty_since, s, f, frame.key});
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.since < b.since;
+    });
+    
+    size_t target = m_capacity * m_dirty_ratio / 200;
+    for (const Candidate& c : candidates) {
+        if (m_dirty_count.load(std::memory_order_relaxed) <= target) {
+            break;
+        }
+        Shard& shard = *m_shards[c.shard];
+        std::unique_lock<std::shared_mutex> shard_lock(shard.mutex);
+        // 收集候选之后帧可能已被替换或写回，重新确认
+        Frame& frame = shard.frames[c.frame];
+        if (frame.valid && frame.dirty && frame.key == c.key) {
+            write_back(shard, c.frame);
         }
     }
-    return true;
 }
 
-void BlockCache::print_stats() const {
-    std::lock_guard<std::mutex> lock(m_mutex);
+void BlockCache::get_stats(BlockCacheStats* stats) const {
+    stats->hits = get_hits();
+    stats->misses = get_misses();
+    stats->meta_hits = m_meta_hits.load(std::memory_order_relaxed);
+    stats->meta_misses = m_meta_misses.load(std::memory_order_relaxed);
+    stats->data_hits = m_data_hits.load(std::memory_order_relaxed);
+    stats->data_misses = m_data_misses.load(std::memory_order_relaxed);
+    stats->size = get_size();
+    stats->capacity = m_capacity;
+    stats->replacements = get_replacements();
+    stats->dirty = get_dirty_count();
+    stats->writebacks = get_writebacks();
+    stats->prefetched = get_prefetched();
     
+    PolicyCounters counters;
+    for (const auto& shard : m_shards) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        shard->policy->add_counters(counters);
+    }
+    stats->policy = m_policy;
+    stats->probation_hits = counters.probation_hits;
+    stats->protected_hits = counters.protected_hits;
+    stats->ghost_hits = counters.ghost_hits;
+    stats->promotions = counters.promotions;
+    stats->second_chances = counters.second_chances;
+}
+
+void BlockCache::print_stats() const {
     if (m_capacity == 0) {
         std::cout << "📊 Block Cache: DISABLED" << std::endl;
         return;
     }
     
-    size_t total_accesses = m_hits + m_misses;
-    double hit_rate = (total_accesses > 0) ? (100.0 * m_hits / total_accesses) : 0.0;
+    BlockCacheStats s;
+    get_stats(&s);
+    size_t total_accesses = s.hits + s.misses;
+    double hit_rate = (total_accesses > 0) ? (100.0 * s.hits / total_accesses) : 0.0;
     
     std::cout << "\n📊 Block Cache Statistics:" << std::endl;
-    std::cout << "   Capacity:     " << m_capacity << " blocks" << std::endl;
-    std::cout << "   Current Size: " << m_items.size() << " blocks" << std::endl;
-    std::cout << "   Hits:         " << m_hits << std::endl;
-    std::cout << "   Misses:       " << m_misses << std::endl;
+    std::cout << "   Capacity:     " << s.capacity << " blocks (" << m_shards.size() << " shards)" << std::endl;
+    std::cout << "   Policy:       " << eviction_policy_name(m_policy) << std::endl;
+    std::cout << "   Current Size: " << s.size << " blocks" << std::endl;
+    std::cout << "   Hits:         " << s.hits << std::endl;
+    std::cout << "   Misses:       " << s.misses << std::endl;
     std::cout << "   Hit Rate:     " << std::fixed << std::setprecision(2) << hit_rate << "%" << std::endl;
-    std::cout << "   Replacements: " << m_replacements << std::endl;
+    std::cout << "   Meta Hit/Miss: " << s.meta_hits << " / " << s.meta_misses << std::endl;
+    std::cout << "   Data Hit/Miss: " << s.data_hits << " / " << s.data_misses << std::endl;
+    std::cout << "   Replacements: " << s.replacements << std::endl;
+    std::cout << "   Prefetched:   " << s.prefetched << " blocks" << std::endl;
+    if (m_policy == BLOCK_CACHE_POLICY_S3FIFO) {
+        std::cout << "   Small/Main Hits: " << s.probation_hits << " / " << s.protected_hits << std::endl;
+        std::cout << "   Ghost Hits:   " << s.ghost_hits << std::endl;
+        std::cout << "   Promotions:   " << s.promotions << std::endl;
+    }
+    std::cout << "   Second Chances: " << s.second_chances << std::endl;
+    std::cout << "   Write Mode:   " << (is_write_back() ? "write-back" : "write-through") << std::endl;
+    std::cout << "   Dirty Blocks: " << s.dirty << std::endl;
+    std::cout << "   Write-backs:  " << s.writebacks << std::endl;
 }
 
 // ==================== C 接口实现 ====================
 
 void block_cache_init(size_t capacity) {
+    block_cache_init_ex(capacity, BLOCK_CACHE_POLICY_CLOCK);
+}
+
+void block_cache_init_ex(size_t capacity, int policy) {
     if (g_block_cache != nullptr) {
         delete g_block_cache;
     }
-    g_block_cache = new BlockCache(capacity);
+    g_block_cache = new BlockCache(capacity, policy);
 }
 
 void block_cache_destroy() {
@@ -229,6 +672,10 @@ void block_cache_destroy() {
 }
 
 void read_block_cached(int fd, int block_id, void* buf) {
+    // 元数据块在日志中有更新的映像（尚未写回原位置）
+    if (journal_read_block(fd, block_id, buf)) {
+        return;
+    }
     if (g_block_cache != nullptr) {
         g_block_cache->read_block_cached(fd, block_id, buf);
     } else {
@@ -237,7 +684,46 @@ void read_block_cached(int fd, int block_id, void* buf) {
     }
 }
 
+void read_blocks_cached(int fd, const int* block_ids, int count, void* const* bufs) {
+    // 可能有块在日志中有映像（元数据块、结构块）时先从日志取，剩下的再批量读取
+    if (journal_may_hold(fd, block_ids, count)) {
+        std::vector<int> rest_ids;
+        std::vector<void*> rest_bufs;
+        for (int i = 0; i < count; i++) {
+            if (!journal_read_block(fd, block_ids[i], bufs[i])) {
+                rest_ids.push_back(block_ids[i]);
+                rest_bufs.push_back(bufs[i]);
+            }
+        }
+        if ((int)rest_ids.size() < count) {
+            read_blocks_cached(fd, rest_ids.data(), (int)rest_ids.size(), rest_bufs.data());
+            return;
+        }
+    }
+    if (g_block_cache != nullptr) {
+        g_block_cache->read_blocks_cached(fd, block_ids, count, bufs);
+    } else {
+        // 如果缓存未初始化，直接读取（仍合并连续段）
+        std::vector<int> all(count > 0 ? count : 0);
+        for (int i = 0; i < count; i++) {
+            all[i] = i;
+        }
+        read_pending_runs(fd, block_ids, bufs, all);
+    }
+}
+
+int block_cache_prefetch(int fd, const int* block_ids, int count) {
+    if (g_block_cache != nullptr) {
+        return (int)g_block_cache->prefetch(fd, block_ids, count);
+    }
+    return 0;
+}
+
 void write_block_cached(int fd, int block_id, const void* buf) {
+    // 挂了日志的磁盘：元数据块记入当前事务，提交时才写盘
+    if (journal_write_block(fd, block_id, buf)) {
+        return;
+    }
     if (g_block_cache != nullptr) {
         g_block_cache->write_block_cached(fd, block_id, buf);
     } else {
@@ -252,6 +738,57 @@ void block_cache_flush(int fd) {
     }
 }
 
+void block_cache_sync(int fd) {
+    // 挂了日志的磁盘：提交当前事务（提交时先写回脏数据块）
+    if (journal_commit(fd) == 0) {
+        return;
+    }
+    if (g_block_cache != nullptr) {
+        g_block_cache->sync(fd);
+    } else if (fd >= 0) {
+        block_device_flush(fd);
+    }
+}
+
+void block_cache_set_write_back(int enabled, unsigned int max_age_ms, unsigned int dirty_ratio) {
+    if (g_block_cache != nullptr) {
+        g_block_cache->set_write_back(enabled != 0, max_age_ms, dirty_ratio);
+    }
+}
+
+void block_cache_get_writeback_stats(size_t* dirty, size_t* writebacks) {
+    if (g_block_cache != nullptr) {
+        if (dirty) *dirty = g_block_cache->get_dirty_count();
+        if (writebacks) *writebacks = g_block_cache->get_writebacks();
+    } else {
+        if (dirty) *dirty = 0;
+        if (writebacks) *writebacks = 0;
+    }
+}
+
+void block_cache_invalidate(int fd, int block_id) {
+    if (g_block_cache != nullptr) {
+        g_block_cache->invalidate(fd, block_id);
+    }
+}
+
+void block_cache_discard(int fd) {
+    if (g_block_cache != nullptr) {
+        g_block_cache->discard(fd);
+    }
+}
+
+void block_cache_get_stats_ex(BlockCacheStats* stats) {
+    if (stats == nullptr) {
+        return;
+    }
+    if (g_block_cache != nullptr) {
+        g_block_cache->get_stats(stats);
+    } else {
+        memset(stats, 0, sizeof(BlockCacheStats));
+    }
+}
+
 void block_cache_clear() {
     if (g_block_cache != nullptr) {
         g_block_cache->clear();
@@ -0,0 +1,483 @@
+// block_device.cpp - 块设备后端实现
+#include "../include/block_device.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 打洞不可用时（文件系统不支持）按这么大的块写 0
+static const size_t DISCARD_ZERO_CHUNK = 64 * 1024;
+
+// ==================== PreadDevice ====================
+
+PreadDevice::PreadDevice(int fd, bool owns) : m_fd(fd) {
+    m_owns = owns;
+}
+
+PreadDevice::~PreadDevice() {
+    if (m_owns && m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+long long PreadDevice::size() const {
+    struct stat st;
+    return fstat(m_fd, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+int PreadDevice::resize(long long bytes) {
+    return ftruncate(m_fd, (off_t)bytes) == 0 ? 0 : -1;
+}
+
+long long PreadDevice::read(void* buf, size_t len, long long offset) {
+    return pread(m_fd, buf, len, (off_t)offset);
+}
+
+long long PreadDevice::write(const void* buf, size_t len, long long offset) {
+    return pwrite(m_fd, buf, len, (off_t)offset);
+}
+
+long long PreadDevice::readv(const struct iovec* iov, int count, long long offset) {
+    return preadv(m_fd, iov, count, (off_t)offset);
+}
+
+long long PreadDevice::writev(const struct iovec* iov, int count, long long offset) {
+    return pwritev(m_fd, iov, count, (off_t)offset);
+}
+
+int PreadDevice::flush() {
+    return fdatasync(m_fd) == 0 ? 0 : -1;
+}
+
+int PreadDevice::discard(long long offset, long long len) {
+    if (len <= 0) {
+        return 0;
+    }
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)len) == 0) {
+        return 0;
+    }
+#endif
+    // 不支持打洞：写 0（不越过文件末尾）
+    long long end = std::min(offset + len, size());
+    std::vector<char> zeros(DISCARD_ZERO_CHUNK, 0);
+    for (long long pos = offset; pos < end; pos += DISCARD_ZERO_CHUNK) {
+        size_t n = (size_t)std::min<long long>(DISCARD_ZERO_CHUNK, end - pos);
+        if (pwrite(m_fd, zeros.data(), n, (off_t)pos) != (ssize_t)n) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// ==================== MmapDevice ====================
+
+MmapDevice::MmapDevice(int fd) : m_fd(fd) {
+    struct stat st;
+    m_ok = fstat(fd, &st) == 0 && map(st.st_size);
+}
+
+MmapDevice::~MmapDevice() {
+    unmap();
+    if (m_owns && m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+// 映射文件的前 bytes 字节（0 字节时不映射）
+bool MmapDevice::map(long long bytes) {
+    m_base = nullptr;
+    m_size = 0;
+    if (bytes <= 0) {
+        return true;
+    }
+    void* base = mmap(nullptr, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap disk");
+        return false;
+    }
+    m_base = (char*)base;
+    m_size = bytes;
+    return true;
+}
+
+void MmapDevice::unmap() {
+    if (m_base) {
+        munmap(m_base, (size_t)m_size);
+    }
+    m_base = nullptr;
+    m_size = 0;
+}
+
+long long MmapDevice::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_size;
+}
+
+int MmapDevice::resize(long long bytes) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    unmap();
+    if (ftruncate(m_fd, (off_t)bytes) != 0) {
+        return -1;
+    }
+    return map(bytes) ? 0 : -1;
+}
+
+long long MmapDevice::read(void* buf, size_t len, long long offset) {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (offset < 0 || offset >= m_size) {
+        return 0;
+    }
+    size_t n = (size_t)std::min<long long>(len, m_size - offset);
+    memcpy(buf, m_base + offset, n);
+    return (long long)n;
+}
+
+long long MmapDevice::write(const void* buf, size_t len, long long offset) {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (offset < 0 || offset >= m_size) {
+        return -1;  // 映射之外（镜像大小在格式化时就固定了）
+    }
+    size_t n = (size_t)std::min<long long>(len, m_size - offset);
+    memcpy(m_base + offset, buf, n);
+    return (long long)n;
+}
+
+long long MmapDevice::readv(const struct iovec* iov, int count, long long offset) {
+    long long done = 0;
+    for (int i = 0; i < count; i++) {
+        long long n = read(iov[i].iov_base, iov[i].iov_len, offset + done);
+        done += n;
+        if (n < (long long)iov[i].iov_len) {
+            break;
+        }
+    }
+    return done;
+}
+
+long long MmapDevice::writev(const struct iovec* iov, int count, long long offset) {
+    long long done = 0;
+    for (int i = 0; i < count; i++) {
+        long long n = write(iov[i].iov_base, iov[i].iov_len, offset + done);
+        if (n < 0) {
+            return done > 0 ? done : -1;
+        }
+        done += n;
+        if (n < (long long)iov[i].iov_len) {
+            break;
+        }
+    }
+    return done;
+}
+
+int MmapDevice::flush() {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (m_base && msync(m_base, (size_t)m_size, MS_SYNC) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int MmapDevice::discard(long long offset, long long len) {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (offset < 0 || offset >= m_size || len <= 0) {
+        return 0;
+    }
+    len = std::min(len, m_size - offset);
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // 共享映射和文件是同一份页缓存：打洞后映射里读出的也是 0
+    if (fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)len) == 0) {
+        return 0;
+    }
+#endif
+    memset(m_base + offset, 0, (size_t)len);
+    return 0;
+}
+
+// ==================== MemoryDevice ====================
+
+MemoryDevice::MemoryDevice(int handle, std::shared_ptr<MemoryImage> image)
+    : m_handle(handle), m_image(std::move(image)) {}
+
+MemoryDevice::~MemoryDevice() {
+    if (m_owns && m_handle >= 0) {
+        close(m_handle);
+    }
+}
+
+long long MemoryDevice::size() const {
+    std::shared_lock<std::shared_mutex> lock(m_image->mutex);
+    return (long long)m_image->data.size();
+}
+
+int MemoryDevice::resize(long long bytes) {
+    if (bytes < 0) {
+        return -1;
+    }
+    std::unique_lock<std::shared_mutex> lock(m_image->mutex);
+    m_image->data.resize((size_t)bytes);
+    return 0;
+}
+
+long long MemoryDevice::read(void* buf, size_t len, long long offset) {
+    std::shared_lock<std::shared_mutex> lock(m_image->mutex);
+    long long size = (long long)m_image->data.size();
+    if (offset < 0 || offset >= size) {
+        return 0;
+    }
+    size_t n = (size_t)std::min<long long>(len, size - offset);
+    memcpy(buf, m_image->data.data() + offset, n);
+    return (long long)n;
+}
+
+long long MemoryDevice::write(const void* buf, size_t len, long long offset) {
+    if (offset < 0) {
+        return -1;
+    }
+    {
+        // 范围内的写入只持共享锁：不同区域的并发写入互不影响
+        std::shared_lock<std::shared_mutex> lock(m_image->mutex);
+        if (offset + (long long)len <= (long long)m_image->data.size()) {
+            memcpy(m_image->data.data() + offset, buf, len);
+            return (long long)len;
+        }
+    }
+    // 写到末尾之后：和普通文件一样扩大
+    std::unique_lock<std::shared_mutex> lock(m_image->mutex);
+    if (offset + (long long)len > (long long)m_image->data.size()) {
+        m_image->data.resize((size_t)(offset + len));
+    }
+    memcpy(m_image->data.data() + offset, buf, len);
+    return (long long)len;
+}
+
+long long MemoryDevice::readv(const struct iovec* iov, int count, long long offset) {
+    long long done = 0;
+    for (int i = 0; i < count; i++) {
+        long long n = read(iov[i].iov_base, iov[i].iov_len, offset + done);
+        done += n;
+        if (n < (long long)iov[i].iov_len) {
+            break;
+        }
+    }
+    return done;
+}
+
+long long MemoryDevice::writev(const struct iovec* iov, int count, long long offset) {
+    long long done = 0;
+    for (int i = 0; i < count; i++) {
+        long long n = write(iov[i].iov_base, iov[i].iov_len, offset + done);
+        if (n < 0) {
+            return done > 0 ? done : -1;
+        }
+        done += n;
+    }
+    return done;
+}
+
+int MemoryDevice::discard(long long offset, long long len) {
+    std::shared_lock<std::shared_mutex> lock(m_image->mutex);
+    long long size = (long long)m_image->data.size();
+    if (offset < 0 || offset >= size || len <= 0) {
+        return 0;
+    }
+    memset(m_image->data.data() + offset, 0, (size_t)std::min(len, size - offset));
+    return 0;
+}
+
+// ==================== 创建与登记 ====================
+
+namespace {
+
+std::atomic<int> g_default_type{-1};
+
+// 内存盘：路径 -> 内容（进程结束时消失）
+std::mutex g_images_mutex;
+std::unordered_map<std::string, std::shared_ptr<MemoryImage>> g_images;
+
+// 句柄 -> 设备
+std::shared_mutex g_registry_mutex;
+std::unordered_map<int, std::unique_ptr<BlockDevice>> g_devices;
+
+// 第一次打开某个路径的内存盘：镜像文件存在时读入它的内容
+std::shared_ptr<MemoryImage> memory_image(const char* path) {
+    std::lock_guard<std::mutex> lock(g_images_mutex);
+    auto it = g_images.find(path);
+    if (it != g_images.end()) {
+        return it->second;
+    }
+    auto image = std::make_shared<MemoryImage>();
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            image->data.resize((size_t)st.st_size);
+            size_t done = 0;
+            while (done < image->data.size()) {
+                ssize_t n = pread(fd, image->data.data() + done, image->data.size() - done, (off_t)done);
+                if (n <= 0) {
+                    break;
+                }
+                done += (size_t)n;
+            }
+            image->data.resize(done);
+        }
+        close(fd);
+    }
+    g_images[path] = image;
+    return image;
+}
+
+}  // namespace
+
+std::unique_ptr<BlockDevice> make_block_device(const char* path, int type) {
+    if (type == BLOCK_DEVICE_MEMORY) {
+        int handle = open("/dev/null", O_RDONLY);
+        if (handle < 0) {
+            perror("open /dev/null");
+            return nullptr;
+        }
+        return std::unique_ptr<BlockDevice>(new MemoryDevice(handle, memory_image(path)));
+    }
+    if (type != BLOCK_DEVICE_PREAD && type != BLOCK_DEVICE_MMAP) {
+        return nullptr;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        perror("open disk");
+        return nullptr;
+    }
+    if (type == BLOCK_DEVICE_PREAD) {
+        return std::unique_ptr<BlockDevice>(new PreadDevice(fd, true));
+    }
+    std::unique_ptr<MmapDevice> device(new MmapDevice(fd));
+    if (!device->mapped_ok()) {
+        return nullptr;
+    }
+    return std::unique_ptr<BlockDevice>(device.release());
+}
+
+BlockDevice* block_device_get(int fd) {
+    std::shared_lock<std::shared_mutex> lock(g_registry_mutex);
+    auto it = g_devices.find(fd);
+    return it != g_devices.end() ? it->second.get() : nullptr;
+}
+
+// ==================== C 接口实现 ====================
+
+int block_device_default_type(void) {
+    int type = g_default_type.load();
+    if (type < 0) {
+        const char* env = getenv("FS_BLOCK_DEVICE");
+        type = env ? block_device_parse_type(env) : -1;
+        if (type < 0) {
+            type = BLOCK_DEVICE_PREAD;
+        }
+        g_default_type.store(type);
+    }
+    return type;
+}
+
+void block_device_set_default_type(int type) {
+    if (block_device_type_name(type)[0] != '?') {
+        g_default_type.store(type);
+    }
+}
+
+const char* block_device_type_name(int type) {
+    switch (type) {
+        case BLOCK_DEVICE_PREAD: return "pread";
+        case BLOCK_DEVICE_MMAP: return "mmap";
+        case BLOCK_DEVICE_MEMORY: return "memory";
+        default: return "?";
+    }
+}
+
+int block_device_parse_type(const char* name) {
+    for (int type : {BLOCK_DEVICE_PREAD, BLOCK_DEVICE_MMAP, BLOCK_DEVICE_MEMORY}) {
+        if (name && strcmp(name, block_device_type_name(type)) == 0) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+int block_device_open(const char* path, int type) {
+    std::unique_ptr<BlockDevice> device = make_block_device(path, type);
+    if (!device) {
+        return -1;
+    }
+    int fd = device->handle();
+
+    std::unique_ptr<BlockDevice> stale;
+    {
+        std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+        auto it = g_devices.find(fd);
+        if (it != g_devices.end()) {
+            // 同号句柄还登记着：原来的 fd 已经被直接关闭，编号刚被重新分配给新设备
+            stale = std::move(it->second);
+            stale->disown();
+        }
+        g_devices[fd] = std::move(device);
+    }
+    return fd;
+}
+
+void block_device_close(int fd) {
+    std::unique_ptr<BlockDevice> device;
+    {
+        std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+        auto it = g_devices.find(fd);
+        if (it == g_devices.end()) {
+            lock.unlock();
+            close(fd);  // 没有登记的原始 fd
+            return;
+        }
+        device = std::move(it->second);
+        g_devices.erase(it);
+    }
+}
+
+int block_device_type(int fd) {
+    BlockDevice* device = block_device_get(fd);
+    return device ? device->type() : -1;
+}
+
+long long block_device_size(int fd) {
+    BlockDevice* device = block_device_get(fd);
+    return device ? device->size() : PreadDevice(fd, false).size();
+}
+
+int block_device_resize(int fd, long long bytes) {
+    BlockDevice* device = block_device_get(fd);
+    return device ? device->resize(bytes) : PreadDevice(fd, false).resize(bytes);
+}
+
+long long block_device_read(int fd, void* buf, long long len, long long offset) {
+    BlockDevice* device = block_device_get(fd);
+    return device ? device->read(buf, (size_t)len, offset) : PreadDevice(fd, false).read(buf, (size_t)len, offset);
+}
+
+long long block_device_write(int fd, const void* buf, long long len, long long offset) {
+    BlockDevice* device = block_device_get(fd);
+    return device ? device->write(buf, (size_t)len, offset) : PreadDevice(fd, false).write(buf, (size_t)len, offset);
+}
+
+int block_device_flush(int fd) {
+    BlockDevice* device = block_device_get(fd);
+    return device ? device->flush() : PreadDevice(fd, false).flush();
+}
+
+int block_device_discard(int fd, long long offset, long long len) {
+    BlockDevice* device = block_device_get(fd);
+    return device ? device->discard(offset, len) : PreadDevice(fd, false).discard(offset, len);
+}
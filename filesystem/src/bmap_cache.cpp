@@ -0,0 +1,117 @@
+// bmap_cache.cpp - extent 树节点解码缓存实现
+#include "../include/bmap_cache.h"
+#include "../include/block_cache.h"
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+// 默认缓存 256 个树节点，足够覆盖常用的大文件 / 大目录
+static const size_t BMAP_CACHE_CAPACITY = 256;
+
+// 全局缓存实例
+static BmapCache g_bmap_cache(BMAP_CACHE_CAPACITY);
+
+// ==================== BmapCache 类实现 ====================
+
+BmapCache::BmapCache(size_t capacity)
+    : m_capacity(capacity), m_generation(0), m_hits(0), m_misses(0), m_invalidations(0) {
+    m_entries.reserve(capacity);
+}
+
+bool BmapCache::lookup(int fd, int node_block, int first, int count, int* out) {
+    if (node_block < 0 || first < 0 || count < 0 || first + count > disk_block_size(fd) / (int)sizeof(int)) {
+        return false;
+    }
+    uint64_t key = make_key(fd, node_block);
+
+    // 快路径：共享锁下直接复制需要的那一段
+    uint64_t generation;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it != m_entries.end()) {
+            memcpy(out, it->second->pointers + first, count * sizeof(int));
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        generation = m_generation;
+    }
+
+    // 慢路径：锁外读取节点（经过块缓存，能看到尚未落盘的修改）
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    auto entry = std::make_unique<Entry>();
+    read_block_cached(fd, node_block, entry->pointers);
+    memcpy(out, entry->pointers + first, count * sizeof(int));
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (m_generation != generation || m_entries.count(key)) {
+        return true;  // 读盘期间有作废或其他线程已装入：不装入
+    }
+    if (m_entries.size() >= m_capacity) {
+        m_entries.erase(m_entries.begin());  // 满了随便淘汰一个，重新解码的代价只是一次缓存块读取
+    }
+    m_entries.emplace(key, std::move(entry));
+    return true;
+}
+
+void BmapCache::invalidate(int fd, int node_block) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_generation++;
+    if (m_entries.erase(make_key(fd, node_block))) {
+        m_invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BmapCache::discard(int fd) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_generation++;
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if ((int)(it->first >> 32) == fd) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void BmapCache::get_stats(BmapCacheStats* stats) const {
+    stats->hits = m_hits.load(std::memory_order_relaxed);
+    stats->misses = m_misses.load(std::memory_order_relaxed);
+    stats->invalidations = m_invalidations.load(std::memory_order_relaxed);
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    stats->entries = m_entries.size();
+}
+
+void BmapCache::print_stats() const {
+    BmapCacheStats s;
+    get_stats(&s);
+    std::cout << "\n📊 Bmap Cache Statistics:" << std::endl;
+    std::cout << "   Entries:       " << s.entries << " / " << m_capacity << std::endl;
+    std::cout << "   Hits:          " << s.hits << std::endl;
+    std::cout << "   Misses:        " << s.misses << std::endl;
+    std::cout << "   Invalidations: " << s.invalidations << std::endl;
+}
+
+// ==================== C 接口实现 ====================
+
+int bmap_cache_lookup(int fd, int node_block, int first, int count, int* out) {
+    return g_bmap_cache.lookup(fd, node_block, first, count, out) ? 0 : -1;
+}
+
+void bmap_cache_invalidate(int fd, int node_block) {
+    g_bmap_cache.invalidate(fd, node_block);
+}
+
+void bmap_cache_discard(int fd) {
+    g_bmap_cache.discard(fd);
+}
+
+void bmap_cache_get_stats(BmapCacheStats* stats) {
+    if (stats != nullptr) {
+        g_bmap_cache.get_stats(stats);
+    }
+}
+
+void bmap_cache_print_stats() {
+    g_bmap_cache.print_stats();
+}
@@ -0,0 +1,191 @@
+// cache_policy.cpp - 块缓存替换策略实现
+#include "../include/cache_policy.h"
+
+std::unique_ptr<EvictionPolicy> make_eviction_policy(int policy, size_t frame_count) {
+    if (policy == BLOCK_CACHE_POLICY_S3FIFO) {
+        return std::make_unique<S3FifoPolicy>(frame_count);
+    }
+    return std::make_unique<ClockPolicy>(frame_count);
+}
+
+const char* eviction_policy_name(int policy) {
+    return policy == BLOCK_CACHE_POLICY_S3FIFO ? "S3-FIFO" : "CLOCK";
+}
+
+// ==================== ClockPolicy ====================
+
+ClockPolicy::ClockPolicy(size_t frame_count)
+    : m_frame_count(frame_count), m_ref(new std::atomic<uint8_t>[frame_count]) {
+    for (size_t i = 0; i < frame_count; i++) {
+        m_ref[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void ClockPolicy::on_insert(size_t f, uint64_t) {
+    // 新块引用位为 0：只被装入过一次的块在下一圈就会被替换
+    m_ref[f].store(0, std::memory_order_relaxed);
+}
+
+void ClockPolicy::on_access(size_t f) {
+    m_ref[f].store(1, std::memory_order_relaxed);
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ClockPolicy::on_remove(size_t f) {
+    m_ref[f].store(0, std::memory_order_relaxed);
+}
+
+size_t ClockPolicy::pick_victim() {
+    // 引用位为 1 的帧给第二次机会，最多转两圈必然找到引用位为 0 的帧
+    for (;;) {
+        size_t f = m_hand;
+        m_hand = (m_hand + 1) % m_frame_count;
+        if (m_ref[f].load(std::memory_order_relaxed)) {
+            m_ref[f].store(0, std::memory_order_relaxed);
+            m_second_chances++;
+            continue;
+        }
+        return f;
+    }
+}
+
+void ClockPolicy::add_counters(PolicyCounters& counters) const {
+    counters.protected_hits += m_hits.load(std::memory_order_relaxed);
+    counters.second_chances += m_second_chances;
+}
+
+// ==================== S3FifoPolicy ====================
+
+S3FifoPolicy::S3FifoPolicy(size_t frame_count)
+    : m_frame_count(frame_count),
+      m_small_target(frame_count / 10 > 0 ? frame_count / 10 : 1),
+      m_freq(new std::atomic<uint8_t>[frame_count]),
+      m_queue(new uint8_t[frame_count]()),
+      m_gen(new uint32_t[frame_count]()),
+      m_key(new uint64_t[frame_count]()) {
+    for (size_t i = 0; i < frame_count; i++) {
+        m_freq[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void S3FifoPolicy::on_insert(size_t f, uint64_t key) {
+    m_key[f] = key;
+    m_freq[f].store(0, std::memory_order_relaxed);
+
+    auto it = m_ghost_index.find(key);
+    if (it != m_ghost_index.end()) {
+        // 最近从小队列被挤出又回来：说明不是一次性访问，直接进主队列
+        m_ghost_index.erase(it);
+        m_ghost_hits++;
+        m_queue[f] = MAIN;
+        m_main.push_back({f, m_gen[f]});
+        m_main_size++;
+    } else {
+        m_queue[f] = SMALL;
+        m_small.push_back({f, m_gen[f]});
+        m_small_size++;
+    }
+}
+
+void S3FifoPolicy::on_access(size_t f) {
+    // 频率上限 3；并发命中时偶尔少加一次无关紧要，不用 CAS
+    uint8_t freq = m_freq[f].load(std::memory_order_relaxed);
+    if (freq < 3) {
+        m_freq[f].store(freq + 1, std::memory_order_relaxed);
+    }
+    if (m_queue[f] == SMALL) {
+        m_probation_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_protected_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void S3FifoPolicy::detach(size_t f) {
+    if (m_queue[f] == SMALL) {
+        m_small_size--;
+    } else if (m_queue[f] == MAIN) {
+        m_main_size--;
+    }
+    m_queue[f] = NONE;
+    m_gen[f]++;  // 队列中残留的元素作废
+    m_freq[f].store(0, std::memory_order_relaxed);
+}
+
+void S3FifoPolicy::on_remove(size_t f) {
+    detach(f);
+}
+
+bool S3FifoPolicy::pop_valid(std::deque<Entry>& queue, uint8_t which, size_t& frame) {
+    while (!queue.empty()) {
+        Entry e = queue.front();
+        queue.pop_front();
+        if (m_gen[e.frame] == e.gen && m_queue[e.frame] == which) {
+            frame = e.frame;
+            return true;
+        }
+    }
+    return false;
+}
+
+void S3FifoPolicy::push_ghost(uint64_t key) {
+    uint64_t seq = ++m_ghost_seq;
+    m_ghost_index[key] = seq;
+    m_ghost.emplace_back(key, seq);
+
+    // 幽灵队列只保留约一个主队列大小的键
+    while (m_ghost_index.size() > m_frame_count || m_ghost.size() > 2 * m_frame_count) {
+        auto old = m_ghost.front();
+        m_ghost.pop_front();
+        auto it = m_ghost_index.find(old.first);
+        if (it != m_ghost_index.end() && it->second == old.second) {
+            m_ghost_index.erase(it);
+        }
+    }
+}
+
+size_t S3FifoPolicy::pick_victim() {
+    for (;;) {
+        size_t f;
+        if (m_small_size >= m_small_target || m_main_size == 0) {
+            if (!pop_valid(m_small, SMALL, f)) {
+                m_small_size = 0;  // 计数与队列不一致（不应发生），以队列为准
+                continue;
+            }
+            if (m_freq[f].load(std::memory_order_relaxed) > 0) {
+                // 在小队列里被访问过：晋升到主队列
+                m_freq[f].store(0, std::memory_order_relaxed);
+                m_queue[f] = MAIN;
+                m_small_size--;
+                m_main_size++;
+                m_main.push_back({f, m_gen[f]});
+                m_promotions++;
+                continue;
+            }
+            push_ghost(m_key[f]);
+            detach(f);
+            return f;
+        }
+
+        if (!pop_valid(m_main, MAIN, f)) {
+            m_main_size = 0;
+            continue;
+        }
+        uint8_t freq = m_freq[f].load(std::memory_order_relaxed);
+        if (freq > 0) {
+            m_freq[f].store(freq - 1, std::memory_order_relaxed);
+            m_main.push_back({f, m_gen[f]});
+            m_second_chances++;
+            continue;
+        }
+        detach(f);
+        return f;
+    }
+}
+
+void S3FifoPolicy::add_counters(PolicyCounters& counters) const {
+    counters.probation_hits += m_probation_hits.load(std::memory_order_relaxed);
+    counters.protected_hits += m_protected_hits.load(std::memory_order_relaxed);
+    counters.ghost_hits += m_ghost_hits;
+    counters.promotions += m_promotions;
+    counters.second_chances += m_second_chances;
+}
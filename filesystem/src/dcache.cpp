@@ -0,0 +1,282 @@
+// dcache.cpp - 路径解析目录项缓存实现
+#include "../include/dcache.h"
+#include "../include/inode.h"
+#include "../include/path.h"
+#include <cstring>
+#include <iostream>
+
+// (父目录, 名字) 表 4096 槽（约 400KB），完整路径表 1024 槽（约 290KB）
+static const size_t DCACHE_COMPONENT_SLOTS = 4096;
+static const size_t DCACHE_PATH_SLOTS = 1024;
+
+static_assert(DIR_NAME_SIZE <= 8 * sizeof(uint64_t), "dcache component key too short");
+static_assert(MAX_PATH_LENGTH <= 32 * sizeof(uint64_t), "dcache path key too short");
+
+// 全局缓存实例
+static DentryCache g_dcache(DCACHE_COMPONENT_SLOTS, DCACHE_PATH_SLOTS);
+
+// FNV-1a（按 64 位字），只用于选槽位，键仍然逐字比较
+template <size_t N>
+static uint64_t hash_key(const uint64_t (&words)[N]) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < N; i++) {
+        h ^= words[i];
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+// 把字符串打包进键（不足部分补零）；超长返回 false，调用者不缓存
+static bool pack_string(uint64_t* words, size_t word_count, const char* s) {
+    size_t len = strlen(s);
+    if (len >= word_count * sizeof(uint64_t)) {
+        return false;
+    }
+    memset(words, 0, word_count * sizeof(uint64_t));
+    memcpy(words, s, len);
+    return true;
+}
+
+// ==================== SeqlockTable 实现 ====================
+
+template <size_t KeyWords>
+SeqlockTable<KeyWords>::SeqlockTable(size_t slot_count) {
+    size_t n = 1;
+    while (n < slot_count) {
+        n <<= 1;
+    }
+    m_mask = n - 1;
+    m_slots.reset(new Slot[n]);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t w = 0; w < KeyWords; w++) {
+            m_slots[i].key[w].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+template <size_t KeyWords>
+bool SeqlockTable<KeyWords>::lookup(const Key& key, uint64_t hash, int* value, uint64_t* stamp) const {
+    const Slot& slot = m_slots[hash & m_mask];
+
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1) {
+        return false;  // 正在写：按未命中处理，不等待
+    }
+    if (slot.hash.load(std::memory_order_relaxed) != hash) {
+        return false;
+    }
+    for (size_t w = 0; w < KeyWords; w++) {
+        if (slot.key[w].load(std::memory_order_relaxed) != key.words[w]) {
+            return false;
+        }
+    }
+    int v = slot.value.load(std::memory_order_relaxed);
+    uint64_t s = slot.stamp.load(std::memory_order_relaxed);
+
+    // 读完字段后再核对序列号：期间有写入则读到的可能是新旧混合的条目
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != seq) {
+        return false;
+    }
+    *value = v;
+    *stamp = s;
+    return true;
+}
+
+template <size_t KeyWords>
+void SeqlockTable<KeyWords>::insert(const Key& key, uint64_t hash, int value, uint64_t stamp) {
+    Slot& slot = m_slots[hash & m_mask];
+
+    std::lock_guard<std::mutex> lock(m_write_mutex);
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.hash.store(hash, std::memory_order_relaxed);
+    for (size_t w = 0; w < KeyWords; w++) {
+        slot.key[w].store(key.words[w], std::memory_order_relaxed);
+    }
+    slot.value.store(value, std::memory_order_relaxed);
+    slot.stamp.store(stamp, std::memory_order_relaxed);
+
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+// ==================== DentryCache 类实现 ====================
+
+// epoch 从 1 开始：从未写过的槽位 stamp 为 0，永远不会被当成有效条目
+DentryCache::DentryCache(size_t component_slots, size_t path_slots)
+    : m_components(component_slots), m_paths(path_slots),
+      m_epoch(1), m_add_gen(0), m_remove_gen(0),
+      m_hits(0), m_negative_hits(0), m_misses(0),
+      m_path_hits(0), m_path_misses(0), m_invalidations(0) {
+}
+
+void DentryCache::snapshot(DcacheToken* token) const {
+    token->epoch = m_epoch.load(std::memory_order_acquire);
+    token->add_gen = m_add_gen.load(std::memory_order_acquire);
+    token->remove_gen = m_remove_gen.load(std::memory_order_acquire);
+}
+
+uint64_t DentryCache::make_stamp(const DcacheToken& token, int inode_id) {
+    uint32_t gen = inode_id >= 0 ? token.remove_gen : token.add_gen;
+    return ((uint64_t)token.epoch << 32) | gen;
+}
+
+bool DentryCache::stamp_valid(uint64_t stamp, int inode_id) const {
+    if ((uint32_t)(stamp >> 32) != m_epoch.load(std::memory_order_acquire)) {
+        return false;
+    }
+    uint32_t gen = inode_id >= 0 ? m_remove_gen.load(std::memory_order_acquire)
+                                 : m_add_gen.load(std::memory_order_acquire);
+    return (uint32_t)stamp == gen;
+}
+
+// 键的第 0 个字存 (fd, 父目录) 或 fd，其余存字符串
+template <typename Key>
+static bool make_component_key(Key& key, int fd, int parent_id, const char* name) {
+    key.words[0] = ((uint64_t)(uint32_t)fd << 32) | (uint32_t)parent_id;
+    return pack_string(key.words + 1, sizeof(key.words) / sizeof(uint64_t) - 1, name);
+}
+
+template <typename Key>
+static bool make_path_key(Key& key, int fd, const char* path) {
+    key.words[0] = (uint64_t)(uint32_t)fd;
+    return pack_string(key.words + 1, sizeof(key.words) / sizeof(uint64_t) - 1, path);
+}
+
+bool DentryCache::lookup(int fd, int parent_id, const char* name, int* inode_id) {
+    SeqlockTable<COMPONENT_KEY_WORDS>::Key key;
+    int value;
+    uint64_t stamp;
+    if (make_component_key(key, fd, parent_id, name) &&
+        m_components.lookup(key, hash_key(key.words), &value, &stamp) &&
+        stamp_valid(stamp, value)) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        if (value < 0) {
+            m_negative_hits.fetch_add(1, std::memory_order_relaxed);
+        }
+        *inode_id = value;
+        return true;
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void DentryCache::insert(int fd, int parent_id, const char* name, int inode_id, const DcacheToken& token) {
+    SeqlockTable<COMPONENT_KEY_WORDS>::Key key;
+    if (make_component_key(key, fd, parent_id, name)) {
+        m_components.insert(key, hash_key(key.words), inode_id < 0 ? -1 : inode_id,
+                            make_stamp(token, inode_id));
+    }
+}
+
+bool DentryCache::lookup_path(int fd, const char* path, int* inode_id) {
+    SeqlockTable<PATH_KEY_WORDS>::Key key;
+    int value;
+    uint64_t stamp;
+    if (make_path_key(key, fd, path) &&
+        m_paths.lookup(key, hash_key(key.words), &value, &stamp) &&
+        stamp_valid(stamp, value)) {
+        m_path_hits.fetch_add(1, std::memory_order_relaxed);
+        *inode_id = value;
+        return true;
+    }
+    m_path_misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void DentryCache::insert_path(int fd, const char* path, int inode_id, const DcacheToken& token) {
+    SeqlockTable<PATH_KEY_WORDS>::Key key;
+    if (make_path_key(key, fd, path)) {
+        m_paths.insert(key, hash_key(key.words), inode_id < 0 ? -1 : inode_id,
+                       make_stamp(token, inode_id));
+    }
+}
+
+void DentryCache::note_add(int fd, int parent_id, const char* name, int inode_id) {
+    // 先递增版本号再插入：并发慢路径用旧快照插入的负条目一写进去就是失效的
+    m_add_gen.fetch_add(1, std::memory_order_acq_rel);
+    m_invalidations.fetch_add(1, std::memory_order_relaxed);
+    DcacheToken token;
+    snapshot(&token);
+    insert(fd, parent_id, name, inode_id, token);
+}
+
+void DentryCache::note_remove(int fd, int parent_id, const char* name) {
+    m_remove_gen.fetch_add(1, std::memory_order_acq_rel);
+    m_invalidations.fetch_add(1, std::memory_order_relaxed);
+    DcacheToken token;
+    snapshot(&token);
+    insert(fd, parent_id, name, -1, token);
+}
+
+void DentryCache::invalidate() {
+    m_epoch.fetch_add(1, std::memory_order_acq_rel);
+    m_invalidations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DentryCache::get_stats(DcacheStats* stats) const {
+    stats->hits = m_hits.load(std::memory_order_relaxed);
+    stats->negative_hits = m_negative_hits.load(std::memory_order_relaxed);
+    stats->misses = m_misses.load(std::memory_order_relaxed);
+    stats->path_hits = m_path_hits.load(std::memory_order_relaxed);
+    stats->path_misses = m_path_misses.load(std::memory_order_relaxed);
+    stats->invalidations = m_invalidations.load(std::memory_order_relaxed);
+}
+
+void DentryCache::print_stats() const {
+    DcacheStats s;
+    get_stats(&s);
+    std::cout << "\n📊 Dentry Cache Statistics:" << std::endl;
+    std::cout << "   Component hits:   " << s.hits << " (negative " << s.negative_hits << ")" << std::endl;
+    std::cout << "   Component misses: " << s.misses << std::endl;
+    std::cout << "   Path hits:        " << s.path_hits << std::endl;
+    std::cout << "   Path misses:      " << s.path_misses << std::endl;
+    std::cout << "   Invalidations:    " << s.invalidations << std::endl;
+}
+
+// ==================== C 接口实现 ====================
+
+void dcache_snapshot(DcacheToken* token) {
+    g_dcache.snapshot(token);
+}
+
+int dcache_lookup(int fd, int parent_id, const char* name, int* inode_id) {
+    return g_dcache.lookup(fd, parent_id, name, inode_id) ? 1 : 0;
+}
+
+void dcache_insert(int fd, int parent_id, const char* name, int inode_id, const DcacheToken* token) {
+    g_dcache.insert(fd, parent_id, name, inode_id, *token);
+}
+
+int dcache_lookup_path(int fd, const char* path, int* inode_id) {
+    return g_dcache.lookup_path(fd, path, inode_id) ? 1 : 0;
+}
+
+void dcache_insert_path(int fd, const char* path, int inode_id, const DcacheToken* token) {
+    g_dcache.insert_path(fd, path, inode_id, *token);
+}
+
+void dcache_note_add(int fd, int parent_id, const char* name, int inode_id) {
+    g_dcache.note_add(fd, parent_id, name, inode_id);
+}
+
+void dcache_note_remove(int fd, int parent_id, const char* name) {
+    g_dcache.note_remove(fd, parent_id, name);
+}
+
+void dcache_invalidate(int fd) {
+    (void)fd;  // 版本号是全局的：作废所有 fd，重建的代价只是几次目录查找
+    g_dcache.invalidate();
+}
+
+void dcache_get_stats(DcacheStats* stats) {
+    if (stats != nullptr) {
+        g_dcache.get_stats(stats);
+    }
+}
+
+void dcache_print_stats() {
+    g_dcache.print_stats();
+}
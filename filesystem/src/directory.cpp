@@ -1,20 +1,291 @@
 // directory.cpp
 #include "../include/inode.h"
+#include "../include/allocator.h"
+#include "../include/dcache.h"
+#include "../include/extent.h"
+#include "../include/journal.h"
 #include <cstring>
 #include <cstdio>
+#include <vector>
+using std::vector;
 
 // 最大重试次数（用于处理 COW 相关的临时失败）
 static const int MAX_RETRY_COUNT = 3;
 
+// ==================== 目录哈希索引 ====================
+//
+// 线性的 DirEntry 数组仍然是目录内容的唯一权威来源（dir_get_entry、快照、旧代码都只看它），
+// 哈希索引只是加速结构，存放在一个不挂在任何目录下的隐藏文件 inode 中（Inode::dir_index）：
+//   第 0 块：DirIndexHeader
+//   第 1 块起：DirIndexSlot 数组（开放寻址、线性探测，容量为 2 的幂）
+// 索引文件的读写走 inode_read_data / inode_write_data，快照后的修改自动 COW。
+//
+// 头部记录索引覆盖的目录项数，与目录大小不一致时（例如崩溃在两次写之间）视为失效：
+// 查找退回线性扫描，下一次插入时重建。
+
+static const uint32_t DIR_INDEX_MAGIC = 0x58495844;  // 'DXIX'
+static const int DIR_INDEX_MIN_SLOTS = 256;           // 最少 2 块槽位
+static const int DIR_INDEX_SLOT_EMPTY = 0;
+static const int DIR_INDEX_SLOT_DELETED = -1;
+
+struct DirIndexHeader {
+    uint32_t magic;
+    int capacity;      // 槽位数（2 的幂）
+    int count;         // 有效槽位数
+    int deleted;       // 删除标记数
+    int entry_count;   // 索引覆盖的目录项数
+};
+
+struct DirIndexSlot {
+    uint32_t hash;
+    int entry;         // 目录项下标 + 1；0 = 空，-1 = 已删除
+};
+
+// 每块槽位数随块大小变化，这里是上限（栈上缓冲区用）
+static const int MAX_DIR_INDEX_SLOTS_PER_BLOCK = MAX_BLOCK_SIZE / sizeof(DirIndexSlot);
+
+// FNV-1a；只看实际存进 DirEntry 的部分（超长名字会被截断）
+static uint32_t dir_name_hash(const char* name) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < DIR_NAME_SIZE - 1 && name[i] != '\0'; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int slot_offset(int fd, int slot) {
+    return disk_block_size(fd) + slot * (int)sizeof(DirIndexSlot);
+}
+
+// 打开目录的索引：索引存在且与目录大小一致时返回 true
+static bool dir_index_open(int fd, const Inode* dir_inode, Inode* index_inode, DirIndexHeader* hdr) {
+    if (dir_inode->dir_index < 0) {
+        return false;
+    }
+    if (read_inode(fd, dir_inode->dir_index, index_inode) != 0 || index_inode->type != INODE_TYPE_FILE) {
+        return false;
+    }
+    if (inode_read_data(fd, index_inode, (char*)hdr, 0, sizeof(DirIndexHeader)) != (int)sizeof(DirIndexHeader)) {
+        return false;
+    }
+    int entry_count = dir_inode->size / sizeof(DirEntry);
+    return hdr->magic == DIR_INDEX_MAGIC && hdr->capacity >= DIR_INDEX_MIN_SLOTS &&
+           hdr->entry_count == entry_count;
+}
+
+// 读取目录项（带下标检查）
+static bool read_dir_entry(int fd, const Inode* dir_inode, int index, DirEntry* entry) {
+    return inode_read_data(fd, dir_inode, (char*)entry, index * sizeof(DirEntry), sizeof(DirEntry))
+           == (int)sizeof(DirEntry);
+}
+
+/**
+ * 在索引中探测名字
+ * @param want_entry >= 0 时只找指向该目录项的槽位（不读目录项比较名字）
+ * @param slot_out 找到的槽位号
+ * @param free_out 探测路径上第一个可用槽位（空或已删除），用于插入
+ * @param free_deleted 该可用槽位是否是删除标记（复用时删除数要减一）
+ * @return 目录项下标，-1 表示不存在
+ */
+static int dir_index_probe(int fd, const Inode* dir_inode, const Inode* index_inode,
+                           const DirIndexHeader& hdr, const char* name, int want_entry,
+                           int* slot_out, int* free_out, bool* free_deleted = nullptr) {
+    uint32_t hash = dir_name_hash(name);
+    int mask = hdr.capacity - 1;
+    int slot = (int)(hash & (uint32_t)mask);
+    if (free_out) *free_out = -1;
+
+    // 按块批量读取槽位，探测链一般只落在一两块内
+    DirIndexSlot batch[MAX_DIR_INDEX_SLOTS_PER_BLOCK];
+    const int slots_per_block = disk_block_size(fd) / (int)sizeof(DirIndexSlot);
+    int batch_start = -1;
+    for (int probes = 0; probes < hdr.capacity; probes++, slot = (slot + 1) & mask) {
+        if (batch_start < 0 || slot < batch_start || slot >= batch_start + slots_per_block) {
+            batch_start = slot - slot % slots_per_block;
+            int n = hdr.capacity - batch_start;
+            if (n > slots_per_block) n = slots_per_block;
+            int bytes = n * (int)sizeof(DirIndexSlot);
+            if (inode_read_data(fd, index_inode, (char*)batch, slot_offset(fd, batch_start), bytes) != bytes) {
+                return -1;
+            }
+        }
+
+        const DirIndexSlot& s = batch[slot - batch_start];
+        if (s.entry == DIR_INDEX_SLOT_EMPTY || s.entry == DIR_INDEX_SLOT_DELETED) {
+            if (free_out && *free_out < 0) {
+                *free_out = slot;
+                if (free_deleted) *free_deleted = (s.entry == DIR_INDEX_SLOT_DELETED);
+            }
+            if (s.entry == DIR_INDEX_SLOT_EMPTY) {
+                return -1;
+            }
+            continue;
+        }
+        if (s.hash != hash) {
+            continue;
+        }
+
+        int entry_index = s.entry - 1;
+        if (want_entry >= 0) {
+            if (entry_index == want_entry) {
+                if (slot_out) *slot_out = slot;
+                return entry_index;
+            }
+            continue;
+        }
+        DirEntry entry;
+        if (read_dir_entry(fd, dir_inode, entry_index, &entry) && strcmp(entry.name, name) == 0) {
+            if (slot_out) *slot_out = slot;
+            return entry_index;
+        }
+    }
+    return -1;
+}
+
+static bool dir_index_write_slot(int fd, Inode* index_inode, int index_inode_id, int slot,
+                                 uint32_t hash, int entry) {
+    DirIndexSlot s = {hash, entry};
+    JournalMetadataScope metadata_scope;
+    return inode_write_data(fd, index_inode, index_inode_id, (const char*)&s,
+                            slot_offset(fd, slot), sizeof(s)) == (int)sizeof(s);
+}
+
+static bool dir_index_write_header(int fd, Inode* index_inode, int index_inode_id, const DirIndexHeader& hdr) {
+    JournalMetadataScope metadata_scope;
+    return inode_write_data(fd, index_inode, index_inode_id, (const char*)&hdr,
+                            0, sizeof(hdr)) == (int)sizeof(hdr);
+}
+
+// 按目录当前内容（重新）建立索引；目录 inode 的 dir_index 可能被更新并写回
+static bool dir_index_build(int fd, Inode* dir_inode, int dir_inode_id) {
+    int entry_count = dir_inode->size / sizeof(DirEntry);
+
+    int capacity = DIR_INDEX_MIN_SLOTS;
+    while (capacity < entry_count * 2) {
+        capacity *= 2;
+    }
+    const int block_size = disk_block_size(fd);
+    const int slots_per_block = block_size / (int)sizeof(DirIndexSlot);
+    int blocks = 1 + (capacity + slots_per_block - 1) / slots_per_block;
+
+    // 一次读出全部目录项，在内存中填好槽位
+    vector<DirEntry> entries(entry_count);
+    if (entry_count > 0 &&
+        inode_read_data(fd, dir_inode, (char*)entries.data(), 0, entry_count * sizeof(DirEntry))
+            != entry_count * (int)sizeof(DirEntry)) {
+        return false;
+    }
+
+    vector<char> image((size_t)blocks * block_size, 0);
+    DirIndexHeader* hdr = (DirIndexHeader*)image.data();
+    hdr->magic = DIR_INDEX_MAGIC;
+    hdr->capacity = capacity;
+    hdr->count = entry_count;
+    hdr->deleted = 0;
+    hdr->entry_count = entry_count;
+    DirIndexSlot* slots = (DirIndexSlot*)(image.data() + block_size);
+    for (int i = 0; i < entry_count; i++) {
+        uint32_t hash = dir_name_hash(entries[i].name);
+        int slot = (int)(hash & (uint32_t)(capacity - 1));
+        while (slots[slot].entry != DIR_INDEX_SLOT_EMPTY) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        slots[slot].hash = hash;
+        slots[slot].entry = i + 1;
+    }
+
+    // 复用已有的索引 inode（旧内容整体覆盖），没有就新建一个
+    int index_inode_id = dir_inode->dir_index;
+    Inode index_inode;
+    bool reuse = index_inode_id >= 0 && read_inode(fd, index_inode_id, &index_inode) == 0 &&
+                 index_inode.type == INODE_TYPE_FILE;
+    if (!reuse) {
+        index_inode_id = alloc_inode(fd);
+        if (index_inode_id < 0) {
+            return false;
+        }
+        init_inode(&index_inode, INODE_TYPE_FILE);
+        write_inode(fd, index_inode_id, &index_inode);
+        dir_inode->dir_index = index_inode_id;
+        write_inode(fd, dir_inode_id, dir_inode);
+    }
+
+    int written;
+    {
+        JournalMetadataScope metadata_scope;
+        written = inode_write_data(fd, &index_inode, index_inode_id, image.data(), 0, (int)image.size());
+    }
+    if (written != (int)image.size()) {
+        // 写入不完整：让头部失效，查找退回线性扫描
+        DirIndexHeader bad = {};
+        dir_index_write_header(fd, &index_inode, index_inode_id, bad);
+        return false;
+    }
+    return true;
+}
+
+void dir_index_drop(int fd, Inode* dir_inode) {
+    if (dir_inode->dir_index < 0) {
+        return;
+    }
+    Inode index_inode;
+    if (read_inode(fd, dir_inode->dir_index, &index_inode) == 0 && index_inode.type == INODE_TYPE_FILE) {
+        inode_free_blocks(fd, &index_inode);
+        write_inode(fd, dir_inode->dir_index, &index_inode);
+        free_inode(fd, dir_inode->dir_index);
+    }
+    dir_inode->dir_index = -1;
+}
+
+// 新目录项已追加到下标 entry_index 之后维护索引
+static void dir_index_after_add(int fd, Inode* dir_inode, int dir_inode_id, const char* name, int entry_index) {
+    int entry_count = dir_inode->size / sizeof(DirEntry);
+    Inode index_inode;
+    DirIndexHeader hdr;
+
+    // 索引覆盖的是追加之前的内容：原地插入一个槽位
+    if (dir_inode->dir_index >= 0 &&
+        read_inode(fd, dir_inode->dir_index, &index_inode) == 0 &&
+        inode_read_data(fd, &index_inode, (char*)&hdr, 0, sizeof(hdr)) == (int)sizeof(hdr) &&
+        hdr.magic == DIR_INDEX_MAGIC && hdr.entry_count == entry_index &&
+        (hdr.count + hdr.deleted + 1) * 2 <= hdr.capacity) {
+        int free_slot = -1;
+        bool free_deleted = false;
+        Inode before = *dir_inode;
+        before.size = entry_index * sizeof(DirEntry);
+        dir_index_probe(fd, &before, &index_inode, hdr, name, -1, nullptr, &free_slot, &free_deleted);
+        if (free_slot >= 0 &&
+            dir_index_write_slot(fd, &index_inode, dir_inode->dir_index, free_slot,
+                                 dir_name_hash(name), entry_index + 1)) {
+            if (free_deleted) {
+                hdr.deleted--;
+            }
+            hdr.count++;
+            hdr.entry_count = entry_count;
+            if (dir_index_write_header(fd, &index_inode, dir_inode->dir_index, hdr)) {
+                return;
+            }
+        }
+    }
+
+    // 没有索引、索引失效或装载率过高：目录足够大时整体（重新）建立
+    if (entry_count >= DIR_INDEX_MIN_ENTRIES) {
+        dir_index_build(fd, dir_inode, dir_inode_id);
+    }
+}
+
+// ==================== 目录操作 ====================
+
 // 向目录中添加条目
 // 返回值：0 成功，-1 一般错误，-2 同名条目已存在，-3 写入失败
-int dir_add_entry(int fd, Inode* dir_inode, int dir_inode_id, 
+int dir_add_entry(int fd, Inode* dir_inode, int dir_inode_id,
                   const char* name, int inode_id) {
     if (dir_inode->type != INODE_TYPE_DIR) {
         fprintf(stderr, "[dir_add_entry] ERROR: not a directory (type=%d)\n", dir_inode->type);
         return -1;
     }
-    
+
     // 使用重试逻辑来处理可能的 COW 相关临时失败
     for (int retry = 0; retry < MAX_RETRY_COUNT; retry++) {
         // 第一步：重新读取最新的目录inode以获取最新的size（并发安全）
@@ -23,103 +294,119 @@ int dir_add_entry(int fd, Inode* dir_inode, int dir_inode_id,
             fprintf(stderr, "[dir_add_entry] ERROR: failed to read inode %d\n", dir_inode_id);
             return -1;
         }
-        
+
         // 验证 inode 类型
         if (fresh_dir_inode.type != INODE_TYPE_DIR) {
             fprintf(stderr, "[dir_add_entry] ERROR: fresh inode not a dir (type=%d)\n", fresh_dir_inode.type);
             return -1;
         }
-        
-        // 第二步：验证不存在同名条目（使用最新的inode）
+
+        // 第二步：验证不存在同名条目（使用最新的inode；有索引时只探测一条链）
         if (dir_find_entry(fd, &fresh_dir_inode, name) != -1) {
             fprintf(stderr, "[dir_add_entry] Entry '%s' already exists\n", name);
             return -2;  // 同名条目已存在
         }
-        
+
         // 创建新目录项
         DirEntry new_entry;
+        memset(&new_entry, 0, sizeof(new_entry));
         new_entry.inode_id = inode_id;
         strncpy(new_entry.name, name, DIR_NAME_SIZE - 1);
         new_entry.name[DIR_NAME_SIZE - 1] = '\0';
-        
+
         // 第三步：写入目录项（使用最新的inode）
         int entry_index = fresh_dir_inode.size / sizeof(DirEntry);
         int offset = entry_index * sizeof(DirEntry);
-        
-        fprintf(stderr, "[dir_add_entry] Writing '%s' to dir %d at offset %d (size before=%d)\n", 
-                name, dir_inode_id, offset, fresh_dir_inode.size);
-        
-        int result = inode_write_data(fd, &fresh_dir_inode, dir_inode_id, 
-                                      (const char*)&new_entry, 
+
+        int result = inode_write_data(fd, &fresh_dir_inode, dir_inode_id,
+                                      (const char*)&new_entry,
                                       offset, sizeof(DirEntry));
-        
-        fprintf(stderr, "[dir_add_entry] Write result: %d (expected %zu), size after=%d\n", 
-                result, sizeof(DirEntry), fresh_dir_inode.size);
-        
-        // 写入成功
+
+        // 写入成功：维护哈希索引（索引只是加速结构，失败时查找会退回线性扫描）
         if (result == (int)sizeof(DirEntry)) {
-            // 验证写入（使用更新后的inode）
-            fprintf(stderr, "[dir_add_entry] Before verify - entry_count=%d, offset=%d\n", 
-                    fresh_dir_inode.size / (int)sizeof(DirEntry), offset);
-            
-            // 尝试直接读取刚写入的数据
-            DirEntry verify_entry;
-            int read_result = inode_read_data(fd, &fresh_dir_inode, (char*)&verify_entry, offset, sizeof(DirEntry));
-            fprintf(stderr, "[dir_add_entry] Direct read at offset %d: result=%d, name='%s', inode_id=%d\n",
-                    offset, read_result, verify_entry.name, verify_entry.inode_id);
-            
-            int found = dir_find_entry(fd, &fresh_dir_inode, name);
-            fprintf(stderr, "[dir_add_entry] Verify: found=%d, fresh_size=%d\n", found, fresh_dir_inode.size);
-            
+            dir_index_after_add(fd, &fresh_dir_inode, dir_inode_id, new_entry.name, entry_index);
+            dcache_note_add(fd, dir_inode_id, new_entry.name, inode_id);
+
+            // 新 inode 的第一个数据块放在父目录附近（这条目录项所在的块之后）
+            if (inode_id != dir_inode_id && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+                int entry_block = -1;
+                extent_map(fd, &fresh_dir_inode, offset / disk_block_size(fd), 1, &entry_block);
+                allocator_set_goal(fd, inode_id, entry_block);
+            }
+
             // 更新调用者的inode
             *dir_inode = fresh_dir_inode;
             return 0;
         }
-        
+
         // 写入失败，检查是否因为并发修改导致需要重试
         // 重新读取 inode 检查 size 是否已被其他操作修改
         Inode check_inode;
         read_inode(fd, dir_inode_id, &check_inode);
-        
-        fprintf(stderr, "[dir_add_entry] Write failed, retry=%d, check_size=%d, fresh_size=%d\n", 
+
+        fprintf(stderr, "[dir_add_entry] Write failed, retry=%d, check_size=%d, fresh_size=%d\n",
                 retry, check_inode.size, fresh_dir_inode.size);
-        
+
         if (check_inode.size != fresh_dir_inode.size) {
             // size 已改变，说明有并发修改，重试
             continue;
         }
-        
+
         // 如果 size 没变但写入仍失败，可能是资源不足，不再重试
         break;
     }
-    
+
     fprintf(stderr, "[dir_add_entry] FAILED after retries for '%s'\n", name);
     return -3;  // 写入失败
 }
 
+// 线性查找目录项下标（每次读一整块目录项）
+static int dir_linear_find(int fd, const Inode* dir_inode, const char* name) {
+    int entry_count = dir_inode->size / sizeof(DirEntry);
+    DirEntry entries[MAX_DIRENT_PER_BLOCK];
+    const int dirent_per_block = disk_block_size(fd) / (int)sizeof(DirEntry);
+
+    for (int first = 0; first < entry_count; first += dirent_per_block) {
+        int n = entry_count - first;
+        if (n > dirent_per_block) n = dirent_per_block;
+        int bytes = inode_read_data(fd, dir_inode, (char*)entries, first * sizeof(DirEntry), n * sizeof(DirEntry));
+        n = bytes / sizeof(DirEntry);
+        for (int i = 0; i < n; i++) {
+            if (strcmp(entries[i].name, name) == 0) {
+                return first + i;
+            }
+        }
+    }
+    return -1;
+}
+
+// 查找目录项下标：有有效索引时走索引，否则线性扫描
+static int dir_find_index(int fd, const Inode* dir_inode, const char* name, DirEntry* entry) {
+    Inode index_inode;
+    DirIndexHeader hdr;
+    int index;
+    if (dir_index_open(fd, dir_inode, &index_inode, &hdr)) {
+        index = dir_index_probe(fd, dir_inode, &index_inode, hdr, name, -1, nullptr, nullptr);
+    } else {
+        index = dir_linear_find(fd, dir_inode, name);
+    }
+    if (index >= 0 && entry != nullptr && !read_dir_entry(fd, dir_inode, index, entry)) {
+        return -1;
+    }
+    return index;
+}
+
 // 在目录中查找条目
 int dir_find_entry(int fd, const Inode* dir_inode, const char* name) {
     if (dir_inode->type != INODE_TYPE_DIR) {
         return -1; // 不是目录
     }
-    
-    int entry_count = dir_inode->size / sizeof(DirEntry);
-    
-    for (int i = 0; i < entry_count; i++) {
-        DirEntry entry;
-        int offset = i * sizeof(DirEntry);
-        
-        if (inode_read_data(fd, dir_inode, (char*)&entry, offset, sizeof(DirEntry)) 
-            != sizeof(DirEntry)) {
-            continue;
-        }
-        
-        if (strcmp(entry.name, name) == 0) {
-            return entry.inode_id; // 返回找到的inode id
-        }
+
+    DirEntry entry;
+    if (dir_find_index(fd, dir_inode, name, &entry) < 0) {
+        return -1; // 未找到
     }
-    
-    return -1; // 未找到
+    return entry.inode_id; // 返回找到的inode id
 }
 
 // 获取目录中的第index个条目
@@ -127,15 +414,15 @@ int dir_get_entry(int fd, const Inode* dir_inode, int index, DirEntry* entry) {
     if (dir_inode->type != INODE_TYPE_DIR) {
         return -1; // 不是目录
     }
-    
+
     int entry_count = dir_inode->size / sizeof(DirEntry);
     if (index >= entry_count) {
         return -1; // 索引超出范围
     }
-    
+
     int offset = index * sizeof(DirEntry);
     int bytes_read = inode_read_data(fd, dir_inode, (char*)entry, offset, sizeof(DirEntry));
-    
+
     return (bytes_read == sizeof(DirEntry)) ? 0 : -1;
 }
 
@@ -144,53 +431,70 @@ int dir_remove_entry(int fd, Inode* dir_inode, int dir_inode_id, const char* nam
     if (dir_inode->type != INODE_TYPE_DIR) {
         return -1; // 不是目录
     }
-    
+
     int entry_count = dir_inode->size / sizeof(DirEntry);
-    int found_index = -1;
-    
-    // 查找要删除的条目
-    for (int i = 0; i < entry_count; i++) {
-        DirEntry entry;
-        int offset = i * sizeof(DirEntry);
-        
-        if (inode_read_data(fd, dir_inode, (char*)&entry, offset, sizeof(DirEntry)) 
-            != sizeof(DirEntry)) {
-            continue;
-        }
-        
-        if (strcmp(entry.name, name) == 0) {
-            found_index = i;
-            break;
-        }
+
+    // 查找要删除的条目（删除前先确认索引是否有效，删除后据此维护索引）
+    Inode index_inode;
+    DirIndexHeader hdr;
+    bool indexed = dir_index_open(fd, dir_inode, &index_inode, &hdr);
+    int removed_slot = -1;
+    int found_index;
+    if (indexed) {
+        found_index = dir_index_probe(fd, dir_inode, &index_inode, hdr, name, -1, &removed_slot, nullptr);
+    } else {
+        found_index = dir_linear_find(fd, dir_inode, name);
     }
-    
+
     if (found_index == -1) {
         return -1; // 条目不存在
     }
-    
+
     // 如果不是最后一个条目，需要用最后一个条目覆盖它
-    if (found_index < entry_count - 1) {
-        DirEntry last_entry;
-        int last_offset = (entry_count - 1) * sizeof(DirEntry);
-        
-        if (inode_read_data(fd, dir_inode, (char*)&last_entry, last_offset, sizeof(DirEntry)) 
-            != sizeof(DirEntry)) {
+    DirEntry last_entry;
+    bool moved = found_index < entry_count - 1;
+    if (moved) {
+        if (!read_dir_entry(fd, dir_inode, entry_count - 1, &last_entry)) {
             return -1;  // 读取失败
         }
-        
+
         int target_offset = found_index * sizeof(DirEntry);
-        int written = inode_write_data(fd, dir_inode, dir_inode_id, (char*)&last_entry, 
+        int written = inode_write_data(fd, dir_inode, dir_inode_id, (char*)&last_entry,
                                        target_offset, sizeof(DirEntry));
         if (written != sizeof(DirEntry)) {
             return -1;  // 写入失败，不修改目录大小
         }
     }
-    
+
     // 只有在成功写入后才缩小目录大小
     dir_inode->size -= sizeof(DirEntry);
-    
+
     // 写回inode
     write_inode(fd, dir_inode_id, dir_inode);
-    
+
+    // 维护索引：删除的槽位打删除标记，被搬动的最后一项改指向新下标
+    if (indexed) {
+        bool ok = dir_index_write_slot(fd, &index_inode, dir_inode->dir_index, removed_slot,
+                                       0, DIR_INDEX_SLOT_DELETED);
+        if (ok && moved) {
+            int moved_slot = -1;
+            Inode before = *dir_inode;
+            before.size = entry_count * sizeof(DirEntry);
+            ok = dir_index_probe(fd, &before, &index_inode, hdr, last_entry.name, entry_count - 1,
+                                 &moved_slot, nullptr) >= 0 &&
+                 dir_index_write_slot(fd, &index_inode, dir_inode->dir_index, moved_slot,
+                                      dir_name_hash(last_entry.name), found_index + 1);
+        }
+        if (ok) {
+            hdr.count--;
+            hdr.deleted++;
+            hdr.entry_count = entry_count - 1;
+            dir_index_write_header(fd, &index_inode, dir_inode->dir_index, hdr);
+        }
+        // 失败时头部的目录项数与目录大小不再一致，索引自动失效
+    }
+
+    // 目录内容已改变后再通知 dentry 缓存（之前取的快照插入的正条目都会失效）
+    dcache_note_remove(fd, dir_inode_id, name);
     return 0;
-}
\ No newline at end of file
+}
@@ -1,62 +1,211 @@
 // 在 disk.cpp 中添加以下实现
 #include "../include/disk.h"
 #include "../include/inode.h" 
+#include "../include/allocator.h"
+#include "../include/block_cache.h"
+#include "../include/block_device.h"
+#include "../include/bmap_cache.h"
+#include "../include/extent.h"
+#include "../include/dcache.h"
+#include "../include/journal.h"
+#include "../include/ref_table.h"
+#include "../include/reclaimer.h"
+#include "../include/snapshot_catalog.h"
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <climits>
 #include <cstring>
 #include <iostream>
 #include <cassert>
 #include <ctime>
 #include <vector>
+#include <string>
+#include <algorithm>
 #include <map>
 #include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+
+// 块位图按 64 位字处理（小端：第 i 位 = 字节 i/8 的第 i%8 位，与分配器一致），共 disk_mask_words 个字
+
+// 清掉掩码中元数据区（data_block_start 之前）的位
+static void mask_data_region(const DiskGeometry& g, uint64_t* words) {
+    for (int b = 0; b < g.data_block_start; b += 64) {
+        int n = std::min(64, g.data_block_start - b);
+        words[b / 64] &= n == 64 ? 0 : (~0ULL << n);
+    }
+}
+
+// 读出从 start 开始的 blocks 个位图块，按 64 位字返回前 nbits 位（之后的位清零）
+static std::vector<uint64_t> read_bitmap_region(int fd, int start, int blocks, int nbits) {
+    int block_size = disk_block_size(fd);
+    std::vector<uint64_t> words((size_t)blocks * block_size / sizeof(uint64_t), 0);
+    for (int i = 0; i < blocks; i++) {
+        read_block_cached(fd, start + i, (char*)words.data() + (size_t)i * block_size);
+    }
+    words.resize((nbits + 63) / 64);
+    if (nbits % 64 != 0) {
+        words.back() &= ~(~0ULL << (nbits % 64));
+    }
+    return words;
+}
 
 // 在 disk.cpp 文件中添加以下前向声明
 void check_and_repair_filesystem(int fd);
-void check_ref_count_consistency(int fd, const char* block_bitmap);
-static void format_disk_image(int fd);
+void check_ref_count_consistency(int fd, const uint64_t* block_bitmap);
+static void format_disk_image(int fd, const DiskGeometry& g);
+static void epochs_load(int fd);
+static void epochs_discard(int fd);
+static uint32_t collect_snapshot_blocks(int fd, int exclude_id, uint64_t* words,
+                                        std::vector<int>* metadata_blocks = nullptr);
+static void resume_snapshot_reclaim(int fd);
+static void collect_inode_blocks(int fd, const Inode* inode, std::vector<int>& blocks);
+static void count_inode_blocks(int fd, const Inode* inode, std::vector<int>& refs);
+
+// 每个已挂载磁盘最近一次 disk_open 的情况
+static std::mutex g_mount_info_mutex;
+static std::map<int, DiskMountInfo> g_mount_info;
+
+static uint64_t mount_clock_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 改写 superblock 的挂载状态（进入当前日志事务）
+// 挂载时写 DIRTY 后由 finish_mount 单独提交；关闭时写 CLEAN，和最后的元数据在同一个事务里
+static void set_mount_state(int fd, uint32_t state) {
+    Superblock sb;
+    read_superblock(fd, &sb);
+    if (sb.state == state) {
+        return;
+    }
+    sb.state = state;
+    write_superblock(fd, &sb);
+}
+
+// 挂载的最后一步：标记 DIRTY 并立即提交，记录挂载耗时
+// 文件数据不经日志、提交之前就可能写回原位置，所以 DIRTY 必须在接受任何写之前落盘，
+// 否则崩溃后磁盘上仍是 CLEAN，下次挂载会跳过一致性检查
+static int finish_mount(int fd, DiskMountInfo info, uint64_t start_ns) {
+    set_mount_state(fd, FS_STATE_DIRTY);
+    journal_commit(fd);
+    info.mount_ns = mount_clock_ns() - start_ns;
+
+    std::lock_guard<std::mutex> lock(g_mount_info_mutex);
+    g_mount_info[fd] = info;
+    return fd;
+}
+
+// 格式化并挂载：新磁盘，或者格式 / 版本不匹配的旧镜像（数据被清空）
+static int format_and_mount(int fd, const DiskGeometry& g, DiskMountInfo info, uint64_t start_ns) {
+    geometry_load(fd, &g);
+    format_disk_image(fd, g);
+    journal_load(fd);
+    ref_table_load(fd);
+    snapshot_catalog_load(fd);
+    allocator_load(fd);
+    epochs_load(fd);
+    info.formatted = 1;
+    return finish_mount(fd, info, start_ns);
+}
 
 // 修改disk_open函数 - 添加初始化检查
 int disk_open(const char* path) {
-    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    return disk_open_with(path, block_device_default_type());
+}
+
+int disk_open_with(const char* path, int device_type) {
+    uint64_t start_ns = mount_clock_ns();
+    int fd = block_device_open(path, device_type);
     if (fd < 0) {
-        perror("open disk");
         return -1;  // 返回错误而不是退出程序
     }
+
+    // 同号 fd 可能残留上一次未正常关闭的分配器状态和缓存块，直接丢弃
+    snapshot_reclaim_cancel(fd);
+    allocator_discard(fd);
+    ref_table_discard(fd);
+    snapshot_catalog_discard(fd);
+    journal_discard(fd);
+    block_cache_discard(fd);
+    bmap_cache_discard(fd);
+    dcache_invalidate(fd);
+    geometry_discard(fd);
+    
+    DiskMountInfo info{};
     
     // 检查文件系统是否已初始化
-    off_t file_size = lseek(fd, 0, SEEK_END);
-    lseek(fd, 0, SEEK_SET);
+    long long file_size = block_device_size(fd);
     
-    // 如果文件大小为0，说明是新磁盘：直接格式化
+    // 如果文件大小为0，说明是新磁盘：按默认布局格式化
+    DiskGeometry g;
     if (file_size == 0) {
-        format_disk_image(fd);
-        return fd;
+        disk_plan_geometry(DEFAULT_DISK_SIZE, DEFAULT_BLOCK_SIZE, 0, &g);
+        return format_and_mount(fd, g, info, start_ns);
     }
 
-    // 文件已存在：先读 superblock 判断格式/版本是否匹配
+    // 文件已存在：布局在 superblock 中，格式化之后不再改变，直接读磁盘上的 superblock 判断格式/版本是否匹配
+    // （superblock 总在前 MIN_BLOCK_SIZE 字节里，此时还不知道块大小）
+    char raw[MIN_BLOCK_SIZE];
     Superblock sb{};
-    read_superblock(fd, &sb);
+    if (block_device_read(fd, raw, MIN_BLOCK_SIZE, 0) == MIN_BLOCK_SIZE) {
+        memcpy(&sb, raw, sizeof(Superblock));
+    }
 
-    const bool basic_invalid = (sb.block_count <= 0 || sb.inode_count <= 0 || sb.block_size != BLOCK_SIZE);
     const bool version_mismatch =
         (sb.magic != FS_SUPERBLOCK_MAGIC) ||
         (sb.version != FS_VERSION) ||
         (sb.dirent_size != (uint32_t)sizeof(DirEntry));
+    const bool basic_invalid = version_mismatch || !disk_geometry_valid(&sb.geometry) ||
+        sb.block_size != sb.geometry.block_size || sb.block_count != sb.geometry.block_count ||
+        sb.inode_count != sb.geometry.inode_count ||
+        file_size < (long long)sb.geometry.block_count * sb.geometry.block_size;
 
-    // 若发现旧格式或明显损坏：重新格式化（清空旧数据）
-    if (basic_invalid || version_mismatch) {
+    // 若发现旧格式或明显损坏：按镜像文件现有的大小重新格式化（清空旧数据）
+    if (basic_invalid) {
         std::cout << "⚠ Detected incompatible or uninitialized filesystem image. Re-formatting disk..." << std::endl;
-        format_disk_image(fd);
-        return fd;
+        if (disk_plan_geometry(file_size, DEFAULT_BLOCK_SIZE, 0, &g) != 0) {
+            disk_plan_geometry(DEFAULT_DISK_SIZE, DEFAULT_BLOCK_SIZE, 0, &g);
+        }
+        return format_and_mount(fd, g, info, start_ns);
+    }
+
+    // 格式匹配：先重放日志中已提交的事务（上次没有正常关闭），再装入引用计数表和快照目录
+    // 上次正常关闭（CLEAN）时位图、计数和引用计数表一定一致，跳过检查；否则检查/修复
+    geometry_load(fd, &sb.geometry);
+    info.replayed = journal_recover(fd);
+    read_superblock(fd, &sb);
+    journal_load(fd);
+    ref_table_load(fd);
+    snapshot_catalog_load(fd);
+    if (sb.state != FS_STATE_CLEAN) {
+        check_and_repair_filesystem(fd);
+        info.checked = 1;
     }
 
-    // 格式匹配：再做一致性检查/修复
-    check_and_repair_filesystem(fd);
+    // 检查完成后把位图装入内存分配器
+    allocator_load(fd);
+    epochs_load(fd);
+    finish_mount(fd, info, start_ns);
+    
+    // 上次关闭前没有回收完的已删除快照：继续回收
+    resume_snapshot_reclaim(fd);
     
     return fd;
 }
 
+int disk_get_mount_info(int fd, DiskMountInfo* info) {
+    std::lock_guard<std::mutex> lock(g_mount_info_mutex);
+    auto it = g_mount_info.find(fd);
+    if (it == g_mount_info.end() || !info) {
+        return -1;
+    }
+    *info = it->second;
+    return 0;
+}
+
 // 修改check_and_repair_filesystem - 添加初始化检查
 void check_and_repair_filesystem(int fd) {
     std::cout << "检查文件系统一致性..." << std::endl;
@@ -66,23 +215,19 @@ void check_and_repair_filesystem(int fd) {
     
     // 检查superblock是否有效（检查标志位或一些已知值）
     // 简单方法：检查inode_count和block_count是否合理
-    if (sb.block_count <= 0 || sb.inode_count <= 0 || sb.block_size != BLOCK_SIZE ||
+    const DiskGeometry& g = *disk_geometry(fd);
+    if (sb.block_count <= 0 || sb.inode_count <= 0 || sb.block_size != g.block_size ||
         sb.magic != FS_SUPERBLOCK_MAGIC || sb.version != FS_VERSION) {
         std::cout << "⚠ 未初始化的文件系统，跳过一致性检查" << std::endl;
         return;
     }
     
-    // 1. 检查inode bitmap vs SB计数
-    char inode_bitmap[BLOCK_SIZE];
-    read_block(fd, INODE_BITMAP_BLOCK, inode_bitmap);
+    // 1. 检查inode bitmap vs SB计数（按 64 位字 popcount）
+    std::vector<uint64_t> inode_bitmap = read_bitmap_region(fd, g.inode_bitmap_start, g.inode_bitmap_blocks, g.inode_count);
     
-    int actual_free_inodes = 0;
-    for (int i = 0; i < BLOCK_SIZE * 8; i++) {
-        int byte_idx = i / 8;
-        int bit_idx = i % 8;
-        if (!(inode_bitmap[byte_idx] & (1 << bit_idx))) {
-            actual_free_inodes++;
-        }
+    int actual_free_inodes = g.inode_count;
+    for (uint64_t word : inode_bitmap) {
+        actual_free_inodes -= __builtin_popcountll(word);
     }
     
     // 只有在有明显差异时才修复（容差范围：差异不超过5）
@@ -99,19 +244,14 @@ void check_and_repair_filesystem(int fd) {
         std::cout << "✓ inode计数一致" << std::endl;
     }
     
-    // 2. 检查block bitmap vs SB计数
-    char block_bitmap[BLOCK_SIZE];
-    read_block(fd, BLOCK_BITMAP_BLOCK, block_bitmap);
+    // 2. 检查block bitmap vs SB计数（只数数据区，元数据区的位先清掉）
+    std::vector<uint64_t> block_bitmap = read_bitmap_region(fd, g.block_bitmap_start, g.block_bitmap_blocks, g.block_count);
     
-    int actual_free_blocks = 0;
-    int max_blocks = (BLOCK_SIZE * 8 < BLOCK_COUNT) ? BLOCK_SIZE * 8 : BLOCK_COUNT;
-    
-    for (int i = DATA_BLOCK_START; i < max_blocks; i++) {
-        int byte_idx = i / 8;
-        int bit_idx = i % 8;
-        if (!(block_bitmap[byte_idx] & (1 << bit_idx))) {
-            actual_free_blocks++;
-        }
+    std::vector<uint64_t> data_bits = block_bitmap;
+    mask_data_region(g, data_bits.data());
+    int actual_free_blocks = g.block_count - g.data_block_start;
+    for (uint64_t word : data_bits) {
+        actual_free_blocks -= __builtin_popcountll(word);
     }
     
     // 只有在有明显差异时才修复（容差范围：差异不超过5）
@@ -128,137 +268,202 @@ void check_and_repair_filesystem(int fd) {
         std::cout << "✓ block计数一致" << std::endl;
     }
     
-    // 3. 检查RefCount表一致性
-    check_ref_count_consistency(fd, block_bitmap);
+    // 3. 检查RefCount表一致性（内存中的引用计数表，挂载时已整体读入一次）
+    check_ref_count_consistency(fd, block_bitmap.data());
     
     std::cout << "一致性检查完成" << std::endl;
 }
 
 // 修改check_ref_count_consistency - 更精确的检查
-// 注意：只检查数据块（DATA_BLOCK_START之后），元数据块由系统管理
-void check_ref_count_consistency(int fd, const char* block_bitmap) {
-    int repairs = 0;
-    int issues = 0;
-    int max_blocks = (BLOCK_SIZE * 8 < BLOCK_COUNT) ? BLOCK_SIZE * 8 : BLOCK_COUNT;
-    
-    // 批量修复：先收集所有需要修复的块
-    std::vector<int> blocks_to_fix;
-    
-    // 只检查数据块区域（跳过元数据块）
-    for (int i = DATA_BLOCK_START; i < max_blocks; i++) {
-        int byte_idx = i / 8;
-        int bit_idx = i % 8;
-        
-        // 块已分配
-        if (block_bitmap[byte_idx] & (1 << bit_idx)) {
-            int ref_count = get_block_ref_count(fd, i);
-            
-            // 已分配的数据块ref_count应该 >= 1
-            if (ref_count <= 0) {
-                issues++;
-                blocks_to_fix.push_back(i);
-            }
-        } else {
-            // 块未分配，RefCount应该为0
-            int ref_count = get_block_ref_count(fd, i);
-            if (ref_count > 0) {
-                // 这种情况也需要修复：未分配的块不应该有引用计数
-                issues++;
-                // 直接清零，不需要加入修复列表
-                int ref_count_block_offset = i / BLOCK_SIZE;
-                int ref_count_index = i % BLOCK_SIZE;
-                if (ref_count_block_offset < REF_COUNT_TABLE_BLOCKS) {
-                    char ref_count_buf[BLOCK_SIZE];
-                    read_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
-                    ref_count_buf[ref_count_index] = 0;
-                    write_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
-                    repairs++;
-                    if (repairs <= 10) {
-                        std::cout << "修复块" << i << "的RefCount: " << ref_count << " → 0 (未分配)" << std::endl;
-                    }
-                }
-            }
-        }
+// 注意：只检查数据块（data_block_start之后），元数据块由系统管理
+// 整张表按位图掩码批量检查 / 修复，每个引用计数表块只读写一次
+void check_ref_count_consistency(int fd, const uint64_t* block_bitmap) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    const int words = disk_mask_words(&g);
+    std::vector<uint64_t> allocated(block_bitmap, block_bitmap + words);
+    std::vector<uint64_t> unallocated(words);
+    for (int w = 0; w < words; w++) {
+        unallocated[w] = ~allocated[w];
+    }
+    if (g.block_count % 64 != 0) {
+        unallocated[words - 1] &= ~(~0ULL << (g.block_count % 64));
+    }
+    mask_data_region(g, allocated.data());
+    mask_data_region(g, unallocated.data());
+    
+    // 已分配的数据块ref_count应该 >= 1
+    // 只属于快照的块（活跃文件系统已经不再引用）引用计数为 0，是正常状态
+    std::vector<uint64_t> snapshot_blocks(words);
+    collect_snapshot_blocks(fd, -1, snapshot_blocks.data());
+    for (int w = 0; w < words; w++) {
+        allocated[w] &= ~snapshot_blocks[w];
+    }
+    std::vector<uint64_t> missing(words);
+    int missing_count = ref_count_zero_mask(fd, allocated.data(), missing.data());
+    
+    // 块未分配，RefCount应该为0
+    std::vector<uint64_t> unallocated_zero(words);
+    std::vector<uint64_t> stray(words);
+    ref_count_zero_mask(fd, unallocated.data(), unallocated_zero.data());
+    int stray_count = 0;
+    for (int w = 0; w < words; w++) {
+        stray[w] = unallocated[w] & ~unallocated_zero[w];
+        stray_count += __builtin_popcountll(stray[w]);
     }
     
-    // 批量修复所有问题块
-    if (!blocks_to_fix.empty()) {
-        // 按RefCount表块分组，减少磁盘I/O
-        std::map<int, std::vector<int>> blocks_by_ref_table;
-        
-        for (int block_id : blocks_to_fix) {
-            int ref_count_block_offset = block_id / BLOCK_SIZE;
-            if (ref_count_block_offset < REF_COUNT_TABLE_BLOCKS) {
-                blocks_by_ref_table[ref_count_block_offset].push_back(block_id);
-            }
-        }
-        
-        // 逐个RefCount表块进行修复
-        for (auto& pair : blocks_by_ref_table) {
-            int ref_table_block = pair.first;
-            std::vector<int>& blocks = pair.second;
-            
-            char ref_count_buf[BLOCK_SIZE];
-            read_block(fd, REF_COUNT_TABLE_START + ref_table_block, ref_count_buf);
-            
-            for (int block_id : blocks) {
-                int ref_count_index = block_id % BLOCK_SIZE;
-                ref_count_buf[ref_count_index] = 1;
-                repairs++;
-                
-                // 只打印前10个修复信息，避免输出过多
-                if (repairs <= 10) {
-                    std::cout << "修复块" << block_id << "的RefCount: 0 → 1" << std::endl;
-                }
-            }
-            
-            write_block(fd, REF_COUNT_TABLE_START + ref_table_block, ref_count_buf);
+    if (missing_count == 0 && stray_count == 0) {
+        std::cout << "✓ RefCount一致性检查通过" << std::endl;
+        return;
+    }
+    
+    // 只打印前10个修复信息，避免输出过多
+    int printed = 0;
+    for (int w = 0; w < words && printed < 10; w++) {
+        for (uint64_t bits = stray[w]; bits != 0 && printed < 10; bits &= bits - 1, printed++) {
+            int b = w * 64 + __builtin_ctzll(bits);
+            std::cout << "修复块" << b << "的RefCount: " << get_block_ref_count(fd, b) << " → 0 (未分配)" << std::endl;
         }
-        
-        if (repairs > 10) {
-            std::cout << "✓ 共修复了 " << repairs << " 个RefCount问题" << std::endl;
-        } else if (repairs > 0) {
-            std::cout << "✓ 修复了 " << repairs << " 个引用计数问题" << std::endl;
+        for (uint64_t bits = missing[w]; bits != 0 && printed < 10; bits &= bits - 1, printed++) {
+            std::cout << "修复块" << w * 64 + __builtin_ctzll(bits) << "的RefCount: 0 → 1" << std::endl;
         }
+    }
+    
+    ref_count_clear_mask(fd, stray.data());
+    ref_count_add_mask(fd, missing.data(), 1);
+    
+    int repairs = missing_count + stray_count;
+    if (repairs > 10) {
+        std::cout << "✓ 共修复了 " << repairs << " 个RefCount问题" << std::endl;
     } else {
-        std::cout << "✓ RefCount一致性检查通过" << std::endl;
+        std::cout << "✓ 修复了 " << repairs << " 个引用计数问题" << std::endl;
     }
 }
 
 void disk_close(int fd) {
-    close(fd);
+    // 停止该磁盘上的后台回收（未完成的快照保持 DELETING，下次挂载时继续）
+    snapshot_reclaim_cancel(fd);
+
+    // 先提交进行中的修改：超过日志容量的事务要从分配器取暂存块
+    journal_commit(fd);
+
+    // 再把引用计数表和分配器中尚未写回的位图、计数写入块缓存（计数在位图之前）
+    ref_table_unload(fd);
+    allocator_unload(fd);
+
+    // 再写回块缓存中属于该 fd 的脏块；CLEAN 标记和最后的元数据一起提交，写回原位置后丢弃这些缓存块（fd 号之后可能被复用）
+    block_cache_flush(fd);
+    set_mount_state(fd, FS_STATE_CLEAN);
+    journal_unload(fd);
+    block_cache_discard(fd);
+    bmap_cache_discard(fd);
+    dcache_invalidate(fd);
+    epochs_discard(fd);
+    snapshot_catalog_discard(fd);
+    {
+        std::lock_guard<std::mutex> lock(g_mount_info_mutex);
+        g_mount_info.erase(fd);
+    }
+    geometry_discard(fd);
+    block_device_close(fd);
 }
 
+// 块读写都经过 fd 上登记的块设备后端（block_device.h）；没有登记的原始 fd 按 pread / pwrite 访问
 void read_block(int fd, int block_id, void* buf) {
-    off_t offset = (off_t)block_id * BLOCK_SIZE;
-    // 使用 pread 代替 lseek+read，确保线程安全
-    ssize_t bytes_read = pread(fd, buf, BLOCK_SIZE, offset);
-    if (bytes_read != BLOCK_SIZE) {
+    int block_size = disk_block_size(fd);
+    long long offset = (long long)block_id * block_size;
+    long long bytes_read = block_device_read(fd, buf, block_size, offset);
+    if (bytes_read != block_size) {
         // 读取失败，填充0
-        memset(buf, 0, BLOCK_SIZE);
+        memset(buf, 0, block_size);
+    }
+}
+
+void read_block_run(int fd, int start_block, int count, void* const* bufs) {
+#ifdef IOV_MAX
+    const int max_iov = IOV_MAX;
+#else
+    const int max_iov = 1024;
+#endif
+    int block_size = disk_block_size(fd);
+    PreadDevice raw(fd, false);
+    BlockDevice* device = block_device_get(fd);
+    if (!device) {
+        device = &raw;
+    }
+    int done = 0;
+    while (done < count) {
+        int n = std::min(count - done, max_iov);
+        std::vector<struct iovec> iov(n);
+        for (int i = 0; i < n; i++) {
+            iov[i].iov_base = bufs[done + i];
+            iov[i].iov_len = block_size;
+        }
+        
+        long long offset = (long long)(start_block + done) * block_size;
+        long long bytes_read = device->readv(iov.data(), n, offset);
+        int full = bytes_read > 0 ? (int)(bytes_read / block_size) : 0;
+        if (full == 0) {
+            // 读取失败（或不足一块）：这一块填充 0，继续读后面的块
+            memset(bufs[done], 0, block_size);
+            full = 1;
+        }
+        // 短读时只认完整的块，剩下的块下一轮重新读
+        done += full;
     }
 }
 
 void write_block(int fd, int block_id, const void* buf) {
-    off_t offset = (off_t)block_id * BLOCK_SIZE;
-    // 使用 pwrite 代替 lseek+write，确保线程安全
-    ssize_t bytes_written = pwrite(fd, buf, BLOCK_SIZE, offset);
-    if (bytes_written != BLOCK_SIZE) {
+    int block_size = disk_block_size(fd);
+    long long offset = (long long)block_id * block_size;
+    long long bytes_written = block_device_write(fd, buf, block_size, offset);
+    if (bytes_written != block_size) {
         // 写入失败，这是严重错误，但我们暂时不处理
         // 在生产环境中应该记录错误或抛出异常
     }
 }
 
+void write_block_run(int fd, int start_block, int count, const void* const* bufs) {
+#ifdef IOV_MAX
+    const int max_iov = IOV_MAX;
+#else
+    const int max_iov = 1024;
+#endif
+    int block_size = disk_block_size(fd);
+    PreadDevice raw(fd, false);
+    BlockDevice* device = block_device_get(fd);
+    if (!device) {
+        device = &raw;
+    }
+    int done = 0;
+    while (done < count) {
+        int n = std::min(count - done, max_iov);
+        std::vector<struct iovec> iov(n);
+        for (int i = 0; i < n; i++) {
+            iov[i].iov_base = const_cast<void*>(bufs[done + i]);
+            iov[i].iov_len = block_size;
+        }
+
+        long long offset = (long long)(start_block + done) * block_size;
+        long long bytes_written = device->writev(iov.data(), n, offset);
+        int full = bytes_written > 0 ? (int)(bytes_written / block_size) : 0;
+        if (full == 0) {
+            // 写入失败：与 write_block 一样不处理，跳过这一块
+            full = 1;
+        }
+        done += full;
+    }
+}
+
 // 读取数据块的一部分内容
 int read_data_block(int fd, int block_id, void* buf, int offset, int size) {
     // 参数检查
-    if (offset < 0 || size <= 0 || offset + size > BLOCK_SIZE) {
+    if (offset < 0 || size <= 0 || offset + size > disk_block_size(fd)) {
         return -1;
     }
     
-    // 读取整个块
-    char block_buf[BLOCK_SIZE];
-    read_block(fd, block_id, block_buf);
+    // 读取整个块（经过块缓存，写回模式下才能看到尚未落盘的数据）
+    char block_buf[MAX_BLOCK_SIZE];
+    read_block_cached(fd, block_id, block_buf);
     
     // 拷贝需要的数据
     memcpy(buf, block_buf + offset, size);
@@ -269,19 +474,19 @@ int read_data_block(int fd, int block_id, void* buf, int offset, int size) {
 // 写入数据块的一部分内容
 int write_data_block(int fd, int block_id, const void* data, int offset, int size) {
     // 参数检查
-    if (offset < 0 || size <= 0 || offset + size > BLOCK_SIZE) {
+    if (offset < 0 || size <= 0 || offset + size > disk_block_size(fd)) {
         return -1;
     }
     
     // 读取整个块
-    char block_buf[BLOCK_SIZE];
-    read_block(fd, block_id, block_buf);
+    char block_buf[MAX_BLOCK_SIZE];
+    read_block_cached(fd, block_id, block_buf);
     
     // 更新数据
     memcpy(block_buf + offset, data, size);
     
     // 写回整个块
-    write_block(fd, block_id, block_buf);
+    write_block_cached(fd, block_id, block_buf);
     
     return size;
 }
@@ -289,599 +494,1249 @@ int write_data_block(int fd, int block_id, const void* data, int offset, int siz
 // superblock相关逻辑
 // superblock读取
 void read_superblock(int fd, Superblock* sb) {
-    char buf[BLOCK_SIZE];
-    read_block(fd, SUPERBLOCK_BLOCK, buf);
+    char buf[MAX_BLOCK_SIZE];
+    read_block_cached(fd, SUPERBLOCK_BLOCK, buf);
     memcpy(sb, buf, sizeof(Superblock));
+
+    // 位图是惰性写回的，磁盘上的空闲计数可能落后，以内存分配器为准
+    allocator_get_free_counts(fd, &sb->free_inode_count, &sb->free_block_count);
 }
 
 // superblock写回
 void write_superblock(int fd, const Superblock* sb) {
-    char buf[BLOCK_SIZE];
-    memset(buf, 0, BLOCK_SIZE);
+    char buf[MAX_BLOCK_SIZE];
+    memset(buf, 0, sizeof(buf));
     memcpy(buf, sb, sizeof(Superblock));
-    write_block(fd, SUPERBLOCK_BLOCK, buf);
+    write_block_cached(fd, SUPERBLOCK_BLOCK, buf);
 }
 
-// 简化的 mkfs：用于在 disk_open 时自动初始化/升级磁盘镜像。
-// 注意：这会清空现有数据（对作业测试场景更友好，避免结构升级导致旧镜像无法读取）。
-static void format_disk_image(int fd) {
-    // 1) 扩展文件到完整大小并清零（ftruncate 不保证内容为 0，但后续会写关键元数据区域）
-    if (ftruncate(fd, DISK_SIZE) != 0) {
-        perror("ftruncate disk");
+// 格式化：按给定布局写出空文件系统（mkfs 和 disk_open 自动格式化共用，清空现有数据）
+// 直接写原始块：此时 fd 可能没有挂载，也不经过块缓存和日志
+static void format_disk_image(int fd, const DiskGeometry& g) {
+    const int bs = g.block_size;
+    auto put_block = [fd, bs](int block_id, const void* buf) {
+        if (block_device_write(fd, buf, bs, (long long)block_id * bs) != bs) {
+            perror("format disk");
+        }
+    };
+
+    // 1) 截断再扩展到完整大小：设备内容全部为 0（文件后端是稀疏文件，未写的块不占空间），
+    //    空的日志区、出生 epoch 表、快照目录和其余 inode 表都不必再写
+    if (block_device_resize(fd, 0) != 0 || block_device_resize(fd, (long long)g.block_count * bs) != 0) {
+        perror("resize disk");
         // 尝试继续执行
     }
 
-    char buf[BLOCK_SIZE];
+    std::vector<char> buf(bs);
 
     // ---- Superblock ----
     Superblock sb{};
-    sb.block_size = BLOCK_SIZE;
-    sb.block_count = BLOCK_COUNT;
-    sb.inode_count = BLOCK_SIZE * 8;
-    sb.free_inode_count = BLOCK_SIZE * 8 - 1;
-    sb.free_block_count = BLOCK_COUNT - DATA_BLOCK_START - 1;
+    sb.block_size = bs;
+    sb.block_count = g.block_count;
+    sb.inode_count = g.inode_count;
+    sb.free_inode_count = g.inode_count - 1;
+    sb.free_block_count = g.block_count - g.data_block_start - 1;
     sb.magic = FS_SUPERBLOCK_MAGIC;
     sb.version = FS_VERSION;
     sb.dirent_size = (uint32_t)sizeof(DirEntry);
-    sb.reserved = 0;
+    sb.received_epoch = 0;
+    sb.epoch = 1;
+    sb.snapshot_epoch = 0;
+    sb.state = FS_STATE_CLEAN;
+    sb.geometry = g;
+    memcpy(buf.data(), &sb, sizeof(sb));
+    put_block(SUPERBLOCK_BLOCK, buf.data());
 
-    memset(buf, 0, BLOCK_SIZE);
-    memcpy(buf, &sb, sizeof(sb));
-    write_block(fd, SUPERBLOCK_BLOCK, buf);
-
-    // ---- inode bitmap ----
-    memset(buf, 0, BLOCK_SIZE);
-    // inode 0 occupied
+    // ---- inode bitmap：inode 0（根目录）已占用 ----
+    std::fill(buf.begin(), buf.end(), 0);
     buf[0] |= 1;
-    write_block(fd, INODE_BITMAP_BLOCK, buf);
-
-    // ---- block bitmap ----
-    memset(buf, 0, BLOCK_SIZE);
-    // mark metadata blocks + root dir block as allocated
-    for (int i = 0; i < DATA_BLOCK_START + 1; i++) {  // +1 for root dir block
-        buf[i / 8] |= (1 << (i % 8));
-    }
-    write_block(fd, BLOCK_BITMAP_BLOCK, buf);
-
-    // ---- ref_count table ----
-    memset(buf, 0, BLOCK_SIZE);
-    for (int i = 0; i < REF_COUNT_TABLE_BLOCKS; i++) {
-        write_block(fd, REF_COUNT_TABLE_START + i, buf);
-    }
-    // 设置元数据块ref_count=1
-    for (int i = 0; i <= DATA_BLOCK_START; i++) {
-        int block_offset = i / BLOCK_SIZE;
-        int block_index = i % BLOCK_SIZE;
-        char ref_buf[BLOCK_SIZE];
-        read_block(fd, REF_COUNT_TABLE_START + block_offset, ref_buf);
-        ref_buf[block_index] = 1;
-        write_block(fd, REF_COUNT_TABLE_START + block_offset, ref_buf);
-    }
+    put_block(g.inode_bitmap_start, buf.data());
 
-    // ---- inode table ----
-    memset(buf, 0, BLOCK_SIZE);
-    for (int i = 0; i < INODE_TABLE_BLOCK_COUNT; i++) {
-        write_block(fd, INODE_TABLE_START + i, buf);
+    // ---- block bitmap：元数据块 + 根目录块 [0, data_block_start] 已占用 ----
+    const int used = g.data_block_start + 1;
+    const int bits_per_block = bs * 8;
+    for (int k = 0; k * bits_per_block < used; k++) {
+        std::fill(buf.begin(), buf.end(), 0);
+        for (int i = k * bits_per_block; i < used && i < (k + 1) * bits_per_block; i++) {
+            int bit = i - k * bits_per_block;
+            buf[bit / 8] |= (char)(1 << (bit % 8));
+        }
+        put_block(g.block_bitmap_start + k, buf.data());
     }
 
-    // ---- snapshot table ----
-    memset(buf, 0, BLOCK_SIZE);
-    for (int i = 0; i < SNAPSHOT_TABLE_BLOCKS; i++) {
-        write_block(fd, SNAPSHOT_TABLE_START + i, buf);
+    // ---- ref_count table：同一批块 ref_count=1 ----
+    for (int k = 0; k * bs < used; k++) {
+        std::fill(buf.begin(), buf.end(), 0);
+        for (int i = k * bs; i < used && i < (k + 1) * bs; i++) {
+            buf[i - k * bs] = 1;
+        }
+        put_block(g.ref_count_start + k, buf.data());
     }
 
-    // ---- root inode ----
+    // ---- root inode（inode 表第一块的第一项）----
+    std::fill(buf.begin(), buf.end(), 0);
     Inode root_inode;
     init_inode(&root_inode, INODE_TYPE_DIR);
-    root_inode.direct_blocks[0] = DATA_BLOCK_START;
-    write_inode(fd, 0, &root_inode);
+    root_inode.extents[0] = Extent{0, g.data_block_start, 1};
+    root_inode.extent_count = 1;
+    memcpy(buf.data(), &root_inode, sizeof(Inode));
+    put_block(g.inode_table_start, buf.data());
 
-    // write back SB again (consistent counts)
-    memset(buf, 0, BLOCK_SIZE);
-    memcpy(buf, &sb, sizeof(sb));
-    write_block(fd, SUPERBLOCK_BLOCK, buf);
+    std::cout << "✓ disk image formatted, version=" << sb.version
+              << ", dirent_size=" << sb.dirent_size << ", block_size=" << bs
+              << ", blocks=" << g.block_count << ", inodes=" << g.inode_count << std::endl;
+}
 
-    std::cout << "✓ disk image formatted (auto-mkfs), version=" << sb.version
-              << ", dirent_size=" << sb.dirent_size << std::endl;
+int disk_format(const char* path, const DiskGeometry* geometry) {
+    if (!path || !disk_geometry_valid(geometry)) {
+        return -1;
+    }
+    int fd = block_device_open(path, block_device_default_type());
+    if (fd < 0) {
+        return -1;
+    }
+    format_disk_image(fd, *geometry);
+    int result = block_device_flush(fd);
+    block_device_close(fd);
+    return result;
 }
 
 // 分配一个 inode
-// 修改后的 alloc_inode
+// 位图和空闲计数由内存分配器维护，惰性写回（见 allocator.h）
 int alloc_inode(int fd) {
-    char buf[BLOCK_SIZE];
-    read_block(fd, INODE_BITMAP_BLOCK, buf);
-    
-    // 查找第一个为0的位（空闲inode）
-    for (int i = 0; i < BLOCK_SIZE * 8; i++) {
-        int byte_index = i / 8;
-        int bit_index = i % 8;
-        
-        if (!(buf[byte_index] & (1 << bit_index))) {
-            // 第一步：标记bitmap为已使用（关键操作1）
-            buf[byte_index] |= (1 << bit_index);
-            write_block(fd, INODE_BITMAP_BLOCK, buf);
-            
-            // 第二步：更新superblock中的空闲inode计数（关键操作2 - 提交点）
-            Superblock sb;
-            read_superblock(fd, &sb);
-            sb.free_inode_count--;
-            write_superblock(fd, &sb);
-            
-            // 原子性保证：SB是最后一个改动的关键元数据
-            // 如果crash，启动时检查可以修正不一致
-            
-            return i;
-        }
-    }
-    
-    return -1;
+    return allocator_alloc_inode(fd);
 }
 
 // 释放一个 inode
 void free_inode(int fd, int inode_id) {
-    char buf[BLOCK_SIZE];
-    read_block(fd, INODE_BITMAP_BLOCK, buf);
-    
-    int byte_index = inode_id / 8;
-    int bit_index = inode_id % 8;
-    
-    // 第一步：标记为未使用（关键操作1）
-    buf[byte_index] &= ~(1 << bit_index);
-    write_block(fd, INODE_BITMAP_BLOCK, buf);
-    
-    // 第二步：更新superblock中的空闲inode计数（关键操作2 - 提交点）
+    allocator_free_inode(fd, inode_id);
+}
+
+// ==================== 快照 epoch ====================
+//
+// 每个块记录分配时的 epoch（出生 epoch），superblock 记录当前 epoch 和最新快照的 epoch。
+// 创建快照只是把当前 epoch 记为快照 epoch 再加一：此前出生且仍在使用的块都属于这个快照，
+// 之后出生的块都不属于任何快照。写入时出生 epoch 不大于最新快照 epoch 的块需要 COW，
+// 引用计数只统计活跃文件系统内的引用，创建快照不再逐块修改。
+
+// superblock 中两个 epoch 的内存副本：每次分配和 COW 判断都要用，不必每次读 superblock
+struct SnapshotEpochs {
+    uint32_t epoch;
+    uint32_t snapshot_epoch;
+};
+static std::shared_mutex g_epochs_mutex;
+static std::map<int, SnapshotEpochs> g_epochs;
+
+static SnapshotEpochs read_epochs_from_superblock(int fd) {
+    char buf[MAX_BLOCK_SIZE];
+    read_block_cached(fd, SUPERBLOCK_BLOCK, buf);
     Superblock sb;
-    read_superblock(fd, &sb);
-    sb.free_inode_count++;
-    write_superblock(fd, &sb);
+    memcpy(&sb, buf, sizeof(Superblock));
+    return SnapshotEpochs{sb.epoch, sb.snapshot_epoch};
 }
 
-int alloc_block(int fd) {
-    char buf[BLOCK_SIZE];
-    read_block(fd, BLOCK_BITMAP_BLOCK, buf);
+static void epochs_load(int fd) {
+    SnapshotEpochs epochs = read_epochs_from_superblock(fd);
+    std::unique_lock<std::shared_mutex> lock(g_epochs_mutex);
+    g_epochs[fd] = epochs;
+}
+
+static void epochs_discard(int fd) {
+    std::unique_lock<std::shared_mutex> lock(g_epochs_mutex);
+    g_epochs.erase(fd);
+}
+
+static SnapshotEpochs epochs_get(int fd) {
+    {
+        std::shared_lock<std::shared_mutex> lock(g_epochs_mutex);
+        auto it = g_epochs.find(fd);
+        if (it != g_epochs.end()) {
+            return it->second;
+        }
+    }
+    // 尚未加载（disk_open 完成之前）：直接读 superblock
+    return read_epochs_from_superblock(fd);
+}
+
+// 更新内存副本并写入 superblock
+// 只在创建 / 删除快照时调用，调用者保证期间没有并发的分配（分配器写回计数时也会读-改-写 superblock）
+static void epochs_set(int fd, const SnapshotEpochs& epochs) {
+    {
+        std::unique_lock<std::shared_mutex> lock(g_epochs_mutex);
+        g_epochs[fd] = epochs;
+    }
+    char buf[MAX_BLOCK_SIZE];
+    read_block_cached(fd, SUPERBLOCK_BLOCK, buf);
+    Superblock sb;
+    memcpy(&sb, buf, sizeof(Superblock));
+    sb.epoch = epochs.epoch;
+    sb.snapshot_epoch = epochs.snapshot_epoch;
+    memcpy(buf, &sb, sizeof(Superblock));
+    write_block_cached(fd, SUPERBLOCK_BLOCK, buf);
+}
+
+// 引用计数和出生 epoch 都在内存表中读写（见 ref_table.h），随分配器的写回落盘
+static uint32_t get_block_birth(int fd, int block_id) {
+    return ref_table_birth(fd, block_id);
+}
+
+static void set_block_birth(int fd, int block_id, uint32_t epoch) {
+    ref_table_set_birth(fd, block_id, epoch);
+}
+
+static void set_block_birth_mask(int fd, const uint64_t* mask, uint32_t epoch) {
+    ref_table_set_birth_mask(fd, mask, epoch);
+}
+
+// 块是否可能被快照共享：出生 epoch 不晚于最新快照
+static bool block_in_snapshot(int fd, int block_id) {
+    SnapshotEpochs epochs = epochs_get(fd);
+    return epochs.snapshot_epoch != 0 && get_block_birth(fd, block_id) <= epochs.snapshot_epoch;
+}
+
+// 快照表的修改（创建 / 恢复 / 删除）和后台回收的每一步互斥（独占）
+// 前台读写不需要这把锁：回收只释放活跃文件系统已不再引用的块
+// 只读快照视图持有共享锁：读取期间快照的块不会被回收
+static std::shared_mutex g_snapshot_mutex;
+
+// ==================== 快照副本 ====================
+//
+// 快照的位图 / inode 表副本按段顺序排成 copy_blocks 个块（各段含义见 SNAPSHOT_SCOPE_FULL / SUBTREE），
+// 副本块号依次记在 map_blocks 指向的块号表里
+
+// 三段各自的块数
+static void snapshot_section_blocks(const DiskGeometry& g, const Snapshot& snapshot, int counts[3]) {
+    if (snapshot.scope == SNAPSHOT_SCOPE_SUBTREE) {
+        int ids_per_block = g.block_size / (int)sizeof(int);
+        int inodes_per_block = g.block_size / (int)sizeof(Inode);
+        counts[0] = (snapshot.total_inodes_used + ids_per_block - 1) / ids_per_block;
+        counts[1] = (snapshot.total_blocks_used + ids_per_block - 1) / ids_per_block;
+        counts[2] = (snapshot.total_inodes_used + inodes_per_block - 1) / inodes_per_block;
+    } else {
+        counts[0] = g.inode_bitmap_blocks;
+        counts[1] = g.block_bitmap_blocks;
+        counts[2] = g.inode_table_blocks;
+    }
+}
+
+// 全部副本块号（按顺序，读块号表）
+static std::vector<int> snapshot_copy_blocks(int fd, const Snapshot& snapshot) {
+    const int per_map = disk_block_size(fd) / (int)sizeof(int);
+    std::vector<int> copies;
+    int ids[MAX_BLOCK_SIZE / sizeof(int)];
+    for (int m = 0; m < SNAPSHOT_MAP_BLOCKS && (int)copies.size() < snapshot.copy_blocks; m++) {
+        if (snapshot.map_blocks[m] <= 0) {
+            break;
+        }
+        read_block_cached(fd, snapshot.map_blocks[m], ids);
+        for (int j = 0; j < per_map && (int)copies.size() < snapshot.copy_blocks; j++) {
+            copies.push_back(ids[j]);
+        }
+    }
+    return copies;
+}
+
+// 第 section 段第 index 块的块号（只读一个块号表块）；不存在时返回 0
+static int snapshot_copy_block(int fd, const Snapshot& snapshot, int section, int index) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    int counts[3];
+    snapshot_section_blocks(g, snapshot, counts);
+    if (index < 0 || index >= counts[section]) {
+        return 0;
+    }
+    int k = index;
+    for (int i = 0; i < section; i++) {
+        k += counts[i];
+    }
+    const int per_map = g.block_size / (int)sizeof(int);
+    if (k >= snapshot.copy_blocks || k / per_map >= SNAPSHOT_MAP_BLOCKS || snapshot.map_blocks[k / per_map] <= 0) {
+        return 0;
+    }
+    int ids[MAX_BLOCK_SIZE / sizeof(int)];
+    read_block_cached(fd, snapshot.map_blocks[k / per_map], ids);
+    return ids[k % per_map];
+}
+
+// 按 snapshot 的范围（和子树大小）分配副本块和块号表，写出块号表，填好 map_blocks / copy_blocks
+// 失败时已分配的块全部释放
+static bool alloc_snapshot_copies(int fd, Snapshot* snapshot, std::vector<int>& copies) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    int counts[3];
+    snapshot_section_blocks(g, *snapshot, counts);
+    const int total = counts[0] + counts[1] + counts[2];
+    const int per_map = g.block_size / (int)sizeof(int);
+    const int map_count = (total + per_map - 1) / per_map;
+    if (map_count > SNAPSHOT_MAP_BLOCKS) {
+        return false;
+    }
     
-    int max_blocks = (BLOCK_SIZE * 8 < BLOCK_COUNT) ? BLOCK_SIZE * 8 : BLOCK_COUNT;
-    for (int i = 0; i < max_blocks; i++) {
-        int byte_index = i / 8;
-        int bit_index = i % 8;
-        
-        if (!(buf[byte_index] & (1 << bit_index))) {
-            // 第一步：标记bitmap为已分配
-            buf[byte_index] |= (1 << bit_index);
-            write_block(fd, BLOCK_BITMAP_BLOCK, buf);
-            
-            // 第二步：初始化引用计数为1
-            int ref_count_block_offset = i / BLOCK_SIZE;
-            int ref_count_index = i % BLOCK_SIZE;
-            
-            if (ref_count_block_offset < REF_COUNT_TABLE_BLOCKS) {
-                char ref_count_buf[BLOCK_SIZE];
-                read_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
-                ref_count_buf[ref_count_index] = 1;
-                write_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
+    std::vector<int> allocated;
+    for (int i = 0; i < total + map_count; i++) {
+        int b = alloc_block(fd);
+        if (b == -1) {
+            for (int a : allocated) {
+                free_block(fd, a);
             }
-            
-            // 第三步：更新superblock（提交点）
-            Superblock sb;
-            read_superblock(fd, &sb);
-            sb.free_block_count--;
-            write_superblock(fd, &sb);
-            
-            return i;
+            return false;
+        }
+        allocated.push_back(b);
+    }
+    copies.assign(allocated.begin(), allocated.begin() + total);
+    
+    memset(snapshot->map_blocks, 0, sizeof(snapshot->map_blocks));
+    for (int m = 0; m < map_count; m++) {
+        int ids[MAX_BLOCK_SIZE / sizeof(int)];
+        memset(ids, 0, sizeof(ids));
+        for (int j = 0; j < per_map && m * per_map + j < total; j++) {
+            ids[j] = copies[m * per_map + j];
         }
+        snapshot->map_blocks[m] = allocated[total + m];
+        write_block_cached(fd, snapshot->map_blocks[m], ids);
     }
-    return -1;
+    snapshot->copy_blocks = total;
+    return true;
 }
 
-// 修改free_block函数
-// 注意：此函数处理引用计数并在必要时释放块
-// 支持防御性调用（即使块已经释放也不会出错）
-void free_block(int fd, int block_id) {
-    char buf[BLOCK_SIZE];
-    read_block(fd, BLOCK_BITMAP_BLOCK, buf);
-    
-    // 检查块是否已经释放
-    int byte_index = block_id / 8;
-    int bit_index = block_id % 8;
-    bool already_free = !(buf[byte_index] & (1 << bit_index));
-    
-    // 如果块已经释放，直接返回（防御性编程）
-    if (already_free) {
-        return;
+// 释放副本块和块号表
+static void free_snapshot_copies(int fd, const Snapshot& snapshot) {
+    for (int b : snapshot_copy_blocks(fd, snapshot)) {
+        if (b > 0) {
+            free_block(fd, b);
+        }
     }
+    for (int m = 0; m < SNAPSHOT_MAP_BLOCKS; m++) {
+        if (snapshot.map_blocks[m] > 0) {
+            free_block(fd, snapshot.map_blocks[m]);
+        }
+    }
+}
+
+// 读 / 写一段副本：buf 为该段块数 × 块大小字节
+static void read_copy_section(int fd, const Snapshot& snapshot, const std::vector<int>& copies, int section, void* buf) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    int counts[3];
+    snapshot_section_blocks(g, snapshot, counts);
+    int first = section == 0 ? 0 : (section == 1 ? counts[0] : counts[0] + counts[1]);
+    for (int i = 0; i < counts[section]; i++) {
+        char* dst = (char*)buf + (size_t)i * g.block_size;
+        if (first + i < (int)copies.size() && copies[first + i] > 0) {
+            read_block_cached(fd, copies[first + i], dst);
+        } else {
+            memset(dst, 0, g.block_size);
+        }
+    }
+}
+
+static void write_copy_section(int fd, const Snapshot& snapshot, const std::vector<int>& copies, int section, const void* buf) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    int counts[3];
+    snapshot_section_blocks(g, snapshot, counts);
+    int first = section == 0 ? 0 : (section == 1 ? counts[0] : counts[0] + counts[1]);
+    for (int i = 0; i < counts[section] && first + i < (int)copies.size(); i++) {
+        write_block_cached(fd, copies[first + i], (const char*)buf + (size_t)i * g.block_size);
+    }
+}
+
+// 子树快照钉住的块（第二段，按块号升序，共 total_blocks_used 个）
+static std::vector<int> read_snapshot_pinned_blocks(int fd, const Snapshot& snapshot,
+                                                    const std::vector<int>& copies) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    int counts[3];
+    snapshot_section_blocks(g, snapshot, counts);
+    std::vector<int> pinned((size_t)counts[1] * g.block_size / sizeof(int));
+    read_copy_section(fd, snapshot, copies, 1, pinned.data());
+    pinned.resize(snapshot.total_blocks_used);
+    return pinned;
+}
+
+// 快照保存的块位图（第二段；子树快照由钉住的块号列表展开），按 64 位字返回 disk_mask_words 个字
+static std::vector<uint64_t> read_snapshot_block_bitmap(int fd, const Snapshot& snapshot,
+                                                        const std::vector<int>& copies) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    if (snapshot.scope == SNAPSHOT_SCOPE_SUBTREE) {
+        std::vector<uint64_t> words(disk_mask_words(&g), 0);
+        for (int b : read_snapshot_pinned_blocks(fd, snapshot, copies)) {
+            if (b >= g.data_block_start && b < g.block_count) {
+                words[b / 64] |= 1ULL << (b % 64);
+            }
+        }
+        return words;
+    }
+    std::vector<uint64_t> words((size_t)g.block_bitmap_blocks * g.block_size / sizeof(uint64_t), 0);
+    read_copy_section(fd, snapshot, copies, 1, words.data());
+    words.resize(disk_mask_words(&g));
+    if (g.block_count % 64 != 0) {
+        words.back() &= ~(~0ULL << (g.block_count % 64));
+    }
+    return words;
+}
+
+// 快照占用的块：各自保存的块位图，加上快照自身的副本块和块号表（metadata_blocks）
+// 包括尚未回收完的 DELETING 快照（它们的块在回收之前仍然有效）；快照目录的表项块也算作元数据块
+// words 为 disk_mask_words 个字；exclude_id >= 0 时跳过该快照；返回其余激活快照中最大的 epoch（没有快照时为 0）
+static uint32_t collect_snapshot_blocks(int fd, int exclude_id, uint64_t* words,
+                                        std::vector<int>* metadata_blocks) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    const int mask_words = disk_mask_words(&g);
+    memset(words, 0, (size_t)mask_words * sizeof(uint64_t));
+    uint32_t max_epoch = 0;
+    
+    auto mark_metadata = [&](int b) {
+        if (b > 0 && b < g.block_count) {
+            words[b / 64] |= 1ULL << (b % 64);
+            if (metadata_blocks != nullptr) {
+                metadata_blocks->push_back(b);
+            }
+        }
+    };
     
-    // 计算引用计数位置
-    int ref_count_block_offset = block_id / BLOCK_SIZE;
-    int ref_count_index = block_id % BLOCK_SIZE;
-    
-    // 检查当前引用计数
-    int current_ref_count = 0;
-    if (ref_count_block_offset < REF_COUNT_TABLE_BLOCKS) {
-        char ref_count_buf[BLOCK_SIZE];
-        read_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
-        current_ref_count = ref_count_buf[ref_count_index];
+    for (const Snapshot& snap : snapshot_catalog_entries(fd, SNAPSHOT_STATE_ANY)) {
+        if (snap.id == exclude_id) {
+            continue;
+        }
+        
+        std::vector<int> copies = snapshot_copy_blocks(fd, snap);
+        std::vector<uint64_t> bitmap = read_snapshot_block_bitmap(fd, snap, copies);
+        for (int w = 0; w < mask_words; w++) {
+            words[w] |= bitmap[w];
+        }
         
-        // 如果引用计数 > 1，只减少计数不真正释放
-        if (current_ref_count > 1) {
-            ref_count_buf[ref_count_index]--;
-            write_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
-            return;
+        for (int b : copies) {
+            mark_metadata(b);
+        }
+        for (int b : snap.map_blocks) {
+            mark_metadata(b);
         }
         
-        // 如果引用计数 == 1 或 0，清零
-        ref_count_buf[ref_count_index] = 0;
-        write_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
+        if (snap.active == SNAPSHOT_ACTIVE) {
+            max_epoch = std::max(max_epoch, snap.epoch);
+        }
     }
     
-    // 标记bitmap为未使用
-    buf[byte_index] &= ~(1 << bit_index);
-    write_block(fd, BLOCK_BITMAP_BLOCK, buf);
-    
-    // 更新superblock（提交点）
-    Superblock sb;
-    read_superblock(fd, &sb);
-    sb.free_block_count++;
-    write_superblock(fd, &sb);
+    std::vector<uint64_t> catalog_blocks(mask_words, 0);
+    snapshot_catalog_mark_blocks(fd, catalog_blocks.data());
+    for (int w = 0; w < mask_words; w++) {
+        words[w] |= catalog_blocks[w];
+        for (uint64_t bits = catalog_blocks[w]; bits != 0 && metadata_blocks != nullptr; bits &= bits - 1) {
+            metadata_blocks->push_back(w * 64 + __builtin_ctzll(bits));
+        }
+    }
+    return max_epoch;
+}
+
+// 激活快照中最大的 epoch（只遍历内存中的快照目录，不读各快照的位图）
+static uint32_t latest_snapshot_epoch(int fd) {
+    uint32_t max_epoch = 0;
+    for (const Snapshot& snap : snapshot_catalog_entries(fd, SNAPSHOT_ACTIVE)) {
+        max_epoch = std::max(max_epoch, snap.epoch);
+    }
+    return max_epoch;
+}
+
+// 读取一个快照表项；槽位不存在时返回 false
+static bool read_snapshot_entry(int fd, int snapshot_id, Snapshot* snapshot) {
+    return snapshot_catalog_get(fd, snapshot_id, snapshot) == 0;
+}
+
+// 修改一个快照表项的状态
+static void set_snapshot_state(int fd, int snapshot_id, int state) {
+    Snapshot snapshot;
+    if (read_snapshot_entry(fd, snapshot_id, &snapshot)) {
+        snapshot.active = state;
+        snapshot_catalog_put(fd, &snapshot);
+    }
+}
+
+int alloc_block(int fd) {
+    return alloc_block_goal(fd, -1, -1);
+}
+
+int alloc_block_goal(int fd, int goal, int owner) {
+    // 第一步：在内存位图中分配（就近查找，不做磁盘 I/O），引用计数在分配器锁内置为 1
+    int block_id = allocator_alloc_block_goal(fd, goal, owner);
+
+    // 空闲块都在暂缓复用（释放它们的事务还没提交，或日志里还有它们的映像）：提交、再不够就检查点，然后重试
+    // 持有日志句柄时不能提交，直接报告空间不足
+    if (block_id < 0 && !journal_in_handle() && allocator_held_blocks(fd) > 0) {
+        journal_commit(fd);
+        block_id = allocator_alloc_block_goal(fd, goal, owner);
+        if (block_id < 0 && allocator_held_blocks(fd) > 0) {
+            journal_checkpoint(fd);
+            block_id = allocator_alloc_block_goal(fd, goal, owner);
+        }
+    }
+    if (block_id < 0) {
+        return -1;
+    }
+
+    // 第二步：记录出生 epoch（块号被复用时覆盖上一次的值）
+    set_block_birth(fd, block_id, epochs_get(fd).epoch);
+
+    return block_id;
+}
+
+// 修改free_block函数
+// 注意：此函数处理引用计数并在必要时释放块
+// 支持防御性调用（即使块已经释放也不会出错）
+void free_block(int fd, int block_id) {
+    // 引用计数 > 1 时只减少计数不真正释放；== 1 或 0 时清零并标记内存位图为未使用
+    // （计数随位图一起惰性写回）。检查、递减和释放在分配器锁内一次完成：
+    // 后台回收线程会同时释放计数为 0 的块，分两步做可能把已经被重新分配的块再释放一次
+    // 块已经释放时直接返回（防御性编程）
+    allocator_release_block(fd, block_id);
 }
 
 
 int create_snapshot(int fd, const char* name) {
+    std::lock_guard<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
+    JournalTransaction txn(fd);  // 整个快照是一个操作，返回时提交
+    const DiskGeometry& g = *disk_geometry(fd);
+    
     Superblock current_sb;
     read_superblock(fd, &current_sb);
     
+    Snapshot new_snapshot;
+    memset(&new_snapshot, 0, sizeof(Snapshot));
+    new_snapshot.scope = SNAPSHOT_SCOPE_FULL;
+    
     // 第一阶段：分配并保存所有元数据（但快照未激活）
-    int inode_bitmap_snapshot_block = alloc_block(fd);
-    int block_bitmap_snapshot_block = alloc_block(fd);
-    int inode_table_snapshot_blocks[16];
-    
-    for (int i = 0; i < 16; i++) {
-        inode_table_snapshot_blocks[i] = alloc_block(fd);
-        if (inode_table_snapshot_blocks[i] == -1) {
-            // 清理已分配的块
-            for (int j = 0; j < i; j++) {
-                free_block(fd, inode_table_snapshot_blocks[j]);
-            }
-            free_block(fd, block_bitmap_snapshot_block);
-            free_block(fd, inode_bitmap_snapshot_block);
-            return -1;
-        }
+    std::vector<int> copies;
+    if (!alloc_snapshot_copies(fd, &new_snapshot, copies)) {
+        return -1;
     }
     
     // 读取并保存inode和块位图
-    char inode_bitmap[BLOCK_SIZE];
-    char block_bitmap[BLOCK_SIZE];
-    read_block(fd, INODE_BITMAP_BLOCK, inode_bitmap);
-    read_block(fd, BLOCK_BITMAP_BLOCK, block_bitmap);
-    
-    // 保存inode表
-    for (int i = 0; i < 16; i++) {
-        char inode_block[BLOCK_SIZE];
-        read_block(fd, INODE_TABLE_START + i, inode_block);
-        write_block(fd, inode_table_snapshot_blocks[i], inode_block);
-    }
-    
-    // 保存位图
-    write_block(fd, inode_bitmap_snapshot_block, inode_bitmap);
-    write_block(fd, block_bitmap_snapshot_block, block_bitmap);
-    
-    // 查找空闲快照槽位
-    char buf[BLOCK_SIZE];
-    int snapshots_per_block = BLOCK_SIZE / sizeof(Snapshot);
-    int free_slot = -1;
-    
-    for (int i = 0; i < SNAPSHOT_TABLE_BLOCKS; i++) {
-        read_block(fd, SNAPSHOT_TABLE_START + i, buf);
-        Snapshot* block_snapshots = (Snapshot*)buf;
-        
-        for (int j = 0; j < snapshots_per_block && 
-             (i * snapshots_per_block + j) < MAX_SNAPSHOTS; j++) {
-            if (!block_snapshots[j].active && free_slot == -1) {
-                free_slot = i * snapshots_per_block + j;
-                break;
-            }
-        }
-        if (free_slot != -1) break;
+    std::vector<char> inode_bitmap((size_t)g.inode_bitmap_blocks * g.block_size);
+    std::vector<char> block_bitmap((size_t)g.block_bitmap_blocks * g.block_size);
+    allocator_copy_inode_bitmap(fd, inode_bitmap.data());
+    allocator_copy_block_bitmap(fd, block_bitmap.data());
+    write_copy_section(fd, new_snapshot, copies, 0, inode_bitmap.data());
+    write_copy_section(fd, new_snapshot, copies, 1, block_bitmap.data());
+    
+    // 保存inode表（逐块复制，不必整段放进内存）
+    const int table_first = g.inode_bitmap_blocks + g.block_bitmap_blocks;
+    for (int i = 0; i < g.inode_table_blocks; i++) {
+        char inode_block[MAX_BLOCK_SIZE];
+        read_block_cached(fd, g.inode_table_start + i, inode_block);
+        write_block_cached(fd, copies[table_first + i], inode_block);
     }
     
+    // 取空闲快照槽位（内存中的空闲表，目录满时按需扩展）
+    int free_slot = snapshot_catalog_alloc_slot(fd);
+    
     if (free_slot == -1) {
-        free_block(fd, inode_bitmap_snapshot_block);
-        free_block(fd, block_bitmap_snapshot_block);
-        for (int i = 0; i < 16; i++) {
-            free_block(fd, inode_table_snapshot_blocks[i]);
-        }
+        free_snapshot_copies(fd, new_snapshot);
         return -1;
     }
     
     // 创建快照结构但暂不激活
-    Snapshot new_snapshot;
-    memset(&new_snapshot, 0, sizeof(Snapshot));
     new_snapshot.id = free_slot;
-    new_snapshot.active = 0;  // ← 关键：先不激活
+    new_snapshot.active = SNAPSHOT_FREE;  // ← 关键：先不激活
     new_snapshot.timestamp = (int)time(nullptr);
     new_snapshot.root_inode_id = 0;
     strncpy(new_snapshot.name, name, sizeof(new_snapshot.name) - 1);
     new_snapshot.name[sizeof(new_snapshot.name) - 1] = '\0';
     
     new_snapshot.sb_at_snapshot = current_sb;
-    new_snapshot.inode_bitmap_block = inode_bitmap_snapshot_block;
-    new_snapshot.block_bitmap_block = block_bitmap_snapshot_block;
-    for (int i = 0; i < 16; i++) {
-        new_snapshot.inode_table_blocks[i] = inode_table_snapshot_blocks[i];
-    }
     
     new_snapshot.total_inodes_used = current_sb.inode_count - current_sb.free_inode_count;
     new_snapshot.total_blocks_used = current_sb.block_count - current_sb.free_block_count;
     
+    SnapshotEpochs epochs = epochs_get(fd);
+    new_snapshot.epoch = epochs.epoch;
+    
     // 第一步：写入快照表（未激活状态）
-    int block_id = SNAPSHOT_TABLE_START + (free_slot / snapshots_per_block);
-    int offset = free_slot % snapshots_per_block;
-    read_block(fd, block_id, buf);
-    Snapshot* snapshots = (Snapshot*)buf;
-    snapshots[offset] = new_snapshot;
-    write_block(fd, block_id, buf);
-    
-    // 第二阶段：增加所有数据块的引用计数（跳过元数据块）
-    // 注意：只增加数据块的引用计数，元数据块不参与快照的引用计数管理
-    int max_blocks = (BLOCK_SIZE * 8 < BLOCK_COUNT) ? BLOCK_SIZE * 8 : BLOCK_COUNT;
-    for (int block_id_iter = DATA_BLOCK_START; block_id_iter < max_blocks; block_id_iter++) {
-        int byte_index = block_id_iter / 8;
-        int bit_index = block_id_iter % 8;
-        
-        if (block_bitmap[byte_index] & (1 << bit_index)) {
-            increment_block_ref_count(fd, block_id_iter);
-        }
-    }
+    snapshot_catalog_put(fd, &new_snapshot);
+    
+    // 第二阶段：推进 epoch（O(1)，不再逐块增加引用计数）
+    // 出生 epoch 不大于快照 epoch 的块从此需要 COW，之后分配的块出生在新的 epoch
+    epochs.snapshot_epoch = epochs.epoch;
+    epochs.epoch++;
+    epochs_set(fd, epochs);
     
     // 第三步：激活快照（这是最后一个关键操作）
-    read_block(fd, block_id, buf);
-    snapshots = (Snapshot*)buf;
-    snapshots[offset].active = 1;  // ← 激活快照，标记操作完成
-    write_block(fd, block_id, buf);
+    new_snapshot.active = SNAPSHOT_ACTIVE;  // ← 激活快照，标记操作完成
+    snapshot_catalog_put(fd, &new_snapshot);
+
+    // 快照是持久化点：txn 结束时提交，分配器中的位图变化和缓存中的脏块一并落盘
+    allocator_sync(fd);
     
     return free_slot;
 }
 
-// 替换 src/disk.cpp 中的 list_snapshots 函数实现
-int list_snapshots(int fd, Snapshot* snapshots, int max_count) {
-    if (!snapshots || max_count <= 0) {
-        return -1;
-    }
-    
-    char buf[BLOCK_SIZE];
-    int snapshots_per_block = BLOCK_SIZE / sizeof(Snapshot);
-    int count = 0;
-    
-    for (int i = 0; i < SNAPSHOT_TABLE_BLOCKS && count < max_count; i++) {
-        read_block(fd, SNAPSHOT_TABLE_START + i, buf);
-        Snapshot* block_snapshots = (Snapshot*)buf;
-        
-        for (int j = 0; j < snapshots_per_block && 
-             (i * snapshots_per_block + j) < MAX_SNAPSHOTS && 
-             count < max_count; j++) {
-            
-            if (block_snapshots[j].active) {
-                snapshots[count] = block_snapshots[j];
-                count++;
+// ==================== 子树快照 ====================
+
+// 子树中的 inode：root 和从它经目录项可达的全部 inode（广度优先，root 在第一个）
+// 目录的哈希索引不算在内（快照中的目录不带索引，恢复后按需重建）
+// 超过 inode 表容量（目录项有环或已损坏）时返回 false
+static bool collect_subtree_inodes(int fd, int root_inode_id, std::vector<int>& members) {
+    const int max_members = disk_geometry(fd)->inode_count;
+    std::set<int> seen{root_inode_id};
+    members.assign(1, root_inode_id);
+    
+    for (size_t next = 0; next < members.size(); next++) {
+        Inode inode;
+        read_inode(fd, members[next], &inode);
+        if (inode.type != INODE_TYPE_DIR) {
+            continue;
+        }
+        
+        int entry_count = inode.size / sizeof(DirEntry);
+        for (int i = 0; i < entry_count; i++) {
+            DirEntry entry;
+            if (dir_get_entry(fd, &inode, i, &entry) != 0 || entry.inode_id < 0) {
+                continue;
+            }
+            if (seen.insert(entry.inode_id).second) {
+                if ((int)members.size() >= max_members) {
+                    return false;
+                }
+                members.push_back(entry.inode_id);
             }
         }
     }
-    
-return count; // 返回找到的快照数量
+    return true;
 }
 
-// 增加块引用计数
-// 增加块引用计数
-int increment_block_ref_count(int fd, int block_id) {
-    if (block_id < 0 || block_id >= BLOCK_COUNT) {
+int create_subtree_snapshot(int fd, int root_inode_id, const char* name) {
+    std::lock_guard<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
+    JournalTransaction txn(fd);
+    
+    Inode root;
+    if (allocator_inode_allocated(fd, root_inode_id) != 1 ||
+        read_inode(fd, root_inode_id, &root) != 0 || root.type != INODE_TYPE_DIR) {
         return -1;
     }
     
-    // 检查块是否已分配
-    char bitmap[BLOCK_SIZE];
-    read_block(fd, BLOCK_BITMAP_BLOCK, bitmap);
-    int byte_index = block_id / 8;
-    int bit_index = block_id % 8;
+    std::vector<int> members;
+    if (!collect_subtree_inodes(fd, root_inode_id, members)) {
+        return -1;
+    }
     
-    if (!(bitmap[byte_index] & (1 << bit_index))) {
-        return -1; // 块未分配
+    int free_slot = snapshot_catalog_alloc_slot(fd);
+    if (free_slot == -1) {
+        return -1;
     }
     
-    // 计算ref_count在哪个块中
-    int ref_count_block_offset = block_id / BLOCK_SIZE;
-    int ref_count_index = block_id % BLOCK_SIZE;
+    const DiskGeometry& g = *disk_geometry(fd);
+    Snapshot new_snapshot;
+    memset(&new_snapshot, 0, sizeof(Snapshot));
+    new_snapshot.scope = SNAPSHOT_SCOPE_SUBTREE;
+    new_snapshot.total_inodes_used = (int)members.size();
+    
+    // 第一阶段：读出子树的 inode，收集它们引用的块（排序去重后就是要钉住的块号列表）
+    std::vector<Inode> members_saved(members.size());
+    std::vector<int> pinned;
+    for (size_t k = 0; k < members.size(); k++) {
+        read_inode(fd, members[k], &members_saved[k]);
+        members_saved[k].dir_index = -1;  // 哈希索引不进快照
+        collect_inode_blocks(fd, &members_saved[k], pinned);
+    }
+    std::sort(pinned.begin(), pinned.end());
+    pinned.erase(std::unique(pinned.begin(), pinned.end()), pinned.end());
+    new_snapshot.total_blocks_used = (int)pinned.size();
     
-    // 检查是否超出ref_count表的范围
-    if (ref_count_block_offset >= REF_COUNT_TABLE_BLOCKS) {
+    // 第二阶段：分配编号列表、钉住的块号列表和 inode 副本所需的块（只按子树大小分配），写出三段
+    std::vector<int> copies;
+    if (!alloc_snapshot_copies(fd, &new_snapshot, copies)) {
         return -1;
     }
+    int counts[3];
+    snapshot_section_blocks(g, new_snapshot, counts);
+    
+    std::vector<int> ids((size_t)counts[0] * g.block_size / sizeof(int), 0);
+    std::vector<Inode> saved((size_t)counts[2] * g.block_size / sizeof(Inode));
+    memset(saved.data(), 0, saved.size() * sizeof(Inode));
+    std::copy(members.begin(), members.end(), ids.begin());
+    std::copy(members_saved.begin(), members_saved.end(), saved.begin());
+    std::vector<int> pinned_section((size_t)counts[1] * g.block_size / sizeof(int), 0);
+    std::copy(pinned.begin(), pinned.end(), pinned_section.begin());
+    write_copy_section(fd, new_snapshot, copies, 0, ids.data());
+    write_copy_section(fd, new_snapshot, copies, 1, pinned_section.data());
+    write_copy_section(fd, new_snapshot, copies, 2, saved.data());
     
-    // 读取ref_count块
-    char ref_count_buf[BLOCK_SIZE];
-    read_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
-    
-    // 增加引用计数
-    unsigned char ref_count = ref_count_buf[ref_count_index];
-    if (ref_count >= 255) {
-        return -1; // 溢出
+    new_snapshot.id = free_slot;
+    new_snapshot.active = SNAPSHOT_FREE;
+    new_snapshot.timestamp = (int)time(nullptr);
+    new_snapshot.root_inode_id = root_inode_id;
+    strncpy(new_snapshot.name, name, sizeof(new_snapshot.name) - 1);
+    new_snapshot.name[sizeof(new_snapshot.name) - 1] = '\0';
+    read_superblock(fd, &new_snapshot.sb_at_snapshot);
+    new_snapshot.epoch = 0;
+    
+    // 第三阶段：逐块钉住子树的块（引用计数加一，之后的写入 COW，删除文件时块保留），再激活
+    // 计数已饱和（255）的块加不上：钉住的次数比引用少一次，之后减一会在快照仍引用时释放它。
+    // 这时撤销已经加上的块，整个快照失败
+    for (size_t i = 0; i < pinned.size(); i++) {
+        if (ref_table_add(fd, pinned[i], 1) < 0) {
+            for (size_t j = 0; j < i; j++) {
+                ref_table_add(fd, pinned[j], -1);
+            }
+            free_snapshot_copies(fd, new_snapshot);
+            allocator_sync(fd);
+            return -1;
+        }
     }
+    new_snapshot.active = SNAPSHOT_ACTIVE;
+    snapshot_catalog_put(fd, &new_snapshot);
     
-    ref_count_buf[ref_count_index]++;
-    write_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
+    allocator_sync(fd);
     
+    return free_slot;
+}
+
+// 替换 src/disk.cpp 中的 list_snapshots 函数实现
+// 按编号顺序返回激活的快照（内存中的快照目录，不做 I/O）
+int list_snapshots(int fd, Snapshot* snapshots, int max_count) {
+    return snapshot_catalog_list(fd, SNAPSHOT_ACTIVE, snapshots, max_count);
+}
+
+int find_snapshot(int fd, const char* name) {
+    return snapshot_catalog_find(fd, name);
+}
+
+int get_snapshot(int fd, int snapshot_id, Snapshot* snapshot) {
+    Snapshot entry;
+    if (snapshot == nullptr || !read_snapshot_entry(fd, snapshot_id, &entry) || entry.active != SNAPSHOT_ACTIVE) {
+        return -1;
+    }
+    *snapshot = entry;
     return 0;
 }
 
-// 减少块引用计数
-int decrement_block_ref_count(int fd, int block_id) {
-    if (block_id < 0 || block_id >= BLOCK_COUNT) {
+int count_snapshots(int fd) {
+    return snapshot_catalog_count(fd, SNAPSHOT_ACTIVE);
+}
+
+int snapshot_read_inode_tables(int fd, int snapshot_id, void* inode_bitmap, void* inode_table) {
+    Snapshot snapshot;
+    if (!read_snapshot_entry(fd, snapshot_id, &snapshot) || snapshot.active != SNAPSHOT_ACTIVE ||
+        snapshot.scope != SNAPSHOT_SCOPE_FULL) {
         return -1;
     }
-    
-    // 检查块是否已分配
-    char bitmap[BLOCK_SIZE];
-    read_block(fd, BLOCK_BITMAP_BLOCK, bitmap);
-    int byte_index = block_id / 8;
-    int bit_index = block_id % 8;
-    
-    if (!(bitmap[byte_index] & (1 << bit_index))) {
-        return -1; // 块未分配
+    std::vector<int> copies = snapshot_copy_blocks(fd, snapshot);
+    read_copy_section(fd, snapshot, copies, 0, inode_bitmap);
+    read_copy_section(fd, snapshot, copies, 2, inode_table);
+    return 0;
+}
+
+void snapshot_table_lock(int exclusive) {
+    if (exclusive) {
+        g_snapshot_mutex.lock();
+    } else {
+        g_snapshot_mutex.lock_shared();
+    }
+}
+
+void snapshot_table_unlock(int exclusive) {
+    if (exclusive) {
+        g_snapshot_mutex.unlock();
+    } else {
+        g_snapshot_mutex.unlock_shared();
+    }
+}
+
+// ==================== 只读快照视图 ====================
+
+// 快照中保存的 inode；快照里没有这个 inode 时返回 false
+static bool snapshot_view_inode(int fd, const Snapshot& snapshot, int inode_id, Inode* inode) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    const int inodes_per_block = g.block_size / sizeof(Inode);
+    char buf[MAX_BLOCK_SIZE];
+    
+    if (snapshot.scope == SNAPSHOT_SCOPE_SUBTREE) {
+        const int ids_per_block = g.block_size / sizeof(int);
+        const int* ids = (const int*)buf;
+        for (int k = 0; k < snapshot.total_inodes_used; k++) {
+            if (k % ids_per_block == 0) {
+                read_block_cached(fd, snapshot_copy_block(fd, snapshot, 0, k / ids_per_block), buf);
+            }
+            if (ids[k % ids_per_block] == inode_id) {
+                read_block_cached(fd, snapshot_copy_block(fd, snapshot, 2, k / inodes_per_block), buf);
+                *inode = ((const Inode*)buf)[k % inodes_per_block];
+                return true;
+            }
+        }
+        return false;
     }
     
-    // 计算ref_count在哪个块中
-    int ref_count_block_offset = block_id / BLOCK_SIZE;
-    int ref_count_index = block_id % BLOCK_SIZE;
-    
-    // 检查是否超出ref_count表的范围
-    if (ref_count_block_offset >= REF_COUNT_TABLE_BLOCKS) {
+    if (inode_id < 0 || inode_id >= g.inode_count) {
+        return false;
+    }
+    const int bits_per_block = g.block_size * 8;
+    read_block_cached(fd, snapshot_copy_block(fd, snapshot, 0, inode_id / bits_per_block), buf);
+    int bit = inode_id % bits_per_block;
+    if (!(buf[bit / 8] & (1 << (bit % 8)))) {
+        return false;
+    }
+    read_block_cached(fd, snapshot_copy_block(fd, snapshot, 2, inode_id / inodes_per_block), buf);
+    *inode = ((const Inode*)buf)[inode_id % inodes_per_block];
+    return true;
+}
+
+// 按快照中的目录内容逐级解析路径，返回 inode 编号（-1 = 不存在）
+// 目录项线性扫描：目录的哈希索引在隐藏 inode 里，快照中不一定有对应的副本
+static int snapshot_view_lookup(int fd, const Snapshot& snapshot, const char* path, Inode* inode) {
+    int inode_id = snapshot.scope == SNAPSHOT_SCOPE_SUBTREE ? snapshot.root_inode_id : 0;
+    if (!snapshot_view_inode(fd, snapshot, inode_id, inode)) {
         return -1;
     }
     
-    // 读取ref_count块
-    char ref_count_buf[BLOCK_SIZE];
-    read_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
+    const char* p = path != nullptr ? path : "";
+    while (*p != '\0') {
+        const char* end = strchr(p, '/');
+        size_t len = end != nullptr ? (size_t)(end - p) : strlen(p);
+        std::string name(p, len);
+        p += len;
+        if (*p == '/') {
+            p++;
+        }
+        if (name.empty() || name == ".") {
+            continue;
+        }
+        if (inode->type != INODE_TYPE_DIR) {
+            return -1;
+        }
+        
+        int next = -1;
+        int entry_count = inode->size / sizeof(DirEntry);
+        for (int i = 0; i < entry_count && next < 0; i++) {
+            DirEntry entry;
+            if (dir_get_entry(fd, inode, i, &entry) == 0 &&
+                strncmp(entry.name, name.c_str(), DIR_NAME_SIZE) == 0) {
+                next = entry.inode_id;
+            }
+        }
+        if (next < 0 || !snapshot_view_inode(fd, snapshot, next, inode)) {
+            return -1;
+        }
+        inode_id = next;
+    }
+    return inode_id;
+}
+
+int snapshot_stat(int fd, int snapshot_id, const char* path, Inode* inode) {
+    std::shared_lock<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
     
-    // 减少引用计数
-    unsigned char ref_count = ref_count_buf[ref_count_index];
-    if (ref_count <= 0) {
+    Snapshot snapshot;
+    if (inode == nullptr || !read_snapshot_entry(fd, snapshot_id, &snapshot) ||
+        snapshot.active != SNAPSHOT_ACTIVE) {
         return -1;
     }
+    return snapshot_view_lookup(fd, snapshot, path, inode);
+}
+
+int snapshot_read_file(int fd, int snapshot_id, const char* path, char* buf, int offset, int size) {
+    std::shared_lock<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
     
-    ref_count_buf[ref_count_index]--;
-    write_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
+    Snapshot snapshot;
+    if (!read_snapshot_entry(fd, snapshot_id, &snapshot) || snapshot.active != SNAPSHOT_ACTIVE) {
+        return -1;
+    }
+    Inode inode;
+    if (snapshot_view_lookup(fd, snapshot, path, &inode) < 0 || inode.type != INODE_TYPE_FILE ||
+        offset < 0 || size < 0) {
+        return -1;
+    }
     
-    return 0;
+    // 数据块被快照持有（出生 epoch 或钉住的引用计数），共享锁期间不会被回收
+    if (offset >= inode.size) {
+        return 0;
+    }
+    return inode_read_data(fd, &inode, buf, offset, std::min(size, inode.size - offset));
 }
 
-// 获取块引用计数
-int get_block_ref_count(int fd, int block_id) {
-    if (block_id < 0 || block_id >= BLOCK_COUNT) {
+// 增加块引用计数
+int increment_block_ref_count(int fd, int block_id) {
+    if (block_id < 0 || block_id >= disk_geometry(fd)->block_count) {
         return -1;
     }
     
-    // 计算ref_count在哪个块中
-    int ref_count_block_offset = block_id / BLOCK_SIZE;
-    int ref_count_index = block_id % BLOCK_SIZE;
+    // 检查块是否已分配
+    if (allocator_block_allocated(fd, block_id) != 1) {
+        return -1; // 块未分配
+    }
     
-    // 检查是否超出ref_count表的范围
-    if (ref_count_block_offset >= REF_COUNT_TABLE_BLOCKS) {
+    // 255 时溢出
+    return ref_table_add(fd, block_id, 1) < 0 ? -1 : 0;
+}
+
+// 减少块引用计数
+int decrement_block_ref_count(int fd, int block_id) {
+    if (block_id < 0 || block_id >= disk_geometry(fd)->block_count) {
         return -1;
     }
     
-    // 读取ref_count块
-    char ref_count_buf[BLOCK_SIZE];
-    read_block(fd, REF_COUNT_TABLE_START + ref_count_block_offset, ref_count_buf);
+    // 检查块是否已分配
+    if (allocator_block_allocated(fd, block_id) != 1) {
+        return -1; // 块未分配
+    }
     
-    // 返回引用计数
-    return (int)ref_count_buf[ref_count_index];
+    // 已经是 0 时失败
+    return ref_table_add(fd, block_id, -1) < 0 ? -1 : 0;
+}
+
+// 获取块引用计数（内存表，不做 I/O）
+int get_block_ref_count(int fd, int block_id) {
+    return ref_table_get(fd, block_id);
+}
+
+// ==================== 批量引用计数 ====================
+
+// 内存表上的掩码操作；元数据区的计数不参与
+// 复制掩码并清掉元数据区
+static std::vector<uint64_t> data_region_mask(int fd, const uint64_t* mask) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    std::vector<uint64_t> data_mask(mask, mask + disk_mask_words(&g));
+    mask_data_region(g, data_mask.data());
+    return data_mask;
+}
+
+int ref_count_add_mask(int fd, const uint64_t* mask, int delta) {
+    std::vector<uint64_t> data_mask = data_region_mask(fd, mask);
+    return ref_table_add_mask(fd, data_mask.data(), delta);
+}
+
+int ref_count_add_mask_blocked(int fd, const uint64_t* mask, int delta, uint64_t* blocked) {
+    std::vector<uint64_t> data_mask = data_region_mask(fd, mask);
+    return ref_table_add_mask_blocked(fd, data_mask.data(), delta, blocked);
+}
+
+int ref_count_zero_mask(int fd, const uint64_t* mask, uint64_t* zero) {
+    std::vector<uint64_t> data_mask = data_region_mask(fd, mask);
+    return ref_table_zero_mask(fd, data_mask.data(), zero);
+}
+
+void ref_count_clear_mask(int fd, const uint64_t* mask) {
+    std::vector<uint64_t> data_mask = data_region_mask(fd, mask);
+    ref_table_clear_mask(fd, data_mask.data());
+}
+
+int free_block_mask(int fd, const uint64_t* mask) {
+    std::vector<uint64_t> data_mask = data_region_mask(fd, mask);
+    
+    ref_count_clear_mask(fd, data_mask.data());
+    return allocator_free_block_mask(fd, data_mask.data(), (int)data_mask.size());
 }
 
 // COW复制块
 int copy_on_write_block(int fd, int block_id) {
-    if (block_id < 0 || block_id >= BLOCK_COUNT) {
+    return copy_on_write_block_goal(fd, block_id, -1, -1);
+}
+
+int copy_on_write_block_goal(int fd, int block_id, int goal, int owner) {
+    if (block_id < 0 || block_id >= disk_geometry(fd)->block_count) {
         return -1;
     }
     
-    // 检查引用计数
-    int ref_count = get_block_ref_count(fd, block_id);
-    if (ref_count <= 1) {
-        // 如果只有一个引用或没有引用，不需要复制
+    // 没有被其他 inode 或快照共享，不需要复制
+    if (!block_needs_cow(fd, block_id)) {
         return block_id;
     }
     
-    // 分配新块
-    int new_block_id = alloc_block(fd);
+    // 分配新块（放在 goal 附近：改写整个文件时副本连成一段）
+    int new_block_id = alloc_block_goal(fd, goal, owner);
     if (new_block_id == -1) {
         return -1;
     }
     
     // 复制数据
-    char buf[BLOCK_SIZE];
-    read_block(fd, block_id, buf);
-    write_block(fd, new_block_id, buf);
+    char buf[MAX_BLOCK_SIZE];
+    read_block_cached(fd, block_id, buf);
+    write_block_cached(fd, new_block_id, buf);
     
-    // 减少旧块引用计数
-    decrement_block_ref_count(fd, block_id);
+    // 释放旧块的这一个引用（仍被快照共享时保留）
+    release_block(fd, block_id);
     
     // 新块的引用计数应该为1（已由alloc_block设置）
     return new_block_id;
 }
 
-int restore_snapshot(int fd, int snapshot_id) {
-    if (snapshot_id < 0 || snapshot_id >= MAX_SNAPSHOTS) {
+int block_needs_cow(int fd, int block_id) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    if (block_id < g.data_block_start || block_id >= g.block_count) {
+        return 0;
+    }
+    if (get_block_ref_count(fd, block_id) > 1) {
+        return 1;  // 被多个 inode 共享（restore_directory_tree）
+    }
+    return block_in_snapshot(fd, block_id) ? 1 : 0;
+}
+
+int release_block(int fd, int block_id) {
+    if (block_id < 0 || block_id >= disk_geometry(fd)->block_count) {
         return -1;
     }
     
-    char buf[BLOCK_SIZE];
-    int snapshots_per_block = BLOCK_SIZE / sizeof(Snapshot);
-    int block_idx = snapshot_id / snapshots_per_block;
-    int entry_idx = snapshot_id % snapshots_per_block;
+    // 计数已经是 0 时递减失败，按 0 处理
+    decrement_block_ref_count(fd, block_id);
+    if (get_block_ref_count(fd, block_id) != 0) {
+        return 0;
+    }
+    
+    // 快照仍然引用：保留为只属于快照的块，删除快照时再释放
+    if (block_in_snapshot(fd, block_id)) {
+        return 0;
+    }
     
-    int block_id = SNAPSHOT_TABLE_START + block_idx;
-    if (block_id >= SNAPSHOT_TABLE_START + SNAPSHOT_TABLE_BLOCKS) {
+    // 只在计数仍为 0 时释放：这期间块可能已被回收线程释放并重新分配出去
+    return allocator_free_unreferenced_block(fd, block_id);
+}
+
+// 列出一个 inode 引用的块（数据块和 extent 树节点，只取数据区），追加到 blocks
+static void collect_inode_blocks(int fd, const Inode* inode, std::vector<int>& blocks) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    auto add = [&](int b) {
+        if (b >= g.data_block_start && b < g.block_count) {
+            blocks.push_back(b);
+        }
+    };
+    
+    std::vector<Extent> extents;
+    std::vector<int> nodes;
+    extent_collect(fd, inode, &extents, &nodes);
+    for (const Extent& e : extents) {
+        for (int i = 0; i < e.length; i++) {
+            add(e.start + i);
+        }
+    }
+    for (int b : nodes) {
+        add(b);
+    }
+}
+
+// 统计一个 inode 引用的块：refs 按块号计数（block_count 项）
+static void count_inode_blocks(int fd, const Inode* inode, std::vector<int>& refs) {
+    std::vector<int> blocks;
+    collect_inode_blocks(fd, inode, blocks);
+    for (int b : blocks) {
+        refs[b]++;
+    }
+}
+
+// 恢复子树快照：只改写 root 之下的 inode，子树之外的文件不受影响
+// 注意：调用者持有 g_snapshot_mutex 和日志句柄（返回后提交）
+static int restore_subtree_snapshot(int fd, const Snapshot& snapshot) {
+    int root_id = snapshot.root_inode_id;
+    Inode root;
+    if (allocator_inode_allocated(fd, root_id) != 1 || read_inode(fd, root_id, &root) != 0 ||
+        root.type != INODE_TYPE_DIR) {
+        std::cout << "子树快照的根目录已不存在" << std::endl;
         return -1;
     }
     
-    read_block(fd, block_id, buf);
-    Snapshot* snapshots = (Snapshot*)buf;
+    // 快照保存的 inode 编号和副本
+    const DiskGeometry& g = *disk_geometry(fd);
+    int saved_count = snapshot.total_inodes_used;
+    int counts[3];
+    snapshot_section_blocks(g, snapshot, counts);
+    std::vector<int> copies = snapshot_copy_blocks(fd, snapshot);
+    std::vector<int> saved_ids((size_t)counts[0] * g.block_size / sizeof(int));
+    std::vector<Inode> saved((size_t)counts[2] * g.block_size / sizeof(Inode));
+    read_copy_section(fd, snapshot, copies, 0, saved_ids.data());
+    read_copy_section(fd, snapshot, copies, 2, saved.data());
+    saved.resize(saved_count);
+    
+    std::vector<int> current;
+    if (!collect_subtree_inodes(fd, root_id, current)) {
+        return -1;
+    }
+    
+    // 空闲 inode 不够重建整棵子树时直接失败（不做任何修改）
+    int free_inodes = 0;
+    int free_blocks = 0;
+    allocator_get_free_counts(fd, &free_inodes, &free_blocks);
+    if (free_inodes + (int)current.size() < saved_count) {
+        return -1;
+    }
+    
+    // 0. 快照中的块先计入活跃引用（按块号排序后逐块累加，开销与子树大小成正比）
+    //    这些块都被快照钉住，释放当前子树时不会被释放；计数会超过 255 的块加不上，
+    //    这时撤销已经加上的引用并失败（不做任何修改）
+    std::vector<int> saved_blocks;
+    for (int k = 0; k < saved_count; k++) {
+        collect_inode_blocks(fd, &saved[k], saved_blocks);
+    }
+    std::sort(saved_blocks.begin(), saved_blocks.end());
+    std::vector<std::pair<int, int>> refs;
+    for (int b : saved_blocks) {
+        if (!refs.empty() && refs.back().first == b) {
+            refs.back().second++;
+        } else {
+            refs.push_back({b, 1});
+        }
+    }
+    for (size_t i = 0; i < refs.size(); i++) {
+        if (ref_table_add(fd, refs[i].first, refs[i].second) < 0) {
+            for (size_t j = 0; j < i; j++) {
+                ref_table_add(fd, refs[j].first, -refs[j].second);
+            }
+            std::cout << "子树快照中的块引用计数已饱和" << std::endl;
+            return -1;
+        }
+    }
+    
+    // 1. 释放当前子树：数据块减去活跃引用（被快照钉住的块保留），root 之外的 inode 释放
+    for (int id : current) {
+        Inode inode;
+        read_inode(fd, id, &inode);
+        inode_free_blocks(fd, &inode);
+        if (id != root_id) {
+            free_inode(fd, id);
+        }
+    }
     
-    if (!snapshots[entry_idx].active) {
+    // 2. 按原编号占用 inode；编号已被子树之外的文件占用时换一个新编号
+    std::map<int, int> remap;
+    std::vector<int> targets(saved_count, root_id);
+    for (int k = 1; k < saved_count; k++) {
+        targets[k] = saved_ids[k];
+        if (allocator_claim_inode(fd, saved_ids[k]) != 0) {
+            targets[k] = alloc_inode(fd);
+            remap[saved_ids[k]] = targets[k];
+        }
+    }
+    
+    // 3. 写回 inode（快照中的块已在第 0 步计入活跃引用）
+    for (int k = 0; k < saved_count; k++) {
+        write_inode(fd, targets[k], &saved[k]);
+    }
+    
+    // 4. 换了编号的 inode：改写父目录中的目录项（目录块被快照钉住，写入时 COW）
+    for (int k = 0; k < saved_count && !remap.empty(); k++) {
+        if (saved[k].type != INODE_TYPE_DIR) {
+            continue;
+        }
+        Inode dir;
+        read_inode(fd, targets[k], &dir);
+        int entry_count = dir.size / sizeof(DirEntry);
+        for (int i = 0; i < entry_count; i++) {
+            DirEntry entry;
+            if (dir_get_entry(fd, &dir, i, &entry) != 0) {
+                continue;
+            }
+            auto it = remap.find(entry.inode_id);
+            if (it != remap.end()) {
+                entry.inode_id = it->second;
+                inode_write_data(fd, &dir, targets[k], (const char*)&entry, i * sizeof(DirEntry), sizeof(DirEntry));
+            }
+        }
+        write_inode(fd, targets[k], &dir);
+    }
+    
+    // 子树的块指针和目录内容整体替换：extent 树节点解码缓存和路径缓存作废
+    bmap_cache_discard(fd);
+    dcache_invalidate(fd);
+    
+    allocator_sync(fd);
+    std::cout << "子树快照恢复成功（" << saved_count << " 个 inode";
+    if (!remap.empty()) {
+        std::cout << "，" << remap.size() << " 个换了编号";
+    }
+    std::cout << "）" << std::endl;
+    return 0;
+}
+
+int restore_snapshot(int fd, int snapshot_id) {
+    if (snapshot_id < 0) {
+        return -1;
+    }
+    
+    std::lock_guard<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
+    JournalTransaction txn(fd);  // 恢复改写的位图、inode 表和引用计数在同一个事务里，返回时提交
+    
+    Snapshot snapshot;
+    if (!read_snapshot_entry(fd, snapshot_id, &snapshot) || snapshot.active != SNAPSHOT_ACTIVE) {
         std::cout << "快照不存在或未激活" << std::endl;
         return -1;
     }
     
-    Snapshot snapshot = snapshots[entry_idx];
     std::cout << "准备恢复快照，根inode_id: " << snapshot.root_inode_id << std::endl;
     
-    // 读取当前的块位图（在覆盖前保存）
-    char current_block_bitmap[BLOCK_SIZE];
-    read_block(fd, BLOCK_BITMAP_BLOCK, current_block_bitmap);
+    if (snapshot.scope == SNAPSHOT_SCOPE_SUBTREE) {
+        return restore_subtree_snapshot(fd, snapshot);
+    }
     
-    // 读取快照的块位图
-    char snapshot_block_bitmap[BLOCK_SIZE];
-    read_block(fd, snapshot.block_bitmap_block, snapshot_block_bitmap);
+    // 1. 统计恢复后每个数据块的活跃引用：遍历快照保存的 inode 表
+    const DiskGeometry& g = *disk_geometry(fd);
+    std::vector<int> copies = snapshot_copy_blocks(fd, snapshot);
+    std::vector<char> inode_bitmap((size_t)g.inode_bitmap_blocks * g.block_size);
+    read_copy_section(fd, snapshot, copies, 0, inode_bitmap.data());
+    const int table_first = g.inode_bitmap_blocks + g.block_bitmap_blocks;
+    
+    std::vector<int> live_refs(g.block_count, 0);
+    int inodes_per_block = g.block_size / sizeof(Inode);
+    for (int i = 0; i < g.inode_table_blocks; i++) {
+        char inode_block[MAX_BLOCK_SIZE];
+        read_block_cached(fd, copies[table_first + i], inode_block);
+        const Inode* inodes = (const Inode*)inode_block;
+        for (int j = 0; j < inodes_per_block; j++) {
+            int inode_id = i * inodes_per_block + j;
+            if (inode_bitmap[inode_id / 8] & (1 << (inode_id % 8))) {
+                count_inode_blocks(fd, &inodes[j], live_refs);
+            }
+        }
+    }
     
-    // 所有写操作在一起（原子恢复）
-    // 1. 恢复superblock
-    write_superblock(fd, &snapshot.sb_at_snapshot);
-    
-    // 2. 恢复inode和块位图
-    char inode_bitmap[BLOCK_SIZE];
-    char block_bitmap[BLOCK_SIZE];
-    read_block(fd, snapshot.inode_bitmap_block, inode_bitmap);
-    read_block(fd, snapshot.block_bitmap_block, block_bitmap);
-    
-    write_block(fd, INODE_BITMAP_BLOCK, inode_bitmap);
-    write_block(fd, BLOCK_BITMAP_BLOCK, block_bitmap);
-    
-    // 3. 恢复inode表
-    for (int i = 0; i < 16; i++) {
-        char inode_block[BLOCK_SIZE];
-        read_block(fd, snapshot.inode_table_blocks[i], inode_block);
-        write_block(fd, INODE_TABLE_START + i, inode_block);
-    }
-    
-    // 4. 更新引用计数
-    // 对于在当前文件系统中使用但不在快照中的块，减少引用计数
-    // 对于在快照中但不在当前文件系统中的块，不需要改变（快照已经持有引用）
-    int max_blocks = (BLOCK_SIZE * 8 < BLOCK_COUNT) ? BLOCK_SIZE * 8 : BLOCK_COUNT;
-    for (int block_id_iter = DATA_BLOCK_START; block_id_iter < max_blocks; block_id_iter++) {
-        int byte_index = block_id_iter / 8;
-        int bit_index = block_id_iter % 8;
-        
-        bool in_current = (current_block_bitmap[byte_index] & (1 << bit_index)) != 0;
-        bool in_snapshot = (snapshot_block_bitmap[byte_index] & (1 << bit_index)) != 0;
-        
-        // 如果块在当前文件系统中但不在快照中，减少引用计数
-        if (in_current && !in_snapshot) {
-            int ref_count = get_block_ref_count(fd, block_id_iter);
-            if (ref_count > 0) {
-                decrement_block_ref_count(fd, block_id_iter);
+    // 2. 恢复后的块位图 = 元数据区 + 所有激活快照占用的块
+    //    本快照的块位图覆盖了恢复后活跃文件系统的全部块；当前文件系统独有的块随之释放
+    std::vector<uint64_t> block_bitmap((size_t)g.block_bitmap_blocks * g.block_size / sizeof(uint64_t), 0);
+    std::vector<int> metadata_blocks;
+    collect_snapshot_blocks(fd, -1, block_bitmap.data(), &metadata_blocks);
+    for (int b = 0; b < g.data_block_start; b++) {
+        block_bitmap[b / 64] |= 1ULL << (b % 64);
+    }
+    for (int b : metadata_blocks) {
+        live_refs[b] = 1;  // 快照自身的副本块和块号表固定为 1
+    }
+    
+    // 激活的子树快照仍然钉住各自的块（计数加一）
+    for (const Snapshot& entry : snapshot_catalog_entries(fd, SNAPSHOT_ACTIVE)) {
+        if (entry.scope != SNAPSHOT_SCOPE_SUBTREE) {
+            continue;
+        }
+        for (int b : read_snapshot_pinned_blocks(fd, entry, snapshot_copy_blocks(fd, entry))) {
+            if (b >= g.data_block_start && b < g.block_count) {
+                live_refs[b]++;
             }
         }
-        // 如果块在快照中但不在当前文件系统中，不需要操作
-        // 因为快照创建时已经增加了引用计数
     }
     
+    // 所有写操作在一起（原子恢复）
+    // 3. 恢复superblock（epoch 不回退：快照之后出生的块号可能已被复用）
+    SnapshotEpochs epochs = epochs_get(fd);
+    Superblock restored_sb = snapshot.sb_at_snapshot;
+    restored_sb.epoch = epochs.epoch;
+    restored_sb.snapshot_epoch = epochs.snapshot_epoch;
+    restored_sb.state = FS_STATE_DIRTY;
+    write_superblock(fd, &restored_sb);
+    
+    // 4. 恢复inode和块位图
+    for (int i = 0; i < g.inode_bitmap_blocks; i++) {
+        write_block_cached(fd, g.inode_bitmap_start + i, inode_bitmap.data() + (size_t)i * g.block_size);
+    }
+    for (int i = 0; i < g.block_bitmap_blocks; i++) {
+        write_block_cached(fd, g.block_bitmap_start + i, (const char*)block_bitmap.data() + (size_t)i * g.block_size);
+    }
+    
+    // 5. 恢复inode表
+    for (int i = 0; i < g.inode_table_blocks; i++) {
+        char inode_block[MAX_BLOCK_SIZE];
+        read_block_cached(fd, copies[table_first + i], inode_block);
+        write_block_cached(fd, g.inode_table_start + i, inode_block);
+    }
+    
+    // 6. 按统计结果整体重写数据块的引用计数（只属于快照的块为 0）
+    for (int b = g.data_block_start; b < g.block_count; b++) {
+        ref_table_set(fd, b, std::min(live_refs[b], 255));
+    }
+    
+    // 位图和 inode 表已被整体替换：内存分配器重新加载，extent 树节点解码缓存和路径缓存作废
+    allocator_reload(fd);
+    bmap_cache_discard(fd);
+    dcache_invalidate(fd);
+    
+    allocator_sync(fd);
     std::cout << "快照恢复成功" << std::endl;
     return 0;
 }
@@ -903,37 +1758,11 @@ int restore_directory_tree(int fd, int source_inode_id, int target_inode_id) {
     read_inode(fd, target_inode_id, &target_inode);
     
     // 释放目标inode的现有数据块
-    if (target_inode.block_count > 0) {
-        // 释放直接块
-        for (int i = 0; i < target_inode.block_count && i < DIRECT_BLOCK_COUNT; i++) {
-            if (target_inode.direct_blocks[i] != -1) {
-                decrement_block_ref_count(fd, target_inode.direct_blocks[i]);
-                if (get_block_ref_count(fd, target_inode.direct_blocks[i]) == 0) {
-                    free_block(fd, target_inode.direct_blocks[i]);
-                }
-            }
-        }
-        
-        // 释放间接块
-        if (target_inode.indirect_block != -1) {
-            int pointers[POINTERS_PER_BLOCK];
-            read_block(fd, target_inode.indirect_block, pointers);
-            
-            int indirect_count = target_inode.block_count - DIRECT_BLOCK_COUNT;
-            for (int i = 0; i < indirect_count && i < POINTERS_PER_BLOCK; i++) {
-                if (pointers[i] != -1) {
-                    decrement_block_ref_count(fd, pointers[i]);
-                    if (get_block_ref_count(fd, pointers[i]) == 0) {
-                        free_block(fd, pointers[i]);
-                    }
-                }
-            }
-            
-            decrement_block_ref_count(fd, target_inode.indirect_block);
-            if (get_block_ref_count(fd, target_inode.indirect_block) == 0) {
-                free_block(fd, target_inode.indirect_block);
-            }
-        }
+    extent_release_all(fd, &target_inode);
+    
+    // 目标原有的哈希索引描述的是旧内容，释放掉，之后插入时按新内容重建
+    if (target_inode.dir_index >= 0) {
+        dir_index_drop(fd, &target_inode);
     }
     
     // 复制源inode的块指针到目标inode
@@ -941,89 +1770,138 @@ int restore_directory_tree(int fd, int source_inode_id, int target_inode_id) {
     target_inode.size = source_inode.size;
     target_inode.block_count = source_inode.block_count;
     
-    // 复制直接块指针
-    for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
-        target_inode.direct_blocks[i] = source_inode.direct_blocks[i];
-        if (i < source_inode.block_count && source_inode.direct_blocks[i] != -1) {
-            // 增加引用计数
-            increment_block_ref_count(fd, source_inode.direct_blocks[i]);
-        }
-    }
-    
-    // 复制间接块指针
-    target_inode.indirect_block = source_inode.indirect_block;
-    if (source_inode.indirect_block != -1) {
-        increment_block_ref_count(fd, source_inode.indirect_block);
-    }
+    // 复制映射区（extent 或内联内容）：两个 inode 共享同一批数据块和树节点，各加一个引用
+    target_inode.flags = source_inode.flags;
+    target_inode.extent_depth = source_inode.extent_depth;
+    target_inode.extent_count = source_inode.extent_count;
+    memcpy(target_inode.inline_data, source_inode.inline_data, INODE_INLINE_SIZE);
+    extent_share_all(fd, &source_inode);
     
     // 写回目标inode
     write_inode(fd, target_inode_id, &target_inode);
     
+    // 目标目录下的整棵子树都换了内容，路径缓存整体作废
+    dcache_invalidate(fd);
+    
     return 0;
 }
 int delete_snapshot(int fd, int snapshot_id) {
-    if (snapshot_id < 0 || snapshot_id >= MAX_SNAPSHOTS) {
+    if (snapshot_id < 0) {
         return -1;
     }
-    
-    char buf[BLOCK_SIZE];
-    int snapshots_per_block = BLOCK_SIZE / sizeof(Snapshot);
-    int block_idx = snapshot_id / snapshots_per_block;
-    int entry_idx = snapshot_id % snapshots_per_block;
-    
-    int block_id = SNAPSHOT_TABLE_START + block_idx;
-    if (block_id >= SNAPSHOT_TABLE_START + SNAPSHOT_TABLE_BLOCKS) {
-        return -1;
+
+    {
+        std::lock_guard<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
+        JournalTransaction txn(fd, false);  // 状态切换和去掉钉住的引用在同一个事务里
+
+        Snapshot snapshot;
+        if (!read_snapshot_entry(fd, snapshot_id, &snapshot) || snapshot.active != SNAPSHOT_ACTIVE) {
+            return -1;
+        }
+
+        // 第一步：立即标记为 DELETING（对外不可见，槽位在回收完成前不复用）
+        set_snapshot_state(fd, snapshot_id, SNAPSHOT_DELETING);
+
+        // 子树快照：和状态切换一起去掉钉住的那一次引用（只做一次，继续回收时不再重复）
+        // 活跃文件系统已不再引用的块计数归零，由下面的回收释放
+        if (snapshot.scope == SNAPSHOT_SCOPE_SUBTREE) {
+            for (int b : read_snapshot_pinned_blocks(fd, snapshot, snapshot_copy_blocks(fd, snapshot))) {
+                ref_table_add(fd, b, -1);
+            }
+        }
+
+        // 最新快照的 epoch 可能变小：出生 epoch 大于它的块不再需要 COW
+        SnapshotEpochs epochs = epochs_get(fd);
+        epochs.snapshot_epoch = latest_snapshot_epoch(fd);
+        epochs_set(fd, epochs);
+
+        allocator_sync(fd);
     }
-    
-    read_block(fd, block_id, buf);
-    Snapshot* snapshots = (Snapshot*)buf;
-    
-    if (!snapshots[entry_idx].active) {
+
+    // 第二阶段：回收只属于这个快照的块
+    // 后台回收线程在运行时交给它（立即返回），否则就地回收
+    if (snapshot_reclaim_enqueue(fd, snapshot_id) != 0) {
+        snapshot_reclaim_chunk(fd, snapshot_id, 0, disk_geometry(fd)->block_count);
+        snapshot_reclaim_finish(fd, snapshot_id);
+    }
+    return 0;
+}
+
+int snapshot_reclaim_chunk(int fd, int snapshot_id, int first_block, int count) {
+    std::lock_guard<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
+    JournalTransaction txn(fd, false);  // 一步的释放和出生 epoch 修改不会被拆到两个事务里（不等提交）
+
+    Snapshot snapshot;
+    if (!read_snapshot_entry(fd, snapshot_id, &snapshot) || snapshot.active != SNAPSHOT_DELETING) {
         return -1;
     }
-    
-    Snapshot snapshot_to_delete = snapshots[entry_idx];
-    
-    // 第一步：立即标记为非活动（防止快照被使用）
-    snapshots[entry_idx].active = 0;
-    write_block(fd, block_id, buf);
-    
-    // 第二阶段：安全地清理资源（即使失败也无关紧要）
-    if (snapshot_to_delete.block_bitmap_block > 0) {
-        char snapshot_block_bitmap[BLOCK_SIZE];
-        read_block(fd, snapshot_to_delete.block_bitmap_block, snapshot_block_bitmap);
-        
-        // 只减少数据块的引用计数（与create_snapshot对应）
-        int max_blocks = (BLOCK_SIZE * 8 < BLOCK_COUNT) ? BLOCK_SIZE * 8 : BLOCK_COUNT;
-        for (int block_id_iter = DATA_BLOCK_START; block_id_iter < max_blocks; block_id_iter++) {
-            int byte_index = block_id_iter / 8;
-            int bit_index = block_id_iter % 8;
-            
-            if (snapshot_block_bitmap[byte_index] & (1 << bit_index)) {
-                // 直接调用free_block，它会处理引用计数
-                // free_block内部会检查RefCount：
-                // - 如果>1，只减少计数
-                // - 如果=1或0，清零并释放块
-                free_block(fd, block_id_iter);
-            }
-        }
+
+    // 只处理 [first_block, first_block + count) 对应的位图字
+    const DiskGeometry& g = *disk_geometry(fd);
+    const int mask_words = disk_mask_words(&g);
+    int first_word = std::max(0, first_block / 64);
+    int end_word = std::min(mask_words, (first_block + count + 63) / 64);
+    if (snapshot.copy_blocks <= 0 || first_word >= end_word) {
+        return 0;
     }
-    
-    // 释放元数据块
-    // 注意：这些块可能已经在上面的循环中被处理过了（如果它们在快照位图中）
-    // free_block会检查bitmap，如果已经释放就不会重复操作
-    if (snapshot_to_delete.inode_bitmap_block > 0) {
-        free_block(fd, snapshot_to_delete.inode_bitmap_block);
+
+    // 候选块 = 本快照的块位图 & ~其余快照占用的块
+    // 其余快照每一步都重新收集：两步之间可能创建了新快照
+    std::vector<uint64_t> other_blocks(mask_words);
+    collect_snapshot_blocks(fd, snapshot_id, other_blocks.data());
+
+    std::vector<uint64_t> only_here = read_snapshot_block_bitmap(fd, snapshot, snapshot_copy_blocks(fd, snapshot));
+    for (int w = 0; w < mask_words; w++) {
+        only_here[w] = (w >= first_word && w < end_word) ? (only_here[w] & ~other_blocks[w]) : 0;
     }
-    if (snapshot_to_delete.block_bitmap_block > 0) {
-        free_block(fd, snapshot_to_delete.block_bitmap_block);
+    mask_data_region(g, only_here.data());
+
+    // 活跃文件系统已不再引用的块随快照一起释放（已空闲的块会被忽略）
+    // 前台的分配 / 释放不持有快照锁：计数检查和释放在分配器锁内一次完成，
+    // 刚被前台释放又重新分配出去的块计数已是 1，不会被释放第二次
+    std::vector<uint64_t> unreferenced(mask_words);
+    int freed = allocator_free_unreferenced_mask(fd, only_here.data(), mask_words, unreferenced.data());
+
+    // 其余块仍在使用但不再被任何快照共享：出生 epoch 改为当前值，之后就地写入
+    for (int w = 0; w < mask_words; w++) {
+        only_here[w] &= ~unreferenced[w];
     }
-    for (int i = 0; i < 16; i++) {
-        if (snapshot_to_delete.inode_table_blocks[i] > 0) {
-            free_block(fd, snapshot_to_delete.inode_table_blocks[i]);
-        }
+    set_block_birth_mask(fd, only_here.data(), epochs_get(fd).epoch);
+
+    return freed;
+}
+
+int snapshot_reclaim_finish(int fd, int snapshot_id) {
+    std::lock_guard<std::shared_mutex> snapshot_lock(g_snapshot_mutex);
+    JournalTransaction txn(fd, false);
+
+    Snapshot snapshot;
+    if (!read_snapshot_entry(fd, snapshot_id, &snapshot) || snapshot.active != SNAPSHOT_DELETING) {
+        return -1;
     }
-    
+
+    // 释放副本块和块号表
+    // 注意：这些块可能已经在回收时被处理过了（如果它们在快照位图中）
+    // free_block会检查bitmap，如果已经释放就不会重复操作
+    free_snapshot_copies(fd, snapshot);
+
+    // 回收完成：槽位可以复用
+    set_snapshot_state(fd, snapshot_id, SNAPSHOT_FREE);
+    allocator_sync(fd);
     return 0;
-}
\ No newline at end of file
+}
+
+// 挂载时继续回收上次没有回收完的快照（回收被关闭或崩溃打断）
+static void resume_snapshot_reclaim(int fd) {
+    std::vector<int> deleting;
+    for (const Snapshot& snapshot : snapshot_catalog_entries(fd, SNAPSHOT_DELETING)) {
+        deleting.push_back(snapshot.id);
+    }
+
+    for (int id : deleting) {
+        if (snapshot_reclaim_enqueue(fd, id) != 0) {
+            snapshot_reclaim_chunk(fd, id, 0, disk_geometry(fd)->block_count);
+            snapshot_reclaim_finish(fd, id);
+        }
+    }
+}
@@ -0,0 +1,353 @@
+// extent.cpp - inode 的 extent 映射实现
+#include "../include/extent.h"
+#include "../include/allocator.h"
+#include "../include/block_cache.h"
+#include "../include/bmap_cache.h"
+#include "../include/journal.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+using std::vector;
+
+namespace {
+
+// 内存中的一个树节点（block = -1 表示 inode 中的树根）
+struct ExtentNode {
+    int block = -1;
+    int depth = 0;
+    vector<Extent> items;
+};
+
+} // namespace
+
+static bool node_block_valid(const DiskGeometry& g, int block) {
+    return block >= g.data_block_start && block < g.block_count;
+}
+
+// 读一个树节点（经过 bmap 缓存），检查 magic、深度和项数
+static bool load_node(int fd, int block, int depth, ExtentNode* node) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    if (!node_block_valid(g, block)) {
+        return false;
+    }
+    const int header_words = sizeof(ExtentNodeHeader) / sizeof(int);
+    ExtentNodeHeader hdr;
+    if (bmap_cache_lookup(fd, block, 0, header_words, (int*)&hdr) != 0) {
+        return false;
+    }
+    if (hdr.magic != EXTENT_NODE_MAGIC || hdr.depth != depth ||
+        hdr.count <= 0 || hdr.count > extent_node_capacity(g.block_size)) {
+        return false;
+    }
+    node->block = block;
+    node->depth = depth;
+    node->items.resize(hdr.count);
+    const int item_words = sizeof(Extent) / sizeof(int);
+    return bmap_cache_lookup(fd, block, header_words, hdr.count * item_words, (int*)node->items.data()) == 0;
+}
+
+// 整块写回一个树节点，解码缓存中的旧内容作废
+static void store_node(int fd, const ExtentNode& node) {
+    const int block_size = disk_block_size(fd);
+    char buf[MAX_BLOCK_SIZE];
+    memset(buf, 0, block_size);
+    ExtentNodeHeader hdr = {EXTENT_NODE_MAGIC, node.depth, (int)node.items.size(), 0};
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), node.items.data(), node.items.size() * sizeof(Extent));
+    JournalMetadataScope metadata_scope;
+    write_block_cached(fd, node.block, buf);
+    bmap_cache_invalidate(fd, node.block);
+}
+
+// 索引项 i 覆盖 [items[i].logical, items[i + 1].logical)；第一项向前覆盖到 0
+static int child_slot(const vector<Extent>& items, int logical) {
+    auto it = std::upper_bound(items.begin(), items.end(), logical,
+                               [](int l, const Extent& e) { return l < e.logical; });
+    return it == items.begin() ? 0 : (int)(it - items.begin()) - 1;
+}
+
+// 按顺序追加一项，和前一项逻辑、物理都连续时合并
+static void push_merged(vector<Extent>& out, const Extent& e) {
+    if (!out.empty()) {
+        Extent& last = out.back();
+        if (last.logical + last.length == e.logical && last.start + last.length == e.start) {
+            last.length += e.length;
+            return;
+        }
+    }
+    out.push_back(e);
+}
+
+// 在叶子中放入 add：被它覆盖的部分从原有 extent 中切掉（一个 extent 最多切成前后两段）
+static void leaf_insert(vector<Extent>& items, const Extent& add) {
+    const int end = add.logical + add.length;
+    vector<Extent> out;
+    out.reserve(items.size() + 2);
+    bool placed = false;
+    for (const Extent& e : items) {
+        const int e_end = e.logical + e.length;
+        if (e_end <= add.logical || e.logical >= end) {
+            if (!placed && e.logical >= end) {
+                push_merged(out, add);
+                placed = true;
+            }
+            push_merged(out, e);
+            continue;
+        }
+        if (e.logical < add.logical) {
+            push_merged(out, Extent{e.logical, e.start, add.logical - e.logical});
+        }
+        if (!placed) {
+            push_merged(out, add);
+            placed = true;
+        }
+        if (e_end > end) {
+            push_merged(out, Extent{end, e.start + (end - e.logical), e_end - end});
+        }
+    }
+    if (!placed) {
+        push_merged(out, add);
+    }
+    items.swap(out);
+}
+
+static int map_items(int fd, const Extent* items, int count, int depth, int first, int n, int* out) {
+    int result = 0;
+    for (int i = 0; i < count; i++) {
+        const Extent& e = items[i];
+        if (depth == 0) {
+            if (e.logical >= first + n) {
+                break;
+            }
+            int lo = std::max(first, e.logical);
+            int hi = std::min(first + n, e.logical + e.length);
+            for (int l = lo; l < hi; l++) {
+                out[l - first] = e.start + (l - e.logical);
+            }
+            continue;
+        }
+        int lo = i == 0 ? INT_MIN : e.logical;
+        int hi = i + 1 < count ? items[i + 1].logical : INT_MAX;
+        if (lo >= first + n) {
+            break;
+        }
+        if (hi <= first) {
+            continue;
+        }
+        ExtentNode child;
+        if (!load_node(fd, e.start, depth - 1, &child) ||
+            map_items(fd, child.items.data(), (int)child.items.size(), depth - 1, first, n, out) != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+static void collect_items(int fd, const Extent* items, int count, int depth,
+                          vector<Extent>* extents, vector<int>* nodes) {
+    for (int i = 0; i < count; i++) {
+        if (depth == 0) {
+            if (extents) {
+                extents->push_back(items[i]);
+            }
+            continue;
+        }
+        ExtentNode child;
+        if (!load_node(fd, items[i].start, depth - 1, &child)) {
+            continue;
+        }
+        if (nodes) {
+            nodes->push_back(child.block);
+        }
+        collect_items(fd, child.items.data(), (int)child.items.size(), depth - 1, extents, nodes);
+    }
+}
+
+void extent_collect(int fd, const Inode* inode, vector<Extent>* extents, vector<int>* nodes) {
+    int count = std::min(std::max(inode->extent_count, 0), INODE_EXTENT_COUNT);
+    collect_items(fd, inode->extents, count, inode->extent_depth, extents, nodes);
+}
+
+// ==================== C 接口 ====================
+
+int extent_map(int fd, const Inode* inode, int first, int count, int* out) {
+    if (first < 0 || count < 0) {
+        return -1;
+    }
+    std::fill(out, out + count, -1);
+    int root_count = std::min(std::max(inode->extent_count, 0), INODE_EXTENT_COUNT);
+    return map_items(fd, inode->extents, root_count, inode->extent_depth, first, count, out);
+}
+
+int extent_insert(int fd, Inode* inode, int logical, int start, int count) {
+    if (count <= 0) {
+        return 0;
+    }
+    const int capacity = extent_node_capacity(disk_block_size(fd));
+
+    // 从根走到要修改的叶子
+    vector<ExtentNode> path(1);
+    path[0].depth = inode->extent_depth;
+    path[0].items.assign(inode->extents, inode->extents + std::min(std::max(inode->extent_count, 0), INODE_EXTENT_COUNT));
+    vector<int> slots;
+    while (path.back().depth > 0) {
+        const ExtentNode& parent = path.back();
+        if (parent.items.empty()) {
+            return -1;
+        }
+        int slot = child_slot(parent.items, logical);
+        ExtentNode child;
+        if (!load_node(fd, parent.items[slot].start, parent.depth - 1, &child)) {
+            return -1;
+        }
+        slots.push_back(slot);
+        path.push_back(std::move(child));
+    }
+
+    // 写回路径上的每一层最多复制一块、拆出一块，根满了再加一块：空间不够时什么都不改
+    int free_inodes = 0, free_blocks = 0;
+    if (allocator_get_free_counts(fd, &free_inodes, &free_blocks) && free_blocks < 2 * (int)path.size() + 1) {
+        return -1;
+    }
+
+    vector<Extent>& leaf = path.back().items;
+    bool appending = leaf.empty() || logical >= leaf.back().logical + leaf.back().length;
+    leaf_insert(leaf, Extent{logical, start, count});
+
+    // 从叶子往上写回：节点被共享时先复制；放不下时拆成两个（追加时左边留满），父节点增加一项
+    for (size_t level = path.size() - 1; level > 0; level--) {
+        ExtentNode& node = path[level];
+        ExtentNode& parent = path[level - 1];
+        int slot = slots[level - 1];
+
+        ExtentNode sibling;
+        if ((int)node.items.size() > capacity) {
+            int keep = appending ? capacity : (int)node.items.size() / 2;
+            sibling.depth = node.depth;
+            sibling.items.assign(node.items.begin() + keep, node.items.end());
+            node.items.resize(keep);
+            sibling.block = alloc_block(fd);
+            if (sibling.block == -1) {
+                return -1;
+            }
+        }
+        int block = copy_on_write_block(fd, node.block);
+        if (block == -1) {
+            if (sibling.block != -1) {
+                free_block(fd, sibling.block);
+            }
+            return -1;
+        }
+        node.block = block;
+        store_node(fd, node);
+        parent.items[slot].logical = node.items[0].logical;
+        parent.items[slot].start = block;
+        if (sibling.block != -1) {
+            store_node(fd, sibling);
+            parent.items.insert(parent.items.begin() + slot + 1, Extent{sibling.items[0].logical, sibling.block, 0});
+        }
+    }
+
+    // 根放不下：整个根移进一个新节点，inode 里只留指向它的一项，树高加一
+    ExtentNode& root = path[0];
+    if ((int)root.items.size() > INODE_EXTENT_COUNT) {
+        ExtentNode node;
+        node.block = alloc_block(fd);
+        if (node.block == -1) {
+            return -1;
+        }
+        node.depth = root.depth;
+        node.items = root.items;
+        store_node(fd, node);
+        root.items.assign(1, Extent{node.items[0].logical, node.block, 0});
+        root.depth++;
+    }
+
+    inode->extent_depth = root.depth;
+    inode->extent_count = (int)root.items.size();
+    std::copy(root.items.begin(), root.items.end(), inode->extents);
+    return 0;
+}
+
+void extent_release_all(int fd, Inode* inode) {
+    vector<Extent> extents;
+    vector<int> nodes;
+    extent_collect(fd, inode, &extents, &nodes);
+    for (const Extent& e : extents) {
+        for (int i = 0; i < e.length; i++) {
+            release_block(fd, e.start + i);
+        }
+    }
+    // 节点块号之后可能被复用，真正释放时解码缓存一并作废
+    for (int block : nodes) {
+        if (release_block(fd, block) == 1) {
+            bmap_cache_invalidate(fd, block);
+        }
+    }
+
+    inode->extent_depth = 0;
+    inode->extent_count = 0;
+    for (int i = 0; i < INODE_EXTENT_COUNT; i++) {
+        inode->extents[i] = Extent{0, -1, 0};
+    }
+}
+
+void extent_share_all(int fd, const Inode* inode) {
+    vector<Extent> extents;
+    vector<int> nodes;
+    extent_collect(fd, inode, &extents, &nodes);
+    for (const Extent& e : extents) {
+        for (int i = 0; i < e.length; i++) {
+            increment_block_ref_count(fd, e.start + i);
+        }
+    }
+    for (int block : nodes) {
+        increment_block_ref_count(fd, block);
+    }
+}
+
+int extent_count_extents(int fd, const Inode* inode) {
+    if (inode->extent_depth == 0) {
+        return std::min(std::max(inode->extent_count, 0), INODE_EXTENT_COUNT);
+    }
+    vector<Extent> extents;
+    extent_collect(fd, inode, &extents, nullptr);
+    return (int)extents.size();
+}
+
+int extent_fragmentation_report(int fd, FragmentationReport* report) {
+    memset(report, 0, sizeof(FragmentationReport));
+    const DiskGeometry& g = *disk_geometry(fd);
+    if (g.inode_count == 0) {
+        return -1;
+    }
+    for (int inode_id = 0; inode_id < g.inode_count; inode_id++) {
+        Inode inode;
+        if (allocator_inode_allocated(fd, inode_id) != 1 || read_inode(fd, inode_id, &inode) < 0 ||
+            inode.type != INODE_TYPE_FILE || (inode.flags & INODE_FLAG_INLINE) || inode.block_count <= 0) {
+            continue;
+        }
+        int extents = extent_count_extents(fd, &inode);
+        report->files++;
+        report->blocks += inode.block_count;
+        report->extents += extents;
+        if (extents > 1) {
+            report->fragmented_files++;
+        }
+    }
+    report->avg_extent_blocks = report->extents ? (double)report->blocks / report->extents : 0.0;
+    return 0;
+}
+
+void extent_print_fragmentation(int fd) {
+    FragmentationReport r;
+    if (extent_fragmentation_report(fd, &r) != 0) {
+        return;
+    }
+    std::cout << "\n📊 Fragmentation Report:" << std::endl;
+    std::cout << "   Files (with blocks): " << r.files << std::endl;
+    std::cout << "   Fragmented files:    " << r.fragmented_files << std::endl;
+    std::cout << "   Blocks / extents:    " << r.blocks << " / " << r.extents << std::endl;
+    std::cout << "   Avg extent length:   " << r.avg_extent_blocks << " blocks" << std::endl;
+}
@@ -0,0 +1,166 @@
+// geometry.cpp - 磁盘布局：mkfs 选择布局，挂载后按 fd 查询
+#include "../include/disk.h"
+#include "../include/inode.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+// 默认每 16KB 磁盘空间一个 inode
+static const long long BYTES_PER_INODE = 16 * 1024;
+static const int MIN_INODE_COUNT = 64;
+
+// 日志大小随磁盘增长：每 128 块一个日志块，限制在 [64, 1024] 块
+static const int BLOCKS_PER_JOURNAL_BLOCK = 128;
+static const int MIN_JOURNAL_BLOCKS = 64;
+static const int MAX_JOURNAL_BLOCKS = 1024;
+
+// 块号是 int，位图位号也是 int：总块数不超过 2^30
+static const long long MAX_BLOCK_COUNT = 1LL << 30;
+
+static int blocks_for(long long bytes, int block_size) {
+    return (int)((bytes + block_size - 1) / block_size);
+}
+
+// 快照副本块号表最多能记录的副本块数
+static long long snapshot_copy_capacity(int block_size) {
+    return (long long)SNAPSHOT_MAP_BLOCKS * (block_size / (int)sizeof(int));
+}
+
+int disk_plan_geometry(long long disk_size, int block_size, int inode_count, DiskGeometry* geometry) {
+    if (!geometry || block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE ||
+        (block_size & (block_size - 1)) != 0 || inode_count < 0) {
+        return -1;
+    }
+    long long block_count = disk_size / block_size;
+    if (block_count <= 0 || block_count > MAX_BLOCK_COUNT) {
+        return -1;
+    }
+
+    // inode 数向上取整到 inode 表的整块
+    int inodes_per_block = block_size / (int)sizeof(Inode);
+    long long inodes = inode_count > 0 ? inode_count : std::max<long long>(MIN_INODE_COUNT, disk_size / BYTES_PER_INODE);
+    inodes = (inodes + inodes_per_block - 1) / inodes_per_block * inodes_per_block;
+    if (inodes > block_count) {
+        return -1;
+    }
+
+    DiskGeometry g{};
+    g.block_size = block_size;
+    g.block_count = (int)block_count;
+    g.inode_count = (int)inodes;
+
+    int next = SUPERBLOCK_BLOCK + 1;
+    auto place = [&next](int* start, int* blocks, int count) {
+        *start = next;
+        *blocks = count;
+        next += count;
+    };
+    place(&g.inode_bitmap_start, &g.inode_bitmap_blocks, blocks_for((inodes + 7) / 8, block_size));
+    place(&g.block_bitmap_start, &g.block_bitmap_blocks, blocks_for((block_count + 7) / 8, block_size));
+    place(&g.inode_table_start, &g.inode_table_blocks, (int)(inodes / inodes_per_block));
+    place(&g.snapshot_table_start, &g.snapshot_table_blocks, SNAPSHOT_TABLE_BLOCKS);
+    place(&g.ref_count_start, &g.ref_count_blocks, blocks_for(block_count, block_size));
+    place(&g.birth_table_start, &g.birth_table_blocks, blocks_for(block_count * (long long)sizeof(uint32_t), block_size));
+    int journal_blocks = (int)std::min<long long>(MAX_JOURNAL_BLOCKS,
+                                                  std::max<long long>(MIN_JOURNAL_BLOCKS, block_count / BLOCKS_PER_JOURNAL_BLOCK));
+    place(&g.journal_start, &g.journal_blocks, journal_blocks);
+    g.data_block_start = next;
+
+    if (!disk_geometry_valid(&g)) {
+        return -1;
+    }
+    *geometry = g;
+    return 0;
+}
+
+int disk_geometry_valid(const DiskGeometry* geometry) {
+    if (!geometry) {
+        return 0;
+    }
+    const DiskGeometry& g = *geometry;
+    if (g.block_size < MIN_BLOCK_SIZE || g.block_size > MAX_BLOCK_SIZE || (g.block_size & (g.block_size - 1)) != 0 ||
+        g.block_count <= 0 || g.block_count > MAX_BLOCK_COUNT || g.inode_count <= 0 ||
+        (int)sizeof(Snapshot) > g.block_size) {
+        return 0;
+    }
+
+    // 各区域按顺序首尾相接，大小足够容纳对应的表
+    long long bits_per_block = (long long)g.block_size * 8;
+    int inodes_per_block = g.block_size / (int)sizeof(Inode);
+    const int regions[][3] = {
+        {g.inode_bitmap_start, g.inode_bitmap_blocks, (int)((g.inode_count + bits_per_block - 1) / bits_per_block)},
+        {g.block_bitmap_start, g.block_bitmap_blocks, (int)((g.block_count + bits_per_block - 1) / bits_per_block)},
+        {g.inode_table_start, g.inode_table_blocks, (g.inode_count + inodes_per_block - 1) / inodes_per_block},
+        {g.snapshot_table_start, g.snapshot_table_blocks, 1},
+        {g.ref_count_start, g.ref_count_blocks, blocks_for(g.block_count, g.block_size)},
+        {g.birth_table_start, g.birth_table_blocks, blocks_for(g.block_count * (long long)sizeof(uint32_t), g.block_size)},
+        {g.journal_start, g.journal_blocks, 8},
+    };
+    int next = SUPERBLOCK_BLOCK + 1;
+    for (const auto& region : regions) {
+        if (region[0] != next || region[1] < region[2]) {
+            return 0;
+        }
+        next += region[1];
+    }
+    // 数据区至少放得下根目录的第一个块
+    if (g.data_block_start != next || g.data_block_start + 1 >= g.block_count) {
+        return 0;
+    }
+
+    // 快照副本：整盘快照（两张位图 + inode 表）和最大的子树快照（编号列表 + inode 副本）都要放得下
+    // 子树快照的块号列表随子树的数据量增长，放不下时 create_subtree_snapshot 失败
+    long long full = (long long)g.inode_bitmap_blocks + g.block_bitmap_blocks + g.inode_table_blocks;
+    long long subtree = blocks_for((long long)g.inode_count * sizeof(int), g.block_size) + g.inode_table_blocks;
+    return std::max(full, subtree) <= snapshot_copy_capacity(g.block_size) ? 1 : 0;
+}
+
+// ==================== 每个磁盘的布局 ====================
+
+namespace {
+
+// 块缓存的每次读写都要查块大小：fd 较小时按 fd 直接索引，不加锁
+const int DIRECT_SLOTS = 1024;
+std::atomic<const DiskGeometry*> g_slots[DIRECT_SLOTS];
+
+std::shared_mutex g_registry_mutex;
+std::unordered_map<int, std::unique_ptr<DiskGeometry>> g_geometries;
+
+const DiskGeometry g_unmounted{};
+
+}  // namespace
+
+void geometry_load(int fd, const DiskGeometry* geometry) {
+    auto g = std::make_unique<DiskGeometry>(*geometry);
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    if (fd >= 0 && fd < DIRECT_SLOTS) {
+        g_slots[fd].store(g.get(), std::memory_order_release);
+    }
+    g_geometries[fd] = std::move(g);
+}
+
+void geometry_discard(int fd) {
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    if (fd >= 0 && fd < DIRECT_SLOTS) {
+        g_slots[fd].store(nullptr, std::memory_order_release);
+    }
+    g_geometries.erase(fd);
+}
+
+const DiskGeometry* disk_geometry(int fd) {
+    if (fd >= 0 && fd < DIRECT_SLOTS) {
+        const DiskGeometry* g = g_slots[fd].load(std::memory_order_acquire);
+        return g ? g : &g_unmounted;
+    }
+    std::shared_lock<std::shared_mutex> lock(g_registry_mutex);
+    auto it = g_geometries.find(fd);
+    return it != g_geometries.end() ? it->second.get() : &g_unmounted;
+}
+
+int disk_block_size(int fd) {
+    return disk_geometry(fd)->block_size;
+}
@@ -1,36 +1,62 @@
 // inode.cpp
 #include "../include/inode.h"
+#include "../include/allocator.h"
 #include "../include/block_cache.h"
+#include "../include/extent.h"
+#include "../include/journal.h"
 #include <cstring>
 #include <vector>
 #include <algorithm>
+#include <mutex>
 using std::vector;
 using std::min;
 
+static_assert(sizeof(Inode) == 128, "inode record must stay 128 bytes");
+
+// 清空映射区：普通文件回到内联状态（内联区全 0），其他 inode 是空的 extent 映射
+static void reset_content(Inode* inode, bool as_inline) {
+    inode->extent_depth = 0;
+    inode->extent_count = 0;
+    memset(inode->inline_data, 0, INODE_INLINE_SIZE);
+    if (as_inline) {
+        inode->flags |= INODE_FLAG_INLINE;
+    } else {
+        inode->flags &= ~INODE_FLAG_INLINE;
+        for (int i = 0; i < INODE_EXTENT_COUNT; i++) {
+            inode->extents[i] = Extent{0, -1, 0};
+        }
+    }
+}
+
 // 初始化inode
 void init_inode(Inode* inode, int type) {
     inode->type = type;
     inode->size = 0;
     inode->block_count = 0;
+    inode->dir_index = -1;
+    inode->flags = 0;
     
-    // 初始化直接块指针
-    for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
-        inode->direct_blocks[i] = -1;
-    }
-    
-    // 初始化间接块指针
-    inode->indirect_block = -1;
+    // 新的普通文件先内联存放，目录从空的 extent 映射开始
+    reset_content(inode, type == INODE_TYPE_FILE);
 }
 
+// inode 表块的读-改-写：一个块里有多个 inode，并发写同一块里的不同 inode 时必须串行，
+// 否则后写回的整块会覆盖先写回的 inode（读 inode 只复制一次整块，不需要加锁）
+// inode 表的块数随布局变化，锁按块号分条
+static const int INODE_BLOCK_LOCK_STRIPES = 64;
+static std::mutex g_inode_block_locks[INODE_BLOCK_LOCK_STRIPES];
+
 // 将inode写入磁盘
 int write_inode(int fd, int inode_id, const Inode* inode) {
     // 计算inode在inode表中的位置
-    int inode_per_block = BLOCK_SIZE / sizeof(Inode);
-    int block_id = INODE_TABLE_START + (inode_id / inode_per_block);
+    const DiskGeometry& g = *disk_geometry(fd);
+    int inode_per_block = g.block_size / sizeof(Inode);
+    int block_id = g.inode_table_start + (inode_id / inode_per_block);
     int offset = inode_id % inode_per_block;
     
     // 读取对应的块
-    char buf[BLOCK_SIZE];
+    std::lock_guard<std::mutex> lock(g_inode_block_locks[(inode_id / inode_per_block) % INODE_BLOCK_LOCK_STRIPES]);
+    char buf[MAX_BLOCK_SIZE];
     read_block_cached(fd, block_id, buf);
     
     // 更新inode
@@ -46,12 +72,13 @@ int write_inode(int fd, int inode_id, const Inode* inode) {
 // 从磁盘读取inode
 int read_inode(int fd, int inode_id, Inode* inode) {
     // 计算inode在inode表中的位置
-    int inode_per_block = BLOCK_SIZE / sizeof(Inode);
-    int block_id = INODE_TABLE_START + (inode_id / inode_per_block);
+    const DiskGeometry& g = *disk_geometry(fd);
+    int inode_per_block = g.block_size / sizeof(Inode);
+    int block_id = g.inode_table_start + (inode_id / inode_per_block);
     int offset = inode_id % inode_per_block;
     
     // 读取对应的块
-    char buf[BLOCK_SIZE];
+    char buf[MAX_BLOCK_SIZE];
     read_block_cached(fd, block_id, buf);
     
     // 获取inode
@@ -61,47 +88,44 @@ int read_inode(int fd, int inode_id, Inode* inode) {
     return 0;
 }
 
+// 最后一个数据块之后的块号（就近分配的目标），没有数据块时 -1
+static int goal_after_last(int fd, const Inode* inode) {
+    if (inode->block_count <= 0 || (inode->flags & INODE_FLAG_INLINE)) {
+        return -1;
+    }
+    int last = -1;
+    extent_map(fd, inode, inode->block_count - 1, 1, &last);
+    return last >= 0 ? last + 1 : -1;
+}
+
+void inode_write_begin(int fd, int inode_id) {
+    allocator_reserve_begin(fd, inode_id);
+}
+
+void inode_write_end(int fd, int inode_id) {
+    allocator_reserve_end(fd, inode_id);
+}
+
 // 为inode分配一个数据块
 int inode_alloc_block(int fd, Inode* inode) {
-    // 分配一个数据块
-    int block_id = alloc_block(fd);
+    // 内联的文件：空文件直接改成 extent 映射，已有内容要经过 inode_write_data 搬出
+    if (inode->flags & INODE_FLAG_INLINE) {
+        if (inode->size > 0) {
+            return -1;
+        }
+        reset_content(inode, false);
+    }
+    
+    // 分配一个数据块（紧接在最后一块之后）
+    int block_id = alloc_block_goal(fd, goal_after_last(fd, inode), -1);
     if (block_id == -1) {
         return -1; // 没有可用的数据块
     }
     
-    // 如果直接块还有空间
-    if (inode->block_count < DIRECT_BLOCK_COUNT) {
-        inode->direct_blocks[inode->block_count] = block_id;
-    } else {
-        // 需要使用间接块
-        // 如果还没有间接块，则分配一个
-        if (inode->indirect_block == -1) {
-            inode->indirect_block = alloc_block(fd);
-            if (inode->indirect_block == -1) {
-                // 回滚之前分配的数据块
-                free_block(fd, block_id);
-                return -1;
-            }
-            
-            // 初始化间接块
-            int pointers[POINTERS_PER_BLOCK];
-            for (int i = 0; i < POINTERS_PER_BLOCK; i++) {
-                pointers[i] = -1;
-            }
-            pointers[0] = block_id;
-            write_block_cached(fd, inode->indirect_block, pointers);
-        } else {
-            // 读取现有的间接块
-            int pointers[POINTERS_PER_BLOCK];
-            read_block_cached(fd, inode->indirect_block, pointers);
-            
-            // 在间接块中找到空闲位置
-            int indirect_index = inode->block_count - DIRECT_BLOCK_COUNT;
-            pointers[indirect_index] = block_id;
-            
-            // 写回间接块
-            write_block_cached(fd, inode->indirect_block, pointers);
-        }
+    // 追加到映射末尾（与上一个 extent 物理连续时直接延长它）
+    if (extent_insert(fd, inode, inode->block_count, block_id, 1) != 0) {
+        free_block(fd, block_id);
+        return -1;
     }
     
     inode->block_count++;
@@ -113,143 +137,165 @@ int inode_alloc_block(int fd, Inode* inode) {
 // 释放inode占用的所有数据块
 // 修正 inode_free_blocks 函数，确保正确处理引用计数
 void inode_free_blocks(int fd, Inode* inode) {
-    // 释放直接块
-    for (int i = 0; i < inode->block_count && i < DIRECT_BLOCK_COUNT; i++) {
-        if (inode->direct_blocks[i] != -1) {
-            decrement_block_ref_count(fd, inode->direct_blocks[i]);
-            if (get_block_ref_count(fd, inode->direct_blocks[i]) == 0) {
-                free_block(fd, inode->direct_blocks[i]);
-            }
-        }
+    // 目录的哈希索引随目录一起释放
+    if (inode->type == INODE_TYPE_DIR && inode->dir_index >= 0) {
+        dir_index_drop(fd, inode);
     }
     
-    // 释放间接块指向的数据块
-    if (inode->indirect_block != -1) {
-        int pointers[POINTERS_PER_BLOCK];
-        read_block_cached(fd, inode->indirect_block, pointers);
-        
-        int indirect_count = inode->block_count - DIRECT_BLOCK_COUNT;
-        for (int i = 0; i < indirect_count && i < POINTERS_PER_BLOCK; i++) {
-            if (pointers[i] != -1) {
-                decrement_block_ref_count(fd, pointers[i]);
-                if (get_block_ref_count(fd, pointers[i]) == 0) {
-                    free_block(fd, pointers[i]);
-                }
-            }
-        }
-        
-        // 释放间接块本身
-        decrement_block_ref_count(fd, inode->indirect_block);
-        if (get_block_ref_count(fd, inode->indirect_block) == 0) {
-            free_block(fd, inode->indirect_block);
-        }
-    }
-    
-    // 重置inode
-    for (int i = 0; i < DIRECT_BLOCK_COUNT; i++) {
-        inode->direct_blocks[i] = -1;
+    // 释放数据块和 extent 树节点，映射清空；截断为空的普通文件回到内联状态
+    if (!(inode->flags & INODE_FLAG_INLINE)) {
+        extent_release_all(fd, inode);
     }
-    inode->indirect_block = -1;
+    reset_content(inode, inode->type == INODE_TYPE_FILE);
     inode->block_count = 0;
     inode->size = 0;
 }
 
+// 内联内容搬到数据块：清掉内联状态，原有内容按普通文件重新写入
+static int promote_inline(int fd, Inode* inode, int inode_id) {
+    char content[INODE_INLINE_SIZE];
+    int size = min(inode->size, INODE_INLINE_SIZE);
+    memcpy(content, inode->inline_data, INODE_INLINE_SIZE);
+    reset_content(inode, false);
+    inode->size = 0;
+    if (size > 0 && inode_write_data(fd, inode, inode_id, content, 0, size) != size) {
+        // 搬不出去（空间不足）：已分配的块退回，保持内联
+        extent_release_all(fd, inode);
+        reset_content(inode, true);
+        memcpy(inode->inline_data, content, INODE_INLINE_SIZE);
+        inode->block_count = 0;
+        inode->size = size;
+        return -1;
+    }
+    return 0;
+}
+
 // 修改inode_write_data函数以支持COW
 // 在 inode.cpp 中修改
 int inode_write_data(int fd, Inode* inode, int inode_id, 
                      const char* data, int offset, int size) {
     if (size <= 0) return 0;
     
+    // 目录的数据块是结构块（目录项指向 inode），写入经过日志
+    JournalMetadataScope metadata_scope(inode->type == INODE_TYPE_DIR);
+    
     // 计算写入结束位置和需要的总块数
+    const int block_size = disk_block_size(fd);
+    if (offset < 0 || (long long)offset + size > MAX_FILE_SIZE) {
+        return -1; // 超出单个文件的最大大小
+    }
     int end_pos = offset + size;
-    int blocks_needed = (end_pos + BLOCK_SIZE - 1) / BLOCK_SIZE;
     
-    // 如果需要更多块，分配它们
-    while (inode->block_count < blocks_needed) {
-        int block_id = alloc_block(fd);
+    // 内联的小文件：写完仍放得下就只改 inode；放不下时先把已有内容搬到数据块
+    if (inode->flags & INODE_FLAG_INLINE) {
+        if (end_pos <= INODE_INLINE_SIZE) {
+            memcpy(inode->inline_data + offset, data, size);
+            if (end_pos > inode->size) {
+                inode->size = end_pos;
+            }
+            write_inode(fd, inode_id, inode);
+            return size;
+        }
+        if (promote_inline(fd, inode, inode_id) != 0) {
+            return -1;
+        }
+    }
+    
+    int blocks_needed = (int)(((long long)end_pos + block_size - 1) / block_size);
+    
+    // 新块按物理连续段登记：分配器连续给出相邻块时，整段只插入一个 extent
+    int run_logical = inode->block_count;
+    int run_start = -1;
+    int run_length = 0;
+    auto flush_run = [&]() {
+        if (run_length == 0) {
+            return true;
+        }
+        if (extent_insert(fd, inode, run_logical, run_start, run_length) != 0) {
+            for (int i = 0; i < run_length; i++) {
+                free_block(fd, run_start + i);
+            }
+            run_length = 0;
+            return false;
+        }
+        inode->block_count = run_logical + run_length;
+        run_length = 0;
+        return true;
+    };
+    
+    // 如果需要更多块，分配它们：每一块都以上一块之后为目标，写入期间有预留窗口时从窗口里取
+    char zero_buf[MAX_BLOCK_SIZE];
+    memset(zero_buf, 0, block_size);
+    int goal = blocks_needed > inode->block_count ? goal_after_last(fd, inode) : -1;
+    while (inode->block_count + run_length < blocks_needed) {
+        int block_id = alloc_block_goal(fd, goal, inode_id);
         if (block_id == -1) {
+            flush_run();
             return -1; // 分配失败
         }
         
         // 清零新分配的块（重要！避免读取垃圾数据）
-        char zero_buf[BLOCK_SIZE];
-        memset(zero_buf, 0, BLOCK_SIZE);
         write_block_cached(fd, block_id, zero_buf);
         
-        // 添加到 inode 的块列表
-        if (inode->block_count < DIRECT_BLOCK_COUNT) {
-            inode->direct_blocks[inode->block_count] = block_id;
-        } else {
-            // 需要间接块
-            if (inode->block_count == DIRECT_BLOCK_COUNT) {
-                // 第一次需要间接块，分配它
-                inode->indirect_block = alloc_block(fd);
-                if (inode->indirect_block == -1) {
-                    free_block(fd, block_id);
-                    return -1;
-                }
-                // 初始化间接块
-                int pointers[POINTERS_PER_BLOCK];
-                for (int i = 0; i < POINTERS_PER_BLOCK; i++) {
-                    pointers[i] = -1;
-                }
-                write_block_cached(fd, inode->indirect_block, (void*)pointers);
-            }
-            
-            // 添加到间接块
-            int pointers[POINTERS_PER_BLOCK];
-            read_block_cached(fd, inode->indirect_block, pointers);
-            pointers[inode->block_count - DIRECT_BLOCK_COUNT] = block_id;
-            write_block_cached(fd, inode->indirect_block, (void*)pointers);
+        if (run_length > 0 && block_id != run_start + run_length && !flush_run()) {
+            free_block(fd, block_id);
+            return -1;
         }
-        
-        inode->block_count++;
+        if (run_length == 0) {
+            run_logical = inode->block_count;
+            run_start = block_id;
+        }
+        run_length++;
+        goal = block_id + 1;
+    }
+    if (!flush_run()) {
+        return -1;
     }
     
+    // 一次映射出写入范围内所有块的物理块号
+    int first_block = offset / block_size;
+    vector<int> block_ids(blocks_needed - first_block);
+    extent_map(fd, inode, first_block, blocks_needed - first_block, block_ids.data());
+    
     // 写入数据到各个块
     int written = 0;
     int current_offset = offset;
     
     while (written < size) {
-        int block_index = current_offset / BLOCK_SIZE;
-        int block_offset = current_offset % BLOCK_SIZE;
-        int to_write = std::min(size - written, BLOCK_SIZE - block_offset);
+        int block_index = current_offset / block_size;
+        int block_offset = current_offset % block_size;
+        int to_write = std::min(size - written, block_size - block_offset);
         
         // 获取块 ID
-        int block_id;
-        if (block_index < DIRECT_BLOCK_COUNT) {
-            block_id = inode->direct_blocks[block_index];
-        } else {
-            int pointers[POINTERS_PER_BLOCK];
-            read_block_cached(fd, inode->indirect_block, pointers);
-            block_id = pointers[block_index - DIRECT_BLOCK_COUNT];
-        }
+        int block_id = block_ids[block_index - first_block];
         
-        // COW检查：如果块的引用计数 > 1，需要复制块
-        int ref_count = get_block_ref_count(fd, block_id);
-        if (ref_count > 1) {
-            // 执行COW：复制块
-            int new_block_id = copy_on_write_block(fd, block_id);
+        // COW检查：块被其他 inode 共享（引用计数 > 1）或属于快照（出生 epoch 不晚于最新快照）
+        if (block_needs_cow(fd, block_id)) {
+            // 执行COW：复制块，副本紧接在前一个逻辑块之后（改写整个文件时副本连成一段）
+            int prev = -1;
+            if (block_index > first_block) {
+                prev = block_ids[block_index - first_block - 1];
+            } else if (block_index > 0) {
+                extent_map(fd, inode, block_index - 1, 1, &prev);
+            }
+            int new_block_id = copy_on_write_block_goal(fd, block_id, prev >= 0 ? prev + 1 : -1, inode_id);
             if (new_block_id == -1) {
                 return written; // COW失败，返回已写入的字节数
             }
             
-            // 更新inode中的块指针
-            if (block_index < DIRECT_BLOCK_COUNT) {
-                inode->direct_blocks[block_index] = new_block_id;
-            } else {
-                int pointers[POINTERS_PER_BLOCK];
-                read_block_cached(fd, inode->indirect_block, pointers);
-                pointers[block_index - DIRECT_BLOCK_COUNT] = new_block_id;
-                write_block_cached(fd, inode->indirect_block, (void*)pointers);
+            // 把这个逻辑块改映射到新块（extent 从中间切开；路径上被共享的树节点一并复制）
+            if (extent_insert(fd, inode, block_index, new_block_id, 1) != 0) {
+                free_block(fd, new_block_id);
+                return written;
             }
             
             block_id = new_block_id;
+            block_ids[block_index - first_block] = block_id;
         }
         
         // 如果不是整块写入，需要先读取再写入
-        if (block_offset != 0 || to_write != BLOCK_SIZE) {
-            char temp_buf[BLOCK_SIZE];
+        if (block_offset != 0 || to_write != block_size) {
+            char temp_buf[MAX_BLOCK_SIZE];
             read_block_cached(fd, block_id, temp_buf);
             memcpy(temp_buf + block_offset, data + written, to_write);
             write_block_cached(fd, block_id, temp_buf);
@@ -266,16 +312,90 @@ int inode_write_data(int fd, Inode* inode, int inode_id,
         inode->size = end_pos;
     }
     
-    // 写回 inode
+    // 写回 inode（所有读写都经过同一个块缓存，无需每次写后刷新）
     write_inode(fd, inode_id, inode);
     
-    // 刷新缓存确保数据立即可见（对并发操作很重要）
-    block_cache_flush(fd);
-    
     return written;
 }
 
+// ==================== 顺序读预读 ====================
+
+// 预读窗口（块数）：顺序流从 READAHEAD_MIN 开始，每发一批预读翻倍，最多 READAHEAD_MAX
+static const int READAHEAD_MIN = 4;
+static const int READAHEAD_MAX = 64;
+static const int READAHEAD_SLOTS = 64;
+
+// 每个"文件"的顺序读状态，按 (fd, 第一个 extent) 散列到固定槽位
+// 槽位冲突或块号复用只会让预读判断失误，不影响读到的数据
+struct ReadaheadState {
+    std::mutex mutex;
+    bool used = false;
+    int fd = -1;
+    int file_key = -1;    // inode 中第一个 extent 的物理块号
+    int next_block = 0;   // 上一次读取之后的下一个字节所在的逻辑块
+    int window = READAHEAD_MIN;
+    int ra_end = 0;       // 已预读到的逻辑块（不含）
+};
+static ReadaheadState g_readahead[READAHEAD_SLOTS];
+
+// 读取完成后更新顺序读状态；剩余预读量不足半个窗口时，把下一个窗口读入块缓存
+static void readahead_after_read(int fd, const Inode* inode, int first_block, int next_block) {
+    if (inode->block_count <= 1 || next_block >= inode->block_count) {
+        return;
+    }
+    
+    int file_key = inode->extents[0].start;
+    size_t h = (size_t)(uint32_t)file_key * 0x9E3779B1u ^ (size_t)(uint32_t)fd;
+    ReadaheadState& st = g_readahead[h % READAHEAD_SLOTS];
+    
+    int start, end;
+    {
+        std::lock_guard<std::mutex> lock(st.mutex);
+        bool same_file = st.used && st.fd == fd && st.file_key == file_key;
+        bool sequential = same_file && first_block == st.next_block;
+        
+        if (!sequential) {
+            // 新的读取流：从文件开头读视为顺序读的开始，其他位置先只记录位置
+            st.used = true;
+            st.fd = fd;
+            st.file_key = file_key;
+            st.window = READAHEAD_MIN;
+            st.ra_end = next_block;
+            if (first_block != 0) {
+                st.next_block = next_block;
+                return;
+            }
+        }
+        st.next_block = next_block;
+        
+        if (st.ra_end - next_block > st.window / 2) {
+            return;  // 已预读的部分还够用
+        }
+        if (sequential) {
+            st.window = min(st.window * 2, READAHEAD_MAX);
+        }
+        start = std::max(st.ra_end, next_block);
+        end = min(next_block + st.window, inode->block_count);
+        if (start >= end) {
+            return;
+        }
+        st.ra_end = end;
+    }
+    
+    int ids[READAHEAD_MAX];
+    extent_map(fd, inode, start, end - start, ids);
+    int valid = 0;
+    for (int i = 0; i < end - start; i++) {
+        if (ids[i] >= 0) {
+            ids[valid++] = ids[i];
+        }
+    }
+    block_cache_prefetch(fd, ids, valid);
+}
+
 // 从inode读取数据
+// 一次读取涉及的逻辑块先整体映射为物理块号，再交给 read_blocks_cached：
+// 命中的块从缓存复制，未命中的物理连续段合并成一次 preadv；顺序读时预读下一个窗口
 int inode_read_data(int fd, const Inode* inode, char* buffer, int offset, int size) {
     if (size <= 0 || offset >= inode->size) return 0;
     
@@ -284,43 +404,73 @@ int inode_read_data(int fd, const Inode* inode, char* buffer, int offset, int si
         size = inode->size - offset;
     }
     
-    int bytes_read = 0;
-    int current_offset = offset;
-    int remaining = size;
-    
-    while (remaining > 0) {
-        // 计算当前数据应该读取的逻辑块号和块内偏移
-        int logical_block_num = current_offset / BLOCK_SIZE;
-        int block_offset = current_offset % BLOCK_SIZE;
-        int chunk_size = BLOCK_SIZE - block_offset;
-        if (chunk_size > remaining) {
-            chunk_size = remaining;
+    // 内联的文件：内容就在 inode 里
+    if (inode->flags & INODE_FLAG_INLINE) {
+        if (offset + size > INODE_INLINE_SIZE) {
+            size = std::max(INODE_INLINE_SIZE - offset, 0);  // 损坏的 size 不越过内联区
         }
-        
+        memcpy(buffer, inode->inline_data + offset, size);
+        return size;
+    }
+    
+    const int block_size = disk_block_size(fd);
+    int first_block = offset / block_size;
+    int last_block = (offset + size - 1) / block_size;
+    if (first_block >= inode->block_count) {
+        return 0;
+    }
+    if (last_block >= inode->block_count) {
         // 检查是否超出文件范围
-        if (logical_block_num >= inode->block_count) {
-            break;
-        }
-        
-        // 获取物理块号
+        last_block = inode->block_count - 1;
+        size = (last_block + 1) * block_size - offset;
+    }
+    int count = last_block - first_block + 1;
+    
+    if (count == 1) {
+        // 单块读取（目录项等小读取）：不需要批量路径
         int physical_block_id;
-        if (logical_block_num < DIRECT_BLOCK_COUNT) {
-            physical_block_id = inode->direct_blocks[logical_block_num];
-        } else {
-            // 处理间接块
-            int indirect_index = logical_block_num - DIRECT_BLOCK_COUNT;
-            int pointers[POINTERS_PER_BLOCK];
-            read_block_cached(fd, inode->indirect_block, pointers);
-            physical_block_id = pointers[indirect_index];
-        }
+        extent_map(fd, inode, first_block, 1, &physical_block_id);
+        read_data_block(fd, physical_block_id, buffer, offset % block_size, size);
+    } else {
+        vector<int> ids(count);
+        extent_map(fd, inode, first_block, count, ids.data());
         
-        // 从块中读取数据
-        read_data_block(fd, physical_block_id, buffer + bytes_read, block_offset, chunk_size);
+        // 完整落在读取范围内的块直接读进调用者缓冲区，首尾不完整的块经过暂存区
+        char head[MAX_BLOCK_SIZE];
+        char tail[MAX_BLOCK_SIZE];
+        vector<int> read_ids;
+        vector<void*> bufs;
+        read_ids.reserve(count);
+        bufs.reserve(count);
+        for (int i = 0; i < count; i++) {
+            int block_start = (first_block + i) * block_size;
+            void* dst;
+            if (block_start < offset) {
+                dst = head;
+            } else if (block_start + block_size > offset + size) {
+                dst = tail;
+            } else {
+                dst = buffer + (block_start - offset);
+            }
+            if (ids[i] < 0) {
+                memset(dst, 0, block_size);  // 损坏的块指针按空洞处理
+                continue;
+            }
+            read_ids.push_back(ids[i]);
+            bufs.push_back(dst);
+        }
+        read_blocks_cached(fd, read_ids.data(), (int)read_ids.size(), bufs.data());
         
-        bytes_read += chunk_size;
-        current_offset += chunk_size;
-        remaining -= chunk_size;
+        int head_offset = offset % block_size;
+        if (head_offset != 0) {
+            memcpy(buffer, head + head_offset, block_size - head_offset);
+        }
+        int tail_size = (offset + size) % block_size;
+        if (tail_size != 0) {
+            memcpy(buffer + (last_block * block_size - offset), tail, tail_size);
+        }
     }
     
-    return bytes_read;
-}
\ No newline at end of file
+    readahead_after_read(fd, inode, first_block, (offset + size) / block_size);
+    return size;
+}
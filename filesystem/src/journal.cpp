@@ -0,0 +1,795 @@
+// journal.cpp - 元数据日志实现
+#include "../include/journal.h"
+#include "../include/allocator.h"
+#include "../include/block_cache.h"
+#include "../include/block_device.h"
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const uint32_t JOURNAL_MAGIC = 0x4A524E4C;  // 'JRNL'
+const uint32_t RECORD_DESCRIPTOR = 1;
+const uint32_t RECORD_COMMIT = 2;
+const uint32_t RECORD_REMOTE = 3;    // 远端描述块：后面跟 count 对（原块号，暂存块号），映像在暂存块里
+
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t sequence;   // 日志开头第一个事务的序号；更小的序号都已检查点，作废
+};
+
+// 描述块和提交块共用的记录头，描述块后面跟 count 个块号（远端描述块跟 count 对块号）
+struct JournalRecord {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t sequence;
+    uint32_t count;
+    uint32_t checksum;   // 只在提交块中有效：块号列表和全部映像的校验和
+};
+
+// 日志区在磁盘布局中的位置：日志头之后是循环日志，一个事务至少占描述块和提交块
+struct JournalLayout {
+    int block_size;
+    int header;                  // 日志头块号（= journal_start，它之前的块都经过日志）
+    int log_start;
+    int log_blocks;
+    int max_transaction_blocks;  // 日志放得下、描述块也列得下的最大映像数
+    int split_blocks;            // 当前事务达到这么多块时，新操作开始前先提交（见 journal_begin）
+    int pairs_per_remote;        // 一个远端描述块列得下的块号对数
+    int data_block_start;        // 此后的块只有结构块（见 journal.h）经过日志
+    int block_count;
+
+    explicit JournalLayout(const DiskGeometry& g)
+        : block_size(g.block_size),
+          header(g.journal_start),
+          log_start(g.journal_start + 1),
+          log_blocks(g.journal_blocks - 1),
+          max_transaction_blocks(std::min(g.journal_blocks - 1 - 2,
+                                          (g.block_size - (int)sizeof(JournalRecord)) / (int)sizeof(int32_t))),
+          split_blocks(std::max(1, max_transaction_blocks / 2)),
+          pairs_per_remote((g.block_size - (int)sizeof(JournalRecord)) / (2 * (int)sizeof(int32_t))),
+          data_block_start(g.data_block_start),
+          block_count(g.block_count) {}
+
+    bool journaled(int block_id) const {
+        return (block_id >= 0 && block_id < header) || (block_id >= data_block_start && block_id < block_count);
+    }
+};
+
+struct FsJournal {
+    explicit FsJournal(const DiskGeometry& g) : layout(g), images(g.journal_start) {}
+
+    const JournalLayout layout;
+
+    std::mutex mutex;                  // 保护下面的事务状态，以及 images 的写入
+    std::condition_variable cv;
+    std::shared_mutex image_mutex;     // 读取 images（写入同时持有 mutex）
+
+    // 尚未写回原位置的元数据块的最新内容（按块号，修改时分配，检查点写回原位置后释放）：有映像的块只从这里读
+    std::vector<std::unique_ptr<char[]>> images;
+    int image_count = 0;
+    // 数据区结构块的映像（同上，按块号散列：数据区大，只有少数块进日志）
+    std::unordered_map<int, std::unique_ptr<char[]>> data_images;
+    std::atomic<int> data_image_count{0};  // = data_images.size()，读者不加锁先看它
+
+    std::set<int> running;             // 当前事务修改过的块
+    uint64_t next_tid = 1;             // 当前事务的编号
+    uint64_t committed_tid = 0;        // 已持久化的最大事务编号
+    bool committing = false;           // 有线程正在提交（组提交的领头者）
+    bool locked = false;               // 领头者在等进行中的操作结束，新操作暂缓开始
+    int handles = 0;                   // 进行中的操作数
+    std::atomic<bool> data_written{false};  // 上次提交以来有数据块写入
+
+    // 以下只由领头者访问（committing 保证同一时间只有一个）
+    std::map<int, std::vector<char>> committed;  // 已提交、尚未写回原位置的映像
+    uint32_t sequence = 1;             // 下一个事务的序号
+    int log_head = 0;                  // 下一个事务在日志中的位置
+
+    JournalStats stats{};
+};
+
+std::shared_mutex g_registry_mutex;
+std::unordered_map<int, std::unique_ptr<FsJournal>> g_journals;
+
+// 当前线程的 journal_metadata_begin 嵌套层数，以及持有的日志句柄数
+thread_local int t_metadata_scope = 0;
+thread_local int t_handles = 0;
+
+FsJournal* find_journal(int fd) {
+    std::shared_lock<std::shared_mutex> lock(g_registry_mutex);
+    auto it = g_journals.find(fd);
+    return (it != g_journals.end()) ? it->second.get() : nullptr;
+}
+
+// 块的映像，没有时返回 nullptr
+// 注意：调用者持有 j->image_mutex（共享即可）或 j->mutex
+char* find_image(FsJournal* j, int block_id) {
+    if (block_id < j->layout.header) {
+        return j->images[block_id].get();
+    }
+    auto it = j->data_images.find(block_id);
+    return it != j->data_images.end() ? it->second.get() : nullptr;
+}
+
+// 释放块的映像
+// 注意：调用者同时持有 j->mutex 和独占的 j->image_mutex
+void drop_image(FsJournal* j, int block_id) {
+    if (block_id < j->layout.header) {
+        j->images[block_id].reset();
+        j->image_count--;
+    } else {
+        j->data_images.erase(block_id);
+        j->data_image_count--;
+    }
+}
+
+uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// FNV-1a
+uint32_t checksum_update(uint32_t hash, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint32_t transaction_checksum(uint32_t sequence, const int32_t* ids, int count, const char* images, int block_size) {
+    uint32_t hash = checksum_update(2166136261u, &sequence, sizeof(sequence));
+    hash = checksum_update(hash, ids, count * sizeof(int32_t));
+    return checksum_update(hash, images, (size_t)count * block_size);
+}
+
+void write_header(int fd, const JournalLayout& layout, uint32_t sequence) {
+    char buf[MAX_BLOCK_SIZE];
+    memset(buf, 0, sizeof(buf));
+    JournalHeader header{JOURNAL_MAGIC, sequence};
+    memcpy(buf, &header, sizeof(header));
+    write_block(fd, layout.header, buf);
+}
+
+// 把映像写回原位置：块号有序，物理连续的段合并成一次 pwritev
+void write_home(int fd, const std::vector<int>& ids, const std::vector<const void*>& bufs) {
+    size_t i = 0;
+    while (i < ids.size()) {
+        size_t j = i + 1;
+        while (j < ids.size() && ids[j] == ids[i] + (int)(j - i)) {
+            j++;
+        }
+        write_block_run(fd, ids[i], (int)(j - i), &bufs[i]);
+        i = j;
+    }
+}
+
+// 映像已经写回原位置：释放内存中的副本，之后这些块经块缓存读取（先让缓存里的旧副本失效）
+// 之后又被修改过的块（在当前事务里，或内容已经不同）保留映像
+void release_images(int fd, FsJournal* j, const std::vector<int>& ids, const std::vector<const void*>& bufs) {
+    for (int id : ids) {
+        block_cache_invalidate(fd, id);
+    }
+
+    std::lock_guard<std::mutex> lock(j->mutex);
+    std::unique_lock<std::shared_mutex> image_lock(j->image_mutex);
+    for (size_t i = 0; i < ids.size(); i++) {
+        const char* image = find_image(j, ids[i]);
+        if (image && j->running.count(ids[i]) == 0 && memcmp(image, bufs[i], j->layout.block_size) == 0) {
+            drop_image(j, ids[i]);
+        }
+    }
+}
+
+// 检查点：已提交的映像写回原位置后，日志头序号前移，日志中的事务全部作废
+// 注意：只由领头者调用
+void checkpoint(int fd, FsJournal* j, JournalStats& delta) {
+    if (j->log_head == 0) {
+        return;
+    }
+
+    std::vector<int> ids;
+    std::vector<const void*> bufs;
+    for (const auto& entry : j->committed) {
+        ids.push_back(entry.first);
+        bufs.push_back(entry.second.data());
+    }
+    write_home(fd, ids, bufs);
+    block_device_flush(fd);
+
+    write_header(fd, j->layout, j->sequence);
+    block_device_flush(fd);
+
+    // 日志头已经作废了这些事务：日志区用过的部分告诉设备不再需要（文件后端打洞）
+    const int bs = j->layout.block_size;
+    block_device_discard(fd, (long long)j->layout.log_start * bs, (long long)j->log_head * bs);
+
+    release_images(fd, j, ids, bufs);
+    j->committed.clear();
+    j->log_head = 0;
+    delta.checkpoints++;
+
+    // 日志里不再有旧映像：等检查点的已释放块可以再分配
+    allocator_checkpoint_done(fd);
+}
+
+// 日志放不下的事务：先清空日志，映像写到暂存块，日志里只写远端描述块和提交块；提交后立即检查点，放回暂存块
+// 注意：只由领头者调用，不持有 j->mutex
+void write_remote_transaction(int fd, FsJournal* j, const std::vector<int>& ids,
+                              const std::vector<char>& images, JournalStats& delta) {
+    const JournalLayout& layout = j->layout;
+    const int bs = layout.block_size;
+    const int count = (int)ids.size();
+    checkpoint(fd, j, delta);
+
+    std::vector<const void*> bufs;
+    for (int i = 0; i < count; i++) {
+        bufs.push_back(&images[(size_t)i * bs]);
+    }
+    const int remotes = (count + layout.pairs_per_remote - 1) / layout.pairs_per_remote;
+    std::vector<int> spill(count);
+    if (remotes + 1 > layout.log_blocks || allocator_alloc_spill(fd, count, spill.data()) != 0) {
+        // 连暂存块都没有：只能直接写回原位置（这个事务失去原子性，由挂载检查兜底）
+        std::cout << "⚠️  事务 " << count << " 块超过日志容量且空闲块不够暂存，直接写回原位置" << std::endl;
+        write_home(fd, ids, bufs);
+        block_device_flush(fd);
+        release_images(fd, j, ids, bufs);
+        delta.unlogged++;
+        return;
+    }
+
+    // 暂存块上可能还有块缓存的旧副本（之前属于别的文件）
+    for (int b : spill) {
+        block_cache_invalidate(fd, b);
+    }
+    write_home(fd, spill, bufs);
+
+    std::vector<char> records((size_t)(remotes + 1) * bs, 0);
+    for (int r = 0; r < remotes; r++) {
+        char* block = &records[(size_t)r * bs];
+        int first = r * layout.pairs_per_remote;
+        int n = std::min(layout.pairs_per_remote, count - first);
+        JournalRecord record{JOURNAL_MAGIC, RECORD_REMOTE, j->sequence, (uint32_t)n, 0};
+        memcpy(block, &record, sizeof(record));
+        int32_t* pairs = (int32_t*)(block + sizeof(JournalRecord));
+        for (int i = 0; i < n; i++) {
+            pairs[2 * i] = ids[first + i];
+            pairs[2 * i + 1] = spill[first + i];
+        }
+    }
+    std::vector<int32_t> homes(ids.begin(), ids.end());
+    JournalRecord commit{JOURNAL_MAGIC, RECORD_COMMIT, j->sequence, (uint32_t)count,
+                         transaction_checksum(j->sequence, homes.data(), count, images.data(), bs)};
+    memcpy(&records[(size_t)remotes * bs], &commit, sizeof(commit));
+
+    // 暂存块先落盘，再写日志：提交块有效时映像一定完整
+    block_device_flush(fd);
+    std::vector<const void*> record_bufs;
+    for (int r = 0; r <= remotes; r++) {
+        record_bufs.push_back(&records[(size_t)r * bs]);
+    }
+    write_block_run(fd, layout.log_start, remotes + 1, record_bufs.data());
+    block_device_flush(fd);
+
+    j->log_head = remotes + 1;
+    j->sequence++;
+    for (int i = 0; i < count; i++) {
+        j->committed[ids[i]].assign((const char*)bufs[i], (const char*)bufs[i] + bs);
+    }
+    delta.commits++;
+    delta.blocks_logged += count;
+    delta.overflows++;
+
+    // 检查点之后日志不再引用暂存块
+    checkpoint(fd, j, delta);
+    allocator_release_spill(fd, spill.data(), count);
+}
+
+// 写出一个事务：数据块先落盘，再把描述块、映像和提交块整段写入日志
+// 注意：只由领头者调用，不持有 j->mutex
+void write_transaction(int fd, FsJournal* j, const std::vector<int>& ids,
+                       const std::vector<char>& images, JournalStats& delta) {
+    block_cache_flush(fd);
+    if (j->data_written.exchange(false)) {
+        block_device_flush(fd);
+    }
+
+    const JournalLayout& layout = j->layout;
+    const int bs = layout.block_size;
+    int count = (int)ids.size();
+    if (count == 0) {
+        return;
+    }
+
+    if (count > layout.max_transaction_blocks) {
+        write_remote_transaction(fd, j, ids, images, delta);
+        return;
+    }
+
+    if (j->log_head + count + 2 > layout.log_blocks) {
+        checkpoint(fd, j, delta);
+    }
+
+    char descriptor[MAX_BLOCK_SIZE];
+    char commit[MAX_BLOCK_SIZE];
+    memset(descriptor, 0, sizeof(descriptor));
+    memset(commit, 0, sizeof(commit));
+
+    int32_t* desc_ids = (int32_t*)(descriptor + sizeof(JournalRecord));
+    for (int i = 0; i < count; i++) {
+        desc_ids[i] = ids[i];
+    }
+    JournalRecord record{JOURNAL_MAGIC, RECORD_DESCRIPTOR, j->sequence, (uint32_t)count, 0};
+    memcpy(descriptor, &record, sizeof(record));
+
+    record.type = RECORD_COMMIT;
+    record.checksum = transaction_checksum(j->sequence, desc_ids, count, images.data(), bs);
+    memcpy(commit, &record, sizeof(record));
+
+    std::vector<const void*> bufs;
+    bufs.push_back(descriptor);
+    for (int i = 0; i < count; i++) {
+        bufs.push_back(&images[(size_t)i * bs]);
+    }
+    bufs.push_back(commit);
+    write_block_run(fd, layout.log_start + j->log_head, count + 2, bufs.data());
+    block_device_flush(fd);
+
+    j->log_head += count + 2;
+    j->sequence++;
+    for (int i = 0; i < count; i++) {
+        const char* image = &images[(size_t)i * bs];
+        j->committed[ids[i]].assign(image, image + bs);
+    }
+    delta.commits++;
+    delta.blocks_logged += count;
+}
+
+// 读出日志 pos 处序号为 sequence 的事务（映像在日志里，或远端描述块指向的暂存块里），校验提交块
+// @return 事务占用的日志块数，0 表示不完整或校验失败
+int read_transaction(int fd, const JournalLayout& layout, int pos, uint32_t sequence,
+                     std::vector<int32_t>& ids, std::vector<char>& images) {
+    const int bs = layout.block_size;
+    char block[MAX_BLOCK_SIZE];
+    JournalRecord record;
+    ids.clear();
+    read_block(fd, layout.log_start + pos, block);
+    memcpy(&record, block, sizeof(record));
+    if (record.magic != JOURNAL_MAGIC || record.sequence != sequence) {
+        return 0;
+    }
+
+    int used = 0;
+    if (record.type == RECORD_DESCRIPTOR) {
+        int count = (int)record.count;
+        if (count <= 0 || count > layout.max_transaction_blocks || pos + count + 2 > layout.log_blocks) {
+            return 0;
+        }
+        const int32_t* list = (const int32_t*)(block + sizeof(JournalRecord));
+        ids.assign(list, list + count);
+        images.resize((size_t)count * bs);
+        std::vector<void*> bufs;
+        for (int i = 0; i < count; i++) {
+            bufs.push_back(&images[(size_t)i * bs]);
+        }
+        read_block_run(fd, layout.log_start + pos + 1, count, bufs.data());
+        used = count + 1;
+    } else if (record.type == RECORD_REMOTE) {
+        // 连续的远端描述块，映像逐块从暂存块读
+        std::vector<int32_t> spill;
+        while (record.magic == JOURNAL_MAGIC && record.type == RECORD_REMOTE && record.sequence == sequence) {
+            int count = (int)record.count;
+            if (count <= 0 || count > layout.pairs_per_remote) {
+                return 0;
+            }
+            const int32_t* pairs = (const int32_t*)(block + sizeof(JournalRecord));
+            for (int i = 0; i < count; i++) {
+                if (pairs[2 * i + 1] < layout.data_block_start || pairs[2 * i + 1] >= layout.block_count) {
+                    return 0;
+                }
+                ids.push_back(pairs[2 * i]);
+                spill.push_back(pairs[2 * i + 1]);
+            }
+            if (pos + ++used + 1 > layout.log_blocks) {
+                return 0;
+            }
+            read_block(fd, layout.log_start + pos + used, block);
+            memcpy(&record, block, sizeof(record));
+        }
+        images.resize(ids.size() * bs);
+        for (size_t i = 0; i < ids.size(); i++) {
+            read_block(fd, spill[i], &images[i * bs]);
+        }
+    } else {
+        return 0;
+    }
+
+    for (int32_t id : ids) {
+        if (!layout.journaled(id)) {
+            return 0;
+        }
+    }
+
+    read_block(fd, layout.log_start + pos + used, block);
+    memcpy(&record, block, sizeof(record));
+    if (record.magic != JOURNAL_MAGIC || record.type != RECORD_COMMIT || record.sequence != sequence ||
+        record.count != (uint32_t)ids.size() ||
+        record.checksum != transaction_checksum(sequence, ids.data(), (int)ids.size(), images.data(), bs)) {
+        return 0;
+    }
+    return used + 1;
+}
+
+void merge_stats(FsJournal* j, const JournalStats& delta) {
+    j->stats.commits += delta.commits;
+    j->stats.blocks_logged += delta.blocks_logged;
+    j->stats.checkpoints += delta.checkpoints;
+    j->stats.overflows += delta.overflows;
+    j->stats.unlogged += delta.unlogged;
+    j->stats.commit_ns += delta.commit_ns;
+}
+
+// 领头者：等进行中的操作结束，截取当前事务，释放锁写日志
+// 注意：调用者持有 lock（j->mutex），返回时仍持有
+void commit_locked(int fd, FsJournal* j, std::unique_lock<std::mutex>& lock) {
+    j->committing = true;
+    j->locked = true;
+    j->cv.wait(lock, [j] { return j->handles == 0; });
+
+    // 分配器和引用计数表惰性写回的状态并入这个事务（写入会回到 journal_write_block），此前释放的块归入这个事务
+    lock.unlock();
+    allocator_commit_prepare(fd);
+    lock.lock();
+
+    uint64_t tid = j->next_tid++;
+    std::vector<int> ids(j->running.begin(), j->running.end());
+    j->running.clear();
+
+    // 持有 mutex 时没有写入者，不必再加 image_mutex
+    const int bs = j->layout.block_size;
+    std::vector<char> images(ids.size() * bs);
+    for (size_t i = 0; i < ids.size(); i++) {
+        memcpy(&images[i * bs], find_image(j, ids[i]), bs);
+    }
+    j->locked = false;
+    j->cv.notify_all();
+    lock.unlock();
+
+    JournalStats delta{};
+    uint64_t start = now_ns();
+    write_transaction(fd, j, ids, images, delta);
+    delta.commit_ns = now_ns() - start;
+
+    // 这个事务释放的块现在可以再分配，日志里还有映像的除外
+    std::vector<int> logged;
+    for (auto it = j->committed.lower_bound(j->layout.data_block_start); it != j->committed.end(); ++it) {
+        logged.push_back(it->first);
+    }
+    allocator_commit_done(fd, logged.data(), (int)logged.size());
+
+    lock.lock();
+    merge_stats(j, delta);
+    j->stats.log_used = j->log_head;
+    j->committed_tid = tid;
+    j->committing = false;
+    j->cv.notify_all();
+}
+
+}  // namespace
+
+// ==================== C 接口实现 ====================
+
+int journal_recover(int fd) {
+    const JournalLayout layout(*disk_geometry(fd));
+    char buf[MAX_BLOCK_SIZE];
+    read_block(fd, layout.header, buf);
+    JournalHeader header;
+    memcpy(&header, buf, sizeof(header));
+    if (header.magic != JOURNAL_MAGIC) {
+        return 0;
+    }
+
+    uint32_t sequence = header.sequence;
+    int pos = 0;
+    int replayed = 0;
+    std::vector<int32_t> ids;
+    std::vector<char> images;
+
+    // 从日志开头按序号依次检查，遇到第一个不完整或校验失败的事务就停下
+    while (pos + 2 <= layout.log_blocks) {
+        int used = read_transaction(fd, layout, pos, sequence, ids, images);
+        if (used == 0) {
+            break;
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            write_block(fd, ids[i], &images[i * layout.block_size]);
+        }
+        pos += used;
+        sequence++;
+        replayed++;
+    }
+
+    if (replayed > 0) {
+        // 重放的内容落盘后才能作废日志
+        block_device_flush(fd);
+        write_header(fd, layout, sequence);
+        block_device_flush(fd);
+        std::cout << "✓ 日志重放了 " << replayed << " 个事务" << std::endl;
+    }
+    return replayed;
+}
+
+int journal_load(int fd) {
+    // 格式化等挂载前写入的元数据先写回：之后它们只经过日志，块缓存里不能再有脏副本
+    block_cache_flush(fd);
+
+    auto j = std::make_unique<FsJournal>(*disk_geometry(fd));
+    char buf[MAX_BLOCK_SIZE];
+    read_block(fd, j->layout.header, buf);
+    JournalHeader header;
+    memcpy(&header, buf, sizeof(header));
+    if (header.magic == JOURNAL_MAGIC) {
+        j->sequence = header.sequence;
+    } else {
+        write_header(fd, j->layout, j->sequence);
+        block_device_flush(fd);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_journals[fd] = std::move(j);
+    return 0;
+}
+
+void journal_unload(int fd) {
+    if (journal_commit(fd) != 0) {
+        return;
+    }
+
+    std::unique_ptr<FsJournal> j;
+    {
+        std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+        auto it = g_journals.find(fd);
+        if (it == g_journals.end()) {
+            return;
+        }
+        j = std::move(it->second);
+        g_journals.erase(it);
+    }
+
+    // 关闭时日志清空，下次挂载不需要重放
+    JournalStats delta{};
+    checkpoint(fd, j.get(), delta);
+}
+
+void journal_discard(int fd) {
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_journals.erase(fd);
+}
+
+int journal_attached(int fd) {
+    return find_journal(fd) != nullptr ? 1 : 0;
+}
+
+int journal_read_block(int fd, int block_id, void* buf) {
+    if (block_id < 0) {
+        return 0;
+    }
+    FsJournal* j = find_journal(fd);
+    if (!j || !j->layout.journaled(block_id)) {
+        return 0;
+    }
+    if (block_id >= j->layout.header && j->data_image_count.load(std::memory_order_acquire) == 0) {
+        return 0;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(j->image_mutex);
+    const char* image = find_image(j, block_id);
+    if (!image) {
+        return 0;
+    }
+    memcpy(buf, image, j->layout.block_size);
+    return 1;
+}
+
+int journal_write_block(int fd, int block_id, const void* buf) {
+    if (block_id < 0) {
+        return 0;
+    }
+    FsJournal* j = find_journal(fd);
+    if (!j) {
+        return 0;
+    }
+    bool metadata = block_id < j->layout.header;
+    if (!metadata && !j->layout.journaled(block_id)) {
+        return 0;
+    }
+    // 数据区的块：结构块，或者已经有映像（之后的修改也必须进日志，否则读到的是旧映像）
+    if (!metadata && t_metadata_scope == 0 && j->data_image_count.load(std::memory_order_acquire) == 0) {
+        j->data_written.store(true, std::memory_order_relaxed);
+        return 0;
+    }
+
+    bool first_image = false;
+    {
+        std::lock_guard<std::mutex> lock(j->mutex);
+        char* image = find_image(j, block_id);
+        if (!image && !metadata && t_metadata_scope == 0) {
+            j->data_written.store(true, std::memory_order_relaxed);
+            return 0;
+        }
+
+        std::unique_lock<std::shared_mutex> image_lock(j->image_mutex);
+        if (!image) {
+            if (metadata) {
+                j->images[block_id].reset(new char[j->layout.block_size]);
+                image = j->images[block_id].get();
+                j->image_count++;
+            } else {
+                std::unique_ptr<char[]>& slot = j->data_images[block_id];
+                slot.reset(new char[j->layout.block_size]);
+                image = slot.get();
+                j->data_image_count++;
+                first_image = true;
+            }
+        }
+        memcpy(image, buf, j->layout.block_size);
+        j->running.insert(block_id);
+    }
+
+    // 块缓存里的副本从此不再使用（读取先查日志），让它失效
+    if (first_image) {
+        block_cache_invalidate(fd, block_id);
+    }
+    return 1;
+}
+
+int journal_may_hold(int fd, const int* block_ids, int count) {
+    FsJournal* j = find_journal(fd);
+    if (!j) {
+        return 0;
+    }
+    bool data_images = j->data_image_count.load(std::memory_order_acquire) > 0;
+    for (int i = 0; i < count; i++) {
+        if (block_ids[i] >= 0 && block_ids[i] < j->layout.header) {
+            return 1;
+        }
+        if (data_images && j->layout.journaled(block_ids[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void journal_metadata_begin() {
+    t_metadata_scope++;
+}
+
+void journal_metadata_end() {
+    t_metadata_scope--;
+}
+
+int journal_commit(int fd) {
+    FsJournal* j = find_journal(fd);
+    if (!j) {
+        return -1;
+    }
+
+    allocator_sync(fd);
+
+    std::unique_lock<std::mutex> lock(j->mutex);
+    j->stats.commit_requests++;
+
+    // 当前事务为空、也没有新写入的数据块时，调用者的修改已经在正在提交（或已提交）的事务里
+    bool idle = j->running.empty() && !j->data_written.load(std::memory_order_relaxed);
+    uint64_t target = idle ? j->next_tid - 1 : j->next_tid;
+    while (j->committed_tid < target) {
+        if (j->committing) {
+            j->cv.wait(lock);
+        } else {
+            commit_locked(fd, j, lock);
+        }
+    }
+    return 0;
+}
+
+void journal_begin(int fd) {
+    FsJournal* j = find_journal(fd);
+    if (!j) return;
+
+    std::unique_lock<std::mutex> lock(j->mutex);
+    if (t_handles == 0) {
+        // 当前事务已经很大：先提交它，这个操作从新事务开始（事务只在操作边界切分）
+        if ((int)j->running.size() >= j->layout.split_blocks) {
+            lock.unlock();
+            journal_commit(fd);
+            lock.lock();
+        }
+        j->cv.wait(lock, [j] { return !j->locked; });
+    }
+    // 嵌套的句柄不等待：领头者在等这个线程已经持有的句柄结束
+    j->handles++;
+    t_handles++;
+}
+
+void journal_end(int fd) {
+    FsJournal* j = find_journal(fd);
+    if (!j) return;
+
+    std::lock_guard<std::mutex> lock(j->mutex);
+    t_handles--;
+    if (--j->handles == 0) {
+        j->cv.notify_all();
+    }
+}
+
+int journal_in_handle() {
+    return t_handles > 0 ? 1 : 0;
+}
+
+int journal_checkpoint(int fd) {
+    FsJournal* j = find_journal(fd);
+    if (!j) {
+        return -1;
+    }
+    journal_commit(fd);
+
+    // 以领头者身份做检查点：期间别的提交等待
+    std::unique_lock<std::mutex> lock(j->mutex);
+    j->cv.wait(lock, [j] { return !j->committing; });
+    j->committing = true;
+    lock.unlock();
+
+    JournalStats delta{};
+    checkpoint(fd, j, delta);
+
+    lock.lock();
+    merge_stats(j, delta);
+    j->stats.log_used = j->log_head;
+    j->committing = false;
+    j->cv.notify_all();
+    return 0;
+}
+
+void journal_get_stats(int fd, JournalStats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(JournalStats));
+
+    FsJournal* j = find_journal(fd);
+    if (!j) return;
+
+    std::lock_guard<std::mutex> lock(j->mutex);
+    *stats = j->stats;
+    stats->pending_blocks = (int)j->running.size();
+    stats->resident_images = j->image_count + j->data_image_count.load();
+}
+
+void journal_print_stats(int fd) {
+    JournalStats s;
+    journal_get_stats(fd, &s);
+
+    double avg_us = s.commits ? (double)s.commit_ns / s.commits / 1000.0 : 0.0;
+
+    std::cout << "\n📊 Journal Statistics:" << std::endl;
+    std::cout << "   Commit requests:    " << s.commit_requests << std::endl;
+    std::cout << "   Commits:            " << s.commits << std::endl;
+    std::cout << "   Blocks logged:      " << s.blocks_logged << std::endl;
+    std::cout << "   Checkpoints:        " << s.checkpoints << std::endl;
+    std::cout << "   Overflows:          " << s.overflows << std::endl;
+    std::cout << "   Unlogged:           " << s.unlogged << std::endl;
+    std::cout << "   Avg commit latency: " << avg_us << " us" << std::endl;
+    std::cout << "   Resident images:    " << s.resident_images << std::endl;
+    std::cout << "   Log used:           " << s.log_used << " / " << disk_geometry(fd)->journal_blocks - 1 << std::endl;
+}
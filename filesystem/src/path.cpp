@@ -1,6 +1,7 @@
 // path.cpp
 #include "../include/path.h"
 #include "../include/inode.h"
+#include "../include/dcache.h"
 #include <cstring>
 #include <cstdlib>
 
@@ -37,17 +38,24 @@ int parse_path(int fd, const char* path, int* inode_ids, int max_depth) {
             continue;
         }
         
-        // 在当前目录中查找组件
-        Inode current_inode;
-        if (read_inode(fd, current_inode_id, &current_inode) != 0) {
-            return -1; // 读取inode失败
+        // 在当前目录中查找组件：先查 dentry 缓存，未命中再读 inode 和目录块
+        int next_inode_id;
+        if (!dcache_lookup(fd, current_inode_id, component, &next_inode_id)) {
+            DcacheToken token;
+            dcache_snapshot(&token);
+            
+            Inode current_inode;
+            if (read_inode(fd, current_inode_id, &current_inode) != 0) {
+                return -1; // 读取inode失败
+            }
+            
+            if (current_inode.type != INODE_TYPE_DIR) {
+                return -1; // 不是目录
+            }
+            
+            next_inode_id = dir_find_entry(fd, &current_inode, component);
+            dcache_insert(fd, current_inode_id, component, next_inode_id, &token);
         }
-        
-        if (current_inode.type != INODE_TYPE_DIR) {
-            return -1; // 不是目录
-        }
-        
-        int next_inode_id = dir_find_entry(fd, &current_inode, component);
         if (next_inode_id == -1) {
             return -1; // 找不到条目
         }
@@ -68,15 +76,26 @@ int parse_path(int fd, const char* path, int* inode_ids, int max_depth) {
 }
 
 // 根据路径获取文件或目录的inode ID
+// 完整路径先查 dentry 缓存（含"不存在"的负条目），未命中再逐级解析
 int get_inode_by_path(int fd, const char* path) {
-    int inode_ids[MAX_PATH_DEPTH];
-    int depth = parse_path(fd, path, inode_ids, MAX_PATH_DEPTH);
+    if (!path) {
+        return -1;
+    }
     
-    if (depth <= 0) {
-        return -1; // 路径解析失败
+    int inode_id;
+    if (dcache_lookup_path(fd, path, &inode_id)) {
+        return inode_id;
     }
     
-    return inode_ids[depth - 1]; // 返回最后一个inode ID
+    DcacheToken token;
+    dcache_snapshot(&token);
+    
+    int inode_ids[MAX_PATH_DEPTH];
+    int depth = parse_path(fd, path, inode_ids, MAX_PATH_DEPTH);
+    inode_id = depth <= 0 ? -1 : inode_ids[depth - 1]; // 最后一个inode ID
+    
+    dcache_insert_path(fd, path, inode_id, &token);
+    return inode_id;
 }
 
 // 根据路径获取父目录的inode ID和文件名
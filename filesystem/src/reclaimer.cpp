@@ -0,0 +1,233 @@
+// reclaimer.cpp - 已删除快照的后台块回收实现
+#include "../include/reclaimer.h"
+#include "../include/disk.h"
+#include "../include/block_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// 默认参数：每批 1024 块（16 个位图字），批次间隔 2ms
+static const unsigned int DEFAULT_CHUNK_BLOCKS = 1024;
+static const unsigned int DEFAULT_PAUSE_MS = 2;
+
+// 块缓存的累计访问次数（前台活动的近似；缓存未初始化时恒为 0，不会推迟）
+static unsigned long block_cache_accesses() {
+    BlockCacheStats stats;
+    block_cache_get_stats_ex(&stats);
+    return stats.hits + stats.misses;
+}
+
+// ==================== SnapshotReclaimer 类实现 ====================
+
+SnapshotReclaimer::SnapshotReclaimer()
+    : m_running(false), m_stop(false), m_busy(false), m_current{-1, -1}, m_scanned(0),
+      m_chunk_blocks(DEFAULT_CHUNK_BLOCKS), m_pause(DEFAULT_PAUSE_MS),
+      m_snapshots_reclaimed(0), m_blocks_freed(0), m_chunks(0), m_yields(0) {
+}
+
+SnapshotReclaimer::~SnapshotReclaimer() {
+    stop();
+}
+
+void SnapshotReclaimer::start(unsigned int chunk_blocks, unsigned int pause_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int chunk = chunk_blocks > 0 ? (int)chunk_blocks : (int)DEFAULT_CHUNK_BLOCKS;
+    m_chunk_blocks = std::max(64, chunk / 64 * 64);
+    m_pause = std::chrono::milliseconds(pause_ms > 0 ? pause_ms : DEFAULT_PAUSE_MS);
+    if (!m_worker.joinable()) {
+        m_stop = false;
+        m_running = true;
+        m_worker = std::thread(&SnapshotReclaimer::worker_loop, this);
+    }
+}
+
+void SnapshotReclaimer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return;
+        }
+        m_running = false;
+        m_stop = true;
+    }
+    m_work_cv.notify_all();
+    m_idle_cv.notify_all();
+    m_worker.join();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.clear();  // 快照仍是 DELETING，下次挂载时继续回收
+    m_stop = false;
+}
+
+bool SnapshotReclaimer::enqueue(int fd, int snapshot_id) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return false;
+        }
+        m_queue.push_back(Job{fd, snapshot_id});
+    }
+    m_work_cv.notify_all();
+    return true;
+}
+
+void SnapshotReclaimer::wait(int fd) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_cv.wait(lock, [&]() {
+        bool queued = std::any_of(m_queue.begin(), m_queue.end(), [fd](const Job& j) { return j.fd == fd; });
+        return !m_running || (!queued && !(m_busy && m_current.fd == fd));
+    });
+}
+
+void SnapshotReclaimer::cancel(int fd) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [fd](const Job& j) { return j.fd == fd; }),
+                  m_queue.end());
+    if (!(m_busy && m_current.fd == fd)) {
+        return;
+    }
+
+    auto it = m_cancelling.insert(fd);
+    m_work_cv.notify_all();  // 打断批次之间的等待
+    m_idle_cv.wait(lock, [&]() { return !(m_busy && m_current.fd == fd); });
+    m_cancelling.erase(it);
+}
+
+void SnapshotReclaimer::get_status(SnapshotReclaimStatus* status) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    status->running = m_running ? 1 : 0;
+    status->pending = (int)m_queue.size();
+    status->current_fd = m_busy ? m_current.fd : -1;
+    status->current_snapshot = m_busy ? m_current.snapshot_id : -1;
+    status->current_scanned = m_busy ? m_scanned : 0;
+    status->current_total = m_busy ? disk_geometry(m_current.fd)->block_count : 0;
+    status->snapshots_reclaimed = m_snapshots_reclaimed.load(std::memory_order_relaxed);
+    status->blocks_freed = m_blocks_freed.load(std::memory_order_relaxed);
+    status->chunks = m_chunks.load(std::memory_order_relaxed);
+    status->yields = m_yields.load(std::memory_order_relaxed);
+}
+
+void SnapshotReclaimer::worker_loop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        if (m_queue.empty()) {
+            m_work_cv.wait(lock);
+            continue;
+        }
+
+        Job job = m_queue.front();
+        m_queue.pop_front();
+        m_busy = true;
+        m_current = job;
+        m_scanned = 0;
+
+        reclaim(lock, job);
+
+        m_busy = false;
+        m_idle_cv.notify_all();
+    }
+    m_idle_cv.notify_all();
+}
+
+// 注意：调用者持有 lock；回收磁盘块时释放
+bool SnapshotReclaimer::reclaim(std::unique_lock<std::mutex>& lock, const Job& job) {
+    // 元数据区不会被回收，从第一个包含数据块的位图字开始
+    const DiskGeometry& g = *disk_geometry(job.fd);
+    for (int first = g.data_block_start / 64 * 64; first < g.block_count; first += m_chunk_blocks) {
+        if (interrupted(job)) {
+            return false;
+        }
+
+        int chunk = m_chunk_blocks;
+        lock.unlock();
+        int freed = snapshot_reclaim_chunk(job.fd, job.snapshot_id, first, chunk);
+        lock.lock();
+
+        if (freed < 0) {
+            return false;  // 快照已不是 DELETING（例如被同步回收），没有剩下的工作
+        }
+        m_blocks_freed.fetch_add(freed, std::memory_order_relaxed);
+        m_chunks.fetch_add(1, std::memory_order_relaxed);
+        m_scanned = std::min(g.block_count, first + chunk);
+
+        if (m_scanned < g.block_count && !pause_between_chunks(lock, job)) {
+            return false;
+        }
+    }
+
+    lock.unlock();
+    int result = snapshot_reclaim_finish(job.fd, job.snapshot_id);
+    lock.lock();
+    if (result == 0) {
+        m_snapshots_reclaimed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result == 0;
+}
+
+// 注意：调用者持有 lock，等待期间释放
+bool SnapshotReclaimer::pause_between_chunks(std::unique_lock<std::mutex>& lock, const Job& job) {
+    unsigned long mark = block_cache_accesses();
+    for (int yields = 0;; yields++) {
+        m_work_cv.wait_for(lock, m_pause, [&]() { return interrupted(job); });
+        if (interrupted(job)) {
+            return false;
+        }
+
+        // 等待期间有前台块 I/O：再让一轮
+        unsigned long now = block_cache_accesses();
+        if (now == mark || yields >= MAX_YIELDS) {
+            return true;
+        }
+        mark = now;
+        m_yields.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// ==================== 全局实例 ====================
+
+static SnapshotReclaimer g_reclaimer;
+
+// ==================== C 接口实现 ====================
+
+void snapshot_reclaimer_start(unsigned int chunk_blocks, unsigned int pause_ms) {
+    g_reclaimer.start(chunk_blocks, pause_ms);
+}
+
+void snapshot_reclaimer_stop() {
+    g_reclaimer.stop();
+}
+
+int snapshot_reclaim_enqueue(int fd, int snapshot_id) {
+    return g_reclaimer.enqueue(fd, snapshot_id) ? 0 : -1;
+}
+
+void snapshot_reclaim_wait(int fd) {
+    g_reclaimer.wait(fd);
+}
+
+void snapshot_reclaim_cancel(int fd) {
+    g_reclaimer.cancel(fd);
+}
+
+void snapshot_reclaim_get_status(SnapshotReclaimStatus* status) {
+    if (status == nullptr) {
+        return;
+    }
+    memset(status, 0, sizeof(SnapshotReclaimStatus));
+    g_reclaimer.get_status(status);
+}
+
+void snapshot_reclaim_print_status() {
+    SnapshotReclaimStatus s;
+    snapshot_reclaim_get_status(&s);
+    std::cout << "\n📊 Snapshot Reclaimer Status:" << std::endl;
+    std::cout << "   Running:             " << (s.running ? "yes" : "no") << std::endl;
+    std::cout << "   Pending snapshots:   " << s.pending << std::endl;
+    if (s.current_snapshot >= 0) {
+        std::cout << "   Current:             snapshot " << s.current_snapshot << " (fd " << s.current_fd << "), "
+                  << s.current_scanned << "/" << s.current_total << " blocks scanned" << std::endl;
+    }
+    std::cout << "   Snapshots reclaimed: " << s.snapshots_reclaimed << std::endl;
+    std::cout << "   Blocks freed:        " << s.blocks_freed << std::endl;
+    std::cout << "   Chunks:              " << s.chunks << " (yielded " << s.yields << " times)" << std::endl;
+}
@@ -0,0 +1,151 @@
+// ref_kernels.cpp - 引用计数表批量掩码内核实现
+#include "../include/ref_kernels.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 掩码的一个字节 → 8 个计数字节的选择掩码（位为 1 的字节为 0xFF）
+struct ExpandTable {
+    uint64_t bytes[256];
+
+    constexpr ExpandTable() : bytes() {
+        for (int m = 0; m < 256; m++) {
+            uint64_t v = 0;
+            for (int b = 0; b < 8; b++) {
+                if (m & (1 << b)) {
+                    v |= 0xFFULL << (8 * b);
+                }
+            }
+            bytes[m] = v;
+        }
+    }
+};
+static constexpr ExpandTable g_expand;
+
+#if defined(__SSE2__)
+
+// 16 位掩码 → 16 字节选择掩码
+static inline __m128i expand16(unsigned bits) {
+    return _mm_set_epi64x((long long)g_expand.bytes[(bits >> 8) & 0xFF],
+                          (long long)g_expand.bytes[bits & 0xFF]);
+}
+
+int ref_kernel_add_mask(unsigned char* counts, const uint64_t* mask, int nwords, int delta, uint64_t* blocked_mask) {
+    const __m128i ones = _mm_set1_epi8(1);
+    // 加一时 255 饱和，减一时 0 饱和
+    const __m128i limit = delta > 0 ? _mm_set1_epi8((char)0xFF) : _mm_setzero_si128();
+    int blocked = 0;
+
+    for (int w = 0; w < nwords; w++) {
+        uint64_t m = mask[w];
+        if (m == 0) {
+            continue;
+        }
+        for (int q = 0; q < 4; q++) {
+            unsigned bits = (unsigned)(m >> (16 * q)) & 0xFFFF;
+            if (bits == 0) {
+                continue;
+            }
+            __m128i* p = (__m128i*)(counts + w * 64 + q * 16);
+            __m128i sel = expand16(bits);
+            __m128i c = _mm_loadu_si128(p);
+            __m128i at_limit = _mm_and_si128(_mm_cmpeq_epi8(c, limit), sel);
+            unsigned hit = (unsigned)_mm_movemask_epi8(at_limit);
+            blocked += __builtin_popcount(hit);
+            if (blocked_mask != nullptr && hit != 0) {
+                blocked_mask[w] |= (uint64_t)hit << (16 * q);
+            }
+
+            __m128i step = _mm_and_si128(sel, ones);
+            c = delta > 0 ? _mm_adds_epu8(c, step) : _mm_subs_epu8(c, step);
+            _mm_storeu_si128(p, c);
+        }
+    }
+    return blocked;
+}
+
+int ref_kernel_zero_mask(const unsigned char* counts, const uint64_t* mask, int nwords, uint64_t* zero) {
+    const __m128i z = _mm_setzero_si128();
+    int found = 0;
+
+    for (int w = 0; w < nwords; w++) {
+        uint64_t m = mask[w];
+        uint64_t out = 0;
+        if (m != 0) {
+            for (int q = 0; q < 4; q++) {
+                __m128i c = _mm_loadu_si128((const __m128i*)(counts + w * 64 + q * 16));
+                uint64_t is_zero = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(c, z));
+                out |= is_zero << (16 * q);
+            }
+            out &= m;
+            found += __builtin_popcountll(out);
+        }
+        zero[w] = out;
+    }
+    return found;
+}
+
+void ref_kernel_clear_mask(unsigned char* counts, const uint64_t* mask, int nwords) {
+    for (int w = 0; w < nwords; w++) {
+        uint64_t m = mask[w];
+        if (m == 0) {
+            continue;
+        }
+        for (int q = 0; q < 4; q++) {
+            unsigned bits = (unsigned)(m >> (16 * q)) & 0xFFFF;
+            if (bits == 0) {
+                continue;
+            }
+            __m128i* p = (__m128i*)(counts + w * 64 + q * 16);
+            _mm_storeu_si128(p, _mm_andnot_si128(expand16(bits), _mm_loadu_si128(p)));
+        }
+    }
+}
+
+#else  // 没有 SSE2：逐位处理
+
+int ref_kernel_add_mask(unsigned char* counts, const uint64_t* mask, int nwords, int delta, uint64_t* blocked_mask) {
+    int blocked = 0;
+    for (int w = 0; w < nwords; w++) {
+        for (uint64_t m = mask[w]; m != 0; m &= m - 1) {
+            int b = __builtin_ctzll(m);
+            unsigned char& c = counts[w * 64 + b];
+            if (delta > 0 ? c == 255 : c == 0) {
+                blocked++;
+                if (blocked_mask != nullptr) {
+                    blocked_mask[w] |= 1ULL << b;
+                }
+            } else {
+                c += delta;
+            }
+        }
+    }
+    return blocked;
+}
+
+int ref_kernel_zero_mask(const unsigned char* counts, const uint64_t* mask, int nwords, uint64_t* zero) {
+    int found = 0;
+    for (int w = 0; w < nwords; w++) {
+        uint64_t out = 0;
+        for (uint64_t m = mask[w]; m != 0; m &= m - 1) {
+            int b = __builtin_ctzll(m);
+            if (counts[w * 64 + b] == 0) {
+                out |= 1ULL << b;
+                found++;
+            }
+        }
+        zero[w] = out;
+    }
+    return found;
+}
+
+void ref_kernel_clear_mask(unsigned char* counts, const uint64_t* mask, int nwords) {
+    for (int w = 0; w < nwords; w++) {
+        for (uint64_t m = mask[w]; m != 0; m &= m - 1) {
+            counts[w * 64 + __builtin_ctzll(m)] = 0;
+        }
+    }
+}
+
+#endif
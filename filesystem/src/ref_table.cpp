@@ -0,0 +1,390 @@
+// ref_table.cpp - 内存引用计数表实现
+#include "../include/ref_table.h"
+#include "../include/block_cache.h"
+#include "../include/ref_kernels.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <shared_mutex>
+#include <unordered_map>
+
+// ==================== RefTable 类实现 ====================
+
+RefTable::RefTable(const DiskGeometry& geometry)
+    : m_geometry(geometry),
+      m_count_pages(geometry.ref_count_blocks),
+      m_page_count(geometry.ref_count_blocks + geometry.birth_table_blocks),
+      m_births_per_page(geometry.block_size / (int)sizeof(uint32_t)),
+      m_mask_words_per_count_page(geometry.block_size / 64),
+      m_mask_words(disk_mask_words(&geometry)),
+      m_counts(new std::atomic<unsigned char>[geometry.block_count]),
+      m_births(new std::atomic<uint32_t>[geometry.block_count]),
+      m_page_locks(new std::mutex[geometry.ref_count_blocks + geometry.birth_table_blocks]),
+      m_dirty(new std::atomic<bool>[geometry.ref_count_blocks + geometry.birth_table_blocks]),
+      m_lookups(0), m_updates(0), m_mask_updates(0), m_page_flushes(0) {
+    for (int i = 0; i < m_geometry.block_count; i++) {
+        m_counts[i].store(0, std::memory_order_relaxed);
+        m_births[i].store(0, std::memory_order_relaxed);
+    }
+    for (int p = 0; p < m_page_count; p++) {
+        m_dirty[p].store(false, std::memory_order_relaxed);
+    }
+}
+
+void RefTable::load(int fd) {
+    const int block_size = m_geometry.block_size;
+    const int block_count = m_geometry.block_count;
+    unsigned char buf[MAX_BLOCK_SIZE];
+    for (int p = 0; p < m_count_pages; p++) {
+        read_block_cached(fd, page_block(p), buf);
+        for (int i = 0; i < block_size && p * block_size + i < block_count; i++) {
+            m_counts[p * block_size + i].store(buf[i], std::memory_order_relaxed);
+        }
+    }
+    uint32_t births[MAX_BLOCK_SIZE / sizeof(uint32_t)];
+    for (int p = 0; p < m_geometry.birth_table_blocks; p++) {
+        read_block_cached(fd, page_block(m_count_pages + p), births);
+        for (int i = 0; i < m_births_per_page && p * m_births_per_page + i < block_count; i++) {
+            m_births[p * m_births_per_page + i].store(births[i], std::memory_order_relaxed);
+        }
+    }
+}
+
+void RefTable::flush(int fd) {
+    const int block_size = m_geometry.block_size;
+    const int block_count = m_geometry.block_count;
+    for (int p = 0; p < m_page_count; p++) {
+        // 先清脏标记再读取：读取期间的并发修改会重新置脏
+        if (!m_dirty[p].exchange(false, std::memory_order_acq_rel)) {
+            continue;
+        }
+        if (p < m_count_pages) {
+            unsigned char buf[MAX_BLOCK_SIZE];
+            memset(buf, 0, sizeof(buf));
+            for (int i = 0; i < block_size && p * block_size + i < block_count; i++) {
+                buf[i] = m_counts[p * block_size + i].load(std::memory_order_relaxed);
+            }
+            write_block_cached(fd, page_block(p), buf);
+        } else {
+            int first = (p - m_count_pages) * m_births_per_page;
+            uint32_t births[MAX_BLOCK_SIZE / sizeof(uint32_t)];
+            memset(births, 0, sizeof(births));
+            for (int i = 0; i < m_births_per_page && first + i < block_count; i++) {
+                births[i] = m_births[first + i].load(std::memory_order_relaxed);
+            }
+            write_block_cached(fd, page_block(p), births);
+        }
+        m_page_flushes.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int RefTable::get(int block_id) const {
+    m_lookups.fetch_add(1, std::memory_order_relaxed);
+    return m_counts[block_id].load(std::memory_order_relaxed);
+}
+
+void RefTable::set(int block_id, int count) {
+    int page = count_page(block_id);
+    std::lock_guard<std::mutex> lock(m_page_locks[page]);
+    m_counts[block_id].store((unsigned char)count, std::memory_order_relaxed);
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+    mark_dirty(page);
+}
+
+int RefTable::add(int block_id, int delta) {
+    int page = count_page(block_id);
+    std::lock_guard<std::mutex> lock(m_page_locks[page]);
+    int count = m_counts[block_id].load(std::memory_order_relaxed);
+    if (count + delta < 0 || count + delta > 255) {
+        return -1;
+    }
+    m_counts[block_id].store((unsigned char)(count + delta), std::memory_order_relaxed);
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+    mark_dirty(page);
+    return count + delta;
+}
+
+int RefTable::drop(int block_id) {
+    int page = count_page(block_id);
+    std::lock_guard<std::mutex> lock(m_page_locks[page]);
+    int count = m_counts[block_id].load(std::memory_order_relaxed);
+    int remaining = count > 1 ? count - 1 : 0;
+    m_counts[block_id].store((unsigned char)remaining, std::memory_order_relaxed);
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+    mark_dirty(page);
+    return remaining;
+}
+
+uint32_t RefTable::birth(int block_id) const {
+    m_lookups.fetch_add(1, std::memory_order_relaxed);
+    return m_births[block_id].load(std::memory_order_relaxed);
+}
+
+void RefTable::set_birth(int block_id, uint32_t epoch) {
+    int page = birth_page(block_id);
+    std::lock_guard<std::mutex> lock(m_page_locks[page]);
+    m_births[block_id].store(epoch, std::memory_order_relaxed);
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+    mark_dirty(page);
+}
+
+template <typename Fn>
+void RefTable::for_each_count_page(const uint64_t* mask, Fn fn) {
+    const int block_size = m_geometry.block_size;
+    for (int p = 0; p < m_count_pages; p++) {
+        const uint64_t* m = mask + p * m_mask_words_per_count_page;
+        int nwords = std::min(m_mask_words_per_count_page, m_mask_words - p * m_mask_words_per_count_page);
+        bool any = false;
+        for (int w = 0; w < nwords; w++) {
+            any = any || m[w] != 0;
+        }
+        if (!any) {
+            continue;
+        }
+
+        // 内核处理普通字节数组：整页复制出来，处理完再存回（最后一个字可能超出 block_count，只取有效部分）
+        std::lock_guard<std::mutex> lock(m_page_locks[p]);
+        unsigned char counts[MAX_BLOCK_SIZE] = {};
+        int n = std::min(nwords * 64, m_geometry.block_count - p * block_size);
+        for (int i = 0; i < n; i++) {
+            counts[i] = m_counts[p * block_size + i].load(std::memory_order_relaxed);
+        }
+        if (fn(counts, m, nwords, p)) {
+            for (int i = 0; i < n; i++) {
+                m_counts[p * block_size + i].store(counts[i], std::memory_order_relaxed);
+            }
+            mark_dirty(p);
+        }
+    }
+    m_mask_updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+int RefTable::add_mask(const uint64_t* mask, int delta, uint64_t* blocked_mask) {
+    int blocked = 0;
+    for_each_count_page(mask, [&](unsigned char* counts, const uint64_t* m, int nwords, int p) {
+        uint64_t* out = blocked_mask != nullptr ? blocked_mask + p * m_mask_words_per_count_page : nullptr;
+        blocked += ref_kernel_add_mask(counts, m, nwords, delta, out);
+        return true;
+    });
+    return blocked;
+}
+
+int RefTable::zero_mask(const uint64_t* mask, uint64_t* zero) const {
+    memset(zero, 0, m_mask_words * sizeof(uint64_t));
+    const int block_size = m_geometry.block_size;
+    int found = 0;
+    // 只读：不需要页锁，读到的是某一时刻之后的值（调用者自己保证没有并发修改时结果精确）
+    for (int p = 0; p < m_count_pages; p++) {
+        const uint64_t* m = mask + p * m_mask_words_per_count_page;
+        int nwords = std::min(m_mask_words_per_count_page, m_mask_words - p * m_mask_words_per_count_page);
+        bool any = false;
+        for (int w = 0; w < nwords; w++) {
+            any = any || m[w] != 0;
+        }
+        if (!any) {
+            continue;
+        }
+        unsigned char counts[MAX_BLOCK_SIZE] = {};
+        int n = std::min(nwords * 64, m_geometry.block_count - p * block_size);
+        for (int i = 0; i < n; i++) {
+            counts[i] = m_counts[p * block_size + i].load(std::memory_order_relaxed);
+        }
+        found += ref_kernel_zero_mask(counts, m, nwords, zero + p * m_mask_words_per_count_page);
+    }
+    m_lookups.fetch_add(1, std::memory_order_relaxed);
+    return found;
+}
+
+void RefTable::clear_mask(const uint64_t* mask) {
+    for_each_count_page(mask, [&](unsigned char* counts, const uint64_t* m, int nwords, int) {
+        ref_kernel_clear_mask(counts, m, nwords);
+        return true;
+    });
+}
+
+void RefTable::set_birth_mask(const uint64_t* mask, uint32_t epoch) {
+    const int words_per_page = m_births_per_page / 64;
+    for (int p = 0; p < m_geometry.birth_table_blocks; p++) {
+        const uint64_t* m = mask + p * words_per_page;
+        if (p * words_per_page >= m_mask_words) {
+            break;
+        }
+        int nwords = std::min(words_per_page, m_mask_words - p * words_per_page);
+        bool any = false;
+        for (int w = 0; w < nwords; w++) {
+            any = any || m[w] != 0;
+        }
+        if (!any) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(m_page_locks[m_count_pages + p]);
+        for (int w = 0; w < nwords; w++) {
+            for (uint64_t bits = m[w]; bits != 0; bits &= bits - 1) {
+                int b = p * m_births_per_page + w * 64 + __builtin_ctzll(bits);
+                if (b < m_geometry.block_count) {
+                    m_births[b].store(epoch, std::memory_order_relaxed);
+                }
+            }
+        }
+        mark_dirty(m_count_pages + p);
+    }
+    m_mask_updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RefTable::get_stats(RefTableStats* stats) const {
+    stats->lookups = m_lookups.load(std::memory_order_relaxed);
+    stats->updates = m_updates.load(std::memory_order_relaxed);
+    stats->mask_updates = m_mask_updates.load(std::memory_order_relaxed);
+    stats->page_flushes = m_page_flushes.load(std::memory_order_relaxed);
+    stats->dirty_pages = 0;
+    for (int p = 0; p < m_page_count; p++) {
+        if (m_dirty[p].load(std::memory_order_relaxed)) {
+            stats->dirty_pages++;
+        }
+    }
+}
+
+// ==================== 每个磁盘的表 ====================
+
+namespace {
+
+std::shared_mutex g_registry_mutex;
+std::unordered_map<int, std::unique_ptr<RefTable>> g_tables;
+
+RefTable* find_table(int fd) {
+    std::shared_lock<std::shared_mutex> lock(g_registry_mutex);
+    auto it = g_tables.find(fd);
+    return (it != g_tables.end()) ? it->second.get() : nullptr;
+}
+
+}  // namespace
+
+// ==================== C 接口实现 ====================
+
+int ref_table_load(int fd) {
+    auto t = std::make_unique<RefTable>(*disk_geometry(fd));
+    t->load(fd);
+
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_tables[fd] = std::move(t);
+    return 0;
+}
+
+void ref_table_unload(int fd) {
+    std::unique_ptr<RefTable> t;
+    {
+        std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+        auto it = g_tables.find(fd);
+        if (it == g_tables.end()) {
+            return;
+        }
+        t = std::move(it->second);
+        g_tables.erase(it);
+    }
+    t->flush(fd);
+}
+
+void ref_table_discard(int fd) {
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_tables.erase(fd);
+}
+
+void ref_table_flush(int fd) {
+    RefTable* t = find_table(fd);
+    if (t) {
+        t->flush(fd);
+    }
+}
+
+int ref_table_get(int fd, int block_id) {
+    RefTable* t = find_table(fd);
+    return (t && t->valid_block(block_id)) ? t->get(block_id) : -1;
+}
+
+int ref_table_set(int fd, int block_id, int count) {
+    RefTable* t = find_table(fd);
+    if (!t || !t->valid_block(block_id) || count < 0 || count > 255) {
+        return -1;
+    }
+    t->set(block_id, count);
+    return 0;
+}
+
+int ref_table_add(int fd, int block_id, int delta) {
+    RefTable* t = find_table(fd);
+    return (t && t->valid_block(block_id)) ? t->add(block_id, delta) : -1;
+}
+
+int ref_table_drop(int fd, int block_id) {
+    RefTable* t = find_table(fd);
+    return (t && t->valid_block(block_id)) ? t->drop(block_id) : -1;
+}
+
+uint32_t ref_table_birth(int fd, int block_id) {
+    RefTable* t = find_table(fd);
+    return (t && t->valid_block(block_id)) ? t->birth(block_id) : 0;
+}
+
+int ref_table_set_birth(int fd, int block_id, uint32_t epoch) {
+    RefTable* t = find_table(fd);
+    if (!t || !t->valid_block(block_id)) {
+        return -1;
+    }
+    t->set_birth(block_id, epoch);
+    return 0;
+}
+
+int ref_table_add_mask(int fd, const uint64_t* mask, int delta) {
+    RefTable* t = find_table(fd);
+    return t ? t->add_mask(mask, delta, nullptr) : 0;
+}
+
+int ref_table_add_mask_blocked(int fd, const uint64_t* mask, int delta, uint64_t* blocked) {
+    RefTable* t = find_table(fd);
+    return t ? t->add_mask(mask, delta, blocked) : 0;
+}
+
+int ref_table_zero_mask(int fd, const uint64_t* mask, uint64_t* zero) {
+    RefTable* t = find_table(fd);
+    if (!t) {
+        memset(zero, 0, disk_mask_words(disk_geometry(fd)) * sizeof(uint64_t));
+        return 0;
+    }
+    return t->zero_mask(mask, zero);
+}
+
+void ref_table_clear_mask(int fd, const uint64_t* mask) {
+    RefTable* t = find_table(fd);
+    if (t) {
+        t->clear_mask(mask);
+    }
+}
+
+void ref_table_set_birth_mask(int fd, const uint64_t* mask, uint32_t epoch) {
+    RefTable* t = find_table(fd);
+    if (t) {
+        t->set_birth_mask(mask, epoch);
+    }
+}
+
+void ref_table_get_stats(int fd, RefTableStats* stats) {
+    if (stats == nullptr) {
+        return;
+    }
+    memset(stats, 0, sizeof(RefTableStats));
+    RefTable* t = find_table(fd);
+    if (t) {
+        t->get_stats(stats);
+    }
+}
+
+void ref_table_print_stats(int fd) {
+    RefTableStats s;
+    ref_table_get_stats(fd, &s);
+    std::cout << "\n📊 Ref Table Statistics:" << std::endl;
+    std::cout << "   Lookups:       " << s.lookups << std::endl;
+    std::cout << "   Updates:       " << s.updates << " (mask " << s.mask_updates << ")" << std::endl;
+    std::cout << "   Page flushes:  " << s.page_flushes << std::endl;
+    std::cout << "   Dirty pages:   " << s.dirty_pages << std::endl;
+}
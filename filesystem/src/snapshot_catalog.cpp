@@ -0,0 +1,281 @@
+// snapshot_catalog.cpp - 快照目录实现
+#include "../include/snapshot_catalog.h"
+#include "../include/block_cache.h"
+#include "../include/journal.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+// ==================== SnapshotCatalog 类实现 ====================
+
+bool SnapshotCatalog::matches(const Snapshot& snapshot, int state) {
+    return state == SNAPSHOT_STATE_ANY ? snapshot.active != SNAPSHOT_FREE : snapshot.active == state;
+}
+
+void SnapshotCatalog::index(int snapshot_id, const Snapshot& snapshot) {
+    if (snapshot.active == SNAPSHOT_ACTIVE) {
+        m_by_name[std::string(snapshot.name, strnlen(snapshot.name, sizeof(snapshot.name)))].insert(snapshot_id);
+    }
+    if (snapshot.active == SNAPSHOT_ACTIVE || snapshot.active == SNAPSHOT_DELETING) {
+        m_counts[snapshot.active]++;
+    } else {
+        m_free.insert(snapshot_id);
+        m_counts[SNAPSHOT_FREE]++;
+    }
+}
+
+void SnapshotCatalog::unindex(int snapshot_id, const Snapshot& snapshot) {
+    if (snapshot.active == SNAPSHOT_ACTIVE) {
+        auto it = m_by_name.find(std::string(snapshot.name, strnlen(snapshot.name, sizeof(snapshot.name))));
+        if (it != m_by_name.end()) {
+            it->second.erase(snapshot_id);
+            if (it->second.empty()) {
+                m_by_name.erase(it);
+            }
+        }
+    }
+    if (snapshot.active == SNAPSHOT_ACTIVE || snapshot.active == SNAPSHOT_DELETING) {
+        m_counts[snapshot.active]--;
+    } else {
+        m_free.erase(snapshot_id);
+        m_counts[SNAPSHOT_FREE]--;
+    }
+}
+
+void SnapshotCatalog::load(int fd) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    m_geometry = *disk_geometry(fd);
+    m_ids_per_block = m_geometry.block_size / (int)sizeof(int);
+    m_snapshots_per_block = m_geometry.block_size / (int)sizeof(Snapshot);
+    m_blocks.clear();
+    m_entries.clear();
+    m_by_name.clear();
+    m_free.clear();
+    memset(m_counts, 0, sizeof(m_counts));
+
+    // 目录块号连续存放，遇到 0 结束
+    const DiskGeometry& g = m_geometry;
+    int ids[MAX_POINTERS_PER_BLOCK];
+    for (int i = 0; i < g.snapshot_table_blocks && (int)m_blocks.size() == i * m_ids_per_block; i++) {
+        read_block_cached(fd, g.snapshot_table_start + i, ids);
+        for (int j = 0; j < m_ids_per_block && ids[j] >= g.data_block_start && ids[j] < g.block_count; j++) {
+            m_blocks.push_back(ids[j]);
+        }
+    }
+
+    char buf[MAX_BLOCK_SIZE];
+    for (int block_id : m_blocks) {
+        read_block_cached(fd, block_id, buf);
+        const Snapshot* block_snapshots = (const Snapshot*)buf;
+        for (int j = 0; j < m_snapshots_per_block; j++) {
+            int snapshot_id = (int)m_entries.size();
+            m_entries.push_back(block_snapshots[j]);
+            index(snapshot_id, block_snapshots[j]);
+        }
+    }
+}
+
+void SnapshotCatalog::reset(int fd) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    char zero[MAX_BLOCK_SIZE];
+    memset(zero, 0, sizeof(zero));
+    for (int i = 0; i < m_geometry.snapshot_table_blocks; i++) {
+        write_block_cached(fd, m_geometry.snapshot_table_start + i, zero);
+    }
+    m_blocks.clear();
+    m_entries.clear();
+    m_by_name.clear();
+    m_free.clear();
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+bool SnapshotCatalog::get(int snapshot_id, Snapshot* snapshot) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (snapshot_id < 0 || snapshot_id >= (int)m_entries.size()) {
+        return false;
+    }
+    *snapshot = m_entries[snapshot_id];
+    return true;
+}
+
+bool SnapshotCatalog::put(int fd, const Snapshot& snapshot) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    int snapshot_id = snapshot.id;
+    if (snapshot_id < 0 || snapshot_id >= (int)m_entries.size()) {
+        return false;
+    }
+    unindex(snapshot_id, m_entries[snapshot_id]);
+    m_entries[snapshot_id] = snapshot;
+    index(snapshot_id, snapshot);
+
+    // 整块从内存副本写出，不必先读
+    int block_index = snapshot_id / m_snapshots_per_block;
+    char buf[MAX_BLOCK_SIZE];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, &m_entries[block_index * m_snapshots_per_block], m_snapshots_per_block * sizeof(Snapshot));
+    JournalMetadataScope metadata_scope;  // 表项块在数据区，同样经过日志
+    write_block_cached(fd, m_blocks[block_index], buf);
+    return true;
+}
+
+void SnapshotCatalog::write_directory_block(int fd, int index) const {
+    int ids[MAX_POINTERS_PER_BLOCK];
+    memset(ids, 0, sizeof(ids));
+    for (int j = 0; j < m_ids_per_block && index * m_ids_per_block + j < (int)m_blocks.size(); j++) {
+        ids[j] = m_blocks[index * m_ids_per_block + j];
+    }
+    write_block_cached(fd, m_geometry.snapshot_table_start + index, ids);
+}
+
+int SnapshotCatalog::alloc_slot(int fd) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (!m_free.empty()) {
+        return *m_free.begin();
+    }
+    // 快照表区最多记录 snapshot_table_blocks * (block_size / sizeof(int)) 个表项块
+    if ((int)m_blocks.size() >= m_geometry.snapshot_table_blocks * m_ids_per_block) {
+        return -1;
+    }
+
+    // 扩展：新表项块先清零写出，再登记到目录中
+    int block_id = alloc_block(fd);
+    if (block_id == -1) {
+        return -1;
+    }
+    char zero[MAX_BLOCK_SIZE];
+    memset(zero, 0, sizeof(zero));
+    {
+        JournalMetadataScope metadata_scope;
+        write_block_cached(fd, block_id, zero);
+    }
+
+    m_blocks.push_back(block_id);
+    write_directory_block(fd, ((int)m_blocks.size() - 1) / m_ids_per_block);
+
+    int first = (int)m_entries.size();
+    Snapshot empty;
+    memset(&empty, 0, sizeof(Snapshot));
+    for (int j = 0; j < m_snapshots_per_block; j++) {
+        m_entries.push_back(empty);
+        index(first + j, empty);
+    }
+    return first;
+}
+
+int SnapshotCatalog::find(const char* name) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto it = m_by_name.find(std::string(name, strnlen(name, sizeof(Snapshot::name))));
+    return it != m_by_name.end() ? *it->second.begin() : -1;
+}
+
+int SnapshotCatalog::count(int state) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    if (state == SNAPSHOT_STATE_ANY) {
+        return m_counts[SNAPSHOT_ACTIVE] + m_counts[SNAPSHOT_DELETING];
+    }
+    return (state >= 0 && state < 3) ? m_counts[state] : 0;
+}
+
+std::vector<Snapshot> SnapshotCatalog::list(int state) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    std::vector<Snapshot> result;
+    for (const Snapshot& snapshot : m_entries) {
+        if (matches(snapshot, state)) {
+            result.push_back(snapshot);
+        }
+    }
+    return result;
+}
+
+int SnapshotCatalog::mark_blocks(uint64_t* words) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    for (int b : m_blocks) {
+        words[b / 64] |= 1ULL << (b % 64);
+    }
+    return (int)m_blocks.size();
+}
+
+// ==================== 每个磁盘的目录 ====================
+
+namespace {
+
+std::shared_mutex g_registry_mutex;
+std::unordered_map<int, std::unique_ptr<SnapshotCatalog>> g_catalogs;
+
+SnapshotCatalog* find_catalog(int fd) {
+    std::shared_lock<std::shared_mutex> lock(g_registry_mutex);
+    auto it = g_catalogs.find(fd);
+    return (it != g_catalogs.end()) ? it->second.get() : nullptr;
+}
+
+}  // namespace
+
+// ==================== C 接口实现 ====================
+
+int snapshot_catalog_load(int fd) {
+    auto c = std::make_unique<SnapshotCatalog>();
+    c->load(fd);
+
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_catalogs[fd] = std::move(c);
+    return 0;
+}
+
+void snapshot_catalog_discard(int fd) {
+    std::unique_lock<std::shared_mutex> lock(g_registry_mutex);
+    g_catalogs.erase(fd);
+}
+
+void snapshot_catalog_reset(int fd) {
+    SnapshotCatalog* c = find_catalog(fd);
+    if (c) {
+        c->reset(fd);
+    }
+}
+
+int snapshot_catalog_get(int fd, int snapshot_id, Snapshot* snapshot) {
+    SnapshotCatalog* c = find_catalog(fd);
+    return (c && snapshot && c->get(snapshot_id, snapshot)) ? 0 : -1;
+}
+
+int snapshot_catalog_put(int fd, const Snapshot* snapshot) {
+    SnapshotCatalog* c = find_catalog(fd);
+    return (c && snapshot && c->put(fd, *snapshot)) ? 0 : -1;
+}
+
+int snapshot_catalog_alloc_slot(int fd) {
+    SnapshotCatalog* c = find_catalog(fd);
+    return c ? c->alloc_slot(fd) : -1;
+}
+
+int snapshot_catalog_find(int fd, const char* name) {
+    SnapshotCatalog* c = find_catalog(fd);
+    return (c && name) ? c->find(name) : -1;
+}
+
+int snapshot_catalog_count(int fd, int state) {
+    SnapshotCatalog* c = find_catalog(fd);
+    return c ? c->count(state) : 0;
+}
+
+int snapshot_catalog_list(int fd, int state, Snapshot* snapshots, int max_count) {
+    if (!snapshots || max_count <= 0) {
+        return -1;
+    }
+    std::vector<Snapshot> entries = snapshot_catalog_entries(fd, state);
+    int count = std::min((int)entries.size(), max_count);
+    for (int i = 0; i < count; i++) {
+        snapshots[i] = entries[i];
+    }
+    return count;
+}
+
+int snapshot_catalog_mark_blocks(int fd, uint64_t* words) {
+    SnapshotCatalog* c = find_catalog(fd);
+    return c ? c->mark_blocks(words) : 0;
+}
+
+std::vector<Snapshot> snapshot_catalog_entries(int fd, int state) {
+    SnapshotCatalog* c = find_catalog(fd);
+    return c ? c->list(state) : std::vector<Snapshot>();
+}
@@ -0,0 +1,693 @@
+// snapshot_stream.cpp - 快照差异与流式发送 / 接收实现
+#include "../include/snapshot_stream.h"
+#include "../include/allocator.h"
+#include "../include/block_cache.h"
+#include "../include/bmap_cache.h"
+#include "../include/extent.h"
+#include "../include/dcache.h"
+#include "../include/journal.h"
+#include "../include/ref_table.h"
+#include "../include/snapshot_catalog.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// ==================== 流格式 ====================
+//
+// 头部之后是一串记录，每条记录 = StreamRecord + 负载：
+//   INODE_FREE   无负载                 目标中已删除的 inode
+//   INODE        Inode                  目标中新建或修改的 inode
+//   BLOCK_BITMAP 位图掩码              目标引用的数据块 + 元数据区（接收端的块位图，(block_count + 63) / 64 个 64 位字）
+//   BLOCK        block_size 字节        需要传输的数据块（id = 块号）
+//   END          uint32_t 校验和        之前所有字节的 FNV-1a
+// 所有整数按主机字节序（与磁盘镜像一致）；头部的块大小和块数必须与接收端的布局相同
+// 增量流的头部带基准状态摘要（基准的块位图、inode 位图和 inode 表），接收端的当前状态必须与它一致
+
+static const uint32_t STREAM_MAGIC = 0x4E53534F;  // 'OSSN'
+static const uint32_t STREAM_VERSION = 2;
+
+enum StreamRecordType : uint32_t {
+    REC_END = 0,
+    REC_INODE = 1,
+    REC_INODE_FREE = 2,
+    REC_BLOCK = 3,
+    REC_BLOCK_BITMAP = 4,
+};
+
+struct StreamHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t inode_size;
+    uint32_t base_epoch;      // 0 = 完整流
+    uint32_t target_epoch;    // 0 = 活跃文件系统（接收后不能作为下一次增量流的基准）
+    int32_t target_timestamp;
+    char target_name[32];
+    uint32_t base_digest;     // 增量流：基准的状态摘要（见 state_digest），完整流为 0
+};
+
+struct StreamRecord {
+    uint32_t type;
+    int32_t id;
+};
+
+static const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+static const size_t READ_BUFFER_SIZE = 64 * 1024;
+
+static uint32_t fnv1a(uint32_t h, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static const uint32_t FNV_OFFSET = 2166136261u;
+
+static int popcount_words(const std::vector<uint64_t>& words) {
+    int n = 0;
+    for (uint64_t w : words) {
+        n += __builtin_popcountll(w);
+    }
+    return n;
+}
+
+// 一个 inode 引用的数据块：数据 extent 和 extent 树节点
+static void mark_inode_blocks(int fd, const Inode& inode, std::vector<uint64_t>& blocks) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    auto mark = [&](int b) {
+        if (b >= g.data_block_start && b < g.block_count) {
+            blocks[b / 64] |= 1ULL << (b % 64);
+        }
+    };
+
+    std::vector<Extent> extents;
+    std::vector<int> nodes;
+    extent_collect(fd, &inode, &extents, &nodes);
+    for (const Extent& e : extents) {
+        for (int i = 0; i < e.length; i++) {
+            mark(e.start + i);
+        }
+    }
+    for (int b : nodes) {
+        mark(b);
+    }
+}
+
+// 文件系统状态摘要：块位图（元数据区按已占用计）、inode 位图和已分配的 inode
+// 副本接收后的状态与流的目标相同；之后副本上的任何分配、释放或 inode 修改都会改变摘要
+static uint32_t state_digest(const DiskGeometry& g, const std::vector<uint64_t>& blocks,
+                             const unsigned char* inode_bitmap, const Inode* inodes) {
+    std::vector<uint64_t> bitmap(blocks.begin(), blocks.begin() + disk_mask_words(&g));
+    for (int b = 0; b < g.data_block_start; b++) {
+        bitmap[b / 64] |= 1ULL << (b % 64);
+    }
+    if (g.block_count % 64 != 0) {
+        bitmap.back() &= (1ULL << (g.block_count % 64)) - 1;
+    }
+    uint32_t h = fnv1a(FNV_OFFSET, bitmap.data(), bitmap.size() * sizeof(uint64_t));
+    h = fnv1a(h, inode_bitmap, (size_t)(g.inode_count + 7) / 8);
+    for (int id = 0; id < g.inode_count; id++) {
+        if (inode_bitmap[id / 8] & (1 << (id % 8))) {
+            h = fnv1a(h, &id, sizeof(id));
+            h = fnv1a(h, &inodes[id], sizeof(Inode));
+        }
+    }
+    return h;
+}
+
+// ==================== SnapshotImage / SnapshotDiff ====================
+
+void SnapshotImage::load_empty(int fd) {
+    const DiskGeometry& g = *disk_geometry(fd);
+    epoch = 0;
+    timestamp = 0;
+    memset(name, 0, sizeof(name));
+    inode_bitmap.assign((size_t)g.inode_bitmap_blocks * g.block_size, 0);
+    inodes.assign((size_t)g.inode_table_blocks * (g.block_size / sizeof(Inode)), Inode{});
+    blocks.assign(disk_mask_words(&g), 0);
+}
+
+bool SnapshotImage::load(int fd, int snapshot_id) {
+    load_empty(fd);
+
+    const DiskGeometry& g = *disk_geometry(fd);
+    int inodes_per_block = g.block_size / sizeof(Inode);
+    if (snapshot_id == SNAPSHOT_STREAM_LIVE) {
+        Superblock sb;
+        read_superblock(fd, &sb);
+        timestamp = (int)time(nullptr);
+        strncpy(name, "live", sizeof(name) - 1);
+        allocator_copy_inode_bitmap(fd, inode_bitmap.data());
+        for (int i = 0; i < g.inode_table_blocks; i++) {
+            read_block_cached(fd, g.inode_table_start + i, &inodes[i * inodes_per_block]);
+        }
+    } else {
+        Snapshot snapshot;
+        if (get_snapshot(fd, snapshot_id, &snapshot) != 0 ||
+            snapshot_read_inode_tables(fd, snapshot_id, inode_bitmap.data(), inodes.data()) != 0) {
+            return false;
+        }
+
+        epoch = snapshot.epoch;
+        timestamp = snapshot.timestamp;
+        memcpy(name, snapshot.name, sizeof(name));
+    }
+
+    for (int id = 0; id < (int)inodes.size(); id++) {
+        if (has_inode(id)) {
+            mark_inode_blocks(fd, inodes[id], blocks);
+        }
+    }
+    return true;
+}
+
+bool SnapshotImage::has_inode(int inode_id) const {
+    return inode_id >= 0 && inode_id < (int)inodes.size() &&
+           (inode_bitmap[inode_id / 8] & (1 << (inode_id % 8))) != 0;
+}
+
+void SnapshotDiff::compute(int fd, const SnapshotImage& from, const SnapshotImage& to) {
+    changed_inodes.clear();
+    removed_inodes.clear();
+    for (int id = 0; id < (int)to.inodes.size(); id++) {
+        if (to.has_inode(id)) {
+            if (!from.has_inode(id) || memcmp(&from.inodes[id], &to.inodes[id], sizeof(Inode)) != 0) {
+                changed_inodes.push_back(id);
+            }
+        } else if (from.has_inode(id)) {
+            removed_inodes.push_back(id);
+        }
+    }
+
+    // 目标引用的块中：from 之后出生的，或 from 没有引用的
+    changed_blocks.assign(to.blocks.size(), 0);
+    for (int w = 0; w < (int)to.blocks.size(); w++) {
+        for (uint64_t bits = to.blocks[w]; bits != 0; bits &= bits - 1) {
+            int b = w * 64 + __builtin_ctzll(bits);
+            bool in_from = (from.blocks[w] >> (b % 64)) & 1;
+            if (!in_from || ref_table_birth(fd, b) > from.epoch) {
+                changed_blocks[w] |= 1ULL << (b % 64);
+            }
+        }
+    }
+}
+
+// 装入 from / to 两个视图（调用者持有快照表共享锁）
+static bool load_images(int fd, int from_id, int to_id, SnapshotImage* from, SnapshotImage* to) {
+    if (from_id >= 0) {
+        if (from_id == to_id || !from->load(fd, from_id)) {
+            return false;
+        }
+    } else {
+        from->load_empty(fd);
+    }
+    return to->load(fd, to_id);
+}
+
+static void fill_stats(int fd, const SnapshotImage& from, const SnapshotImage& to, const SnapshotDiff& diff,
+                       SnapshotStreamStats* stats) {
+    stats->incremental = from.epoch != 0 ? 1 : 0;
+    stats->base_epoch = from.epoch;
+    stats->target_epoch = to.epoch;
+    stats->inodes_sent = (int)diff.changed_inodes.size();
+    stats->inodes_removed = (int)diff.removed_inodes.size();
+    stats->blocks_referenced = popcount_words(to.blocks);
+    stats->blocks_sent = popcount_words(diff.changed_blocks);
+
+    long long record = sizeof(StreamRecord);
+    long long bitmap = (long long)to.blocks.size() * sizeof(uint64_t);
+    stats->stream_bytes = (long long)sizeof(StreamHeader) + stats->inodes_removed * record +
+                          stats->inodes_sent * (record + (long long)sizeof(Inode)) +
+                          record + bitmap +
+                          (long long)stats->blocks_sent * (record + disk_block_size(fd)) +
+                          record + (long long)sizeof(uint32_t);
+}
+
+// ==================== 发送 ====================
+
+// 带缓冲的顺序写出，同时累计校验和
+class StreamWriter {
+public:
+    explicit StreamWriter(int out_fd) : m_fd(out_fd), m_hash(FNV_OFFSET), m_ok(true) {
+        m_buffer.reserve(WRITE_BUFFER_SIZE);
+    }
+
+    void put(const void* data, size_t size) {
+        m_hash = fnv1a(m_hash, data, size);
+        const char* p = (const char*)data;
+        m_buffer.insert(m_buffer.end(), p, p + size);
+        if (m_buffer.size() >= WRITE_BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    void record(uint32_t type, int id, const void* payload, size_t size) {
+        StreamRecord rec{type, id};
+        put(&rec, sizeof(rec));
+        if (size > 0) {
+            put(payload, size);
+        }
+    }
+
+    // END 记录：校验和覆盖它之前的所有字节
+    bool finish() {
+        StreamRecord rec{REC_END, 0};
+        put(&rec, sizeof(rec));
+        uint32_t checksum = m_hash;
+        put(&checksum, sizeof(checksum));
+        flush();
+        return m_ok;
+    }
+
+private:
+    void flush() {
+        size_t done = 0;
+        while (m_ok && done < m_buffer.size()) {
+            ssize_t n = write(m_fd, m_buffer.data() + done, m_buffer.size() - done);
+            if (n <= 0) {
+                m_ok = false;
+                break;
+            }
+            done += (size_t)n;
+        }
+        m_buffer.clear();
+    }
+
+    int m_fd;
+    uint32_t m_hash;
+    bool m_ok;
+    std::vector<char> m_buffer;
+};
+
+int snapshot_diff(int fd, int from_id, int to_id, SnapshotStreamStats* stats) {
+    if (stats == nullptr) {
+        return -1;
+    }
+    memset(stats, 0, sizeof(SnapshotStreamStats));
+
+    snapshot_table_lock(0);
+    SnapshotImage from;
+    SnapshotImage to;
+    bool ok = load_images(fd, from_id, to_id, &from, &to);
+    if (ok) {
+        SnapshotDiff diff;
+        diff.compute(fd, from, to);
+        fill_stats(fd, from, to, diff, stats);
+    }
+    snapshot_table_unlock(0);
+    return ok ? 0 : -1;
+}
+
+int snapshot_send(int fd, int from_id, int to_id, int out_fd, SnapshotStreamStats* stats) {
+    SnapshotStreamStats local;
+    if (stats == nullptr) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(SnapshotStreamStats));
+
+    // 共享锁：发送期间两个快照都不会被删除回收，它们的块保持不变
+    snapshot_table_lock(0);
+    SnapshotImage from;
+    SnapshotImage to;
+    if (!load_images(fd, from_id, to_id, &from, &to)) {
+        snapshot_table_unlock(0);
+        return -1;
+    }
+    SnapshotDiff diff;
+    diff.compute(fd, from, to);
+    fill_stats(fd, from, to, diff, stats);
+
+    StreamWriter writer(out_fd);
+    StreamHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = STREAM_MAGIC;
+    header.version = STREAM_VERSION;
+    const DiskGeometry& g = *disk_geometry(fd);
+    header.block_size = g.block_size;
+    header.block_count = g.block_count;
+    header.inode_size = sizeof(Inode);
+    header.base_epoch = from.epoch;
+    header.target_epoch = to.epoch;
+    header.target_timestamp = to.timestamp;
+    memcpy(header.target_name, to.name, sizeof(header.target_name));
+    if (from.epoch != 0) {
+        header.base_digest = state_digest(g, from.blocks, from.inode_bitmap.data(), from.inodes.data());
+    }
+    writer.put(&header, sizeof(header));
+
+    for (int id : diff.removed_inodes) {
+        writer.record(REC_INODE_FREE, id, nullptr, 0);
+    }
+    for (int id : diff.changed_inodes) {
+        writer.record(REC_INODE, id, &to.inodes[id], sizeof(Inode));
+    }
+
+    // 接收端的块位图 = 目标引用的数据块 + 元数据区（快照自身的元数据块不传输）
+    std::vector<uint64_t> bitmap = to.blocks;
+    for (int b = 0; b < g.data_block_start; b++) {
+        bitmap[b / 64] |= 1ULL << (b % 64);
+    }
+    writer.record(REC_BLOCK_BITMAP, 0, bitmap.data(), bitmap.size() * sizeof(uint64_t));
+
+    char buf[MAX_BLOCK_SIZE];
+    for (int w = 0; w < (int)diff.changed_blocks.size(); w++) {
+        for (uint64_t bits = diff.changed_blocks[w]; bits != 0; bits &= bits - 1) {
+            int b = w * 64 + __builtin_ctzll(bits);
+            read_block_cached(fd, b, buf);
+            writer.record(REC_BLOCK, b, buf, g.block_size);
+        }
+    }
+    snapshot_table_unlock(0);
+
+    return writer.finish() ? 0 : -1;
+}
+
+// ==================== 接收 ====================
+
+// 带缓冲的顺序读入，同时累计校验和；spool_fd >= 0 时把读到的字节原样转存（管道输入，第二遍从转存文件读）
+class StreamReader {
+public:
+    StreamReader(int in_fd, int spool_fd)
+        : m_fd(in_fd), m_spool_fd(spool_fd), m_hash(FNV_OFFSET), m_buffer(READ_BUFFER_SIZE) {}
+
+    bool get(void* data, size_t size) {
+        char* p = (char*)data;
+        while (size > 0) {
+            if (m_pos == m_len && !fill()) {
+                return false;
+            }
+            size_t n = std::min(size, m_len - m_pos);
+            memcpy(p, m_buffer.data() + m_pos, n);
+            m_hash = fnv1a(m_hash, p, n);
+            m_pos += n;
+            m_consumed += (long long)n;
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // 已经读到末尾（END 之后不能再有数据）
+    bool at_end() { return m_pos == m_len && !fill(); }
+
+    uint32_t hash() const { return m_hash; }
+    long long consumed() const { return m_consumed; }
+    bool ok() const { return m_ok; }
+
+private:
+    bool fill() {
+        ssize_t n;
+        do {
+            n = read(m_fd, m_buffer.data(), m_buffer.size());
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            m_ok = m_ok && n == 0;
+            return false;
+        }
+        if (m_spool_fd >= 0) {
+            for (ssize_t done = 0; done < n;) {
+                ssize_t w = write(m_spool_fd, m_buffer.data() + done, (size_t)(n - done));
+                if (w <= 0) {
+                    m_ok = false;
+                    return false;
+                }
+                done += w;
+            }
+        }
+        m_pos = 0;
+        m_len = (size_t)n;
+        return true;
+    }
+
+    int m_fd;
+    int m_spool_fd;
+    uint32_t m_hash;
+    bool m_ok = true;
+    std::vector<char> m_buffer;
+    size_t m_pos = 0;
+    size_t m_len = 0;
+    long long m_consumed = 0;
+};
+
+// 头部：格式和布局（按接收端的布局 g）
+static bool read_header(const DiskGeometry& g, StreamReader& reader, StreamHeader* header) {
+    return reader.get(header, sizeof(StreamHeader)) &&
+           header->magic == STREAM_MAGIC && header->version == STREAM_VERSION &&
+           header->block_size == (uint32_t)g.block_size && header->block_count == (uint32_t)g.block_count &&
+           header->inode_size == (uint32_t)sizeof(Inode);
+}
+
+// 记录头：类型和编号合法时返回负载长度，否则返回 -1
+static long long record_payload(const DiskGeometry& g, const StreamRecord& rec) {
+    switch (rec.type) {
+        case REC_END:
+            return 0;
+        case REC_INODE_FREE:
+        case REC_INODE:
+            if (rec.id < 0 || rec.id >= g.inode_count) {
+                return -1;
+            }
+            return rec.type == REC_INODE ? (long long)sizeof(Inode) : 0;
+        case REC_BLOCK_BITMAP:
+            return (long long)disk_mask_words(&g) * sizeof(uint64_t);
+        case REC_BLOCK:
+            if (rec.id < g.data_block_start || rec.id >= g.block_count) {
+                return -1;
+            }
+            return g.block_size;
+        default:
+            return -1;
+    }
+}
+
+// 第一遍：顺序读完整个流，校验格式和校验和（只保留一条记录的负载，内存占用与流大小无关）
+static bool scan_stream(const DiskGeometry& g, int in_fd, int spool_fd, StreamHeader* header, long long* bytes) {
+    StreamReader reader(in_fd, spool_fd);
+    if (!read_header(g, reader, header)) {
+        return false;
+    }
+    std::vector<char> payload((size_t)std::max<long long>(g.block_size, (long long)disk_mask_words(&g) * sizeof(uint64_t)));
+    for (;;) {
+        StreamRecord rec;
+        if (!reader.get(&rec, sizeof(rec))) {
+            return false;  // 没有 END：流被截断
+        }
+        long long size = record_payload(g, rec);
+        if (size < 0) {
+            return false;
+        }
+        if (rec.type == REC_END) {
+            uint32_t expected = reader.hash();
+            uint32_t checksum;
+            if (!reader.get(&checksum, sizeof(checksum)) || checksum != expected || !reader.at_end()) {
+                return false;
+            }
+            *bytes = reader.consumed();
+            return reader.ok();
+        }
+        if (!reader.get(payload.data(), (size_t)size)) {
+            return false;
+        }
+    }
+}
+
+int snapshot_receive(int fd, int in_fd, SnapshotStreamStats* stats) {
+    SnapshotStreamStats local;
+    if (stats == nullptr) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof(SnapshotStreamStats));
+
+    // 先校验整个流：流损坏时副本不做任何修改
+    // 普通文件校验后回到起点再读一遍；管道边校验边转存到临时文件，第二遍从临时文件读
+    const DiskGeometry& g = *disk_geometry(fd);
+    struct stat st;
+    off_t start = lseek(in_fd, 0, SEEK_CUR);
+    bool seekable = start >= 0 && fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode);
+    FILE* spool = seekable ? nullptr : tmpfile();
+    if (!seekable && spool == nullptr) {
+        std::cout << "无法创建快照流的临时文件" << std::endl;
+        return -1;
+    }
+    int source_fd = seekable ? in_fd : fileno(spool);
+    auto close_spool = [&]() {
+        if (spool != nullptr) {
+            fclose(spool);
+        }
+    };
+
+    StreamHeader header;
+    long long stream_bytes = 0;
+    if (!scan_stream(g, in_fd, seekable ? -1 : source_fd, &header, &stream_bytes) ||
+        lseek(source_fd, seekable ? start : 0, SEEK_SET) < 0) {
+        close_spool();
+        std::cout << "快照流损坏或格式不匹配" << std::endl;
+        return -1;
+    }
+    stats->incremental = header.base_epoch != 0 ? 1 : 0;
+    stats->base_epoch = header.base_epoch;
+    stats->target_epoch = header.target_epoch;
+    stats->stream_bytes = stream_bytes;
+
+    snapshot_table_lock(1);
+    if (snapshot_catalog_count(fd, SNAPSHOT_STATE_ANY) > 0) {
+        snapshot_table_unlock(1);
+        close_spool();
+        std::cout << "副本上有快照，不能接收快照流" << std::endl;
+        return -1;
+    }
+    Superblock sb;
+    read_superblock(fd, &sb);
+    if (header.base_epoch != 0 && sb.received_epoch != header.base_epoch) {
+        snapshot_table_unlock(1);
+        close_spool();
+        std::cout << "增量流的基准快照 (epoch " << header.base_epoch << ") 与副本最近接收的快照 (epoch "
+                  << sb.received_epoch << ") 不一致" << std::endl;
+        return -1;
+    }
+
+    int inodes_per_block = g.block_size / sizeof(Inode);
+    std::vector<unsigned char> inode_bitmap((size_t)g.inode_bitmap_blocks * g.block_size, 0);
+    std::vector<Inode> inodes((size_t)g.inode_table_blocks * inodes_per_block, Inode{});
+    if (header.base_epoch != 0) {
+        allocator_copy_inode_bitmap(fd, inode_bitmap.data());
+        for (int i = 0; i < g.inode_table_blocks; i++) {
+            read_block_cached(fd, g.inode_table_start + i, &inodes[i * inodes_per_block]);
+        }
+
+        // 上次接收之后副本被修改过（新分配的块可能正是流要写入的块）：拒绝，副本保持不变
+        std::vector<uint64_t> live((size_t)g.block_bitmap_blocks * g.block_size / sizeof(uint64_t), 0);
+        allocator_copy_block_bitmap(fd, live.data());
+        if (state_digest(g, live, inode_bitmap.data(), inodes.data()) != header.base_digest) {
+            snapshot_table_unlock(1);
+            close_spool();
+            std::cout << "副本在上次接收之后被修改过，不能应用增量流" << std::endl;
+            return -1;
+        }
+    }
+
+    // 从这里开始的改写是一个操作：不会被别的线程的提交拆开
+    journal_begin(fd);
+
+    // 没有快照时目录里只剩空闲槽位：清空目录，表项块随块位图整体改写一起释放
+    snapshot_catalog_reset(fd);
+
+    // 第二遍：逐条应用记录，inode 先在内存中的表上修改，最后整块写回
+    // 块位图按位图区的整块分配，写回时多出的位为 0
+    const int mask_words = disk_mask_words(&g);
+    std::vector<uint64_t> block_bitmap((size_t)g.block_bitmap_blocks * g.block_size / sizeof(uint64_t), 0);
+    std::vector<uint64_t> received(mask_words, 0);
+    StreamReader reader(source_fd, -1);
+    std::vector<char> buffer((size_t)std::max<long long>(g.block_size, (long long)mask_words * sizeof(uint64_t)));
+    const char* payload = buffer.data();
+    StreamRecord rec;
+    StreamHeader again;
+    read_header(g, reader, &again);  // 第一遍已经校验过
+    while (reader.get(&rec, sizeof(rec)) && rec.type != REC_END) {
+        long long size = record_payload(g, rec);
+        if (size < 0 || !reader.get(buffer.data(), (size_t)size)) {
+            break;
+        }
+        switch (rec.type) {
+            case REC_INODE_FREE:
+                inode_bitmap[rec.id / 8] &= ~(1 << (rec.id % 8));
+                memset(&inodes[rec.id], 0, sizeof(Inode));
+                stats->inodes_removed++;
+                break;
+            case REC_INODE:
+                inode_bitmap[rec.id / 8] |= 1 << (rec.id % 8);
+                memcpy(&inodes[rec.id], payload, sizeof(Inode));
+                stats->inodes_sent++;
+                break;
+            case REC_BLOCK_BITMAP:
+                memcpy(block_bitmap.data(), payload, (size_t)mask_words * sizeof(uint64_t));
+                break;
+            case REC_BLOCK:
+                write_block_cached(fd, rec.id, payload);
+                received[rec.id / 64] |= 1ULL << (rec.id % 64);
+                stats->blocks_sent++;
+                break;
+        }
+    }
+    for (int b = 0; b < g.data_block_start; b++) {
+        block_bitmap[b / 64] |= 1ULL << (b % 64);
+    }
+
+    for (int i = 0; i < g.inode_table_blocks; i++) {
+        write_block_cached(fd, g.inode_table_start + i, &inodes[i * inodes_per_block]);
+    }
+    for (int i = 0; i < g.inode_bitmap_blocks; i++) {
+        write_block_cached(fd, g.inode_bitmap_start + i, inode_bitmap.data() + (size_t)i * g.block_size);
+    }
+    for (int i = 0; i < g.block_bitmap_blocks; i++) {
+        write_block_cached(fd, g.block_bitmap_start + i, (const char*)block_bitmap.data() + (size_t)i * g.block_size);
+    }
+
+    // 引用计数按新的 inode 表重新统计；收到的块以当前 epoch 出生（副本上没有快照，不需要 COW）
+    std::vector<uint64_t> referenced(mask_words, 0);
+    std::vector<int> counts(g.block_count, 0);
+    for (int id = 0; id < g.inode_count; id++) {
+        if (!(inode_bitmap[id / 8] & (1 << (id % 8)))) {
+            continue;
+        }
+        std::fill(referenced.begin(), referenced.end(), 0);
+        mark_inode_blocks(fd, inodes[id], referenced);
+        for (int w = 0; w < mask_words; w++) {
+            for (uint64_t bits = referenced[w]; bits != 0; bits &= bits - 1) {
+                counts[w * 64 + __builtin_ctzll(bits)]++;
+            }
+        }
+    }
+    for (int b = g.data_block_start; b < g.block_count; b++) {
+        ref_table_set(fd, b, counts[b]);
+        if ((received[b / 64] >> (b % 64)) & 1) {
+            ref_table_set_birth(fd, b, sb.epoch);
+        }
+    }
+    stats->blocks_referenced = 0;
+    for (int b = g.data_block_start; b < g.block_count; b++) {
+        stats->blocks_referenced += counts[b] > 0 ? 1 : 0;
+    }
+
+    // 位图和 inode 表已整体替换：丢弃内存中的派生状态
+    allocator_reload(fd);
+    bmap_cache_discard(fd);
+    dcache_invalidate(fd);
+
+    // superblock 最后写：空闲计数取自重新加载的分配器
+    read_superblock(fd, &sb);
+    sb.received_epoch = header.target_epoch;
+    write_superblock(fd, &sb);
+    allocator_sync(fd);
+    journal_end(fd);
+    block_cache_sync(fd);
+    snapshot_table_unlock(1);
+    close_spool();
+    return 0;
+}
+
+void snapshot_stream_print_stats(const SnapshotStreamStats* stats) {
+    if (stats == nullptr) {
+        return;
+    }
+    std::cout << "\n📊 Snapshot Stream Statistics:" << std::endl;
+    std::cout << "   Type:              " << (stats->incremental ? "incremental" : "full");
+    if (stats->incremental) {
+        std::cout << " (base epoch " << stats->base_epoch << ")";
+    }
+    std::cout << std::endl;
+    std::cout << "   Target epoch:      " << stats->target_epoch
+              << (stats->target_epoch == 0 ? " (live)" : "") << std::endl;
+    std::cout << "   Inodes:            " << stats->inodes_sent << " changed, "
+              << stats->inodes_removed << " removed" << std::endl;
+    std::cout << "   Blocks:            " << stats->blocks_sent << " sent / "
+              << stats->blocks_referenced << " referenced" << std::endl;
+    std::cout << "   Stream size:       " << stats->stream_bytes << " bytes" << std::endl;
+}
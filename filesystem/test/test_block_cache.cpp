@@ -4,9 +4,15 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <thread>
+#include <chrono>
+#include <vector>
 
 using namespace std;
 
+// 测试在 mkfs 默认布局的镜像上运行
+static const int BLOCK_SIZE = DEFAULT_BLOCK_SIZE;
+
 void test_basic_cache() {
     cout << "\n=== 测试基本缓存功能 ===" << endl;
     
@@ -103,6 +109,66 @@ void test_lru_replacement() {
     disk_close(fd);
 }
 
+// 热块工作集 + 一次性顺序扫描，返回扫描后重读热块的命中数
+static size_t run_scan_workload(int fd, int policy) {
+    const int hot_blocks = 20;
+    const int scan_blocks = 500;
+    block_cache_init_ex(100, policy);
+    
+    char buf[BLOCK_SIZE];
+    // 热块反复访问
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < hot_blocks; i++) {
+            read_block_cached(fd, 600 + i, buf);
+        }
+    }
+    // 一次性扫描（类似快照遍历引用计数表 / 数据块）
+    for (int i = 0; i < scan_blocks; i++) {
+        read_block_cached(fd, 1000 + i, buf);
+    }
+    
+    size_t hits_before, misses_before, size, capacity;
+    block_cache_get_stats(&hits_before, &misses_before, &size, &capacity);
+    for (int i = 0; i < hot_blocks; i++) {
+        read_block_cached(fd, 600 + i, buf);
+    }
+    size_t hits_after, misses_after;
+    block_cache_get_stats(&hits_after, &misses_after, &size, &capacity);
+    
+    block_cache_print_stats();
+    block_cache_destroy();
+    return hits_after - hits_before;
+}
+
+void test_scan_resistance() {
+    cout << "\n=== 测试抗扫描替换策略 ===" << endl;
+    
+    int fd = disk_open("disk.img");
+    assert(fd >= 0);
+    
+    size_t clock_hits = run_scan_workload(fd, BLOCK_CACHE_POLICY_CLOCK);
+    cout << "  CLOCK:   扫描后热块命中 " << clock_hits << "/20" << endl;
+    
+    size_t s3fifo_hits = run_scan_workload(fd, BLOCK_CACHE_POLICY_S3FIFO);
+    cout << "  S3-FIFO: 扫描后热块命中 " << s3fifo_hits << "/20" << endl;
+    assert(s3fifo_hits == 20);
+    cout << "✓ S3-FIFO 下一次性扫描没有冲掉热块" << endl;
+    
+    // 策略计数通过 block_cache_get_stats_ex 暴露
+    block_cache_init_ex(10, BLOCK_CACHE_POLICY_S3FIFO);
+    char buf[BLOCK_SIZE];
+    read_block_cached(fd, 600, buf);
+    read_block_cached(fd, 600, buf);
+    BlockCacheStats stats;
+    block_cache_get_stats_ex(&stats);
+    assert(stats.policy == BLOCK_CACHE_POLICY_S3FIFO);
+    assert(stats.probation_hits == 1);
+    block_cache_destroy();
+    cout << "✓ 策略命中计数正确" << endl;
+    
+    disk_close(fd);
+}
+
 void test_dirty_block_flush() {
     cout << "\n=== 测试脏块刷新 ===" << endl;
     
@@ -140,6 +206,95 @@ void test_dirty_block_flush() {
     disk_close(fd);
 }
 
+void test_write_back_mode() {
+    cout << "\n=== 测试写回模式 ===" << endl;
+    
+    int fd = disk_open("disk.img");
+    assert(fd >= 0);
+    
+    block_cache_init(8);
+    // 最大年龄设得很长，先验证"写入只进缓存"
+    block_cache_set_write_back(1, 60000, 100);
+    
+    char old_buf[BLOCK_SIZE];
+    char new_buf[BLOCK_SIZE];
+    char disk_buf[BLOCK_SIZE];
+    memset(old_buf, 'O', BLOCK_SIZE);
+    memset(new_buf, 'N', BLOCK_SIZE);
+    write_block(fd, 350, old_buf);
+    
+    // 同一块反复写入只在缓存中合并，磁盘保持旧内容
+    for (int i = 0; i < 10; i++) {
+        write_block_cached(fd, 350, new_buf);
+    }
+    read_block(fd, 350, disk_buf);
+    assert(memcmp(disk_buf, old_buf, BLOCK_SIZE) == 0);
+    
+    char read_buf[BLOCK_SIZE];
+    read_block_cached(fd, 350, read_buf);
+    assert(memcmp(read_buf, new_buf, BLOCK_SIZE) == 0);
+    
+    size_t dirty, writebacks;
+    block_cache_get_writeback_stats(&dirty, &writebacks);
+    assert(dirty == 1 && writebacks == 0);
+    cout << "✓ 10 次写入被缓存吸收，磁盘未写" << endl;
+    
+    // 显式持久化点
+    block_cache_sync(fd);
+    read_block(fd, 350, disk_buf);
+    assert(memcmp(disk_buf, new_buf, BLOCK_SIZE) == 0);
+    block_cache_get_writeback_stats(&dirty, &writebacks);
+    assert(dirty == 0 && writebacks == 1);
+    cout << "✓ sync 后数据落盘" << endl;
+    
+    // 淘汰脏块时同步写回
+    for (int i = 0; i < 9; i++) {
+        memset(new_buf, 'a' + i, BLOCK_SIZE);
+        write_block_cached(fd, 360 + i, new_buf);
+    }
+    read_block(fd, 360, disk_buf);
+    memset(new_buf, 'a', BLOCK_SIZE);
+    assert(memcmp(disk_buf, new_buf, BLOCK_SIZE) == 0);
+    cout << "✓ 淘汰的脏块已写回" << endl;
+    
+    // 年龄阈值：后台线程在超时后写回
+    block_cache_set_write_back(1, 50, 100);
+    memset(new_buf, 'T', BLOCK_SIZE);
+    write_block_cached(fd, 370, new_buf);
+    bool flushed = false;
+    for (int i = 0; i < 100 && !flushed; i++) {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        read_block(fd, 370, disk_buf);
+        flushed = memcmp(disk_buf, new_buf, BLOCK_SIZE) == 0;
+    }
+    assert(flushed);
+    cout << "✓ 后台线程按年龄阈值写回" << endl;
+    
+    // 比例阈值：脏块超过 25% 时提前写回（年龄阈值很长）
+    block_cache_set_write_back(1, 60000, 25);
+    for (int i = 0; i < 4; i++) {
+        memset(new_buf, 'R', BLOCK_SIZE);
+        write_block_cached(fd, 380 + i, new_buf);
+    }
+    for (int i = 0; i < 100; i++) {
+        block_cache_get_writeback_stats(&dirty, &writebacks);
+        if (dirty <= 2) break;
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+    assert(dirty <= 2);
+    cout << "✓ 后台线程按比例阈值写回" << endl;
+    
+    block_cache_print_stats();
+    
+    // 关闭写回模式时写回全部脏块
+    block_cache_set_write_back(0, 0, 0);
+    block_cache_get_writeback_stats(&dirty, &writebacks);
+    assert(dirty == 0);
+    
+    block_cache_destroy();
+    disk_close(fd);
+}
+
 void test_cache_disabled() {
     cout << "\n=== 测试禁用缓存 ===" << endl;
     
@@ -194,15 +349,90 @@ void test_performance() {
     disk_close(fd);
 }
 
+// 多线程读命中基准：每个线程在工作集内随机读块，统计吞吐和命中率
+static double run_concurrent_reads(int fd, int threads, int reads_per_thread, int working_set) {
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([=]() {
+            char buf[BLOCK_SIZE];
+            unsigned int seed = 12345u + t * 7919u;
+            for (int i = 0; i < reads_per_thread; i++) {
+                seed = seed * 1103515245u + 12345u;
+                int block_id = 1000 + (int)((seed >> 8) % working_set);
+                read_block_cached(fd, block_id, buf);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return (double)threads * reads_per_thread / seconds;
+}
+
+void test_concurrent_performance() {
+    cout << "\n=== 测试多线程缓存性能 ===" << endl;
+    
+    int fd = disk_open("disk.img");
+    assert(fd >= 0);
+    
+    const int capacity = 1024;
+    const int working_set = 768;       // 工作集小于容量：预热后应全部命中
+    const int reads_per_thread = 200000;
+    block_cache_init(capacity);
+    
+    // 预热
+    char buf[BLOCK_SIZE];
+    for (int i = 0; i < working_set; i++) {
+        read_block_cached(fd, 1000 + i, buf);
+    }
+    
+    int max_threads = (int)thread::hardware_concurrency();
+    if (max_threads < 2) max_threads = 2;
+    if (max_threads > 8) max_threads = 8;
+    
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        size_t hits_before, misses_before, size, cap;
+        block_cache_get_stats(&hits_before, &misses_before, &size, &cap);
+        
+        double ops = run_concurrent_reads(fd, threads, reads_per_thread, working_set);
+        
+        size_t hits_after, misses_after;
+        block_cache_get_stats(&hits_after, &misses_after, &size, &cap);
+        size_t hits = hits_after - hits_before;
+        size_t misses = misses_after - misses_before;
+        double hit_rate = 100.0 * hits / (hits + misses);
+        
+        cout << "  " << threads << " 线程: " << (long)ops << " reads/sec, 命中率 "
+             << hit_rate << "%" << endl;
+        assert(hits + misses == (size_t)threads * reads_per_thread);
+        assert(misses == 0);
+    }
+    
+    // 工作集大于容量：包含 CLOCK 替换路径的吞吐
+    const int large_set = capacity * 2;
+    double ops = run_concurrent_reads(fd, max_threads, reads_per_thread / 4, large_set);
+    cout << "  " << max_threads << " 线程（工作集 " << large_set << " 块）: " << (long)ops
+         << " reads/sec" << endl;
+    
+    block_cache_print_stats();
+    block_cache_destroy();
+    disk_close(fd);
+}
+
 int main() {
     cout << "块缓存测试开始..." << endl;
     
     try {
         test_basic_cache();
         test_lru_replacement();
+        test_scan_resistance();
         test_dirty_block_flush();
+        test_write_back_mode();
         test_cache_disabled();
         test_performance();
+        test_concurrent_performance();
         
         cout << "\n=== 所有测试通过! ===" << endl;
     } catch (const exception& e) {
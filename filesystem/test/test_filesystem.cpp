@@ -1,10 +1,28 @@
 #include "../include/disk.h"
 #include "../include/inode.h"
+#include "../include/allocator.h"
+#include "../include/block_cache.h"
+#include "../include/block_device.h"
+#include "../include/bmap_cache.h"
+#include "../include/extent.h"
+#include "../include/dcache.h"
+#include "../include/ref_table.h"
+#include "../include/journal.h"
+#include <unistd.h>
 #include <iostream>
 #include <cstring>
+#include <cstdio>
 #include <cassert>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 using namespace std;
 
+// 除 test_disk_geometry 外，测试都在 mkfs 默认布局的镜像上运行
+static const int BLOCK_SIZE = DEFAULT_BLOCK_SIZE;
+
 void test_disk_operations() {
     cout << "=== 测试磁盘基本操作 ===" << endl;
     
@@ -24,20 +42,21 @@ void test_disk_operations() {
     char read_buf[BLOCK_SIZE];
     
     memset(write_buf, 0xAA, BLOCK_SIZE); // 填充特定值
-    write_block(fd, DATA_BLOCK_START, write_buf);
+    const int data_block_start = disk_geometry(fd)->data_block_start;
+    write_block(fd, data_block_start, write_buf);
     
     memset(read_buf, 0, BLOCK_SIZE);
-    read_block(fd, DATA_BLOCK_START, read_buf);
+    read_block(fd, data_block_start, read_buf);
     
     assert(memcmp(write_buf, read_buf, BLOCK_SIZE) == 0);
     cout << "块读写测试通过" << endl;
     
     // 测试部分块读写
     char partial_data[] = "Hello FileSystem!";
-    write_data_block(fd, DATA_BLOCK_START, partial_data, 100, strlen(partial_data));
+    write_data_block(fd, data_block_start, partial_data, 100, strlen(partial_data));
     
     char read_partial[100];
-    read_data_block(fd, DATA_BLOCK_START, read_partial, 100, strlen(partial_data));
+    read_data_block(fd, data_block_start, read_partial, 100, strlen(partial_data));
     
     assert(memcmp(partial_data, read_partial, strlen(partial_data)) == 0);
     cout << "部分块读写测试通过" << endl;
@@ -111,6 +130,58 @@ void test_block_allocation() {
     disk_close(fd);
 }
 
+void test_allocator_throughput() {
+    cout << "\n=== 测试内存分配器 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    
+    Superblock sb_orig;
+    read_superblock(fd, &sb_orig);
+    AllocatorStats before;
+    allocator_get_stats(fd, &before);
+    
+    // 连续分配/释放一批数据块，统计每秒分配次数
+    const int N = 1000;
+    int* blocks = new int[N];
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < N; i++) {
+        blocks[i] = alloc_block(fd);
+        assert(blocks[i] >= disk_geometry(fd)->data_block_start);
+    }
+    for (int i = 0; i < N; i++) {
+        free_block(fd, blocks[i]);
+    }
+    auto end = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(end - start).count();
+    
+    // 释放后的块可以被再次分配
+    int again = alloc_block(fd);
+    assert(again >= disk_geometry(fd)->data_block_start);
+    free_block(fd, again);
+    
+    AllocatorStats after;
+    allocator_get_stats(fd, &after);
+    assert(after.block_allocs - before.block_allocs == (uint64_t)N + 1);
+    assert(after.block_frees - before.block_frees == (uint64_t)N + 1);
+    
+    // 空闲计数与分配前一致
+    Superblock sb_new;
+    read_superblock(fd, &sb_new);
+    assert(sb_new.free_block_count == sb_orig.free_block_count);
+    cout << "分配/释放 " << N << " 个块: " << (int)(2 * N / seconds) << " ops/sec" << endl;
+    allocator_print_stats(fd);
+    
+    delete[] blocks;
+    disk_close(fd);
+    
+    // 重新打开后，惰性写回的位图和计数已经落盘
+    fd = disk_open("../disk/disk.img");
+    read_superblock(fd, &sb_new);
+    assert(sb_new.free_block_count == sb_orig.free_block_count);
+    assert(allocator_block_allocated(fd, again) == 0);
+    disk_close(fd);
+}
+
 void test_inode_operations() {
     cout << "\n=== 测试Inode操作 ===" << endl;
     
@@ -201,8 +272,8 @@ void test_file_data_operations() {
     disk_close(fd);
 }
 
-void test_direct_and_indirect_blocks() {
-    cout << "\n=== 测试直接块和间接块 ===" << endl;
+void test_extent_mapping() {
+    cout << "\n=== 测试 extent 映射 ===" << endl;
     
     int fd = disk_open("../disk/disk.img");
     
@@ -213,9 +284,7 @@ void test_direct_and_indirect_blocks() {
     Inode inode;
     init_inode(&inode, INODE_TYPE_FILE);
     
-    // 写入足够多的数据来触发间接块分配
-    // DIRECT_BLOCK_COUNT是10，每个块1024字节
-    // 我们写入12个块的数据
+    // 写入12个块的数据：新块按物理连续段登记成 extent
     char* large_data = new char[BLOCK_SIZE * 12];
     for (int i = 0; i < BLOCK_SIZE * 12; i++) {
         large_data[i] = 'A' + (i % 26);
@@ -231,18 +300,15 @@ void test_direct_and_indirect_blocks() {
     assert(inode.block_count == 12);
     assert(inode.size == BLOCK_SIZE * 12);
     
-    // 验证直接块指针
-    cout << "直接块指针数量: " << DIRECT_BLOCK_COUNT << endl;
-    for (int i = 0; i < min(DIRECT_BLOCK_COUNT, inode.block_count); i++) {
-        cout << "直接块[" << i << "]: " << inode.direct_blocks[i] << endl;
-        assert(inode.direct_blocks[i] != -1);
-    }
-    
-    // 验证间接块指针
-    if (inode.block_count > DIRECT_BLOCK_COUNT) {
-        cout << "间接块指针: " << inode.indirect_block << endl;
-        assert(inode.indirect_block != -1);
+    // 每个逻辑块都有映射，extent 数不超过块数
+    int ids[12];
+    assert(extent_map(fd, &inode, 0, 12, ids) == 0);
+    for (int i = 0; i < 12; i++) {
+        assert(ids[i] != -1);
     }
+    int extents = extent_count_extents(fd, &inode);
+    cout << "extent 数: " << extents << "（树高 " << inode.extent_depth << "）" << endl;
+    assert(extents >= 1 && extents <= 12);
     
     // 读取数据验证
     char* read_buffer = new char[BLOCK_SIZE * 12];
@@ -258,6 +324,1028 @@ void test_direct_and_indirect_blocks() {
     disk_close(fd);
 }
 
+// 大目录：逐个插入 N 个条目，按每 500 个统计平均插入延迟；之后查找和删除都要正确
+void test_directory_index_scaling() {
+    cout << "\n=== 测试大目录哈希索引 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    int dir_id = alloc_inode(fd);
+    assert(dir_id >= 0);
+    Inode dir;
+    init_inode(&dir, INODE_TYPE_DIR);
+    write_inode(fd, dir_id, &dir);
+    
+    const int N = 4000;
+    const int step = 500;
+    char name[DIR_NAME_SIZE];
+    auto bucket_start = chrono::steady_clock::now();
+    for (int i = 0; i < N; i++) {
+        snprintf(name, sizeof(name), "concurrent_paper_%d_%d", i, 1700000000 + i * 7);
+        assert(dir_add_entry(fd, &dir, dir_id, name, 1000 + i) == 0);
+        if ((i + 1) % step == 0) {
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - bucket_start).count();
+            cout << "N=" << (i + 1) << " 平均插入延迟 " << (int)(us / step) << " us" << endl;
+            bucket_start = chrono::steady_clock::now();
+        }
+    }
+    assert(dir.dir_index >= 0);
+    
+    // 重复插入被拒绝
+    snprintf(name, sizeof(name), "concurrent_paper_%d_%d", 123, 1700000000 + 123 * 7);
+    assert(dir_add_entry(fd, &dir, dir_id, name, 1) == -2);
+    
+    // 全部可以查到
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < N; i++) {
+        snprintf(name, sizeof(name), "concurrent_paper_%d_%d", i, 1700000000 + i * 7);
+        assert(dir_find_entry(fd, &dir, name) == 1000 + i);
+    }
+    double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    cout << "查找 " << N << " 项: 平均 " << us / N << " us" << endl;
+    assert(dir_find_entry(fd, &dir, "no_such_paper") == -1);
+    
+    // 删除偶数项（会把末尾条目搬到空位），剩下的仍能查到
+    for (int i = 0; i < N; i += 2) {
+        snprintf(name, sizeof(name), "concurrent_paper_%d_%d", i, 1700000000 + i * 7);
+        assert(dir_remove_entry(fd, &dir, dir_id, name) == 0);
+    }
+    assert(dir.size == (N / 2) * (int)sizeof(DirEntry));
+    for (int i = 0; i < N; i++) {
+        snprintf(name, sizeof(name), "concurrent_paper_%d_%d", i, 1700000000 + i * 7);
+        assert(dir_find_entry(fd, &dir, name) == (i % 2 == 0 ? -1 : 1000 + i));
+    }
+    cout << "删除一半后查找结果正确" << endl;
+    
+    // 目录和它的索引一起释放
+    int index_id = dir.dir_index;
+    inode_free_blocks(fd, &dir);
+    assert(dir.dir_index == -1);
+    write_inode(fd, dir_id, &dir);
+    free_inode(fd, dir_id);
+    assert(allocator_inode_allocated(fd, index_id) == 0);
+    
+    disk_close(fd);
+}
+
+void test_bmap_cache() {
+    cout << "\n=== 测试 bmap 缓存 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    int inode_id = alloc_inode(fd);
+    assert(inode_id >= 0);
+    Inode inode;
+    init_inode(&inode, INODE_TYPE_FILE);
+    
+    // 20 个块，和另一个文件交替逐块追加：每块一个 extent，放不进 inode，映射在一个树叶子里
+    const int blocks = 20;
+    char* data = new char[BLOCK_SIZE * (blocks + 5)];
+    for (int i = 0; i < BLOCK_SIZE * (blocks + 5); i++) {
+        data[i] = (char)('a' + i % 23);
+    }
+    int other_id = alloc_inode(fd);
+    Inode other;
+    init_inode(&other, INODE_TYPE_FILE);
+    for (int b = 0; b < blocks; b++) {
+        assert(inode_write_data(fd, &inode, inode_id, data + b * BLOCK_SIZE, b * BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+        assert(inode_write_data(fd, &other, other_id, data, b * BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+    }
+    assert(inode.extent_depth == 1);
+    
+    // 逐块读取：叶子只解码一次，之后都是命中（每次映射读节点头和项两次）
+    BmapCacheStats before, after;
+    bmap_cache_get_stats(&before);
+    char buf[BLOCK_SIZE];
+    for (int round = 0; round < 3; round++) {
+        for (int b = 0; b < blocks; b++) {
+            assert(inode_read_data(fd, &inode, buf, b * BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+            assert(memcmp(buf, data + b * BLOCK_SIZE, BLOCK_SIZE) == 0);
+        }
+    }
+    bmap_cache_get_stats(&after);
+    assert(after.misses - before.misses <= 1);
+    assert(after.hits - before.hits >= (unsigned long)(2 * 3 * blocks - 1));
+    cout << "树节点命中 " << after.hits - before.hits << " 次，解码 "
+         << after.misses - before.misses << " 次" << endl;
+    
+    // 追加块会改写叶子：旧的解码结果作废，新块可以读到
+    assert(inode_write_data(fd, &inode, inode_id, data + BLOCK_SIZE * blocks, BLOCK_SIZE * blocks, BLOCK_SIZE * 5)
+           == BLOCK_SIZE * 5);
+    bmap_cache_get_stats(&before);
+    assert(before.invalidations > after.invalidations);
+    char* all = new char[BLOCK_SIZE * (blocks + 5)];
+    assert(inode_read_data(fd, &inode, all, 0, BLOCK_SIZE * (blocks + 5)) == BLOCK_SIZE * (blocks + 5));
+    assert(memcmp(all, data, BLOCK_SIZE * (blocks + 5)) == 0);
+    cout << "追加后映射更新正确" << endl;
+    bmap_cache_print_stats();
+    
+    inode_free_blocks(fd, &inode);
+    write_inode(fd, inode_id, &inode);
+    free_inode(fd, inode_id);
+    inode_free_blocks(fd, &other);
+    write_inode(fd, other_id, &other);
+    free_inode(fd, other_id);
+    delete[] data;
+    delete[] all;
+    disk_close(fd);
+}
+
+// 整文件读取 / 1KB 分块顺序读取的吞吐（MB/s），每轮开始前清空块缓存
+// 大文件只需要少数几个 extent；碎片化的文件映射放进多层 extent 树，快照后改写只复制修改路径上的节点
+// 在单独格式化的镜像上运行：块按顺序分配，extent 数和树的形状是确定的
+void test_extent_tree() {
+    cout << "\n=== 测试 extent 树和大文件 ===" << endl;
+    
+    const char* path = "../disk/extent.img";
+    DiskGeometry g;
+    assert(disk_plan_geometry(DEFAULT_DISK_SIZE, DEFAULT_BLOCK_SIZE, 0, &g) == 0);
+    assert(disk_format(path, &g) == 0);
+    int fd = disk_open(path);
+    assert(fd >= 0);
+    
+    // 3MB 顺序写入：远超原来直接块 + 一级间接块 266KB 的上限
+    const int big_size = 3 * 1024 * 1024;
+    vector<char> big(big_size);
+    for (int i = 0; i < big_size; i++) {
+        big[i] = (char)(i * 13 + i / BLOCK_SIZE);
+    }
+    int big_id = alloc_inode(fd);
+    Inode big_inode;
+    init_inode(&big_inode, INODE_TYPE_FILE);
+    for (int off = 0; off < big_size; off += 64 * 1024) {
+        assert(inode_write_data(fd, &big_inode, big_id, big.data() + off, off, 64 * 1024) == 64 * 1024);
+    }
+    assert(big_inode.block_count == big_size / BLOCK_SIZE);
+    
+    // 整文件读取时物理连续的块合并成一次读：连续段数就是需要的读请求数
+    vector<int> ids(big_inode.block_count);
+    assert(extent_map(fd, &big_inode, 0, big_inode.block_count, ids.data()) == 0);
+    int runs = 1;
+    for (int i = 1; i < big_inode.block_count; i++) {
+        if (ids[i] != ids[i - 1] + 1) {
+            runs++;
+        }
+    }
+    int big_extents = extent_count_extents(fd, &big_inode);
+    cout << "3MB 文件: " << big_inode.block_count << " 块，" << big_extents << " 个 extent，"
+         << runs << " 段连续读" << endl;
+    assert(runs == 1 && big_extents == 1 && big_inode.extent_depth == 0);
+    block_cache_clear();
+    vector<char> back(big_size);
+    assert(inode_read_data(fd, &big_inode, back.data(), 0, big_size) == big_size);
+    assert(memcmp(back.data(), big.data(), big_size) == 0);
+    
+    // 两个文件交替逐块追加：每块一个 extent。1KB 块的节点放 84 项，300 项是 4 个叶子，
+    // inode 里放不下 4 个索引项，树高 2
+    const int frag_blocks = 300;
+    vector<char> frag((size_t)frag_blocks * BLOCK_SIZE);
+    for (size_t i = 0; i < frag.size(); i++) {
+        frag[i] = (char)(i * 7 + i / BLOCK_SIZE);
+    }
+    int a_id = alloc_inode(fd);
+    int b_id = alloc_inode(fd);
+    Inode a, b;
+    init_inode(&a, INODE_TYPE_FILE);
+    init_inode(&b, INODE_TYPE_FILE);
+    for (int i = 0; i < frag_blocks; i++) {
+        const char* chunk = frag.data() + (size_t)i * BLOCK_SIZE;
+        assert(inode_write_data(fd, &a, a_id, chunk, i * BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+        assert(inode_write_data(fd, &b, b_id, chunk, i * BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+    }
+    assert(extent_count_extents(fd, &a) == frag_blocks);
+    assert(a.extent_depth == 2);
+    vector<int> nodes;
+    extent_collect(fd, &a, nullptr, &nodes);
+    assert(nodes.size() == 5);
+    back.assign(frag.size(), 0);
+    assert(inode_read_data(fd, &a, back.data(), 0, (int)frag.size()) == (int)frag.size());
+    assert(memcmp(back.data(), frag.data(), frag.size()) == 0);
+    cout << "碎片化文件: " << frag_blocks << " 个 extent，树高 " << a.extent_depth
+         << "，" << nodes.size() << " 个树节点" << endl;
+    
+    // 快照之后改写中间一块：叶子和索引节点都被快照共享，只复制这条路径上的两个节点
+    int snap = create_snapshot(fd, "extent_tree");
+    assert(snap >= 0);
+    vector<char> patch(BLOCK_SIZE, 'P');
+    assert(inode_write_data(fd, &a, a_id, patch.data(), 150 * BLOCK_SIZE, BLOCK_SIZE) == BLOCK_SIZE);
+    vector<int> cow_nodes;
+    extent_collect(fd, &a, nullptr, &cow_nodes);
+    int copied = 0;
+    for (int node : cow_nodes) {
+        if (find(nodes.begin(), nodes.end(), node) == nodes.end()) {
+            copied++;
+        }
+    }
+    assert(copied == 2);
+    assert(extent_count_extents(fd, &a) == frag_blocks);
+    assert(inode_read_data(fd, &a, back.data(), 0, (int)frag.size()) == (int)frag.size());
+    assert(memcmp(back.data() + 150 * BLOCK_SIZE, patch.data(), BLOCK_SIZE) == 0);
+    assert(memcmp(back.data(), frag.data(), 150 * BLOCK_SIZE) == 0);
+    
+    // 恢复快照：映射回到原来的树
+    assert(restore_snapshot(fd, snap) == 0);
+    assert(delete_snapshot(fd, snap) == 0);
+    read_inode(fd, a_id, &a);
+    assert(inode_read_data(fd, &a, back.data(), 0, (int)frag.size()) == (int)frag.size());
+    assert(memcmp(back.data(), frag.data(), frag.size()) == 0);
+    cout << "快照后改写只复制 " << copied << " 个树节点，恢复后内容不变" << endl;
+    
+    // 崩溃后挂载：一致性检查沿 extent 树重建引用计数，树节点仍是已分配的
+    journal_commit(fd);
+    close(fd);
+    assert(disk_open(path) == fd);
+    DiskMountInfo info;
+    assert(disk_get_mount_info(fd, &info) == 0 && info.checked);
+    read_inode(fd, a_id, &a);
+    for (int node : nodes) {
+        assert(allocator_block_allocated(fd, node) == 1);
+        assert(get_block_ref_count(fd, node) == 1);
+    }
+    assert(inode_read_data(fd, &a, back.data(), 0, (int)frag.size()) == (int)frag.size());
+    assert(memcmp(back.data(), frag.data(), frag.size()) == 0);
+    
+    // 全部释放：数据块和树节点一块不漏地回到空闲
+    read_inode(fd, b_id, &b);
+    read_inode(fd, big_id, &big_inode);
+    int file_ids[] = {a_id, b_id, big_id};
+    Inode* files[] = {&a, &b, &big_inode};
+    int mapped = 0;
+    for (int k = 0; k < 3; k++) {
+        vector<int> file_nodes;
+        extent_collect(fd, files[k], nullptr, &file_nodes);
+        mapped += files[k]->block_count + (int)file_nodes.size();
+    }
+    int free_inodes = 0, free_before = 0, free_after = 0;
+    allocator_get_free_counts(fd, &free_inodes, &free_before);
+    for (int k = 0; k < 3; k++) {
+        inode_free_blocks(fd, files[k]);
+        write_inode(fd, file_ids[k], files[k]);
+        free_inode(fd, file_ids[k]);
+    }
+    allocator_get_free_counts(fd, &free_inodes, &free_after);
+    assert(free_after == free_before + mapped);
+    cout << "释放 " << mapped << " 块（含树节点）" << endl;
+    disk_close(fd);
+    unlink(path);
+}
+
+// 小文件内联在 inode 中：写入不分配数据块，读取只需要 inode；长大后透明地搬到数据块，截断为空后回到内联
+void test_inline_small_files() {
+    cout << "\n=== 测试小文件内联 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    int free_inodes = 0, free_before = 0, free_now = 0;
+    allocator_get_free_counts(fd, &free_inodes, &free_before);
+    
+    // meta.txt 这样的小文件：不占数据块
+    const char* meta = "author=alice\nstatus=UNDER_REVIEW\ndecision=\nreviewers=bob,carol\n";
+    const int len = (int)strlen(meta);
+    int inode_id = alloc_inode(fd);
+    Inode inode;
+    init_inode(&inode, INODE_TYPE_FILE);
+    assert(inode.flags & INODE_FLAG_INLINE);
+    assert(inode_write_data(fd, &inode, inode_id, meta, 0, len) == len);
+    assert((inode.flags & INODE_FLAG_INLINE) && inode.block_count == 0 && inode.size == len);
+    allocator_get_free_counts(fd, &free_inodes, &free_now);
+    assert(free_now == free_before);
+    
+    // 读 inode 之后读内容：不访问任何数据块
+    BlockCacheStats before, after;
+    block_cache_get_stats_ex(&before);
+    Inode loaded;
+    read_inode(fd, inode_id, &loaded);
+    char buf[INODE_INLINE_SIZE * 2];
+    assert(inode_read_data(fd, &loaded, buf, 0, sizeof(buf)) == len);
+    assert(memcmp(buf, meta, len) == 0);
+    block_cache_get_stats_ex(&after);
+    assert(after.data_hits + after.data_misses == before.data_hits + before.data_misses);
+    cout << len << " 字节的文件内联在 inode 中，读取没有访问数据块" << endl;
+    
+    // 越过末尾写入，中间的空洞读出 0
+    vector<char> expected(meta, meta + len);
+    expected.resize(INODE_INLINE_SIZE, 0);
+    expected[INODE_INLINE_SIZE - 1] = 'X';
+    assert(inode_write_data(fd, &inode, inode_id, "X", INODE_INLINE_SIZE - 1, 1) == 1);
+    assert((inode.flags & INODE_FLAG_INLINE) && inode.size == INODE_INLINE_SIZE);
+    assert(inode_read_data(fd, &inode, buf, 0, sizeof(buf)) == INODE_INLINE_SIZE);
+    assert(memcmp(buf, expected.data(), INODE_INLINE_SIZE) == 0);
+    
+    // 长到放不下：已有内容搬到数据块，和新写入的部分一起读出
+    const int big_size = BLOCK_SIZE * 2 + 500;
+    expected.resize(big_size);
+    for (int i = INODE_INLINE_SIZE; i < big_size; i++) {
+        expected[i] = (char)('a' + i % 26);
+    }
+    assert(inode_write_data(fd, &inode, inode_id, expected.data() + INODE_INLINE_SIZE, INODE_INLINE_SIZE,
+                            big_size - INODE_INLINE_SIZE) == big_size - INODE_INLINE_SIZE);
+    assert(!(inode.flags & INODE_FLAG_INLINE) && inode.block_count == 3 && inode.size == big_size);
+    read_inode(fd, inode_id, &loaded);
+    vector<char> back(big_size);
+    assert(inode_read_data(fd, &loaded, back.data(), 0, big_size) == big_size);
+    assert(memcmp(back.data(), expected.data(), big_size) == 0);
+    cout << "超过 " << INODE_INLINE_SIZE << " 字节后搬到数据块，内容不变" << endl;
+    
+    // 截断为空：数据块全部释放，之后的小写入又内联
+    inode_free_blocks(fd, &inode);
+    write_inode(fd, inode_id, &inode);
+    assert((inode.flags & INODE_FLAG_INLINE) && inode.block_count == 0 && inode.size == 0);
+    allocator_get_free_counts(fd, &free_inodes, &free_now);
+    assert(free_now == free_before);
+    assert(inode_write_data(fd, &inode, inode_id, "short", 0, 5) == 5);
+    assert((inode.flags & INODE_FLAG_INLINE) && inode.block_count == 0);
+    
+    inode_free_blocks(fd, &inode);
+    write_inode(fd, inode_id, &inode);
+    free_inode(fd, inode_id);
+    disk_close(fd);
+}
+
+// 就近分配：新 inode 的第一块靠近父目录；交错写入的文件有预留窗口时各自连续；快照后改写整个文件时副本连成一段
+void test_locality_allocation() {
+    cout << "\n=== 测试就近分配和预留窗口 ===" << endl;
+    
+    const char* path = "../disk/locality.img";
+    DiskGeometry g;
+    assert(disk_plan_geometry(DEFAULT_DISK_SIZE, DEFAULT_BLOCK_SIZE, 0, &g) == 0);
+    assert(disk_format(path, &g) == 0);
+    int fd = disk_open(path);
+    const int block_size = disk_block_size(fd);
+    
+    auto new_file = [&](Inode* inode) {
+        int inode_id = alloc_inode(fd);
+        init_inode(inode, INODE_TYPE_FILE);
+        write_inode(fd, inode_id, inode);
+        return inode_id;
+    };
+    auto first_block = [&](const Inode* inode) {
+        int block = -1;
+        extent_map(fd, inode, 0, 1, &block);
+        return block;
+    };
+    
+    // 根目录之后先留出一个空洞：写 50 块再删掉，next-fit 游标停在后面那个 200 块的文件之后
+    Inode hole, filler;
+    int hole_id = new_file(&hole);
+    int filler_id = new_file(&filler);
+    vector<char> data(200 * block_size, 'f');
+    assert(inode_write_data(fd, &hole, hole_id, data.data(), 0, 50 * block_size) == 50 * block_size);
+    assert(inode_write_data(fd, &filler, filler_id, data.data(), 0, 200 * block_size) == 200 * block_size);
+    const int filler_start = first_block(&filler);
+    inode_free_blocks(fd, &hole);
+    write_inode(fd, hole_id, &hole);
+    free_inode(fd, hole_id);
+    block_cache_sync(fd);  // 释放的块在释放它们的事务提交之后才能再分配
+    
+    // 新目录和其中的新文件：第一块放在父目录附近（空洞里），而不是游标所在的位置
+    Inode root;
+    read_inode(fd, 0, &root);
+    int dir_id = alloc_inode(fd);
+    Inode dir;
+    init_inode(&dir, INODE_TYPE_DIR);
+    write_inode(fd, dir_id, &dir);
+    assert(dir_add_entry(fd, &root, 0, "papers", dir_id) == 0);
+    assert(dir_add_entry(fd, &dir, dir_id, ".", dir_id) == 0);
+    assert(dir_add_entry(fd, &dir, dir_id, "..", 0) == 0);
+    Inode paper;
+    int paper_id = new_file(&paper);
+    assert(dir_add_entry(fd, &dir, dir_id, "paper.pdf", paper_id) == 0);
+    assert(inode_write_data(fd, &paper, paper_id, data.data(), 0, 4 * block_size) == 4 * block_size);
+    const int dir_block = first_block(&dir);
+    const int paper_block = first_block(&paper);
+    assert(dir_block > first_block(&root) && dir_block < filler_start);
+    assert(paper_block > dir_block && paper_block < filler_start);
+    assert(extent_count_extents(fd, &paper) == 1);
+    cout << "根目录在块 " << first_block(&root) << "，新目录在块 " << dir_block << "，其中的文件在块 " << paper_block
+         << "（游标之后的空闲块从 " << filler_start + 200 << " 开始）" << endl;
+    
+    // 两个文件一块一块交错追加：没有预留窗口时逐块交错，有窗口时各自只有少数几个 extent
+    const int blocks = 100;
+    auto interleave = [&](bool reserve, int* ids, Inode* inodes) {
+        for (int f = 0; f < 2; f++) {
+            ids[f] = new_file(&inodes[f]);
+            if (reserve) {
+                inode_write_begin(fd, ids[f]);
+            }
+        }
+        for (int i = 0; i < blocks; i++) {
+            for (int f = 0; f < 2; f++) {
+                vector<char> chunk(block_size, (char)('a' + f * 13 + i % 13));
+                assert(inode_write_data(fd, &inodes[f], ids[f], chunk.data(), i * block_size, block_size) == block_size);
+            }
+        }
+        for (int f = 0; reserve && f < 2; f++) {
+            inode_write_end(fd, ids[f]);
+        }
+    };
+    int plain_ids[2], reserved_ids[2];
+    Inode plain[2], reserved[2];
+    interleave(false, plain_ids, plain);
+    interleave(true, reserved_ids, reserved);
+    int plain_extents = extent_count_extents(fd, &plain[0]) + extent_count_extents(fd, &plain[1]);
+    int reserved_extents = extent_count_extents(fd, &reserved[0]) + extent_count_extents(fd, &reserved[1]);
+    assert(plain_extents > blocks);
+    assert(reserved_extents <= 8);
+    for (int f = 0; f < 2; f++) {
+        vector<char> back(blocks * block_size);
+        assert(inode_read_data(fd, &reserved[f], back.data(), 0, blocks * block_size) == blocks * block_size);
+        for (int i = 0; i < blocks; i++) {
+            assert(back[i * block_size] == (char)('a' + f * 13 + i % 13));
+        }
+    }
+    cout << "交错写入 2 × " << blocks << " 块：没有窗口 " << plain_extents << " 个 extent，有窗口 "
+         << reserved_extents << " 个" << endl;
+    
+    // 快照后整个文件改写一遍：副本紧接着前一块分配
+    assert(create_snapshot(fd, "locality") >= 0);
+    vector<char> rewrite(blocks * block_size, 'r');
+    inode_write_begin(fd, reserved_ids[0]);
+    assert(inode_write_data(fd, &reserved[0], reserved_ids[0], rewrite.data(), 0, blocks * block_size) == blocks * block_size);
+    inode_write_end(fd, reserved_ids[0]);
+    int rewritten_extents = extent_count_extents(fd, &reserved[0]);
+    assert(rewritten_extents <= 4);
+    cout << "快照后改写 " << blocks << " 块：" << rewritten_extents << " 个 extent" << endl;
+    
+    FragmentationReport report;
+    assert(extent_fragmentation_report(fd, &report) == 0);
+    assert(report.files == 6);
+    assert(report.blocks == 200 + 4 + 4 * blocks);
+    extent_print_fragmentation(fd);
+    allocator_print_stats(fd);
+    
+    disk_close(fd);
+    unlink(path);
+}
+
+// 块设备后端：三种后端读写同一种镜像；discard 之后读出 0；内存盘不写回镜像文件
+void test_block_devices() {
+    cout << "\n=== 测试块设备后端 ===" << endl;
+    
+    const int types[] = {BLOCK_DEVICE_PREAD, BLOCK_DEVICE_MMAP, BLOCK_DEVICE_MEMORY};
+    
+    // 原始接口：单块 / 向量读写、discard、flush
+    const char* raw_path = "../disk/device_raw.img";
+    for (int type : types) {
+        unlink(raw_path);
+        int dev = block_device_open(raw_path, type);
+        assert(dev >= 0 && block_device_type(dev) == type);
+        assert(block_device_resize(dev, 8 * 1024) == 0 && block_device_size(dev) == 8 * 1024);
+        vector<char> block(1024, 'x'), a(1024, 'a'), b(1024, 'b');
+        assert(block_device_write(dev, block.data(), 1024, 0) == 1024);
+        struct iovec iov[2] = {{a.data(), 1024}, {b.data(), 1024}};
+        assert(block_device_get(dev)->writev(iov, 2, 1024) == 2048);
+        
+        assert(block_device_discard(dev, 1024, 1024) == 0);
+        vector<char> back(3 * 1024, '?');
+        struct iovec back_iov[3] = {{back.data(), 1024}, {back.data() + 1024, 1024}, {back.data() + 2048, 1024}};
+        assert(block_device_get(dev)->readv(back_iov, 3, 0) == 3 * 1024);
+        assert(back[0] == 'x' && back[1023] == 'x');
+        assert(back[1024] == 0 && back[2047] == 0);
+        assert(back[2048] == 'b' && back[3071] == 'b');
+        assert(block_device_read(dev, back.data(), 1024, 8 * 1024) == 0);  // 末尾之后
+        assert(block_device_flush(dev) == 0);
+        block_device_close(dev);
+    }
+    unlink(raw_path);
+    cout << "pread / mmap / memory：读写、向量读写、discard 通过" << endl;
+    
+    // 同一个镜像依次用三种后端挂载：pread 写入，mmap 读出并改写，内存盘读到之前的内容
+    const char* path = "../disk/device.img";
+    unlink(path);
+    int fd = disk_open_with(path, BLOCK_DEVICE_PREAD);
+    assert(block_device_type(fd) == BLOCK_DEVICE_PREAD);
+    const int size = 20 * 1024 + 7;
+    vector<char> data(size);
+    for (int i = 0; i < size; i++) {
+        data[i] = (char)(i * 13 + 5);
+    }
+    int inode_id = alloc_inode(fd);
+    Inode inode;
+    init_inode(&inode, INODE_TYPE_FILE);
+    assert(inode_write_data(fd, &inode, inode_id, data.data(), 0, size) == size);
+    disk_close(fd);
+    
+    fd = disk_open_with(path, BLOCK_DEVICE_MMAP);
+    assert(block_device_type(fd) == BLOCK_DEVICE_MMAP);
+    read_inode(fd, inode_id, &inode);
+    vector<char> back(size);
+    assert(inode_read_data(fd, &inode, back.data(), 0, size) == size);
+    assert(memcmp(back.data(), data.data(), size) == 0);
+    memset(data.data(), 'm', 1024);
+    assert(inode_write_data(fd, &inode, inode_id, data.data(), 0, 1024) == 1024);
+    disk_close(fd);
+    
+    // 内存盘从镜像文件读入，改动只留在进程内：再用 pread 打开时还是 mmap 写下的内容
+    fd = disk_open_with(path, BLOCK_DEVICE_MEMORY);
+    assert(block_device_type(fd) == BLOCK_DEVICE_MEMORY);
+    read_inode(fd, inode_id, &inode);
+    assert(inode_read_data(fd, &inode, back.data(), 0, size) == size);
+    assert(memcmp(back.data(), data.data(), size) == 0);
+    vector<char> ram(1024, 'r');
+    assert(inode_write_data(fd, &inode, inode_id, ram.data(), 0, 1024) == 1024);
+    disk_close(fd);
+    
+    fd = disk_open_with(path, BLOCK_DEVICE_MEMORY);
+    read_inode(fd, inode_id, &inode);
+    assert(inode_read_data(fd, &inode, back.data(), 0, 1024) == 1024 && back[0] == 'r');
+    disk_close(fd);
+    
+    fd = disk_open_with(path, BLOCK_DEVICE_PREAD);
+    read_inode(fd, inode_id, &inode);
+    assert(inode_read_data(fd, &inode, back.data(), 0, size) == size);
+    assert(memcmp(back.data(), data.data(), size) == 0);
+    disk_close(fd);
+    unlink(path);
+    cout << "同一镜像在 pread / mmap / memory 之间切换挂载通过（默认后端 "
+         << block_device_type_name(block_device_default_type()) << "）" << endl;
+}
+
+void test_sequential_read_throughput() {
+    cout << "\n=== 测试顺序读吞吐 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    block_cache_init_ex(1024, BLOCK_CACHE_POLICY_S3FIFO);
+    
+    const int sizes_kb[] = {8, 64, 256};
+    const int rounds = 50;
+    for (int size_kb : sizes_kb) {
+        int size = size_kb * 1024;
+        int inode_id = alloc_inode(fd);
+        assert(inode_id >= 0);
+        Inode inode;
+        init_inode(&inode, INODE_TYPE_FILE);
+        
+        char* data = new char[size];
+        char* buf = new char[size];
+        for (int i = 0; i < size; i++) {
+            data[i] = (char)(i * 31 + size_kb);
+        }
+        assert(inode_write_data(fd, &inode, inode_id, data, 0, size) == size);
+        
+        // 整文件一次读取（PAPER_DOWNLOAD 的访问方式）
+        double full_seconds = 0;
+        for (int r = 0; r < rounds; r++) {
+            block_cache_clear();
+            memset(buf, 0, size);
+            auto start = chrono::steady_clock::now();
+            assert(inode_read_data(fd, &inode, buf, 0, size) == size);
+            full_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            assert(memcmp(buf, data, size) == 0);
+        }
+        
+        // 1KB 分块顺序读取（依靠预读）
+        BlockCacheStats before, after;
+        block_cache_get_stats_ex(&before);
+        double chunk_seconds = 0;
+        for (int r = 0; r < rounds; r++) {
+            block_cache_clear();
+            memset(buf, 0, size);
+            auto start = chrono::steady_clock::now();
+            for (int off = 0; off < size; off += BLOCK_SIZE) {
+                assert(inode_read_data(fd, &inode, buf + off, off, BLOCK_SIZE) == BLOCK_SIZE);
+            }
+            chunk_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            assert(memcmp(buf, data, size) == 0);
+        }
+        block_cache_get_stats_ex(&after);
+        assert(after.prefetched > before.prefetched);
+        
+        double mb = (double)size * rounds / (1024.0 * 1024.0);
+        cout << size_kb << "KB 文件: 整文件读取 " << (int)(mb / full_seconds) << " MB/s, "
+             << "1KB 分块顺序读取 " << (int)(mb / chunk_seconds) << " MB/s, "
+             << "预读 " << (after.prefetched - before.prefetched) / rounds << " 块/轮" << endl;
+        
+        inode_free_blocks(fd, &inode);
+        write_inode(fd, inode_id, &inode);
+        free_inode(fd, inode_id);
+        delete[] data;
+        delete[] buf;
+    }
+    
+    disk_close(fd);
+    block_cache_destroy();
+}
+
+// 引用计数表常驻内存：覆盖写未共享的块时，COW 判断不再读取引用计数表 / 出生 epoch 表
+void test_ref_table_overwrite() {
+    cout << "\n=== 测试内存引用计数表 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    block_cache_init_ex(1024, BLOCK_CACHE_POLICY_S3FIFO);
+    
+    const int blocks = 8;
+    int inode_id = alloc_inode(fd);
+    assert(inode_id >= 0);
+    Inode inode;
+    init_inode(&inode, INODE_TYPE_FILE);
+    char data[BLOCK_SIZE * blocks];
+    memset(data, 'r', sizeof(data));
+    assert(inode_write_data(fd, &inode, inode_id, data, 0, sizeof(data)) == (int)sizeof(data));
+    
+    // 整块对齐覆盖写：元数据访问只剩写回 inode 的读-改-写（读、写各算一次）
+    const int rounds = 200;
+    BlockCacheStats before, after;
+    block_cache_get_stats_ex(&before);
+    for (int r = 0; r < rounds; r++) {
+        memset(data, 'a' + r % 26, BLOCK_SIZE);
+        int off = (r % blocks) * BLOCK_SIZE;
+        assert(inode_write_data(fd, &inode, inode_id, data, off, BLOCK_SIZE) == BLOCK_SIZE);
+    }
+    block_cache_get_stats_ex(&after);
+    unsigned long meta = (after.meta_hits + after.meta_misses) - (before.meta_hits + before.meta_misses);
+    cout << "覆盖写 " << rounds << " 次，元数据块访问 " << meta << " 次（"
+         << (double)meta / rounds << " 次/写）" << endl;
+    assert(meta <= 2UL * rounds);
+    
+    // 计数只在内存中修改，分配器写回后落盘：关闭再打开后仍然正确
+    int first_block = inode.extents[0].start;
+    assert(get_block_ref_count(fd, first_block) == 1);
+    ref_table_print_stats(fd);
+    disk_close(fd);
+    
+    fd = disk_open("../disk/disk.img");
+    assert(get_block_ref_count(fd, first_block) == 1);
+    read_inode(fd, inode_id, &inode);
+    inode_free_blocks(fd, &inode);
+    write_inode(fd, inode_id, &inode);
+    free_inode(fd, inode_id);
+    assert(get_block_ref_count(fd, first_block) == 0);
+    disk_close(fd);
+    
+    fd = disk_open("../disk/disk.img");
+    assert(get_block_ref_count(fd, first_block) == 0);
+    disk_close(fd);
+    block_cache_destroy();
+}
+
+// 元数据日志：提交后崩溃（不调用 disk_close），重新挂载时重放日志，未提交的修改整体丢弃
+void test_journal_replay() {
+    cout << "\n=== 测试元数据日志重放 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    
+    int inode_id = alloc_inode(fd);
+    assert(inode_id >= 0);
+    Inode inode;
+    init_inode(&inode, INODE_TYPE_FILE);
+    const char text[] = "journaled metadata";
+    assert(inode_write_data(fd, &inode, inode_id, text, 0, sizeof(text)) == (int)sizeof(text));
+    assert(journal_commit(fd) == 0);
+    
+    JournalStats stats;
+    journal_get_stats(fd, &stats);
+    assert(stats.commits >= 1 && stats.log_used > 0 && stats.pending_blocks == 0);
+    
+    // 提交只写了日志：原位置的 inode 表块还是旧内容
+    int inode_block = disk_geometry(fd)->inode_table_start + inode_id / (BLOCK_SIZE / sizeof(Inode));
+    char raw[BLOCK_SIZE];
+    read_block(fd, inode_block, raw);
+    Inode on_disk;
+    memcpy(&on_disk, raw + (inode_id % (BLOCK_SIZE / sizeof(Inode))) * sizeof(Inode), sizeof(Inode));
+    assert(on_disk.type != INODE_TYPE_FILE || on_disk.size != (int)sizeof(text));
+    
+    // 提交之后的修改：崩溃时丢失
+    int lost_id = alloc_inode(fd);
+    assert(lost_id >= 0);
+    Inode lost;
+    init_inode(&lost, INODE_TYPE_DIR);
+    write_inode(fd, lost_id, &lost);
+    allocator_sync(fd);
+    
+    // 模拟崩溃：直接关闭 fd，同号 fd 重新挂载时丢弃残留的内存状态
+    close(fd);
+    int reopened = disk_open("../disk/disk.img");
+    assert(reopened == fd);
+    
+    assert(allocator_inode_allocated(fd, inode_id) == 1);
+    assert(allocator_inode_allocated(fd, lost_id) == 0);
+    read_inode(fd, inode_id, &inode);
+    assert(inode.type == INODE_TYPE_FILE && inode.size == (int)sizeof(text));
+    char buf[sizeof(text)];
+    assert(inode_read_data(fd, &inode, buf, 0, sizeof(text)) == (int)sizeof(text));
+    assert(memcmp(buf, text, sizeof(text)) == 0);
+    cout << "✓ 已提交的事务重放成功，未提交的修改被丢弃" << endl;
+    
+    // 清理；正常关闭时做检查点，再次挂载不需要重放
+    inode_free_blocks(fd, &inode);
+    free_inode(fd, inode_id);
+    disk_close(fd);
+    fd = disk_open("../disk/disk.img");
+    assert(allocator_inode_allocated(fd, inode_id) == 0);
+    DiskMountInfo info;
+    assert(disk_get_mount_info(fd, &info) == 0);
+    assert(info.replayed == 0);
+    disk_close(fd);
+}
+
+// 组提交：一个操作进行中时，其他线程的提交都等它结束，然后合并成一次日志写入
+void test_journal_group_commit() {
+    cout << "\n=== 测试日志组提交 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    const int threads = 8;
+    
+    JournalStats before;
+    journal_get_stats(fd, &before);
+    
+    journal_begin(fd);
+    vector<int> inode_ids(threads, -1);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([fd, t, &inode_ids]() {
+            int id = alloc_inode(fd);
+            Inode inode;
+            init_inode(&inode, INODE_TYPE_FILE);
+            inode.size = 1000 + t;
+            write_inode(fd, id, &inode);
+            inode_ids[t] = id;
+            journal_commit(fd);
+        });
+    }
+    
+    // 等所有线程都在等待提交，再结束进行中的操作
+    JournalStats stats;
+    do {
+        this_thread::sleep_for(chrono::milliseconds(1));
+        journal_get_stats(fd, &stats);
+    } while (stats.commit_requests - before.commit_requests < (uint64_t)threads);
+    journal_end(fd);
+    for (auto& w : workers) {
+        w.join();
+    }
+    
+    journal_get_stats(fd, &stats);
+    uint64_t commits = stats.commits - before.commits;
+    cout << threads << " 个线程的提交合并为 " << commits << " 次日志写入" << endl;
+    assert(commits == 1);
+    journal_print_stats(fd);
+    
+    // 崩溃后全部可见
+    close(fd);
+    assert(disk_open("../disk/disk.img") == fd);
+    for (int t = 0; t < threads; t++) {
+        Inode inode;
+        read_inode(fd, inode_ids[t], &inode);
+        assert(inode.size == 1000 + t);
+        free_inode(fd, inode_ids[t]);
+    }
+    disk_close(fd);
+}
+
+// 检查点之后日志不再保留映像：元数据块回到块缓存，读到的是检查点写回的新内容
+void test_journal_checkpoint_releases_images() {
+    cout << "\n=== 测试检查点释放日志映像 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    JournalStats before;
+    journal_get_stats(fd, &before);
+    
+    // 逐个修改并提交，直到日志写满做了检查点（每个 inode 先经块缓存读入旧内容）
+    vector<int> ids;
+    JournalStats stats = before;
+    while (stats.checkpoints == before.checkpoints) {
+        int id = alloc_inode(fd);
+        assert(id >= 0);
+        Inode inode;
+        read_inode(fd, id, &inode);
+        init_inode(&inode, INODE_TYPE_FILE);
+        inode.size = 7000 + id;
+        write_inode(fd, id, &inode);
+        ids.push_back(id);
+        journal_commit(fd);
+        journal_get_stats(fd, &stats);
+    }
+    
+    // 常驻的只有检查点之后提交的事务里的块
+    cout << ids.size() << " 次提交后做了检查点，常驻映像 " << stats.resident_images << " 块" << endl;
+    assert(stats.resident_images <= stats.log_used);
+    for (int id : ids) {
+        Inode inode;
+        read_inode(fd, id, &inode);
+        assert(inode.size == 7000 + id);
+    }
+    
+    for (int id : ids) {
+        free_inode(fd, id);
+    }
+    disk_close(fd);
+}
+
+// 目录项块经过日志：提交前不会被块缓存写回原位置；释放的块在事务提交前不再分配
+void test_journal_structural_blocks() {
+    cout << "\n=== 测试结构块日志和暂缓复用 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    Inode root;
+    read_inode(fd, 0, &root);
+    int dir_id = alloc_inode(fd);
+    Inode dir;
+    init_inode(&dir, INODE_TYPE_DIR);
+    write_inode(fd, dir_id, &dir);
+    assert(dir_add_entry(fd, &root, 0, "journaled_dir", dir_id) == 0);
+    assert(dir_add_entry(fd, &dir, dir_id, "kept", 0) == 0);
+    assert(journal_checkpoint(fd) == 0);
+    int dir_block = -1;
+    extent_map(fd, &dir, 0, 1, &dir_block);
+    assert(dir_block >= disk_geometry(fd)->data_block_start);
+    
+    // 提交之后新增的目录项：写回全部脏缓存后，原位置仍是旧内容
+    assert(dir_add_entry(fd, &dir, dir_id, "lost", 0) == 0);
+    block_cache_flush(fd);
+    char raw[BLOCK_SIZE];
+    read_block(fd, dir_block, raw);
+    for (int i = 0; i < BLOCK_SIZE / (int)sizeof(DirEntry); i++) {
+        assert(strcmp(((DirEntry*)raw)[i].name, "lost") != 0);
+    }
+    
+    // 释放的块：位图上已是空闲，提交之前不再分配
+    Inode file;
+    int file_id = alloc_inode(fd);
+    init_inode(&file, INODE_TYPE_FILE);
+    vector<char> data(4 * BLOCK_SIZE, 'h');
+    assert(inode_write_data(fd, &file, file_id, data.data(), 0, (int)data.size()) == (int)data.size());
+    int freed = -1;
+    extent_map(fd, &file, 0, 1, &freed);
+    block_cache_sync(fd);
+    inode_free_blocks(fd, &file);
+    free_inode(fd, file_id);
+    assert(allocator_block_allocated(fd, freed) == 0);
+    assert(allocator_held_blocks(fd) >= 4);
+    block_cache_sync(fd);
+    assert(allocator_held_blocks(fd) == 0);
+    cout << "✓ 数据块 " << freed << " 在释放它的事务提交之后才能再分配" << endl;
+    
+    // 模拟崩溃：只有提交过的目录项留下
+    assert(dir_add_entry(fd, &dir, dir_id, "lost_too", 0) == 0);
+    block_cache_flush(fd);
+    close(fd);
+    int reopened = disk_open("../disk/disk.img");
+    assert(reopened == fd);
+    read_inode(fd, dir_id, &dir);
+    assert(dir_find_entry(fd, &dir, "kept") >= 0);
+    assert(dir_find_entry(fd, &dir, "lost_too") < 0);
+    cout << "✓ 目录块 " << dir_block << " 只经过日志写入，崩溃后没有未提交的目录项" << endl;
+    
+    read_inode(fd, 0, &root);
+    assert(dir_remove_entry(fd, &root, 0, "journaled_dir") == 0);
+    inode_free_blocks(fd, &dir);
+    write_inode(fd, dir_id, &dir);
+    free_inode(fd, dir_id);
+    disk_close(fd);
+}
+
+// 超过日志容量的事务：映像暂存到数据区，提交仍是原子的
+void test_journal_oversized_transaction() {
+    cout << "\n=== 测试超过日志容量的事务 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    JournalStats before;
+    journal_get_stats(fd, &before);
+    
+    // 一次写目录数据就修改超过日志容量的结构块，无法在操作之间拆分
+    int dir_id = alloc_inode(fd);
+    Inode dir;
+    init_inode(&dir, INODE_TYPE_DIR);
+    int blocks = disk_geometry(fd)->journal_blocks + 8;
+    vector<char> data((size_t)blocks * BLOCK_SIZE, 'j');
+    assert(inode_write_data(fd, &dir, dir_id, data.data(), 0, (int)data.size()) == (int)data.size());
+    write_inode(fd, dir_id, &dir);
+    journal_commit(fd);
+    
+    JournalStats after;
+    journal_get_stats(fd, &after);
+    assert(after.overflows > before.overflows);
+    assert(after.unlogged == before.unlogged);
+    assert(allocator_held_blocks(fd) == 0);
+    cout << "✓ " << blocks << " 块的事务经暂存块原子提交" << endl;
+    
+    // 模拟崩溃：提交过的内容都在
+    close(fd);
+    int reopened = disk_open("../disk/disk.img");
+    assert(reopened == fd);
+    read_inode(fd, dir_id, &dir);
+    vector<char> back(data.size());
+    assert(inode_read_data(fd, &dir, back.data(), 0, (int)back.size()) == (int)back.size());
+    assert(back == data);
+    cout << "✓ 崩溃后重新挂载，内容完整" << endl;
+    
+    inode_free_blocks(fd, &dir);
+    write_inode(fd, dir_id, &dir);
+    free_inode(fd, dir_id);
+    disk_close(fd);
+}
+
+// 挂载状态：正常关闭的磁盘挂载时跳过一致性检查，崩溃（没有 disk_close）后的挂载做检查
+void test_clean_mount() {
+    cout << "\n=== 测试正常关闭后的快速挂载 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    disk_close(fd);
+    
+    fd = disk_open("../disk/disk.img");
+    DiskMountInfo info;
+    assert(disk_get_mount_info(fd, &info) == 0);
+    assert(!info.checked && !info.formatted);
+    cout << "正常关闭后挂载: " << info.mount_ns / 1000 << " us（跳过一致性检查）" << endl;
+    
+    // 挂载期间 superblock 是 DIRTY
+    Superblock sb;
+    read_superblock(fd, &sb);
+    assert(sb.state == FS_STATE_DIRTY);
+    
+    // 挂载时 DIRTY 已经提交：还没有任何写就崩溃，下次挂载也要检查
+    close(fd);
+    assert(disk_open("../disk/disk.img") == fd);
+    assert(disk_get_mount_info(fd, &info) == 0);
+    assert(info.checked);
+    cout << "崩溃后挂载: " << info.mount_ns / 1000 << " us（一致性检查）" << endl;
+    disk_close(fd);
+}
+
+void test_disk_geometry() {
+    cout << "\n=== 测试 mkfs 选择的磁盘布局 ===" << endl;
+
+    // 不合法的参数：块大小不是 2 的幂 / 超出范围，磁盘放不下元数据区
+    DiskGeometry g;
+    assert(disk_plan_geometry(8 * 1024 * 1024, 3000, 0, &g) == -1);
+    assert(disk_plan_geometry(8 * 1024 * 1024, 8192, 0, &g) == -1);
+    assert(disk_plan_geometry(64 * 1024, 1024, 0, &g) == -1);
+
+    // 默认参数与 disk_open 自动格式化的布局相同
+    assert(disk_plan_geometry(DEFAULT_DISK_SIZE, DEFAULT_BLOCK_SIZE, 0, &g) == 0);
+    int fd = disk_open("../disk/disk.img");
+    assert(memcmp(disk_geometry(fd), &g, sizeof(g)) == 0);
+    disk_close(fd);
+
+    const char* path = "../disk/geometry.img";
+
+    // 4KB 块：多块文件，快照恢复，重新挂载后内容不变
+    assert(disk_plan_geometry(64LL * 1024 * 1024, 4096, 0, &g) == 0);
+    assert(g.block_count == 16384 && g.data_block_start < g.block_count);
+    assert(disk_format(path, &g) == 0);
+    fd = disk_open(path);
+    assert(fd >= 0);
+    assert(memcmp(disk_geometry(fd), &g, sizeof(g)) == 0);
+    Superblock sb;
+    read_superblock(fd, &sb);
+    assert(sb.block_size == 4096 && sb.block_count == g.block_count && sb.inode_count == g.inode_count);
+    cout << "64MB / 4KB: inode " << g.inode_count << " 个，元数据 " << g.data_block_start << " 块" << endl;
+
+    const int size = 4096 * 18 + 123;
+    vector<char> data(size);
+    for (int i = 0; i < size; i++) {
+        data[i] = (char)(i * 7 + i / 4096);
+    }
+    int inode_id = alloc_inode(fd);
+    Inode inode;
+    init_inode(&inode, INODE_TYPE_FILE);
+    write_inode(fd, inode_id, &inode);
+    assert(inode_write_data(fd, &inode, inode_id, data.data(), 0, size) == size);
+    assert(inode.block_count == 19);
+
+    int snap = create_snapshot(fd, "geometry");
+    assert(snap >= 0);
+    vector<char> changed(4096, 'x');
+    assert(inode_write_data(fd, &inode, inode_id, changed.data(), 4096 * 12, 4096) == 4096);
+    assert(restore_snapshot(fd, snap) == 0);
+    disk_close(fd);
+
+    fd = disk_open(path);
+    assert(disk_block_size(fd) == 4096);
+    read_inode(fd, inode_id, &inode);
+    vector<char> back(size);
+    assert(inode_read_data(fd, &inode, back.data(), 0, size) == size);
+    assert(memcmp(back.data(), data.data(), size) == 0);
+    disk_close(fd);
+    cout << "4KB 块读写、快照恢复、重新挂载通过" << endl;
+
+    // 1KB 块的大磁盘：块位图占多个块，分配越过第一个位图块后崩溃，重新挂载（一致性检查）
+    assert(disk_plan_geometry(32LL * 1024 * 1024, 1024, 0, &g) == 0);
+    assert(g.block_bitmap_blocks == 4);
+    assert(disk_format(path, &g) == 0);
+    fd = disk_open(path);
+    vector<int> blocks;
+    for (int b = alloc_block(fd); b >= 0; b = alloc_block(fd)) {
+        blocks.push_back(b);
+        if (b >= 1024 * 8 + 100) {
+            break;
+        }
+    }
+    assert(blocks.back() >= 1024 * 8);
+    int last = blocks.back();
+    for (size_t i = 0; i + 1 < blocks.size(); i++) {
+        free_block(fd, blocks[i]);
+    }
+    journal_commit(fd);
+    close(fd);
+
+    assert(disk_open(path) == fd);
+    DiskMountInfo info;
+    assert(disk_get_mount_info(fd, &info) == 0 && info.checked);
+    assert(allocator_block_allocated(fd, blocks[0]) == 0);
+    disk_close(fd);
+    cout << "多块位图分配、崩溃后挂载通过（最后分配的块 " << last << "）" << endl;
+    unlink(path);
+}
+
 // 在 test/test_filesystem.cpp 的末尾添加以下测试函数
 
 void test_directory_operations() {
@@ -331,9 +1419,9 @@ void test_directory_operations() {
     // 重新读取 root_inode 以获取最新状态
     read_inode(fd, root_inode_id, &root_inode);
     
-    // 测试重复添加条目（应失败）
+    // 测试重复添加条目（应失败，-2 = 同名条目已存在）
     result = dir_add_entry(fd, &root_inode, root_inode_id, "test.txt", file_inode_id);
-    assert(result == -1);
+    assert(result == -2);
     cout << "防止重复条目测试通过" << endl;
     
     // 测试删除条目
@@ -562,6 +1650,104 @@ void test_path_parsing() {
     disk_close(fd);
 }
 
+// dentry 缓存：正 / 负条目命中、增删后失效、并发读不加锁
+void test_dentry_cache() {
+    cout << "\n=== 测试 dentry 缓存 ===" << endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    Inode root_inode;
+    read_inode(fd, 0, &root_inode);
+    
+    // 不存在的路径会缓存为负条目
+    DcacheStats before, after;
+    dcache_get_stats(&before);
+    assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == -1);
+    assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == -1);
+    dcache_get_stats(&after);
+    assert(after.path_hits - before.path_hits == 1);
+    cout << "负条目命中" << endl;
+    
+    // 创建目录和文件后，负条目失效，能解析到新 inode
+    int dir_id = alloc_inode(fd);
+    assert(dir_id > 0);
+    Inode dir_inode;
+    init_inode(&dir_inode, INODE_TYPE_DIR);
+    write_inode(fd, dir_id, &dir_inode);
+    assert(dir_add_entry(fd, &root_inode, 0, "dcache_dir", dir_id) == 0);
+    
+    int file_id = alloc_inode(fd);
+    assert(file_id > 0);
+    Inode file_inode;
+    init_inode(&file_inode, INODE_TYPE_FILE);
+    write_inode(fd, file_id, &file_inode);
+    assert(dir_add_entry(fd, &dir_inode, dir_id, "a.txt", file_id) == 0);
+    assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == file_id);
+    cout << "增加目录项后负条目失效" << endl;
+    
+    // 逐级解析命中 (父目录, 名字) 条目，不再读目录块
+    int inode_ids[MAX_PATH_DEPTH];
+    dcache_get_stats(&before);
+    assert(parse_path(fd, "/dcache_dir/a.txt", inode_ids, MAX_PATH_DEPTH) == 3);
+    assert(inode_ids[1] == dir_id && inode_ids[2] == file_id);
+    dcache_get_stats(&after);
+    assert(after.hits - before.hits == 2);
+    
+    // 冷 / 热解析耗时对比
+    const int lookups = 10000;
+    auto start = chrono::high_resolution_clock::now();
+    for (int i = 0; i < lookups; i++) {
+        assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == file_id);
+    }
+    double warm_us = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count() / lookups;
+    dcache_invalidate(fd);
+    start = chrono::high_resolution_clock::now();
+    assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == file_id);
+    double cold_us = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count();
+    printf("路径解析：未命中 %.2f us，命中 %.3f us\n", cold_us, warm_us);
+    
+    // 删除后正条目失效
+    assert(dir_remove_entry(fd, &dir_inode, dir_id, "a.txt") == 0);
+    assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == -1);
+    cout << "删除目录项后正条目失效" << endl;
+    
+    // 并发：读线程不加锁反复解析，写线程反复增删同一个名字，
+    // 读到的只能是"不存在"或正确的 inode，写线程结束后必须能看到最终状态
+    atomic<bool> stop(false);
+    atomic<int> bad(0);
+    vector<thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&]() {
+            while (!stop.load()) {
+                int id = get_inode_by_path(fd, "/dcache_dir/a.txt");
+                if (id != -1 && id != file_id) {
+                    bad++;
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 200; i++) {
+        assert(dir_add_entry(fd, &dir_inode, dir_id, "a.txt", file_id) == 0);
+        assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == file_id);
+        assert(dir_remove_entry(fd, &dir_inode, dir_id, "a.txt") == 0);
+        assert(get_inode_by_path(fd, "/dcache_dir/a.txt") == -1);
+    }
+    stop = true;
+    for (auto& r : readers) {
+        r.join();
+    }
+    assert(bad.load() == 0);
+    cout << "并发增删与无锁读取结果一致" << endl;
+    dcache_print_stats();
+    
+    free_inode(fd, file_id);
+    read_inode(fd, 0, &root_inode);
+    assert(dir_remove_entry(fd, &root_inode, 0, "dcache_dir") == 0);
+    inode_free_blocks(fd, &dir_inode);
+    write_inode(fd, dir_id, &dir_inode);
+    free_inode(fd, dir_id);
+    disk_close(fd);
+}
+
 int main() {
     cout << "文件系统测试开始..." << endl;
     
@@ -569,9 +1755,26 @@ int main() {
         test_disk_operations();
         test_inode_allocation();
         test_block_allocation();
+        test_allocator_throughput();
         test_inode_operations();
         test_file_data_operations();
-        test_direct_and_indirect_blocks();
+        test_extent_mapping();
+        test_bmap_cache();
+        test_extent_tree();
+        test_inline_small_files();
+        test_locality_allocation();
+        test_block_devices();
+        test_sequential_read_throughput();
+        test_ref_table_overwrite();
+        test_journal_replay();
+        test_journal_group_commit();
+        test_journal_checkpoint_releases_images();
+        test_journal_structural_blocks();
+        test_journal_oversized_transaction();
+        test_clean_mount();
+        test_disk_geometry();
+        test_directory_index_scaling();
+        test_dentry_cache();
         test_directory_operations();
         test_multilevel_directory();
         test_path_parsing();           // 添加这一行
@@ -1,10 +1,22 @@
 // test/test_snapshot.cpp
+#include "../include/allocator.h"
 #include "../include/disk.h"
+#include "../include/extent.h"
 #include "../include/inode.h"
+#include "../include/path.h"
+#include "../include/reclaimer.h"
+#include "../include/snapshot_stream.h"
+#include <fcntl.h>
 #include <iostream>
 #include <cstring>
 #include <cassert>
 #include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
 using namespace std;
 
 // 在 test/test_snapshot.cpp 中修改 test_snapshot_basic 函数
@@ -234,8 +246,8 @@ void test_multiple_snapshots() {
     
     // 清理所有创建的快照
     // 注意：由于一些快照已经被删除，我们需要重新列出所有快照并删除它们
-    Snapshot snapshots[MAX_SNAPSHOTS];
-    int count = list_snapshots(fd, snapshots, MAX_SNAPSHOTS);
+    std::vector<Snapshot> snapshots(count_snapshots(fd) + 1);
+    int count = list_snapshots(fd, snapshots.data(), (int)snapshots.size());
     for (int i = 0; i < count; i++) {
         if (strncmp(snapshots[i].name, "multi_snap_", 11) == 0 || 
             strncmp(snapshots[i].name, "reuse_snap_", 11) == 0) {
@@ -262,8 +274,8 @@ void test_list_snapshots() {
     assert(snap2_id >= 0);
     
     // 列出快照
-    Snapshot snapshots[MAX_SNAPSHOTS];
-    int count = list_snapshots(fd, snapshots, MAX_SNAPSHOTS);
+    std::vector<Snapshot> snapshots(count_snapshots(fd) + 1);
+    int count = list_snapshots(fd, snapshots.data(), (int)snapshots.size());
     assert(count >= 2);
     
     cout << "找到 " << count << " 个快照" << endl;
@@ -468,7 +480,7 @@ void test_snapshot_edge_cases() {
     assert(invalid_result == -1);
     cout << "无效快照ID测试通过" << endl;
     
-    invalid_result = restore_snapshot(fd, MAX_SNAPSHOTS);
+    invalid_result = restore_snapshot(fd, 1 << 30);
     assert(invalid_result == -1);
     cout << "超出范围快照ID测试通过" << endl;
     
@@ -489,7 +501,7 @@ void test_snapshot_edge_cases() {
 // 诊断函数：打印块的引用计数
 void print_block_ref_counts(int fd, int start, int end) {
     std::cout << "\n块引用计数信息 [" << start << "-" << end << "]:" << std::endl;
-    for (int i = start; i <= end && i < BLOCK_COUNT; i++) {
+    for (int i = start; i <= end && i < disk_geometry(fd)->block_count; i++) {
         int ref_count = get_block_ref_count(fd, i);
         if (ref_count > 0) {
             std::cout << "  块 " << i << ": ref_count=" << ref_count << std::endl;
@@ -501,43 +513,30 @@ void print_block_ref_counts(int fd, int start, int end) {
 void verify_snapshot_consistency(int fd, int snapshot_id) {
     std::cout << "\n验证快照ID=" << snapshot_id << "的一致性..." << std::endl;
     
-    char buf[BLOCK_SIZE];
-    int snapshots_per_block = BLOCK_SIZE / sizeof(Snapshot);
-    int block_idx = snapshot_id / snapshots_per_block;
-    int entry_idx = snapshot_id % snapshots_per_block;
-    
-    read_block(fd, SNAPSHOT_TABLE_START + block_idx, buf);
-    Snapshot* snapshots = (Snapshot*)buf;
-    
-    if (!snapshots[entry_idx].active) {
+    Snapshot snapshot;
+    if (get_snapshot(fd, snapshot_id, &snapshot) != 0) {
         std::cout << "快照未激活" << std::endl;
         return;
     }
     
-    Snapshot snapshot = snapshots[entry_idx];
-    
-    // 验证元数据块是否存在
-    if (snapshot.inode_bitmap_block <= 0 || snapshot.block_bitmap_block <= 0) {
+    // 验证副本块号表是否存在
+    const DiskGeometry& g = *disk_geometry(fd);
+    if (snapshot.copy_blocks <= 0 || snapshot.map_blocks[0] <= 0) {
         std::cout << "错误：元数据块ID无效" << std::endl;
         return;
     }
-    
-    // 验证inode表块
-    int valid_inode_blocks = 0;
-    for (int i = 0; i < 16; i++) {
-        if (snapshot.inode_table_blocks[i] > 0) {
-            valid_inode_blocks++;
-        }
+    std::cout << "副本块数：" << snapshot.copy_blocks << std::endl;
+    
+    // 读取快照的块位图（副本第二段，紧跟 inode 位图）并统计使用的块数
+    int ids[MAX_POINTERS_PER_BLOCK];
+    read_block(fd, snapshot.map_blocks[0], ids);
+    std::vector<unsigned char> snapshot_block_bitmap((size_t)g.block_bitmap_blocks * g.block_size);
+    for (int i = 0; i < g.block_bitmap_blocks; i++) {
+        read_block(fd, ids[g.inode_bitmap_blocks + i], &snapshot_block_bitmap[(size_t)i * g.block_size]);
     }
-    std::cout << "有效的inode表块数：" << valid_inode_blocks << std::endl;
-    
-    // 读取快照的块位图并统计使用的块数
-    char snapshot_block_bitmap[BLOCK_SIZE];
-    read_block(fd, snapshot.block_bitmap_block, snapshot_block_bitmap);
     
     int used_blocks = 0;
-    int max_blocks = (BLOCK_SIZE * 8 < BLOCK_COUNT) ? BLOCK_SIZE * 8 : BLOCK_COUNT;
-    for (int i = DATA_BLOCK_START; i < max_blocks; i++) {
+    for (int i = g.data_block_start; i < g.block_count; i++) {
         int byte_index = i / 8;
         int bit_index = i % 8;
         if (snapshot_block_bitmap[byte_index] & (1 << bit_index)) {
@@ -567,8 +566,8 @@ void test_cow_detailed() {
     assert(block1 >= 0);
     std::cout << "分配块1成功，ID=" << block1 << std::endl;
     
-    char data1[BLOCK_SIZE];
-    memset(data1, 'A', BLOCK_SIZE);
+    char data1[MAX_BLOCK_SIZE];
+    memset(data1, 'A', sizeof(data1));
     write_block(fd, block1, data1);
     std::cout << "块1初始引用计数：" << get_block_ref_count(fd, block1) << std::endl;
     
@@ -590,9 +589,9 @@ void test_cow_detailed() {
     std::cout << "新块引用计数：" << get_block_ref_count(fd, block1_new) << std::endl;
     
     // 验证数据被复制
-    char read_data[BLOCK_SIZE];
+    char read_data[MAX_BLOCK_SIZE];
     read_block(fd, block1_new, read_data);
-    if (memcmp(data1, read_data, BLOCK_SIZE) == 0) {
+    if (memcmp(data1, read_data, disk_block_size(fd)) == 0) {
         std::cout << "✓ 数据成功复制到新块" << std::endl;
     } else {
         std::cout << "⚠ 新块数据不一致" << std::endl;
@@ -730,6 +729,875 @@ void test_space_efficiency() {
     std::cout << "磁盘空间效率测试完成" << std::endl;
 }
 
+// 新增：测试出生 epoch 快照（创建快照与磁盘占用量无关）
+void test_snapshot_birth_epoch() {
+    std::cout << "\n=== 测试出生 epoch 快照 ===" << std::endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    
+    // 几乎为空时创建快照的耗时
+    auto t0 = std::chrono::steady_clock::now();
+    int empty_snap = create_snapshot(fd, "epoch_empty");
+    auto t1 = std::chrono::steady_clock::now();
+    assert(empty_snap >= 0);
+    delete_snapshot(fd, empty_snap);
+    
+    // 填充大部分数据块（留一些给快照元数据和 COW）
+    Superblock sb;
+    read_superblock(fd, &sb);
+    int fill = sb.free_block_count - 200;
+    std::vector<int> blocks;
+    for (int i = 0; i < fill; i++) {
+        int b = alloc_block(fd);
+        assert(b >= 0);
+        blocks.push_back(b);
+    }
+    read_superblock(fd, &sb);
+    int free_before = sb.free_block_count;
+    // 整盘快照的副本：两张位图 + inode 表，加一个块号表块
+    const DiskGeometry& g = *disk_geometry(fd);
+    const int snapshot_copies = g.inode_bitmap_blocks + g.block_bitmap_blocks + g.inode_table_blocks + 1;
+    
+    auto t2 = std::chrono::steady_clock::now();
+    int full_snap = create_snapshot(fd, "epoch_full");
+    auto t3 = std::chrono::steady_clock::now();
+    assert(full_snap >= 0);
+    std::cout << "空盘创建快照：" << std::chrono::duration<double, std::micro>(t1 - t0).count() << " us，"
+              << "占用 " << fill << " 个块后：" << std::chrono::duration<double, std::micro>(t3 - t2).count()
+              << " us" << std::endl;
+    
+    // 创建快照只占用位图和 inode 表副本，不修改数据块的引用计数
+    read_superblock(fd, &sb);
+    assert(free_before - sb.free_block_count == snapshot_copies);
+    for (int b : blocks) {
+        assert(get_block_ref_count(fd, b) == 1);
+        assert(block_needs_cow(fd, b) == 1);
+    }
+    
+    // 快照之后分配的块不属于快照，可以就地写入、直接释放
+    int fresh = alloc_block(fd);
+    assert(fresh >= 0);
+    assert(block_needs_cow(fd, fresh) == 0);
+    assert(release_block(fd, fresh) == 1);
+    
+    // 快照之前的块：活跃引用释放后仍由快照持有
+    for (int b : blocks) {
+        assert(release_block(fd, b) == 0);
+    }
+    read_superblock(fd, &sb);
+    assert(free_before - sb.free_block_count == snapshot_copies);
+    
+    // 删除快照：只属于它的块全部回收
+    assert(delete_snapshot(fd, full_snap) == 0);
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before + fill);
+    std::cout << "删除快照后回收 " << fill << " 个块" << std::endl;
+    
+    disk_close(fd);
+    std::cout << "✓ 出生 epoch 快照测试通过" << std::endl;
+}
+
+// 新增：批量引用计数内核与逐块接口的对比（磁盘占满时）
+void test_ref_count_bulk() {
+    std::cout << "\n=== 测试批量引用计数（逐块 vs 批量）===" << std::endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    
+    Superblock sb;
+    read_superblock(fd, &sb);
+    int free_before = sb.free_block_count;
+    
+    // 占满磁盘
+    std::vector<int> blocks;
+    const int mask_words = disk_mask_words(disk_geometry(fd));
+    std::vector<uint64_t> mask(mask_words, 0);
+    for (int b = alloc_block(fd); b >= 0; b = alloc_block(fd)) {
+        blocks.push_back(b);
+        mask[b / 64] |= 1ULL << (b % 64);
+    }
+    std::cout << "占用 " << blocks.size() << " 个块" << std::endl;
+    
+    auto ms_since = [](std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+    };
+    
+    // 加一：逐块 vs 批量
+    auto t = std::chrono::steady_clock::now();
+    for (int b : blocks) {
+        assert(increment_block_ref_count(fd, b) == 0);
+    }
+    double per_block_inc = ms_since(t);
+    t = std::chrono::steady_clock::now();
+    assert(ref_count_add_mask(fd, mask.data(), 1) == 0);
+    double bulk_inc = ms_since(t);
+    for (int b : blocks) {
+        assert(get_block_ref_count(fd, b) == 3);
+    }
+    
+    // 减一：逐块 vs 批量
+    t = std::chrono::steady_clock::now();
+    for (int b : blocks) {
+        assert(decrement_block_ref_count(fd, b) == 0);
+    }
+    double per_block_dec = ms_since(t);
+    t = std::chrono::steady_clock::now();
+    assert(ref_count_add_mask(fd, mask.data(), -1) == 0);
+    double bulk_dec = ms_since(t);
+    for (int b : blocks) {
+        assert(get_block_ref_count(fd, b) == 1);
+    }
+    
+    // 饱和：0 不再减，计数保持不变
+    std::vector<uint64_t> one(mask_words, 0);
+    one[blocks[0] / 64] |= 1ULL << (blocks[0] % 64);
+    assert(ref_count_add_mask(fd, one.data(), -1) == 0);
+    assert(ref_count_add_mask(fd, one.data(), -1) == 1);
+    assert(get_block_ref_count(fd, blocks[0]) == 0);
+    std::vector<uint64_t> zero(mask_words);
+    assert(ref_count_zero_mask(fd, mask.data(), zero.data()) == 1);
+    assert(zero[blocks[0] / 64] == one[blocks[0] / 64]);
+    assert(ref_count_add_mask(fd, one.data(), 1) == 0);
+    
+    // 释放：前一半逐块，后一半批量
+    size_t half = blocks.size() / 2;
+    t = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < half; i++) {
+        free_block(fd, blocks[i]);
+        mask[blocks[i] / 64] &= ~(1ULL << (blocks[i] % 64));
+    }
+    double per_block_free = ms_since(t);
+    t = std::chrono::steady_clock::now();
+    assert(free_block_mask(fd, mask.data()) == (int)(blocks.size() - half));
+    double bulk_free = ms_since(t);
+    
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before);
+    
+    double n = (double)blocks.size();
+    std::cout << "加一：逐块 " << per_block_inc << " ms，批量 " << bulk_inc << " ms（"
+              << per_block_inc / bulk_inc << "x）" << std::endl;
+    std::cout << "减一：逐块 " << per_block_dec << " ms，批量 " << bulk_dec << " ms（"
+              << per_block_dec / bulk_dec << "x）" << std::endl;
+    std::cout << "释放：逐块 " << per_block_free * 1e6 / half << " ns/块，批量 "
+              << bulk_free * 1e6 / (n - half) << " ns/块" << std::endl;
+    
+    disk_close(fd);
+    std::cout << "✓ 批量引用计数测试通过" << std::endl;
+}
+
+// 新增：测试后台回收（删除快照立即返回，块由后台线程分批释放）
+void test_background_snapshot_delete() {
+    std::cout << "\n=== 测试后台快照回收 ===" << std::endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    
+    // 快照持有大量只属于它的块：活跃引用在快照之后全部释放
+    auto fill_snapshot_only = [&](const char* name, int count) {
+        std::vector<int> blocks;
+        for (int i = 0; i < count; i++) {
+            int b = alloc_block(fd);
+            assert(b >= 0);
+            blocks.push_back(b);
+        }
+        int snap = create_snapshot(fd, name);
+        assert(snap >= 0);
+        for (int b : blocks) {
+            assert(release_block(fd, b) == 0);
+        }
+        return snap;
+    };
+    
+    Superblock sb;
+    read_superblock(fd, &sb);
+    int free_before = sb.free_block_count;
+    int fill = free_before / 2;
+    int snap = fill_snapshot_only("reclaim_bg", fill);
+    
+    snapshot_reclaimer_start(256, 1);
+    SnapshotReclaimStatus before;
+    snapshot_reclaim_get_status(&before);
+    
+    auto t0 = std::chrono::steady_clock::now();
+    assert(delete_snapshot(fd, snap) == 0);
+    auto t1 = std::chrono::steady_clock::now();
+    
+    // 删除后立即不可见，也不能重复删除
+    std::vector<Snapshot> snapshots(count_snapshots(fd) + 1);
+    int count = list_snapshots(fd, snapshots.data(), (int)snapshots.size());
+    for (int i = 0; i < count; i++) {
+        assert(snapshots[i].id != snap);
+    }
+    assert(delete_snapshot(fd, snap) == -1);
+    snapshot_reclaim_print_status();
+    
+    snapshot_reclaim_wait(fd);
+    auto t2 = std::chrono::steady_clock::now();
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before);
+    
+    SnapshotReclaimStatus after;
+    snapshot_reclaim_get_status(&after);
+    assert(after.snapshots_reclaimed == before.snapshots_reclaimed + 1);
+    assert(after.blocks_freed - before.blocks_freed == (unsigned long)fill);
+    assert(after.pending == 0 && after.current_snapshot == -1);
+    std::cout << "delete_snapshot 返回：" << std::chrono::duration<double, std::micro>(t1 - t0).count()
+              << " us，后台回收 " << fill << " 个块：" << std::chrono::duration<double, std::milli>(t2 - t0).count()
+              << " ms（" << after.chunks - before.chunks << " 批）" << std::endl;
+    
+    // 回收被关闭打断：快照保持 DELETING，重新挂载时继续回收
+    snap = fill_snapshot_only("reclaim_resume", fill);
+    snapshot_reclaimer_start(256, 1000);
+    assert(delete_snapshot(fd, snap) == 0);
+    disk_close(fd);
+    snapshot_reclaimer_stop();
+    
+    fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before);
+    count = list_snapshots(fd, snapshots.data(), (int)snapshots.size());
+    for (int i = 0; i < count; i++) {
+        assert(snapshots[i].id != snap);
+    }
+    
+    disk_close(fd);
+    std::cout << "✓ 后台快照回收测试通过" << std::endl;
+}
+
+// 新增：测试后台回收与前台删除 / 写入文件并发
+// 删除快照后文件块不再属于快照，前台删除文件会立即释放它们并可能马上重新分配给新文件；
+// 回收线程随后扫描到这些块时不能把它们当成只属于快照的块再释放一次
+void test_background_reclaim_concurrent_writes() {
+    std::cout << "\n=== 测试后台回收与前台写入并发 ===" << std::endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    
+    const int block_size = disk_block_size(fd);
+    const int threads = 4;
+    const int files_per_thread = 64;
+    const int file_size = block_size * 2;
+    
+    auto content = [&](int inode_id, int round) {
+        std::string data(file_size, (char)('a' + (inode_id + round) % 26));
+        memcpy(&data[0], &inode_id, sizeof(inode_id));
+        return data;
+    };
+    auto make_file = [&](int round) {
+        int id = alloc_inode(fd);
+        assert(id >= 0);
+        Inode inode;
+        init_inode(&inode, INODE_TYPE_FILE);
+        std::string data = content(id, round);
+        assert(inode_write_data(fd, &inode, id, data.data(), 0, file_size) == file_size);
+        write_inode(fd, id, &inode);
+        return id;
+    };
+    auto delete_file = [&](int id) {
+        Inode inode;
+        read_inode(fd, id, &inode);
+        inode_free_blocks(fd, &inode);
+        write_inode(fd, id, &inode);
+        free_inode(fd, id);
+    };
+    
+    Superblock sb;
+    read_superblock(fd, &sb);
+    int free_before = sb.free_block_count;
+    
+    // 条件释放：只释放仍已分配且计数为 0 的块
+    const int mask_words = disk_mask_words(disk_geometry(fd));
+    int b = alloc_block(fd);
+    assert(b >= 0 && get_block_ref_count(fd, b) == 1);
+    std::vector<uint64_t> mask(mask_words), freed(mask_words);
+    mask[b / 64] |= 1ULL << (b % 64);
+    assert(allocator_free_unreferenced_mask(fd, mask.data(), mask_words, freed.data()) == 0);
+    assert(freed[b / 64] == 0 && allocator_block_allocated(fd, b) == 1);
+    assert(decrement_block_ref_count(fd, b) == 0);
+    assert(allocator_free_unreferenced_mask(fd, mask.data(), mask_words, freed.data()) == 1);
+    assert(freed[b / 64] == 1ULL << (b % 64) && allocator_block_allocated(fd, b) == 0);
+    assert(allocator_free_unreferenced_mask(fd, mask.data(), mask_words, freed.data()) == 0);
+    
+    for (int iteration = 0; iteration < 4; iteration++) {
+        // 快照之前写好的文件：删除快照后它们的块只被活跃文件系统引用
+        std::vector<std::vector<std::pair<int, int>>> files(threads);
+        for (int t = 0; t < threads; t++) {
+            for (int i = 0; i < files_per_thread; i++) {
+                files[t].push_back({make_file(0), 0});
+            }
+        }
+        std::string name = "reclaim_race_" + std::to_string(iteration);
+        int snap = create_snapshot(fd, name.c_str());
+        assert(snap >= 0);
+        
+        snapshot_reclaimer_start(64, 1);
+        assert(delete_snapshot(fd, snap) == 0);
+        
+        // 回收进行中：每个线程不断删除旧文件并写入新文件（新文件多半拿到刚释放的块），直到回收结束
+        std::atomic<bool> reclaimed(false);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                do {
+                    for (auto& file : files[t]) {
+                        delete_file(file.first);
+                        file = {make_file(file.second + 1), file.second + 1};
+                    }
+                } while (!reclaimed.load());
+            });
+        }
+        snapshot_reclaim_wait(fd);
+        reclaimed.store(true);
+        for (auto& w : workers) {
+            w.join();
+        }
+        snapshot_reclaimer_stop();
+        
+        // 每个活跃块只属于一个文件、仍已分配、计数为 1，内容没有被别的文件覆盖
+        std::vector<int> owner(disk_geometry(fd)->block_count, -1);
+        for (int t = 0; t < threads; t++) {
+            for (const auto& file : files[t]) {
+                Inode inode;
+                read_inode(fd, file.first, &inode);
+                std::vector<Extent> extents;
+                std::vector<int> nodes;
+                extent_collect(fd, &inode, &extents, &nodes);
+                for (const Extent& e : extents) {
+                    for (int b = e.start; b < e.start + e.length; b++) {
+                        assert(owner[b] == -1);
+                        owner[b] = file.first;
+                        assert(allocator_block_allocated(fd, b) == 1);
+                        assert(get_block_ref_count(fd, b) == 1);
+                    }
+                }
+                std::string data(file_size, '\0');
+                assert(inode_read_data(fd, &inode, &data[0], 0, file_size) == file_size);
+                assert(data == content(file.first, file.second));
+            }
+        }
+        
+        for (int t = 0; t < threads; t++) {
+            for (const auto& file : files[t]) {
+                delete_file(file.first);
+            }
+        }
+    }
+    
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before);
+    
+    disk_close(fd);
+    std::cout << "✓ 后台回收与前台写入并发测试通过" << std::endl;
+}
+
+// 新增：测试子树快照（只保存 / 恢复一个目录之下的文件）
+static int subtree_make_node(int fd, int parent_id, const char* name, int type, const char* data) {
+    int id = alloc_inode(fd);
+    assert(id >= 0);
+    Inode inode;
+    init_inode(&inode, type);
+    if (data != nullptr) {
+        assert(inode_write_data(fd, &inode, id, data, 0, strlen(data)) == (int)strlen(data));
+    }
+    write_inode(fd, id, &inode);
+    if (parent_id >= 0) {
+        Inode parent;
+        read_inode(fd, parent_id, &parent);
+        assert(dir_add_entry(fd, &parent, parent_id, name, id) == 0);
+    }
+    return id;
+}
+
+static std::string subtree_read_file(int fd, int inode_id) {
+    Inode inode;
+    read_inode(fd, inode_id, &inode);
+    std::string data(inode.size, '\0');
+    assert(inode_read_data(fd, &inode, &data[0], 0, inode.size) == inode.size);
+    return data;
+}
+
+static int subtree_lookup(int fd, int dir_id, const char* name) {
+    Inode dir;
+    read_inode(fd, dir_id, &dir);
+    return dir_find_entry(fd, &dir, name);
+}
+
+void test_subtree_snapshot() {
+    std::cout << "\n=== 测试子树快照 ===" << std::endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    
+    // paper/{draft, reviews/r1} 和子树之外的 outside
+    // draft 和 outside 超过内联大小，占数据块（检查数据块的 COW）；r1 内联在 inode 中
+    const std::string padding(INODE_INLINE_SIZE, '.');
+    int paper = subtree_make_node(fd, -1, "paper", INODE_TYPE_DIR, nullptr);
+    int draft = subtree_make_node(fd, paper, "draft", INODE_TYPE_FILE, ("draft v1" + padding).c_str());
+    int reviews = subtree_make_node(fd, paper, "reviews", INODE_TYPE_DIR, nullptr);
+    int r1 = subtree_make_node(fd, reviews, "r1", INODE_TYPE_FILE, "review one");
+    int outside = subtree_make_node(fd, -1, "outside", INODE_TYPE_FILE, ("outside v1" + padding).c_str());
+    Inode outside_inode;
+    read_inode(fd, outside, &outside_inode);
+    int outside_block = outside_inode.extents[0].start;
+    
+    // 子树之外再占用大量块：创建开销不随之增长
+    std::vector<int> bulk;
+    for (int i = 0; i < 4000; i++) {
+        int b = alloc_block(fd);
+        assert(b >= 0);
+        bulk.push_back(b);
+    }
+    
+    Superblock sb;
+    read_superblock(fd, &sb);
+    int free_before = sb.free_block_count;
+    
+    auto t0 = std::chrono::steady_clock::now();
+    int snap = create_subtree_snapshot(fd, paper, "paper_backup");
+    auto t1 = std::chrono::steady_clock::now();
+    assert(snap >= 0);
+    std::cout << "子树快照（4 个 inode，磁盘另占 " << bulk.size() << " 块）："
+              << std::chrono::duration<double, std::micro>(t1 - t0).count() << " us" << std::endl;
+    
+    // 只占用编号列表、钉住的块号列表、一块 inode 副本和一个块号表块（不随磁盘大小变化）；子树之外的块不受影响
+    read_superblock(fd, &sb);
+    assert(free_before - sb.free_block_count == 4);
+    assert(block_needs_cow(fd, outside_block) == 0);
+    assert(block_needs_cow(fd, bulk[0]) == 0);
+    Inode draft_inode;
+    read_inode(fd, draft, &draft_inode);
+    assert(block_needs_cow(fd, draft_inode.extents[0].start) == 1);
+    
+    std::vector<Snapshot> snapshots(count_snapshots(fd) + 1);
+    int count = list_snapshots(fd, snapshots.data(), (int)snapshots.size());
+    bool listed = false;
+    for (int i = 0; i < count; i++) {
+        if (snapshots[i].id == snap) {
+            listed = true;
+            assert(snapshots[i].scope == SNAPSHOT_SCOPE_SUBTREE);
+            assert(snapshots[i].root_inode_id == paper);
+            assert(snapshots[i].total_inodes_used == 4);
+            assert(snapshots[i].total_blocks_used > 0 && snapshots[i].total_blocks_used < 16);
+        }
+    }
+    assert(listed);
+    
+    // 修改子树：改写 draft，删除 r1，新建 notes；r1 的编号被子树之外的新文件占用
+    assert(inode_write_data(fd, &draft_inode, draft, "draft v2", 0, 8) == 8);
+    write_inode(fd, draft, &draft_inode);
+    Inode reviews_inode;
+    read_inode(fd, reviews, &reviews_inode);
+    assert(dir_remove_entry(fd, &reviews_inode, reviews, "r1") == 0);
+    Inode r1_inode;
+    read_inode(fd, r1, &r1_inode);
+    inode_free_blocks(fd, &r1_inode);
+    free_inode(fd, r1);
+    int squatter = subtree_make_node(fd, -1, "squatter", INODE_TYPE_FILE, "not in paper");
+    assert(squatter == r1);
+    subtree_make_node(fd, paper, "notes", INODE_TYPE_FILE, "notes");
+    
+    // 子树之外的修改就地写入
+    assert(inode_write_data(fd, &outside_inode, outside, "outside v2", 0, 10) == 10);
+    write_inode(fd, outside, &outside_inode);
+    assert(outside_inode.extents[0].start == outside_block);
+    
+    // 恢复：子树回到快照时的内容，子树之外保持不变
+    assert(restore_snapshot(fd, snap) == 0);
+    assert(subtree_read_file(fd, draft) == "draft v1" + padding);
+    assert(subtree_lookup(fd, paper, "notes") < 0);
+    int restored_r1 = subtree_lookup(fd, reviews, "r1");
+    assert(restored_r1 >= 0 && restored_r1 != squatter);
+    assert(subtree_read_file(fd, restored_r1) == "review one");
+    assert(subtree_read_file(fd, squatter) == "not in paper");
+    assert(subtree_read_file(fd, outside) == "outside v2" + padding);
+    
+    // 删除快照：去掉钉住的引用，只属于快照的块（draft v2 之前的旧块已随恢复重新使用）全部回收
+    assert(delete_snapshot(fd, snap) == 0);
+    read_inode(fd, draft, &draft_inode);
+    assert(block_needs_cow(fd, draft_inode.extents[0].start) == 0);
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before);  // squatter 内联，不占数据块
+    
+    // 计数已饱和的块钉不住：快照失败，已加上的引用全部撤销，副本块归还
+    read_inode(fd, draft, &draft_inode);
+    int saturated = draft_inode.extents[0].start;
+    int saved_count = get_block_ref_count(fd, saturated);
+    while (get_block_ref_count(fd, saturated) < 255) {
+        assert(increment_block_ref_count(fd, saturated) == 0);
+    }
+    Inode paper_inode;
+    read_inode(fd, paper, &paper_inode);
+    int paper_block = paper_inode.extents[0].start;
+    int paper_count = get_block_ref_count(fd, paper_block);
+    int snapshots_before = count_snapshots(fd);
+    assert(create_subtree_snapshot(fd, paper, "saturated") == -1);
+    assert(count_snapshots(fd) == snapshots_before);
+    assert(get_block_ref_count(fd, saturated) == 255);
+    assert(get_block_ref_count(fd, paper_block) == paper_count);
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before);
+    while (get_block_ref_count(fd, saturated) > saved_count) {
+        assert(decrement_block_ref_count(fd, saturated) == 0);
+    }
+    
+    // 恢复时同样：快照中的块计数会超过 255 时失败，当前子树和各块的计数都不变
+    snap = create_subtree_snapshot(fd, paper, "saturated_restore");
+    assert(snap >= 0);
+    subtree_make_node(fd, paper, "notes2", INODE_TYPE_FILE, "notes two");
+    int pinned_count = get_block_ref_count(fd, saturated);
+    while (get_block_ref_count(fd, saturated) < 255) {
+        assert(increment_block_ref_count(fd, saturated) == 0);
+    }
+    paper_count = get_block_ref_count(fd, paper_block);
+    read_superblock(fd, &sb);
+    int free_pinned = sb.free_block_count;
+    assert(restore_snapshot(fd, snap) == -1);
+    assert(get_block_ref_count(fd, saturated) == 255);
+    assert(get_block_ref_count(fd, paper_block) == paper_count);
+    assert(subtree_lookup(fd, paper, "notes2") >= 0);
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_pinned);
+    while (get_block_ref_count(fd, saturated) > pinned_count) {
+        assert(decrement_block_ref_count(fd, saturated) == 0);
+    }
+    assert(restore_snapshot(fd, snap) == 0);
+    assert(subtree_lookup(fd, paper, "notes2") < 0);
+    assert(delete_snapshot(fd, snap) == 0);
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_before);
+    
+    // 清理
+    for (int id : {draft, restored_r1, reviews, paper, squatter, outside}) {
+        Inode inode;
+        read_inode(fd, id, &inode);
+        inode_free_blocks(fd, &inode);
+        free_inode(fd, id);
+    }
+    for (int b : bulk) {
+        free_block(fd, b);
+    }
+    
+    disk_close(fd);
+    std::cout << "✓ 子树快照测试通过" << std::endl;
+}
+
+// 新增：测试只读快照视图（按快照的 inode 表解析路径并读取，不恢复快照）
+void test_snapshot_read_view() {
+    std::cout << "\n=== 测试只读快照视图 ===" << std::endl;
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    
+    int dir = subtree_make_node(fd, 0, "view_dir", INODE_TYPE_DIR, nullptr);
+    int doc = subtree_make_node(fd, dir, "doc", INODE_TYPE_FILE, "revision 1");
+    
+    int full = create_snapshot(fd, "view_full");
+    int sub = create_subtree_snapshot(fd, dir, "view_sub");
+    assert(full >= 0 && sub >= 0);
+    
+    // 修改活跃文件系统：改写 doc，新建 doc2
+    Inode inode;
+    read_inode(fd, doc, &inode);
+    const char* rev2 = "revision 2 (longer)";
+    assert(inode_write_data(fd, &inode, doc, rev2, 0, strlen(rev2)) == (int)strlen(rev2));
+    write_inode(fd, doc, &inode);
+    int doc2 = subtree_make_node(fd, dir, "doc2", INODE_TYPE_FILE, "new");
+    
+    Superblock before;
+    read_superblock(fd, &before);
+    
+    // 整盘快照从根目录解析，子树快照相对于快照的根目录
+    char buf[64];
+    int n = snapshot_read_file(fd, full, "/view_dir/doc", buf, 0, sizeof(buf));
+    assert(n == 10 && memcmp(buf, "revision 1", 10) == 0);
+    n = snapshot_read_file(fd, sub, "/doc", buf, 0, sizeof(buf));
+    assert(n == 10 && memcmp(buf, "revision 1", 10) == 0);
+    n = snapshot_read_file(fd, full, "view_dir/doc", buf, 9, sizeof(buf));
+    assert(n == 1 && buf[0] == '1');
+    assert(snapshot_read_file(fd, full, "/view_dir/doc", buf, 10, sizeof(buf)) == 0);
+    
+    Inode view;
+    assert(snapshot_stat(fd, full, "/view_dir", &view) == dir && view.type == INODE_TYPE_DIR);
+    assert(snapshot_stat(fd, sub, "/", &view) == dir);
+    assert(snapshot_stat(fd, full, "/view_dir/doc2", &view) == -1);
+    assert(snapshot_stat(fd, sub, "/doc2", &view) == -1);
+    assert(snapshot_read_file(fd, full, "/view_dir", buf, 0, sizeof(buf)) == -1);
+    assert(subtree_read_file(fd, doc) == rev2);
+    
+    // 读取快照不分配、不释放任何块
+    Superblock after;
+    read_superblock(fd, &after);
+    assert(after.free_block_count == before.free_block_count);
+    
+    // 删除后的快照不可读
+    assert(delete_snapshot(fd, sub) == 0);
+    assert(snapshot_stat(fd, sub, "/doc", &view) == -1);
+    assert(delete_snapshot(fd, full) == 0);
+    
+    Inode root;
+    read_inode(fd, 0, &root);
+    assert(dir_remove_entry(fd, &root, 0, "view_dir") == 0);
+    for (int id : {doc, doc2, dir}) {
+        read_inode(fd, id, &inode);
+        inode_free_blocks(fd, &inode);
+        free_inode(fd, id);
+    }
+    
+    disk_close(fd);
+    std::cout << "✓ 只读快照视图测试通过" << std::endl;
+}
+
+// 新增：测试快照流（完整 / 增量发送，接收到另一个磁盘镜像）
+static int stream_send_to_file(int fd, int from_id, int to_id, const char* path, SnapshotStreamStats* stats) {
+    int out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(out_fd >= 0);
+    int result = snapshot_send(fd, from_id, to_id, out_fd, stats);
+    close(out_fd);
+    return result;
+}
+
+static int stream_receive_from_file(int fd, const char* path, SnapshotStreamStats* stats) {
+    int in_fd = open(path, O_RDONLY);
+    assert(in_fd >= 0);
+    int result = snapshot_receive(fd, in_fd, stats);
+    close(in_fd);
+    return result;
+}
+
+// 通过管道接收（不能回到起点重读的输入）
+static int stream_receive_from_pipe(int fd, const char* path, SnapshotStreamStats* stats) {
+    int in_fd = open(path, O_RDONLY);
+    assert(in_fd >= 0);
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0);
+    std::thread writer([&]() {
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(in_fd, buf, sizeof(buf))) > 0) {
+            assert(write(pipe_fds[1], buf, n) == n);
+        }
+        close(pipe_fds[1]);
+    });
+    int result = snapshot_receive(fd, pipe_fds[0], stats);
+    writer.join();
+    close(pipe_fds[0]);
+    close(in_fd);
+    return result;
+}
+
+void test_snapshot_send_receive() {
+    std::cout << "\n=== 测试快照流发送 / 接收 ===" << std::endl;
+    
+    const char* full_stream = "../disk/stream_full.bin";
+    const char* incr_stream = "../disk/stream_incr.bin";
+    const char* replica_path = "../disk/replica.img";
+    const char* tampered_path = "../disk/replica_tampered.img";
+    unlink(replica_path);
+    unlink(tampered_path);
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    
+    // 源：stream_dir/{doc, old, big}，big 占 14 个块
+    int dir = subtree_make_node(fd, 0, "stream_dir", INODE_TYPE_DIR, nullptr);
+    int doc = subtree_make_node(fd, dir, "doc", INODE_TYPE_FILE, "version 1");
+    int old = subtree_make_node(fd, dir, "old", INODE_TYPE_FILE, "to be removed");
+    std::string big_data(disk_block_size(fd) * 14, 'b');
+    int big = subtree_make_node(fd, dir, "big", INODE_TYPE_FILE, big_data.c_str());
+    
+    int base = create_snapshot(fd, "stream_base");
+    assert(base >= 0);
+    
+    // 子树快照和不存在的快照不能发送
+    SnapshotStreamStats stats;
+    int sub = create_subtree_snapshot(fd, dir, "stream_sub");
+    assert(sub >= 0);
+    assert(snapshot_diff(fd, -1, sub, &stats) == -1);
+    assert(delete_snapshot(fd, sub) == 0);
+    assert(snapshot_diff(fd, base, base, &stats) == -1);
+    
+    SnapshotStreamStats full_stats;
+    assert(stream_send_to_file(fd, -1, base, full_stream, &full_stats) == 0);
+    assert(full_stats.incremental == 0 && full_stats.blocks_sent == full_stats.blocks_referenced);
+    
+    // 修改：改写 doc，新建 doc2，删除 old（先新建，old 的编号不会被 doc2 复用）；big 不变
+    Inode inode;
+    read_inode(fd, doc, &inode);
+    assert(inode_write_data(fd, &inode, doc, "version 2", 0, 9) == 9);
+    write_inode(fd, doc, &inode);
+    int doc2 = subtree_make_node(fd, dir, "doc2", INODE_TYPE_FILE, "second doc");
+    Inode dir_inode;
+    read_inode(fd, dir, &dir_inode);
+    assert(dir_remove_entry(fd, &dir_inode, dir, "old") == 0);
+    read_inode(fd, old, &inode);
+    inode_free_blocks(fd, &inode);
+    free_inode(fd, old);
+    
+    int next = create_snapshot(fd, "stream_next");
+    assert(next >= 0);
+    
+    // 增量流只包含变化：doc 的新块、doc2 的块和 stream_dir 的目录块
+    SnapshotStreamStats diff_stats;
+    assert(snapshot_diff(fd, base, next, &diff_stats) == 0);
+    SnapshotStreamStats incr_stats;
+    assert(stream_send_to_file(fd, base, next, incr_stream, &incr_stats) == 0);
+    assert(incr_stats.incremental == 1);
+    assert(incr_stats.stream_bytes == diff_stats.stream_bytes);
+    assert(incr_stats.inodes_removed >= 1);
+    assert(incr_stats.blocks_sent <= 4);
+    assert(incr_stats.stream_bytes < full_stats.stream_bytes / 4);
+    assert(incr_stats.stream_bytes < (long long)disk_block_size(fd) * disk_geometry(fd)->block_count / 100);
+    std::cout << "完整流 " << full_stats.stream_bytes << " 字节，增量流 " << incr_stats.stream_bytes
+              << " 字节（" << incr_stats.blocks_sent << "/" << incr_stats.blocks_referenced << " 块）" << std::endl;
+    
+    // 副本：先接收完整流，再接收增量流
+    int replica = disk_open(replica_path);
+    assert(replica >= 0);
+    assert(stream_receive_from_file(replica, incr_stream, &stats) == -1);  // 基准不匹配
+    assert(stream_receive_from_file(replica, full_stream, &stats) == 0);
+    int r_doc = get_inode_by_path(replica, "/stream_dir/doc");
+    assert(r_doc == doc && subtree_read_file(replica, r_doc) == "version 1");
+    assert(subtree_read_file(replica, big) == big_data);
+    
+    // 接收之后被修改过的副本拒绝增量流（新文件的块可能正是流要写入的块），副本保持不变
+    int tampered = disk_open(tampered_path);
+    assert(tampered >= 0);
+    assert(stream_receive_from_file(tampered, full_stream, &stats) == 0);
+    int local = subtree_make_node(tampered, 0, "local", INODE_TYPE_FILE, big_data.c_str());
+    assert(stream_receive_from_file(tampered, incr_stream, &stats) == -1);
+    assert(subtree_read_file(tampered, local) == big_data);
+    assert(subtree_read_file(tampered, doc) == "version 1");
+    disk_close(tampered);
+    
+    // 重新挂载不算修改；增量流从管道接收（先转存再应用）
+    disk_close(replica);
+    replica = disk_open(replica_path);
+    assert(replica >= 0);
+    assert(stream_receive_from_pipe(replica, incr_stream, &stats) == 0);
+    assert(stats.stream_bytes == incr_stats.stream_bytes);
+    assert(subtree_read_file(replica, doc) == "version 2");
+    assert(subtree_read_file(replica, doc2) == "second doc");
+    assert(subtree_read_file(replica, big) == big_data);
+    assert(subtree_lookup(replica, dir, "old") < 0);
+    assert(stream_receive_from_file(replica, incr_stream, &stats) == -1);  // 已经接收过
+    
+    // 损坏的流被拒绝
+    {
+        int f = open(incr_stream, O_RDWR);
+        char byte;
+        assert(pread(f, &byte, 1, 100) == 1);
+        byte ^= 0x5a;
+        assert(pwrite(f, &byte, 1, 100) == 1);
+        close(f);
+    }
+    assert(stream_receive_from_file(replica, incr_stream, &stats) == -1);
+    
+    // 重新挂载后内容和空闲计数保持一致
+    Superblock sb;
+    read_superblock(replica, &sb);
+    int free_blocks = sb.free_block_count;
+    disk_close(replica);
+    replica = disk_open(replica_path);
+    assert(replica >= 0);
+    read_superblock(replica, &sb);
+    assert(sb.free_block_count == free_blocks);
+    assert(sb.received_epoch != 0);
+    assert(subtree_read_file(replica, doc) == "version 2");
+    disk_close(replica);
+    
+    // 清理
+    assert(delete_snapshot(fd, next) == 0);
+    assert(delete_snapshot(fd, base) == 0);
+    Inode root;
+    read_inode(fd, 0, &root);
+    assert(dir_remove_entry(fd, &root, 0, "stream_dir") == 0);
+    for (int id : {doc, doc2, big, dir}) {
+        read_inode(fd, id, &inode);
+        inode_free_blocks(fd, &inode);
+        free_inode(fd, id);
+    }
+    disk_close(fd);
+    unlink(full_stream);
+    unlink(incr_stream);
+    unlink(replica_path);
+    unlink(tampered_path);
+    std::cout << "✓ 快照流发送 / 接收测试通过" << std::endl;
+}
+
+// 新增：测试可扩展的快照目录（超过原来固定快照表的容量，按名称查找，槽位复用）
+void test_snapshot_catalog() {
+    std::cout << "\n=== 测试快照目录 ===" << std::endl;
+    
+    const int old_capacity = SNAPSHOT_TABLE_BLOCKS * (DEFAULT_BLOCK_SIZE / (int)sizeof(Snapshot));  // 原来固定快照表的槽位数
+    const int hourly = old_capacity * 3;
+    
+    int fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    int existing = count_snapshots(fd);
+    
+    std::vector<int> ids;
+    for (int i = 0; i < hourly; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "hourly_%03d", i);
+        int id = create_snapshot(fd, name);
+        assert(id >= 0);
+        ids.push_back(id);
+    }
+    assert(count_snapshots(fd) == existing + hourly);
+    assert(*std::max_element(ids.begin(), ids.end()) >= old_capacity);
+    
+    // 按名称查找
+    for (int i = 0; i < hourly; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "hourly_%03d", i);
+        assert(find_snapshot(fd, name) == ids[i]);
+    }
+    assert(find_snapshot(fd, "hourly_missing") == -1);
+    Snapshot snapshot;
+    assert(get_snapshot(fd, ids[hourly - 1], &snapshot) == 0);
+    assert(snapshot.id == ids[hourly - 1]);
+    
+    // 删除前一半（保留策略），新快照复用编号最小的空闲槽位，目录不再扩展
+    Superblock sb;
+    for (int i = 0; i < hourly / 2; i++) {
+        assert(delete_snapshot(fd, ids[i]) == 0);
+    }
+    char first_name[32];
+    snprintf(first_name, sizeof(first_name), "hourly_%03d", 0);
+    assert(find_snapshot(fd, first_name) == -1);
+    assert(get_snapshot(fd, ids[0], &snapshot) == -1);
+    read_superblock(fd, &sb);
+    int free_after_delete = sb.free_block_count;
+    
+    int reused = create_snapshot(fd, "hourly_reused");
+    assert(reused == *std::min_element(ids.begin(), ids.begin() + hourly / 2));
+    assert(delete_snapshot(fd, reused) == 0);
+    read_superblock(fd, &sb);
+    assert(sb.free_block_count == free_after_delete);
+    
+    // 重新挂载后名称索引按磁盘上的目录重建，按名称恢复
+    disk_close(fd);
+    fd = disk_open("../disk/disk.img");
+    assert(fd >= 0);
+    assert(count_snapshots(fd) == existing + hourly - hourly / 2);
+    assert(find_snapshot(fd, first_name) == -1);
+    char last_name[32];
+    snprintf(last_name, sizeof(last_name), "hourly_%03d", hourly - 1);
+    assert(find_snapshot(fd, last_name) == ids[hourly - 1]);
+    assert(restore_snapshot(fd, find_snapshot(fd, last_name)) == 0);
+    
+    // 清理
+    for (int i = hourly / 2; i < hourly; i++) {
+        assert(delete_snapshot(fd, ids[i]) == 0);
+    }
+    assert(count_snapshots(fd) == existing);
+    disk_close(fd);
+    std::cout << "✓ 快照目录测试通过（" << hourly << " 个快照）" << std::endl;
+}
+
 // 修改 test/test_snapshot.cpp 中的 main 函数
 int main() {
     std::cout << "快照功能测试开始..." << std::endl;
@@ -748,6 +1616,14 @@ int main() {
         test_cow_detailed();           // 详细COW测试
         test_snapshot_isolation();     // 多快照隔离测试
         test_space_efficiency();       // 空间效率测试
+        test_snapshot_birth_epoch();   // 出生 epoch 快照测试
+        test_ref_count_bulk();         // 批量引用计数对比
+        test_background_snapshot_delete();  // 后台快照回收
+        test_background_reclaim_concurrent_writes();  // 后台回收与前台写入并发
+        test_subtree_snapshot();       // 子树快照
+        test_snapshot_read_view();     // 只读快照视图
+        test_snapshot_send_receive();  // 快照流发送 / 接收
+        test_snapshot_catalog();       // 可扩展的快照目录
         
         std::cout << "\n=== 所有快照测试通过! ===" << std::endl;
     } catch (const std::exception& e) {
@@ -35,4 +35,8 @@ public:
     // 【FileSystem API 调用点 9】提交审核请求
     virtual std::string submitForReview(const std::string& operation, const std::string& path, 
                                        const std::string& user, std::string& errorMsg) = 0;
+
+    // 【FileSystem API 调用点 10】从快照中读取文件（只读，不恢复快照）
+    virtual bool readFileAt(const std::string& snapshotName, const std::string& path, std::string& content,
+                            std::string& errorMsg) = 0;
 };
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "FSProtocol.h"
 #include <string>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 
 // 前向声明，避免包含整个 filesystem 头文件
@@ -12,7 +13,20 @@ struct Inode;
  * RealFileSystemAdapter - 真实文件系统适配器
  * 
  * 将 FSProtocol 接口适配到实际的 filesystem 模块的 C API
- * 使用全局互斥锁保证多线程环境下的原子性
+ *
+ * 锁层次（只能按从上到下的顺序获取，持有下层锁时不再获取上层锁）：
+ * 1. 快照屏障 m_snapshotBarrier：创建 / 恢复快照独占，其余操作共享
+ *    修改文件系统的操作拿到屏障后开始一个日志事务（JournalTransaction），释放目录结构锁和文件锁之后才提交，
+ *    并发的提交合并成一次日志写入（见 journal.h）
+ * 2. 目录结构锁 m_namespaceLock：增删目录项（建目录、建文件、删文件）独占，路径解析共享；
+ *    只在解析和修改目录项期间持有，拿到文件 inode 锁后即释放
+ * 3. 文件 inode 锁 m_inodeLocks（按 inode 编号分条带）：读文件共享，写 / 删文件独占；
+ *    同一时刻最多持有一把
+ * 4. filesystem 模块内部的锁：快照表锁（创建 / 恢复快照时在屏障之内获取，后台回收线程也会短暂持有）、
+ *    分配器、引用计数表块、inode 表块、块缓存分片（后面这些都是叶子锁）
+ * 访问统计用单独的 m_statsMutex，不与以上任何锁嵌套。
+ *
+ * 因此并发读可以完全并行，写不同文件只在创建目录项时短暂串行。
  */
 class RealFileSystemAdapter : public FSProtocol {
 public:
@@ -42,30 +56,54 @@ public:
     std::string getFilePermission(const std::string& path, const std::string& user, std::string& errorMsg) override;
     std::string submitForReview(const std::string& operation, const std::string& path, 
                                 const std::string& user, std::string& errorMsg) override;
+    bool readFileAt(const std::string& snapshotName, const std::string& path, std::string& content,
+                    std::string& errorMsg) override;
 
     // 新增：获取论文访问统计
     size_t getPaperAccessCount(const std::string& paperId) const;
     
     // 新增：获取 block cache 统计
-    void getBlockCacheStats(size_t& hits, size_t& misses, size_t& size, size_t& capacity) const;
+    // 块缓存是 filesystem 模块的全局实例，外层包了 CachingFSProtocol 时也可以直接查询
+    static void getBlockCacheStats(size_t& hits, size_t& misses, size_t& size, size_t& capacity);
+    
+    // 按元数据块 / 数据块分类的 block cache 命中统计
+    static void getBlockCacheClassStats(size_t& metaHits, size_t& metaMisses,
+                                        size_t& dataHits, size_t& dataMisses);
 
 private:
+    // 文件 inode 锁的条带数
+    static const size_t INODE_LOCK_STRIPES = 64;
+    
     int m_fd;                    // 磁盘文件描述符
-    mutable std::mutex m_mutex;  // 全局互斥锁，保护所有 filesystem 操作
+    mutable std::shared_mutex m_snapshotBarrier;                   // 快照屏障
+    mutable std::shared_mutex m_namespaceLock;                     // 目录结构锁
+    mutable std::shared_mutex m_inodeLocks[INODE_LOCK_STRIPES];    // 文件 inode 锁
     
-    // 论文访问统计（paperId -> 访问次数）
+    // 论文访问统计（paperId -> 访问次数），由 m_statsMutex 保护
+    mutable std::mutex m_statsMutex;
     mutable std::unordered_map<std::string, size_t> m_paperAccessCounts;
     
+    // inode 编号对应的锁条带
+    std::shared_mutex& inodeLock(int inodeId) const {
+        return m_inodeLocks[static_cast<size_t>(inodeId) % INODE_LOCK_STRIPES];
+    }
+    
+    // 记录一次论文访问（路径形如 /papers/<paperId>/...）
+    void countPaperAccess(const std::string& normPath);
+    
     // 辅助函数：路径解析
     int pathToInodeId(const std::string& path, std::string& errorMsg);
     
+    // 辅助函数：按名称查找激活的快照 ID（-1 = 不存在）
+    int findSnapshotId(const std::string& snapshotName, std::string& errorMsg);
+    
     // 辅助函数：获取父目录 inode ID 和文件名
     bool getParentAndName(const std::string& path, int& parentInodeId, std::string& name, std::string& errorMsg);
     
     // 辅助函数：递归创建目录
     bool ensureDirectoryExists(const std::string& path, std::string& errorMsg);
     
-    // 内部函数（不加锁，调用者已持有锁）
+    // 内部函数（不加锁，调用者已持有快照屏障共享锁和目录结构独占锁）
     bool ensureDirectoryExistsInternal(const std::string& path, std::string& errorMsg);
     bool createDirectoryInternal(const std::string& path, std::string& errorMsg);
     
@@ -97,7 +97,7 @@ bool CLIProtocol::processCommand(const std::string& command, std::string& respon
         const UserRole role = m_auth->getUserRole(sessionId);
         std::ostringstream oss;
         oss << "OK: ROLE=" << roleToString(role) << "\n";
-        oss << "Common: READ WRITE MKDIR STATUS PAPER_DOWNLOAD\n";
+        oss << "Common: READ READ_AT WRITE MKDIR STATUS PAPER_DOWNLOAD\n";
         if (role == UserRole::AUTHOR) oss << "Author: PAPER_UPLOAD PAPER_REVISE REVIEWS_DOWNLOAD\n";
         if (role == UserRole::REVIEWER) oss << "Reviewer: REVIEW_SUBMIT\n";
         if (role == UserRole::EDITOR) oss << "Editor: ASSIGN_REVIEWER DECIDE REVIEWS_DOWNLOAD\n";
@@ -139,19 +139,27 @@ bool CLIProtocol::processCommand(const std::string& command, std::string& respon
             }
         }
 
-        // 总是返回 block cache 统计
-        if (auto* realFS = dynamic_cast<RealFileSystemAdapter*>(m_fs)) {
-            size_t hits, misses, size, capacity;
-            realFS->getBlockCacheStats(hits, misses, size, capacity);
-            size_t total = hits + misses;
-            double hitRate = (total > 0) ? (100.0 * hits / total) : 0.0;
+        // 总是返回 block cache 统计（块缓存是全局的，不依赖 m_fs 的具体类型）
+        size_t hits, misses, size, capacity;
+        RealFileSystemAdapter::getBlockCacheStats(hits, misses, size, capacity);
+        if (capacity > 0) {
+            size_t metaHits, metaMisses, dataHits, dataMisses;
+            RealFileSystemAdapter::getBlockCacheClassStats(metaHits, metaMisses, dataHits, dataMisses);
+            auto rate = [](size_t h, size_t m) {
+                return (h + m > 0) ? (100.0 * h / (h + m)) : 0.0;
+            };
             
             oss << " block_cache_hits=" << hits
                 << " block_cache_misses=" << misses
-                << " block_cache_hit_rate=" << std::fixed << std::setprecision(2) << hitRate << "%"
+                << " block_cache_hit_rate=" << std::fixed << std::setprecision(2) << rate(hits, misses) << "%"
+                << " block_cache_meta_hit_rate=" << rate(metaHits, metaMisses) << "%"
+                << " block_cache_data_hit_rate=" << rate(dataHits, dataMisses) << "%"
                 << " block_cache_size=" << size
                 << " block_cache_capacity=" << capacity;
-        } else if (m_cacheStatsProvider) {
+        }
+        
+        // 外层文件级缓存统计（CachingFSProtocol）
+        if (m_cacheStatsProvider) {
             // 回退到旧的文件级缓存统计
             const CacheStats s = m_cacheStatsProvider->cacheStats();
             oss << " file_cache_hits=" << s.hits
@@ -210,6 +218,31 @@ bool CLIProtocol::processCommand(const std::string& command, std::string& respon
         } else {
             response = "ERROR: " + errorMsg;
         }
+    } else if (cmd == "READ_AT") {
+        std::string sessionId, snapshotName, path, content;
+        ss >> sessionId >> snapshotName >> path;
+        if (sessionId.empty() || snapshotName.empty() || path.empty()) {
+            response = "ERROR: Usage: READ_AT <sessionToken> <snapshot> <path>";
+            return false;
+        }
+
+        std::string username;
+        if (!m_auth->validateSession(sessionId, username, errorMsg)) {
+            response = "ERROR: Not authenticated: " + errorMsg;
+            return false;
+        }
+        const UserRole role = m_auth->getUserRole(sessionId);
+        if (!m_perm->hasPermission(role, Permission::READ_FILE)) {
+            response = "ERROR: Permission denied.";
+            return false;
+        }
+
+        // 直接读快照中的版本，不恢复快照
+        if (m_fs->readFileAt(snapshotName, path, content, errorMsg)) {
+            response = "OK: " + content;
+        } else {
+            response = "ERROR: " + errorMsg;
+        }
     } else if (cmd == "WRITE") {
         std::string sessionId, path, content;
         ss >> sessionId >> path;
@@ -262,16 +295,20 @@ bool CLIProtocol::processCommand(const std::string& command, std::string& respon
             response = "ERROR: " + errorMsg;
         }
     } else if (cmd == "BACKUP" || cmd == "BACKUP_CREATE") {
-        std::string sessionId, name;
-        ss >> sessionId >> name;
+        std::string sessionId, name, path;
+        ss >> sessionId >> name >> path;
         if (sessionId.empty()) {
-            response = "ERROR: Usage: BACKUP_CREATE <sessionToken> [name]";
+            response = "ERROR: Usage: BACKUP_CREATE <sessionToken> [name] [path]";
             return false;
         }
         // name 为空时由 flow 生成默认名称
-        // 快照是全局的，不需要路径参数
-        if (m_backupFlow->createBackup(sessionId, "/", name, errorMsg)) {
-            response = "OK: Backup created. (快照包含整个文件系统，不包括用户账户)";
+        // path 为空或 "/" 时是整盘快照；指定目录（例如 /papers/<id>）时只备份这棵子树
+        if (path.empty()) {
+            path = "/";
+        }
+        if (m_backupFlow->createBackup(sessionId, path, name, errorMsg)) {
+            response = path == "/" ? "OK: Backup created. (快照包含整个文件系统，不包括用户账户)"
+                                   : "OK: Backup created. (快照只包含 " + path + " 子树)";
         } else {
             response = "ERROR: " + errorMsg;
         }
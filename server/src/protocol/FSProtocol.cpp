@@ -167,6 +167,25 @@ public:
         return reviewId;
     }
 
+    bool readFileAt(const std::string& snapshotName, const std::string& path, std::string& content,
+                    std::string& errorMsg) override {
+        const std::string normPath = normalizePath(path);
+        std::scoped_lock lock(m_mutex);
+
+        auto snap = m_snapshots.find(snapshotName);
+        if (snap == m_snapshots.end()) {
+            errorMsg = "Snapshot not found.";
+            return false;
+        }
+        auto it = snap->second.find(normPath);
+        if (it == snap->second.end()) {
+            errorMsg = "File not found in snapshot.";
+            return false;
+        }
+        content = it->second;
+        return true;
+    }
+
 private:
     struct ReviewRequest {
         std::string operation;
@@ -263,6 +282,12 @@ public:
         return m_inner->submitForReview(operation, path, user, errorMsg);
     }
 
+    bool readFileAt(const std::string& snapshotName, const std::string& path, std::string& content,
+                    std::string& errorMsg) override {
+        // 快照内容不进缓存：缓存键是活跃文件系统的路径
+        return m_inner->readFileAt(snapshotName, path, content, errorMsg);
+    }
+
 private:
     std::unique_ptr<FSProtocol> m_inner;
     LRUCache<std::string, std::string> m_cache;  // 线程安全的LRU缓存
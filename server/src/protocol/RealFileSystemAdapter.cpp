@@ -11,31 +11,55 @@
 #include "inode.h"
 #include "path.h"
 #include "block_cache.h"
+#include "journal.h"
+#include "reclaimer.h"
 
 // ==================== 构造和析构 ====================
 
+// 块缓存容量：1024 块 = 1MB，约为磁盘镜像的 1/8
+static const unsigned long BLOCK_CACHE_CAPACITY = 1024;
+
+// 写回参数：脏块最多驻留 1 秒，脏块超过容量 20% 时提前写回
+static const unsigned int BLOCK_CACHE_MAX_DIRTY_AGE_MS = 1000;
+static const unsigned int BLOCK_CACHE_DIRTY_RATIO = 20;
+
 RealFileSystemAdapter::RealFileSystemAdapter(const std::string& diskPath) {
+    // filesystem 的所有块 I/O（位图、superblock、引用计数表、inode、目录、数据块）
+    // 都经过同一个块缓存，先初始化缓存，挂载时读取的元数据也会被缓存
+    // 用 S3-FIFO：快照 / 恢复对引用计数表和数据块的一次性扫描不会冲掉热的 inode 表和目录块
+    block_cache_init_ex(BLOCK_CACHE_CAPACITY, BLOCK_CACHE_POLICY_S3FIFO);
+    block_cache_set_write_back(1, BLOCK_CACHE_MAX_DIRTY_AGE_MS, BLOCK_CACHE_DIRTY_RATIO);
+    
+    // 删除快照的块回收交给后台线程，在前台 I/O 的间隙分批进行
+    // 先于 disk_open 启动：挂载时发现的未回收完的快照也在后台继续
+    snapshot_reclaimer_start(0, 0);
+    
     m_fd = disk_open(diskPath.c_str());
     if (m_fd < 0) {
+        snapshot_reclaimer_stop();
+        block_cache_destroy();
         std::cerr << "❌ Failed to open disk image: " << diskPath << std::endl;
         throw std::runtime_error("Failed to open disk image: " + diskPath);
     }
     
-    // 禁用块缓存以确保多线程环境下的数据一致性
-    // 底层文件系统代码直接使用 read_block/write_block，绕过缓存
-    // 在多线程环境下，缓存和磁盘数据可能不一致
-    block_cache_init(0);  // 容量为 0 表示禁用缓存
-    
-    std::cout << "✅ Filesystem adapter initialized with disk: " << diskPath << std::endl;
+    // 启动日志：挂载耗时，以及是否因为上次没有正常关闭而重放日志 / 做了一致性检查
+    DiskMountInfo mount{};
+    disk_get_mount_info(m_fd, &mount);
+    std::string mountState = mount.formatted ? "formatted" : (mount.checked ? "consistency check" : "clean");
+    if (mount.replayed > 0) {
+        mountState += ", replayed " + std::to_string(mount.replayed) + " journal transactions";
+    }
+    std::cout << "✅ Filesystem adapter initialized with disk: " << diskPath
+              << " (mount " << mount.mount_ns / 1000 << " us, " << mountState << ")" << std::endl;
 }
 
 RealFileSystemAdapter::~RealFileSystemAdapter() {
     if (m_fd >= 0) {
-        // 刷新并销毁块缓存
-        block_cache_flush(m_fd);
-        block_cache_destroy();
-        
+        // disk_close 会写回分配器状态和该磁盘的脏块，之后再销毁块缓存
+        block_cache_sync(m_fd);
         disk_close(m_fd);
+        snapshot_reclaimer_stop();
+        block_cache_destroy();
         std::cout << "✅ Filesystem adapter closed" << std::endl;
     }
 }
@@ -62,6 +86,15 @@ std::string RealFileSystemAdapter::normalizePath(const std::string& path) {
     return normalized;
 }
 
+int RealFileSystemAdapter::findSnapshotId(const std::string& snapshotName, std::string& errorMsg) {
+    // 快照目录在内存中维护名称索引，按名称查找不再遍历快照表
+    int snapshotId = find_snapshot(m_fd, snapshotName.c_str());
+    if (snapshotId < 0) {
+        errorMsg = "Snapshot not found: " + snapshotName;
+    }
+    return snapshotId;
+}
+
 int RealFileSystemAdapter::pathToInodeId(const std::string& path, std::string& errorMsg) {
     std::string normPath = normalizePath(path);
     
@@ -99,47 +132,40 @@ bool RealFileSystemAdapter::getParentAndName(const std::string& path, int& paren
 }
 
 bool RealFileSystemAdapter::ensureDirectoryExists(const std::string& path, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_lock<std::shared_mutex> barrier(m_snapshotBarrier);
+    JournalTransaction txn(m_fd);
+    std::unique_lock<std::shared_mutex> ns(m_namespaceLock);
     return ensureDirectoryExistsInternal(path, errorMsg);
 }
 
-// 内部函数，不加锁（调用者已持有锁）
+// 内部函数，不加锁（调用者已持有目录结构独占锁）
 bool RealFileSystemAdapter::ensureDirectoryExistsInternal(const std::string& path, std::string& errorMsg) {
     std::string normPath = normalizePath(path);
     
-    std::cout << "[ensureDir] Ensuring " << normPath << " exists" << std::endl;
-    
     // 根目录总是存在
     if (normPath == "/") {
-        std::cout << "[ensureDir] Root directory, returning true" << std::endl;
         return true;
     }
     
     // 检查目录是否已存在
     int inodeId = get_inode_by_path(m_fd, normPath.c_str());
-    std::cout << "[ensureDir] get_inode_by_path returned: " << inodeId << std::endl;
     if (inodeId >= 0) {
         // 目录已存在，检查是否真的是目录
         Inode inode;
         if (read_inode(m_fd, inodeId, &inode) < 0) {
             errorMsg = "Failed to read inode for: " + normPath;
-            std::cout << "[ensureDir] ❌ Failed to read inode" << std::endl;
             return false;
         }
         
         if (inode.type != INODE_TYPE_DIR) {
             errorMsg = "Path exists but is not a directory: " + normPath;
-            std::cout << "[ensureDir] ❌ Path exists but not a directory" << std::endl;
             return false;
         }
         
-        std::cout << "[ensureDir] ✓ Directory already exists" << std::endl;
         return true;  // 目录已存在
     }
     
-    // 目录不存在，需要创建
-    std::cout << "[ensureDir] Directory does not exist, need to create" << std::endl;
-    // 首先确保父目录存在
+    // 目录不存在，需要创建：首先确保父目录存在
     size_t lastSlash = normPath.find_last_of('/');
     if (lastSlash == std::string::npos) {
         errorMsg = "Invalid path: " + normPath;
@@ -147,67 +173,73 @@ bool RealFileSystemAdapter::ensureDirectoryExistsInternal(const std::string& pat
     }
     
     std::string parentPath = (lastSlash == 0) ? "/" : normPath.substr(0, lastSlash);
-    std::cout << "[ensureDir] Recursively ensuring parent: " << parentPath << std::endl;
     if (!ensureDirectoryExistsInternal(parentPath, errorMsg)) {
-        std::cout << "[ensureDir] ❌ Failed to ensure parent: " << errorMsg << std::endl;
         return false;
     }
     
     // 创建当前目录（使用内部函数，避免重复加锁）
-    std::cout << "[ensureDir] Creating directory: " << normPath << std::endl;
     return createDirectoryInternal(normPath, errorMsg);
 }
 
+void RealFileSystemAdapter::countPaperAccess(const std::string& normPath) {
+    if (normPath.find("/papers/") != 0) {
+        return;
+    }
+    size_t start = 8;  // "/papers/" 的长度
+    size_t end = normPath.find('/', start);
+    if (end == std::string::npos) {
+        return;
+    }
+    std::string paperId = normPath.substr(start, end - start);
+    if (!paperId.empty()) {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_paperAccessCounts[paperId]++;
+    }
+}
+
 // ==================== FSProtocol 接口实现 ====================
 
 bool RealFileSystemAdapter::createSnapshot(const std::string& path, const std::string& snapshotName, 
                                            std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    
-    (void)path;  // 当前 filesystem 的快照是全局的，不支持路径级快照
+    // 快照要看到一致的整盘状态：等所有进行中的读写结束，期间不接受新的操作
+    std::unique_lock<std::shared_mutex> barrier(m_snapshotBarrier);
     
     if (snapshotName.empty()) {
         errorMsg = "Snapshot name cannot be empty";
         return false;
     }
     
-    int result = create_snapshot(m_fd, snapshotName.c_str());
+    // 根目录：整盘快照；其他目录：子树快照，只保存这棵子树，恢复时也只改写它
+    std::string normPath = normalizePath(path);
+    int result;
+    if (normPath == "/") {
+        result = create_snapshot(m_fd, snapshotName.c_str());
+    } else {
+        int rootInodeId = pathToInodeId(normPath, errorMsg);
+        if (rootInodeId < 0) {
+            return false;
+        }
+        result = create_subtree_snapshot(m_fd, rootInodeId, snapshotName.c_str());
+    }
     if (result < 0) {
         errorMsg = "Failed to create snapshot: " + snapshotName;
         return false;
     }
     
-    std::cout << "✅ Created snapshot: " << snapshotName << " (ID: " << result << ")" << std::endl;
+    std::cout << "✅ Created snapshot: " << snapshotName << " of " << normPath << " (ID: " << result << ")" << std::endl;
     return true;
 }
 
 bool RealFileSystemAdapter::restoreSnapshot(const std::string& snapshotName, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_lock<std::shared_mutex> barrier(m_snapshotBarrier);
     
     if (snapshotName.empty()) {
         errorMsg = "Snapshot name cannot be empty";
         return false;
     }
     
-    // 查找快照 ID
-    Snapshot snapshots[MAX_SNAPSHOTS];
-    int count = list_snapshots(m_fd, snapshots, MAX_SNAPSHOTS);
-    
-    if (count < 0) {
-        errorMsg = "Failed to list snapshots";
-        return false;
-    }
-    
-    int snapshotId = -1;
-    for (int i = 0; i < count; ++i) {
-        if (snapshots[i].active && snapshotName == snapshots[i].name) {
-            snapshotId = snapshots[i].id;
-            break;
-        }
-    }
-    
+    int snapshotId = findSnapshotId(snapshotName, errorMsg);
     if (snapshotId < 0) {
-        errorMsg = "Snapshot not found: " + snapshotName;
         return false;
     }
     
@@ -222,12 +254,13 @@ bool RealFileSystemAdapter::restoreSnapshot(const std::string& snapshotName, std
 }
 
 std::vector<std::string> RealFileSystemAdapter::listSnapshots(const std::string& path, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    // 快照表只在持有屏障独占锁时修改
+    std::shared_lock<std::shared_mutex> barrier(m_snapshotBarrier);
     
     (void)path;  // 当前 filesystem 的快照是全局的
     
-    Snapshot snapshots[MAX_SNAPSHOTS];
-    int count = list_snapshots(m_fd, snapshots, MAX_SNAPSHOTS);
+    std::vector<Snapshot> snapshots(std::max(count_snapshots(m_fd), 1));
+    int count = list_snapshots(m_fd, snapshots.data(), (int)snapshots.size());
     
     if (count < 0) {
         errorMsg = "Failed to list snapshots";
@@ -246,26 +279,23 @@ std::vector<std::string> RealFileSystemAdapter::listSnapshots(const std::string&
 }
 
 bool RealFileSystemAdapter::readFile(const std::string& path, std::string& content, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_lock<std::shared_mutex> barrier(m_snapshotBarrier);
     
     std::string normPath = normalizePath(path);
     
     // 跟踪论文访问：如果路径包含 /papers/，提取论文ID并增加计数
-    if (normPath.find("/papers/") == 0) {
-        size_t start = 8;  // "/papers/" 的长度
-        size_t end = normPath.find('/', start);
-        if (end != std::string::npos) {
-            std::string paperId = normPath.substr(start, end - start);
-            if (!paperId.empty()) {
-                m_paperAccessCounts[paperId]++;
-            }
+    countPaperAccess(normPath);
+    
+    // 获取文件的 inode ID，并在目录结构锁内拿到文件的共享锁（之后删除操作会等待读完）
+    int inodeId;
+    std::shared_lock<std::shared_mutex> fileLock;
+    {
+        std::shared_lock<std::shared_mutex> ns(m_namespaceLock);
+        inodeId = pathToInodeId(normPath, errorMsg);
+        if (inodeId < 0) {
+            return false;
         }
-    }
-    
-    // 获取文件的 inode ID
-    int inodeId = pathToInodeId(normPath, errorMsg);
-    if (inodeId < 0) {
-        return false;
+        fileLock = std::shared_lock<std::shared_mutex>(inodeLock(inodeId));
     }
     
     // 读取 inode
@@ -301,11 +331,12 @@ bool RealFileSystemAdapter::readFile(const std::string& path, std::string& conte
 
 bool RealFileSystemAdapter::writeFile(const std::string& path, const std::string& content, 
                                       std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_lock<std::shared_mutex> barrier(m_snapshotBarrier);
+    JournalTransaction txn(m_fd);
     
     std::string normPath = normalizePath(path);
     
-    // 首先确保父目录存在（使用内部函数，避免重复加锁）
+    // 拆出父目录路径和文件名
     size_t lastSlash = normPath.find_last_of('/');
     if (lastSlash == std::string::npos || lastSlash == 0) {
         // 路径在根目录下
@@ -319,51 +350,71 @@ bool RealFileSystemAdapter::writeFile(const std::string& path, const std::string
         return false;
     }
     
-    if (!ensureDirectoryExistsInternal(parentPath, errorMsg)) {
-        return false;
-    }
-    
-    // 获取父目录 inode（目录现在一定存在）
-    int parentInodeId = pathToInodeId(parentPath, errorMsg);
-    if (parentInodeId < 0) {
-        return false;
-    }
-    
-    // 读取父目录 inode
-    Inode parentInode;
-    if (read_inode(m_fd, parentInodeId, &parentInode) < 0) {
-        errorMsg = "Failed to read parent directory inode";
-        return false;
+    // 常见情况（覆盖已有文件）只需要目录结构的共享锁
+    int fileInodeId;
+    std::unique_lock<std::shared_mutex> fileLock;
+    {
+        std::shared_lock<std::shared_mutex> ns(m_namespaceLock);
+        fileInodeId = get_inode_by_path(m_fd, normPath.c_str());
+        if (fileInodeId >= 0) {
+            fileLock = std::unique_lock<std::shared_mutex>(inodeLock(fileInodeId));
+        }
     }
     
-    // 检查文件是否已存在
-    int fileInodeId = dir_find_entry(m_fd, &parentInode, fileName.c_str());
-    
     Inode fileInode;
+    bool created = false;
     if (fileInodeId < 0) {
-        // 文件不存在，创建新文件
-        fileInodeId = alloc_inode(m_fd);
-        if (fileInodeId < 0) {
-            errorMsg = "Failed to allocate inode for new file";
+        // 文件不存在：在目录结构独占锁内创建父目录和目录项，
+        // 并在释放之前拿到新文件的锁，别的线程看到这个文件时内容已经写好
+        std::unique_lock<std::shared_mutex> ns(m_namespaceLock);
+        
+        if (!ensureDirectoryExistsInternal(parentPath, errorMsg)) {
             return false;
         }
         
-        init_inode(&fileInode, INODE_TYPE_FILE);
+        // 获取父目录 inode（目录现在一定存在）
+        int parentInodeId = pathToInodeId(parentPath, errorMsg);
+        if (parentInodeId < 0) {
+            return false;
+        }
         
-        // 添加目录条目
-        int addResult = dir_add_entry(m_fd, &parentInode, parentInodeId, fileName.c_str(), fileInodeId);
-        if (addResult < 0) {
-            free_inode(m_fd, fileInodeId);
-            if (addResult == -2) {
-                errorMsg = "File entry already exists: " + fileName;
-            } else if (addResult == -3) {
-                errorMsg = "Failed to write directory entry (disk may be full)";
-            } else {
-                errorMsg = "Failed to add directory entry";
-            }
+        // 读取父目录 inode
+        Inode parentInode;
+        if (read_inode(m_fd, parentInodeId, &parentInode) < 0) {
+            errorMsg = "Failed to read parent directory inode";
             return false;
         }
-    } else {
+        
+        // 重新检查：释放共享锁到拿到独占锁之间，别的线程可能已经创建了同名文件
+        fileInodeId = dir_find_entry(m_fd, &parentInode, fileName.c_str());
+        if (fileInodeId < 0) {
+            fileInodeId = alloc_inode(m_fd);
+            if (fileInodeId < 0) {
+                errorMsg = "Failed to allocate inode for new file";
+                return false;
+            }
+            
+            init_inode(&fileInode, INODE_TYPE_FILE);
+            
+            // 添加目录条目
+            int addResult = dir_add_entry(m_fd, &parentInode, parentInodeId, fileName.c_str(), fileInodeId);
+            if (addResult < 0) {
+                free_inode(m_fd, fileInodeId);
+                if (addResult == -2) {
+                    errorMsg = "File entry already exists: " + fileName;
+                } else if (addResult == -3) {
+                    errorMsg = "Failed to write directory entry (disk may be full)";
+                } else {
+                    errorMsg = "Failed to add directory entry";
+                }
+                return false;
+            }
+            created = true;
+        }
+        fileLock = std::unique_lock<std::shared_mutex>(inodeLock(fileInodeId));
+    }
+    
+    if (!created) {
         // 文件已存在，读取 inode
         if (read_inode(m_fd, fileInodeId, &fileInode) < 0) {
             errorMsg = "Failed to read existing file inode";
@@ -375,16 +426,16 @@ bool RealFileSystemAdapter::writeFile(const std::string& path, const std::string
             return false;
         }
         
-        // 清空旧内容
-        if (fileInode.block_count > 0) {
-            inode_free_blocks(m_fd, &fileInode);
-        }
+        // 清空旧内容（数据块或内联在 inode 中的内容）
+        inode_free_blocks(m_fd, &fileInode);
     }
     
-    // 写入新内容
+    // 写入新内容（写入期间这个文件有自己的预留窗口，同时写入的其他文件不会和它的块交错）
     if (!content.empty()) {
+        inode_write_begin(m_fd, fileInodeId);
         int bytesWritten = inode_write_data(m_fd, &fileInode, fileInodeId, 
                                             content.c_str(), 0, content.length());
+        inode_write_end(m_fd, fileInodeId);
         if (bytesWritten < 0 || bytesWritten != static_cast<int>(content.length())) {
             errorMsg = "Failed to write file data";
             return false;
@@ -399,7 +450,9 @@ bool RealFileSystemAdapter::writeFile(const std::string& path, const std::string
 }
 
 bool RealFileSystemAdapter::deleteFile(const std::string& path, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_lock<std::shared_mutex> barrier(m_snapshotBarrier);
+    JournalTransaction txn(m_fd);
+    std::unique_lock<std::shared_mutex> ns(m_namespaceLock);
     
     std::string normPath = normalizePath(path);
     
@@ -443,10 +496,11 @@ bool RealFileSystemAdapter::deleteFile(const std::string& path, std::string& err
         return false;
     }
     
-    // 释放数据块
-    if (fileInode.block_count > 0) {
-        inode_free_blocks(m_fd, &fileInode);
-    }
+    // 等正在读写这个文件的线程结束（它们在目录结构锁内拿到的文件锁）
+    std::unique_lock<std::shared_mutex> fileLock(inodeLock(fileInodeId));
+    
+    // 释放数据块（内联的小文件没有数据块，这里只清空 inode）
+    inode_free_blocks(m_fd, &fileInode);
     
     // 释放 inode
     free_inode(m_fd, fileInodeId);
@@ -461,11 +515,13 @@ bool RealFileSystemAdapter::deleteFile(const std::string& path, std::string& err
 }
 
 bool RealFileSystemAdapter::createDirectory(const std::string& path, std::string& errorMsg) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::shared_lock<std::shared_mutex> barrier(m_snapshotBarrier);
+    JournalTransaction txn(m_fd);
+    std::unique_lock<std::shared_mutex> ns(m_namespaceLock);
     return createDirectoryInternal(path, errorMsg);
 }
 
-// 内部函数，不加锁（调用者已持有锁）
+// 内部函数，不加锁（调用者已持有目录结构独占锁）
 bool RealFileSystemAdapter::createDirectoryInternal(const std::string& path, std::string& errorMsg) {
     std::string normPath = normalizePath(path);
     
@@ -478,7 +534,6 @@ bool RealFileSystemAdapter::createDirectoryInternal(const std::string& path, std
     int existingInodeId = get_inode_by_path(m_fd, normPath.c_str());
     if (existingInodeId >= 0) {
         // 目录已存在，这不是错误（幂等操作）
-        std::cout << "[createDir] " << normPath << " already exists (inode " << existingInodeId << ")" << std::endl;
         return true;
     }
     
@@ -492,23 +547,17 @@ bool RealFileSystemAdapter::createDirectoryInternal(const std::string& path, std
         return false;
     }
     
-    std::cout << "[createDir] Creating " << normPath << " (parent=" << parentPath << ", name=" << dirName << ")" << std::endl;
-    
     // 确保父目录存在（递归创建）
     if (!ensureDirectoryExistsInternal(parentPath, errorMsg)) {
-        std::cout << "[createDir] Failed to ensure parent exists: " << errorMsg << std::endl;
         return false;
     }
     
     // 获取父目录 inode（父目录现在一定存在）
     int parentInodeId = pathToInodeId(parentPath, errorMsg);
     if (parentInodeId < 0) {
-        std::cout << "[createDir] Parent not found after ensureExists: " << parentPath << std::endl;
         return false;
     }
     
-    std::cout << "[createDir] Parent inode id: " << parentInodeId << std::endl;
-    
     // 读取父目录 inode
     Inode parentInode;
     if (read_inode(m_fd, parentInodeId, &parentInode) < 0) {
@@ -517,25 +566,19 @@ bool RealFileSystemAdapter::createDirectoryInternal(const std::string& path, std
     }
     
     // 分配新的 inode
-    std::cout << "[createDir] Allocating inode for " << dirName << std::endl;
     int newDirInodeId = alloc_inode(m_fd);
     if (newDirInodeId < 0) {
         errorMsg = "Failed to allocate inode for new directory";
-        std::cout << "[createDir] ❌ Failed to allocate inode" << std::endl;
         return false;
     }
-    std::cout << "[createDir] ✓ Allocated inode " << newDirInodeId << std::endl;
     
     // 初始化目录 inode
     Inode newDirInode;
     init_inode(&newDirInode, INODE_TYPE_DIR);
     write_inode(m_fd, newDirInodeId, &newDirInode);
-    std::cout << "[createDir] ✓ Initialized and wrote inode" << std::endl;
     
     // 添加到父目录
-    std::cout << "[createDir] Adding entry '" << dirName << "' to parent inode " << parentInodeId << std::endl;
     int addResult = dir_add_entry(m_fd, &parentInode, parentInodeId, dirName.c_str(), newDirInodeId);
-    std::cout << "[createDir] dir_add_entry result: " << addResult << " for " << dirName << std::endl;
     if (addResult < 0) {
         free_inode(m_fd, newDirInodeId);
         if (addResult == -2) {
@@ -543,13 +586,11 @@ bool RealFileSystemAdapter::createDirectoryInternal(const std::string& path, std
             // 重新读取父目录 inode 以获取最新状态
             read_inode(m_fd, parentInodeId, &parentInode);
             int existingId = dir_find_entry(m_fd, &parentInode, dirName.c_str());
-            std::cout << "[createDir] Entry already exists, existingId: " << existingId << std::endl;
             if (existingId >= 0) {
                 Inode existingInode;
                 if (read_inode(m_fd, existingId, &existingInode) == 0 && 
                     existingInode.type == INODE_TYPE_DIR) {
                     // 目录已存在，这是幂等操作，返回成功
-                    std::cout << "[createDir] Concurrent creation detected, returning success" << std::endl;
                     return true;
                 }
             }
@@ -562,10 +603,6 @@ bool RealFileSystemAdapter::createDirectoryInternal(const std::string& path, std
         return false;
     }
     
-    // 验证目录已创建
-    int verifyId = get_inode_by_path(m_fd, normPath.c_str());
-    std::cout << "[createDir] Verification: " << normPath << " inode=" << verifyId << std::endl;
-    
     return true;
 }
 
@@ -579,6 +616,39 @@ std::string RealFileSystemAdapter::getFilePermission(const std::string& path, co
     return "rwx";  // 默认返回全部权限
 }
 
+bool RealFileSystemAdapter::readFileAt(const std::string& snapshotName, const std::string& path,
+                                       std::string& content, std::string& errorMsg) {
+    // 只读快照视图：不修改活跃文件系统，和普通读一样只持有屏障共享锁
+    // 快照的块由 filesystem 模块的快照锁（共享）保护，读取期间不会被回收
+    std::shared_lock<std::shared_mutex> barrier(m_snapshotBarrier);
+    
+    int snapshotId = findSnapshotId(snapshotName, errorMsg);
+    if (snapshotId < 0) {
+        return false;
+    }
+    
+    std::string normPath = normalizePath(path);
+    Inode inode;
+    if (snapshot_stat(m_fd, snapshotId, normPath.c_str(), &inode) < 0) {
+        errorMsg = "Path not found in snapshot " + snapshotName + ": " + normPath;
+        return false;
+    }
+    if (inode.type != INODE_TYPE_FILE) {
+        errorMsg = "Path is not a file: " + normPath;
+        return false;
+    }
+    
+    std::vector<char> buffer(inode.size);
+    int bytesRead = snapshot_read_file(m_fd, snapshotId, normPath.c_str(), buffer.data(), 0, inode.size);
+    if (bytesRead != inode.size) {
+        errorMsg = "Failed to read file data from snapshot: " + normPath;
+        return false;
+    }
+    
+    content.assign(buffer.begin(), buffer.end());
+    return true;
+}
+
 std::string RealFileSystemAdapter::submitForReview(const std::string& operation, const std::string& path, 
                                                    const std::string& user, std::string& errorMsg) {
     // 审核流程由 Server 层处理
@@ -593,13 +663,23 @@ std::string RealFileSystemAdapter::submitForReview(const std::string& operation,
 // ==================== 统计接口实现 ====================
 
 size_t RealFileSystemAdapter::getPaperAccessCount(const std::string& paperId) const {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<std::mutex> lock(m_statsMutex);
     auto it = m_paperAccessCounts.find(paperId);
     return (it != m_paperAccessCounts.end()) ? it->second : 0;
 }
 
-void RealFileSystemAdapter::getBlockCacheStats(size_t& hits, size_t& misses, size_t& size, size_t& capacity) const {
+void RealFileSystemAdapter::getBlockCacheStats(size_t& hits, size_t& misses, size_t& size, size_t& capacity) {
     // 调用 filesystem 的 C 接口获取 block cache 统计
     block_cache_get_stats(&hits, &misses, &size, &capacity);
 }
 
+void RealFileSystemAdapter::getBlockCacheClassStats(size_t& metaHits, size_t& metaMisses,
+                                                    size_t& dataHits, size_t& dataMisses) {
+    BlockCacheStats stats;
+    block_cache_get_stats_ex(&stats);
+    metaHits = stats.meta_hits;
+    metaMisses = stats.meta_misses;
+    dataHits = stats.data_hits;
+    dataMisses = stats.data_misses;
+}
+
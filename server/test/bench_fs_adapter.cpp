@@ -0,0 +1,130 @@
+// bench_fs_adapter.cpp - RealFileSystemAdapter 并发扩展性基准
+//
+// 用法：bench_fs_adapter [磁盘镜像路径] [每个线程的操作数]
+// 默认在当前目录创建 bench_disk.img（已存在时会被覆盖）
+//
+// 三种负载，分别用 1/2/4/8/16 个线程跑，输出吞吐（ops/s）和相对单线程的加速比：
+// - read   ：所有线程随机读取同一批论文（READ / PAPER_DOWNLOAD）
+// - write  ：每个线程反复覆盖写自己的论文（不同论文的写）
+// - mixed  ：90% 读 + 10% 写自己的论文
+#include "include/protocol/RealFileSystemAdapter.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int PAPER_COUNT = 32;
+static const size_t PAPER_SIZE = 8 * 1024;
+static const int THREAD_COUNTS[] = {1, 2, 4, 8, 16};
+
+static std::string paperPath(int id) {
+    return "/papers/" + std::to_string(id) + "/paper.txt";
+}
+
+static std::string paperContent(int id, int version) {
+    std::string content(PAPER_SIZE, 'a' + id % 26);
+    std::string header = "paper " + std::to_string(id) + " v" + std::to_string(version) + "\n";
+    content.replace(0, header.size(), header);
+    return content;
+}
+
+enum Workload { READ, WRITE, MIXED };
+
+static const char* workloadName(Workload w) {
+    switch (w) {
+        case READ:  return "read";
+        case WRITE: return "write";
+        default:    return "mixed";
+    }
+}
+
+// 跑一轮：threads 个线程各做 opsPerThread 次操作，返回 ops/s；出错时 errors 加一
+static double runWorkload(RealFileSystemAdapter& adapter, Workload w, int threads, int opsPerThread,
+                          std::atomic<int>& errors) {
+    std::atomic<bool> start(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937 rng(1234 + t);
+            std::string content, errorMsg;
+            // 写负载中每个线程只写自己的论文：线程数不超过 PAPER_COUNT 时互不相同
+            int own = t % PAPER_COUNT;
+            while (!start.load()) {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < opsPerThread; i++) {
+                bool write = (w == WRITE) || (w == MIXED && rng() % 10 == 0);
+                bool ok;
+                if (write) {
+                    ok = adapter.writeFile(paperPath(own), paperContent(own, i), errorMsg);
+                } else {
+                    int id = rng() % PAPER_COUNT;
+                    ok = adapter.readFile(paperPath(id), content, errorMsg) && content.size() == PAPER_SIZE;
+                }
+                if (!ok) {
+                    errors++;
+                }
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return (double)threads * opsPerThread / seconds;
+}
+
+int main(int argc, char** argv) {
+    std::string diskPath = argc > 1 ? argv[1] : "bench_disk.img";
+    int opsPerThread = argc > 2 ? std::atoi(argv[2]) : 2000;
+    std::remove(diskPath.c_str());
+
+    RealFileSystemAdapter adapter(diskPath);
+    std::string errorMsg;
+    for (int id = 0; id < PAPER_COUNT; id++) {
+        if (!adapter.writeFile(paperPath(id), paperContent(id, 0), errorMsg)) {
+            std::cerr << "❌ Failed to create " << paperPath(id) << ": " << errorMsg << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "\nRealFileSystemAdapter scaling (" << PAPER_COUNT << " papers x " << PAPER_SIZE / 1024
+              << "KB, " << opsPerThread << " ops/thread, " << std::thread::hardware_concurrency()
+              << " hardware threads)" << std::endl;
+    std::printf("%-8s %8s %14s %9s\n", "workload", "threads", "ops/s", "speedup");
+
+    std::atomic<int> errors(0);
+    for (Workload w : {READ, WRITE, MIXED}) {
+        double base = 0;
+        for (int threads : THREAD_COUNTS) {
+            double opsPerSec = runWorkload(adapter, w, threads, opsPerThread, errors);
+            if (threads == 1) {
+                base = opsPerSec;
+            }
+            std::printf("%-8s %8d %14.0f %8.2fx\n", workloadName(w), threads, opsPerSec, opsPerSec / base);
+        }
+    }
+
+    // 所有论文最后都应该能完整读出
+    std::string content;
+    for (int id = 0; id < PAPER_COUNT; id++) {
+        if (!adapter.readFile(paperPath(id), content, errorMsg) || content.size() != PAPER_SIZE) {
+            errors++;
+        }
+    }
+
+    if (errors.load() != 0) {
+        std::cerr << "❌ " << errors.load() << " operations failed" << std::endl;
+        return 1;
+    }
+    std::cout << "✅ No failed operations" << std::endl;
+    return 0;
+}
@@ -50,6 +50,15 @@ int main() {
         }
         std::cout << std::endl;
         
+        // 从快照读取旧版本（不恢复快照）
+        adapter.writeFile("/test.txt", "Hello, Snapshot!", errorMsg);
+        result = adapter.readFileAt("test_snapshot", "/test.txt", content, errorMsg);
+        if (result && content == "Hello, World!") {
+            std::cout << "✅ Read file at snapshot successful: " << content << std::endl;
+        } else {
+            std::cout << "❌ Read file at snapshot failed: " << errorMsg << std::endl;
+        }
+        
     } catch (const std::exception& e) {
         std::cout << "❌ Exception: " << e.what() << std::endl;
         return 1;